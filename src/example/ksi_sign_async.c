@@ -22,14 +22,6 @@
 #include <stdlib.h>
 #include <errno.h>
 
-#ifdef _WIN32
-#  include <windows.h>
-#  define sleep_ms(x) Sleep((x))
-#else
-#  include <unistd.h>
-#  define sleep_ms(x) usleep((x)*1000)
-#endif
-
 #include <ksi/ksi.h>
 #include <ksi/net.h>
 #include <ksi/net_async.h>
@@ -282,8 +274,12 @@ int main(int argc, char **argv) {
 					break;
 				case KSI_ASYNC_REQUEST_CACHE_FULL:
 					/* The request could not be added to the cache because of unresponsed requests. */
-					/* Wait for a while to avoid busy loop. */
-					sleep_ms(10);
+					/* Wait for the service to make progress to avoid busy loop. */
+					res = KSI_AsyncService_wait(as, -1);
+					if (res != KSI_OK) {
+						fprintf(stderr, "Failed to wait for async service.\n");
+						goto cleanup;
+					}
 					break;
 				default:
 					fprintf(stderr, "Unable to add request.\n");
@@ -298,6 +294,15 @@ int main(int argc, char **argv) {
 			goto cleanup;
 		}
 
+		if (respHandle == NULL && req_no == nof_requests && pending) {
+			/* All requests have been added, block until there is something to process. */
+			res = KSI_AsyncService_wait(as, -1);
+			if (res != KSI_OK) {
+				fprintf(stderr, "Failed to wait for async service.\n");
+				goto cleanup;
+			}
+		}
+
 		if (respHandle != NULL) {
 			char *p_name = NULL;
 			int state = KSI_ASYNC_STATE_UNDEFINED;
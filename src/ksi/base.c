@@ -25,6 +25,10 @@
 #include "net_http.h"
 #include "net_uri.h"
 #include "impl/ctx_impl.h"
+#include "impl/net_impl.h"
+#include "impl/pkitruststore_impl.h"
+#include "impl/publicationsfile_impl.h"
+#include "impl/trust_state_impl.h"
 #include "pkitruststore.h"
 #include "policy.h"
 
@@ -187,6 +191,22 @@ const char *KSI_getErrorString(int statusCode) {
 	}
 }
 
+static void publicationsFileRefresh_reset(KSI_CTX *ctx) {
+	KSI_RequestHandle_free(ctx->publicationsFileRefresh);
+	ctx->publicationsFileRefresh = NULL;
+}
+
+static void publicationsFile_clearValidators(KSI_CTX *ctx) {
+	KSI_free(ctx->publicationsFileETag);
+	ctx->publicationsFileETag = NULL;
+	ctx->publicationsFileLastModified = 0;
+}
+
+static void trustState_detach(KSI_CTX *ctx) {
+	KSI_TrustState_free(ctx->trustState);
+	ctx->trustState = NULL;
+}
+
 static void initOptions(KSI_CTX *ctx) {
 	KSI_CTX_setOption(ctx, KSI_OPT_AGGR_PDU_VER, (void*)KSI_AGGREGATION_PDU_VERSION);
 	KSI_CTX_setOption(ctx, KSI_OPT_EXT_PDU_VER, (void*)KSI_EXTENDING_PDU_VERSION);
@@ -201,8 +221,13 @@ static void initOptions(KSI_CTX *ctx) {
 	KSI_CTX_setOption(ctx, KSI_OPT_EXT_CONF_RECEIVED_CALLBACK, NULL);
 
 	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void*)KSI_CTX_PUBFILE_CACHE_DEFAULT_TTL);
+	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_MAX_STALE_SECONDS, (void*)0);
+	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_INCREMENTAL_DOWNLOAD, (void*)0);
 
 	KSI_CTX_setOption(ctx, KSI_OPT_HA_SAFEGUARD, (void*)KSI_CTX_HA_MAX_SUBSERVICES);
+
+	KSI_CTX_setOption(ctx, KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS, (void*)KSI_CTX_PKI_VERIFICATION_CACHE_DEFAULT_TTL);
+	KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS, (void*)KSI_CTX_PUBFILE_SNAPSHOT_DEFAULT_TTL);
 }
 
 /**
@@ -274,7 +299,14 @@ int KSI_CTX_new(KSI_CTX **context) {
 	ctx->errors_count = 0;
 	ctx->publicationsFile = NULL;
 	ctx->publicationsFileCachedAt = 0;
+	ctx->publicationsFileRefresh = NULL;
+	ctx->publicationsFileETag = NULL;
+	ctx->publicationsFileLastModified = 0;
+	ctx->publicationsFileSnapshot = NULL;
+	ctx->trustState = NULL;
+	ctx->calendarCache = NULL;
 	ctx->pkiTruststore = NULL;
+	ctx->pkiVerificationCache = NULL;
 	ctx->netProvider = NULL;
 	ctx->publicationCertEmail_DEPRECATED = NULL;
 	ctx->loggerCB = NULL;
@@ -320,6 +352,9 @@ int KSI_CTX_new(KSI_CTX **context) {
 	res = KSI_PKITruststore_registerGlobals(ctx);
 	if (res != KSI_OK) goto cleanup;
 
+	res = KSI_PKIVerificationCache_new(ctx, &ctx->pkiVerificationCache);
+	if (res != KSI_OK) goto cleanup;
+
 	res = KSI_DataHashList_new(&ctx->dataHashRecycle);
 	if (res != KSI_OK) goto cleanup;
 
@@ -421,10 +456,16 @@ void KSI_CTX_free(KSI_CTX *ctx) {
 
 		KSI_free(ctx->errors);
 
+		publicationsFileRefresh_reset(ctx);
+		publicationsFile_clearValidators(ctx);
 		KSI_NetworkClient_free(ctx->netProvider);
 		KSI_PKITruststore_free(ctx->pkiTruststore);
+		KSI_PKIVerificationCache_free(ctx->pkiVerificationCache);
 
 		KSI_PublicationsFile_free(ctx->publicationsFile);
+		KSI_TrustState_free(ctx->trustState);
+		KSI_free(ctx->publicationsFileSnapshot);
+		KSI_CalendarCache_free(ctx->calendarCache);
 		KSI_free(ctx->publicationCertEmail_DEPRECATED);
 
 		freeCertConstraintsArray(ctx->certConstraints);
@@ -525,68 +566,370 @@ cleanup:
 
 }
 
-int KSI_receivePublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile **pubFile) {
+static int publicationsFileRefresh_start(KSI_CTX *ctx, bool incremental) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_RequestHandle *handle = NULL;
+
+	KSI_LOG_debug(ctx, "Receiving publications file.");
+
+	res = KSI_sendPublicationRequest(ctx, NULL, 0, &handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Only ask for the file if it has changed since the cached one was received. */
+	if (ctx->publicationsFile != NULL) {
+		if (ctx->publicationsFileETag != NULL) {
+			res = KSI_strdup(ctx->publicationsFileETag, &handle->ifNoneMatch);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+		handle->ifModifiedSince = ctx->publicationsFileLastModified;
+
+		/* Only the records appended after the signed part of the cached file are requested. */
+		if (incremental && ctx->options[KSI_OPT_PUBFILE_INCREMENTAL_DOWNLOAD] &&
+				ctx->publicationsFile->raw != NULL && ctx->publicationsFile->signedDataLength > 0) {
+			handle->rangeStart = ctx->publicationsFile->signedDataLength;
+		}
+	}
+
+	ctx->publicationsFileRefresh = handle;
+	handle = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_RequestHandle_free(handle);
+
+	return res;
+}
+
+/* Appends the received bytes to the signed part of the cached file and verifies the result. */
+static int publicationsFileRefresh_combine(KSI_CTX *ctx, const unsigned char *tail, size_t tail_len, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	const KSI_PublicationsFile *cached = ctx->publicationsFile;
+	unsigned char *raw = NULL;
+	KSI_PublicationsFile *tmp = NULL;
+
+	raw = KSI_malloc(cached->signedDataLength + tail_len);
+	if (raw == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memcpy(raw, cached->raw, cached->signedDataLength);
+	memcpy(raw + cached->signedDataLength, tail, tail_len);
+
+	res = KSI_PublicationsFile_parse(ctx, raw, cached->signedDataLength + tail_len, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* The signature proves that the cached part has not changed. */
+	res = KSI_PublicationsFile_verify(tmp, ctx);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(ctx, "Publications file received incrementally (%llu new bytes).", (unsigned long long)tail_len);
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsFile_free(tmp);
+	KSI_free(raw);
+
+	return res;
+}
+
+static int publicationsFileRefresh_finish(KSI_CTX *ctx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_RequestHandle *handle = ctx->publicationsFileRefresh;
 	const unsigned char *raw = NULL;
 	size_t raw_len = 0;
 	KSI_PublicationsFile *tmp = NULL;
-	time_t now = 0;
 
-	KSI_ERR_clearErrors(ctx);
-	if (ctx == NULL || pubFile == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+	if (handle->notModified && ctx->publicationsFile != NULL) {
+		KSI_LOG_debug(ctx, "Publications file has not been modified.");
+		ctx->publicationsFileCachedAt = time(NULL);
+
+		res = KSI_OK;
 		goto cleanup;
 	}
 
-	if (difftime(time(&now), ctx->publicationsFileCachedAt) >= ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] ||
-			ctx->publicationsFile == NULL) {
-		KSI_LOG_debug(ctx, "Receiving publications file.");
+	res = KSI_RequestHandle_getResponse(handle, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
 
-		res = KSI_sendPublicationRequest(ctx, NULL, 0, &handle);
+	if (handle->partial) {
+		res = publicationsFileRefresh_combine(ctx, raw, raw_len, &tmp);
 		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
+			KSI_LOG_debug(ctx, "Incremental publications file download failed (error: 0x%x), receiving the full file.", res);
+			KSI_ERR_clearErrors(ctx);
+
+			publicationsFileRefresh_reset(ctx);
+			res = publicationsFileRefresh_start(ctx, false);
+			if (res != KSI_OK) goto cleanup;
+
+			res = KSI_RequestHandle_perform(ctx->publicationsFileRefresh);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+
+			/* The full file is never received partially, so this does not recurse further. */
+			res = publicationsFileRefresh_finish(ctx);
 			goto cleanup;
 		}
-
-		res = KSI_RequestHandle_perform(handle);
+	} else {
+		res = KSI_PublicationsFile_parse(ctx, raw, raw_len, &tmp);
 		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
+			KSI_pushError(ctx, res, NULL);
 			goto cleanup;
 		}
+	}
 
-		res = KSI_RequestHandle_getResponse(handle, &raw, &raw_len);
+	/* When a stale file may be served, the replacement must be verified to not replace a good file with a bad one. */
+	if (!handle->partial && ctx->options[KSI_OPT_PUBFILE_MAX_STALE_SECONDS] > 0) {
+		res = KSI_PublicationsFile_verify(tmp, ctx);
 		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
+			KSI_pushError(ctx, res, "Received publications file not verified.");
 			goto cleanup;
 		}
+	}
 
-		res = KSI_PublicationsFile_parse(ctx, raw, raw_len, &tmp);
+	KSI_PublicationsFile_free(ctx->publicationsFile);
+	ctx->publicationsFile = tmp;
+	tmp = NULL;
+	ctx->publicationsFileCachedAt = time(NULL);
+
+	publicationsFile_clearValidators(ctx);
+	ctx->publicationsFileETag = handle->etag;
+	handle->etag = NULL;
+	ctx->publicationsFileLastModified = handle->lastModified;
+
+	KSI_LOG_debug(ctx, "Publications file received.");
+
+	res = KSI_OK;
+
+cleanup:
+
+	publicationsFileRefresh_reset(ctx);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/*
+ * Starts or continues the publications file refresh. If wait is false and the transport supports it,
+ * the call returns without blocking when the response has not been received yet.
+ */
+static int publicationsFileRefresh_run(KSI_CTX *ctx, bool wait) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_RequestHandle *handle = NULL;
+
+	if (ctx->publicationsFileRefresh == NULL) {
+		res = publicationsFileRefresh_start(ctx, true);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	handle = ctx->publicationsFileRefresh;
+
+	if (!wait && handle->poll != NULL) {
+		res = handle->poll(handle, 0);
 		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
+			KSI_pushError(ctx, res, NULL);
+			publicationsFileRefresh_reset(ctx);
 			goto cleanup;
 		}
 
-		res = KSI_CTX_setPublicationsFile(ctx, tmp);
+		if (!handle->completed) {
+			KSI_LOG_debug(ctx, "Publications file refresh in progress.");
+			res = KSI_OK;
+			goto cleanup;
+		}
+	} else if (!handle->completed) {
+		res = KSI_RequestHandle_perform(handle);
 		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
+			KSI_pushError(ctx, res, NULL);
+			publicationsFileRefresh_reset(ctx);
 			goto cleanup;
 		}
-		tmp = NULL;
+	}
+
+	res = publicationsFileRefresh_finish(ctx);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
 
-		ctx->publicationsFileCachedAt = now;
+	return res;
+}
 
-		KSI_LOG_debug(ctx, "Publications file received.");
+static void trustState_releaseRaw(void *state) {
+	KSI_TrustState_free(state);
+}
+
+/* Replaces the publications file, the PKI truststore and the certificate constraints of the context with the ones of the trust state. */
+static int trustState_attach(KSI_CTX *ctx, KSI_TrustState *state) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PKITruststore *pki = NULL;
+	KSI_PublicationsFile *tmp = NULL;
+
+	res = KSI_PKITruststore_share(ctx, state->truststore, &pki);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
 	}
 
-	*pubFile = KSI_PublicationsFile_ref(ctx->publicationsFile);
+	/* The publications file keeps a reference of the trust state for the shared buffer and indexes. */
+	res = KSI_PublicationsFile_fromSharedIndex(ctx, state->index, trustState_releaseRaw, KSI_TrustState_ref(state), &tmp);
+	if (res != KSI_OK) {
+		KSI_TrustState_free(state);
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+	/* The file was verified with the truststore and the constraints of the state. */
+	tmp->verifiedBy = state;
+
+	if (state->certConstraints != NULL) {
+		res = KSI_CTX_setDefaultPubFileCertConstraints(ctx, state->certConstraints);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	} else {
+		freeCertConstraintsArray(ctx->certConstraints);
+		ctx->certConstraints = NULL;
+	}
+
+	KSI_PKITruststore_free(ctx->pkiTruststore);
+	ctx->pkiTruststore = pki;
+	pki = NULL;
+	KSI_PKIVerificationCache_clear(ctx->pkiVerificationCache);
+
+	KSI_PublicationsFile_free(ctx->publicationsFile);
+	ctx->publicationsFile = tmp;
+	tmp = NULL;
+	ctx->publicationsFileCachedAt = state->createdAt;
+	publicationsFileRefresh_reset(ctx);
+	publicationsFile_clearValidators(ctx);
+
+	if (ctx->trustState != state) {
+		KSI_TrustState_free(ctx->trustState);
+		ctx->trustState = KSI_TrustState_ref(state);
+	}
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_RequestHandle_free(handle);
 	KSI_PublicationsFile_free(tmp);
+	KSI_PKITruststore_free(pki);
+
+	return res;
+}
+
+/*
+ * Switches to the newest trust state and refreshes it, if it has expired. Only one of the
+ * contexts sharing the state does the refresh, the others keep using the current state.
+ */
+static int trustState_receive(KSI_CTX *ctx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TrustState *latest = NULL;
+	KSI_TrustState *next = NULL;
+	double age = 0;
+
+	latest = KSI_TrustState_latest(ctx->trustState);
+	if (latest != ctx->trustState || ctx->publicationsFile == NULL) {
+		res = trustState_attach(ctx, latest);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	age = difftime(time(NULL), latest->createdAt);
+	if (age < ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] || !KSI_TrustState_claimRefresh(latest, ctx)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = KSI_TrustState_new(ctx, &next);
+	if (res == KSI_OK) res = KSI_TrustState_replace(latest, next);
+	if (res == KSI_OK) res = trustState_attach(ctx, next);
+	if (res != KSI_OK) {
+		KSI_TrustState_releaseRefresh(latest, ctx);
+
+		if (age >= (double)ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] + (double)ctx->options[KSI_OPT_PUBFILE_MAX_STALE_SECONDS]) {
+			KSI_pushError(ctx, res, "Unable to refresh the shared trust state.");
+			goto cleanup;
+		}
+
+		/* The refresh is retried with the next call. */
+		KSI_LOG_warn(ctx, "Unable to refresh the shared trust state (error: 0x%x), using the cached file.", res);
+		KSI_ERR_clearErrors(ctx);
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_TrustState_free(next);
+
+	return res;
+}
+
+int KSI_receivePublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile **pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	time_t now = 0;
+	double age = 0;
+	bool stale = false;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	age = difftime(time(&now), ctx->publicationsFileCachedAt);
+
+	if (ctx->trustState != NULL) {
+		res = trustState_receive(ctx);
+		if (res != KSI_OK) goto cleanup;
+	} else if (age >= ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] || ctx->publicationsFile == NULL) {
+		/* An expired file is still served while it is not older than the max stale time. */
+		stale = ctx->publicationsFile != NULL &&
+				age < (double)ctx->options[KSI_OPT_PUBFILE_CACHE_TTL_SECONDS] + (double)ctx->options[KSI_OPT_PUBFILE_MAX_STALE_SECONDS];
+
+		res = publicationsFileRefresh_run(ctx, !stale);
+		if (res != KSI_OK) {
+			if (!stale) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+
+			/* The refresh is retried with the next call. */
+			KSI_LOG_warn(ctx, "Unable to refresh the publications file (error: 0x%x), using the cached file.", res);
+			KSI_ERR_clearErrors(ctx);
+		}
+	}
+
+	*pubFile = KSI_PublicationsFile_ref(ctx->publicationsFile);
+
+	res = KSI_OK;
+
+cleanup:
 
 	return res;
 
@@ -1079,6 +1422,33 @@ int KSI_CTX_setExtender(KSI_CTX *ctx, const char *uri, const char *loginId, cons
 	return KSI_CTX_setUri(ctx, uri, loginId, key, KSI_UriClient_setExtender);
 }
 
+int KSI_CTX_setCalendarMirror(KSI_CTX *ctx, KSI_CalendarMirror *mirror) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->isCustomNetProvider) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Unable to set calendar mirror after initial network provider replacement.");
+		goto cleanup;
+	}
+
+	res = KSI_UriClient_setCalendarMirror(ctx->netProvider, mirror);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_CTX_setPublicationUrl(KSI_CTX *ctx, const char *uri){
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -1185,10 +1555,30 @@ cleanup:																					\
 	CTX_VALUEP_SETTER(var, nam, typ, fre)													\
 	CTX_VALUEP_GETTER(var, nam, typ)														\
 
-CTX_VALUEP_SETTER(pkiTruststore, PKITruststore, KSI_PKITruststore, KSI_PKITruststore_free)
+int KSI_CTX_setPKITruststore(KSI_CTX *ctx, KSI_PKITruststore *pki) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (ctx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_PKITruststore_free(ctx->pkiTruststore);
+	ctx->pkiTruststore = pki;
+	/* The truststore is no longer the one of the shared trust state. */
+	trustState_detach(ctx);
+	/* Results verified against the previous truststore may not be valid any more. */
+	KSI_PKIVerificationCache_clear(ctx->pkiVerificationCache);
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
 
 CTX_VALUEP_GETTER(publicationsFile, PublicationsFile, KSI_PublicationsFile)
 
+CTX_GET_SET_VALUE(calendarCache, CalendarCache, KSI_CalendarCache, KSI_CalendarCache_free)
+
 int KSI_CTX_setPublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile *var) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -1201,6 +1591,64 @@ int KSI_CTX_setPublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile *var) {
 	ctx->publicationsFile = var;
 	/* Clear the cache timeout. */
 	ctx->publicationsFileCachedAt = 0;
+	/* The pending refresh and the validators belong to the replaced file. */
+	publicationsFileRefresh_reset(ctx);
+	publicationsFile_clearValidators(ctx);
+	trustState_detach(ctx);
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
+int KSI_CTX_setPublicationsFileSnapshot(KSI_CTX *ctx, const char *fileName) {
+	int res = KSI_UNKNOWN_ERROR;
+	char *tmp = NULL;
+
+	if (ctx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (fileName != NULL) {
+		res = KSI_strdup(fileName, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	KSI_free(ctx->publicationsFileSnapshot);
+	ctx->publicationsFileSnapshot = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmp);
+
+	return res;
+}
+
+int KSI_CTX_setTrustState(KSI_CTX *ctx, KSI_TrustState *state) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (ctx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (state == NULL) {
+		trustState_detach(ctx);
+	} else {
+		res = trustState_attach(ctx, KSI_TrustState_latest(state));
+		if (res != KSI_OK) goto cleanup;
+	}
 
 	res = KSI_OK;
 cleanup:
@@ -1263,6 +1711,9 @@ int KSI_CTX_setNetworkProvider(KSI_CTX *ctx, KSI_NetworkClient *netProvider){
 		goto cleanup;
 	}
 
+	/* The pending refresh was started by the old provider. */
+	publicationsFileRefresh_reset(ctx);
+
 	if (ctx->netProvider != NULL) {
 		KSI_NetworkClient_free (ctx->netProvider);
 	}
@@ -1405,6 +1856,8 @@ int KSI_CTX_setDefaultPubFileCertConstraints(KSI_CTX *ctx, const KSI_CertConstra
 
 	ctx->certConstraints = tmp;
 	tmp = NULL;
+	/* A file verified by the trust state was verified with other constraints. */
+	if (ctx->publicationsFile != NULL) ctx->publicationsFile->verifiedBy = NULL;
 
 	res = KSI_OK;
 
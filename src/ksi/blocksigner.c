@@ -17,12 +17,23 @@
  * reserves and retains all trademark rights.
  */
 
+#include <string.h>
 
 #include "internal.h"
 #include "blocksigner.h"
 #include "tree_builder.h"
 #include "hashchain.h"
 #include "signature_builder.h"
+#include "net_async.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#elif defined(HAVE_PTHREAD_H)
+#  include <pthread.h>
+#endif
+
+/** Number of leaf signatures created by each worker of #KSI_BlockSigner_getAllSignatures between the callbacks. */
+#define SIGNATURE_BATCH_PER_THREAD 32
 
 
 KSI_IMPLEMENT_LIST(KSI_BlockSignerHandle, KSI_BlockSignerHandle_free);
@@ -32,7 +43,17 @@ struct KSI_BlockSigner_st {
 	KSI_CTX *ctx;
 	size_t ref;
 	KSI_TreeBuilder *builder;
+	/** Builder for the leafs added with #KSI_BlockSigner_addLeaves, \c NULL if not used. */
+	KSI_CompactTreeBuilder *compact;
+	/** Builder for the leafs added with #KSI_BlockSigner_addLeaves in the streaming mode, \c NULL if not used. */
+	KSI_StreamTreeBuilder *stream;
+	/** Set if the leafs added in bulk are streamed through a spill file. */
+	bool streaming;
+	/** Name of the spill file, \c NULL for a temporary file. */
+	char *spillFile;
 	KSI_Signature *signature;
+	/** Builder holding the serialized common part of the leaf signatures, \c NULL if not used. */
+	KSI_SignatureBuilder *splicer;
 	KSI_DataHash *prevLeaf;
 	KSI_DataHash *origPrevLeaf;
 	KSI_OctetString *iv;
@@ -40,6 +61,17 @@ struct KSI_BlockSigner_st {
 
 	/** Common hasher object. */
 	KSI_DataHasher *hsr;
+	/** Number of threads for calculating the tree. */
+	size_t threads;
+
+	/** Shards receiving the leafs of the block concurrently, see #KSI_BlockSigner_openShard. */
+	KSI_BlockSigner **shards;
+	size_t shards_len;
+	size_t shards_size;
+	/** Set if the block signer is a shard, it is closed together with its block. */
+	bool isShard;
+	/** KSI context owned by the shard. */
+	KSI_CTX *shardCtx;
 
 	KSI_TreeBuilderLeafProcessor metaDataProcessor;
 	KSI_TreeBuilderLeafProcessor maskingProcessor;
@@ -263,12 +295,23 @@ int KSI_BlockSigner_new(KSI_CTX *ctx, KSI_HashAlgorithm algoId, KSI_DataHash *pr
 	tmp->ctx = ctx;
 	tmp->ref = 1;
 	tmp->builder = NULL;
+	tmp->compact = NULL;
+	tmp->stream = NULL;
+	tmp->streaming = false;
+	tmp->spillFile = NULL;
 	tmp->signature = NULL;
+	tmp->splicer = NULL;
 	tmp->prevLeaf = NULL;
 	tmp->origPrevLeaf = NULL;
 	tmp->iv = NULL;
 	tmp->metaData = NULL;
 	tmp->hsr = NULL;
+	tmp->threads = 0;
+	tmp->shards = NULL;
+	tmp->shards_len = 0;
+	tmp->shards_size = 0;
+	tmp->isShard = false;
+	tmp->shardCtx = NULL;
 
 	tmp->metaDataProcessor.c = tmp;
 	tmp->metaDataProcessor.fn = metaDataProcessor;
@@ -314,20 +357,354 @@ cleanup:
 	return res;
 }
 
+KSI_IMPLEMENT_REF(KSI_BlockSigner);
+
+static void freeShards(KSI_BlockSigner *signer) {
+	size_t i;
+
+	for (i = 0; i < signer->shards_len; i++) {
+		KSI_BlockSigner_free(signer->shards[i]);
+	}
+	KSI_free(signer->shards);
+	signer->shards = NULL;
+	signer->shards_len = 0;
+	signer->shards_size = 0;
+}
+
 void KSI_BlockSigner_free(KSI_BlockSigner *signer) {
 	if (signer != NULL && --signer->ref == 0) {
+		KSI_CTX *shardCtx = signer->shardCtx;
+
+		freeShards(signer);
 		KSI_TreeBuilder_free(signer->builder);
+		KSI_CompactTreeBuilder_free(signer->compact);
+		KSI_StreamTreeBuilder_free(signer->stream);
+		KSI_free(signer->spillFile);
 		KSI_Signature_free(signer->signature);
+		KSI_SignatureBuilder_free(signer->splicer);
 		KSI_OctetString_free(signer->iv);
 		KSI_DataHash_free(signer->prevLeaf);
 		KSI_DataHash_free(signer->origPrevLeaf);
 		KSI_DataHasher_free(signer->hsr);
 		KSI_free(signer);
+		/* The context must outlive all the objects of the shard. */
+		KSI_CTX_free(shardCtx);
+	}
+}
+
+/**
+ * Finalizes the tree and extracts the root hash value and level for signing.
+ */
+static int closeTree(KSI_BlockSigner *signer, KSI_DataHash **root, unsigned *level) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *tmp = NULL;
+	unsigned tmpLevel;
+
+	if (signer->stream != NULL) {
+		res = KSI_StreamTreeBuilder_close(signer->stream);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_StreamTreeBuilder_getRoot(signer->stream, &tmp, &tmpLevel);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	} else if (signer->compact != NULL) {
+		res = KSI_CompactTreeBuilder_close(signer->compact);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_CompactTreeBuilder_getRoot(signer->compact, &tmp, &tmpLevel);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	} else {
+		res = KSI_TreeBuilder_close(signer->builder);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		tmp = KSI_DataHash_ref(signer->builder->rootNode->hash);
+		tmpLevel = signer->builder->rootNode->level;
+	}
+
+	*root = tmp;
+	tmp = NULL;
+	*level = tmpLevel;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(tmp);
+
+	return res;
+}
+
+static bool isTreeBuilderEmpty(const KSI_TreeBuilder *builder) {
+	size_t i;
+
+	if (builder->rootNode != NULL) return false;
+
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		if (builder->stack[i] != NULL) return false;
+	}
+
+	return true;
+}
+
+/**
+ * Builds the signature of a leaf from the block signature and the aggregation hash chain of the leaf.
+ * The \c level is the aggregation level of the input hash of the chain.
+ */
+static int createLeafSignature(KSI_CTX *ctx, const KSI_Signature *signature, KSI_AggregationHashChain *aggr, KSI_uint64_t level, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Signature *tmp = NULL;
+	KSI_SignatureBuilder *builder = NULL;
+
+	/* Build a new signature with the appended aggregation hash chain. */
+	res = KSI_SignatureBuilder_openFromSignature(signature, &builder);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_SignatureBuilder_appendAggregationChain(builder, aggr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_SignatureBuilder_close(builder, level, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*sig = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_SignatureBuilder_free(builder);
+	KSI_Signature_free(tmp);
+
+	return res;
+}
+
+static bool isBlockEmpty(const KSI_BlockSigner *signer) {
+	if (signer->stream != NULL) return KSI_StreamTreeBuilder_getLeafCount(signer->stream) == 0;
+	if (signer->compact != NULL) return KSI_CompactTreeBuilder_getLeafCount(signer->compact) == 0;
+	return isTreeBuilderEmpty(signer->builder);
+}
+
+/**
+ * Copies the hash value into the given context.
+ */
+static int copyDataHash(KSI_CTX *ctx, const KSI_DataHash *hsh, KSI_DataHash **out) {
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_fromImprint(ctx, imprint, imprint_len, out);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Copies the signature into the given context. The objects of a shard must belong to the context
+ * of the shard, as the shard is used by its own thread.
+ */
+static int copySignature(KSI_CTX *ctx, const KSI_Signature *sig, KSI_Signature **out) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_Signature_serialize(sig, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	/* The signature has already been verified in the context of the block. */
+	res = KSI_Signature_parseWithPolicy(ctx, raw, raw_len, KSI_VERIFICATION_POLICY_EMPTY, NULL, out);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+
+	return res;
+}
+
+/**
+ * Closes the trees of the shards and joins their roots in the order of opening the shards into
+ * the root of the block. After signing the block root, every shard gets a signature for its own
+ * root in its own context, so that the leaf signatures are created as for a single block. With
+ * masking, the block continues the masking chain from the last leaf of the last non-empty shard.
+ */
+static int closeAndSignShards(KSI_BlockSigner *signer) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TreeBuilder *top = NULL;
+	KSI_TreeLeafHandle **roots = NULL;
+	unsigned *levels = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_DataHash *shardRoot = NULL;
+	KSI_DataHash *lastLeaf = NULL;
+	KSI_AggregationHashChain *chain = NULL;
+	KSI_Signature *sig = NULL;
+	size_t count = 0;
+	size_t last = 0;
+	size_t i;
+
+	roots = KSI_calloc(signer->shards_len, sizeof(KSI_TreeLeafHandle *));
+	levels = KSI_calloc(signer->shards_len, sizeof(unsigned));
+	if (roots == NULL || levels == NULL) {
+		KSI_pushError(signer->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_TreeBuilder_new(signer->ctx, signer->builder->algo, &top);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < signer->shards_len; i++) {
+		KSI_BlockSigner *shard = signer->shards[i];
+
+		if (isBlockEmpty(shard)) continue;
+
+		res = closeTree(shard, &shardRoot, &levels[i]);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, "Unable to close the shard.");
+			goto cleanup;
+		}
+
+		res = copyDataHash(signer->ctx, shardRoot, &root);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_TreeBuilder_addDataHash(top, root, (int)levels[i], &roots[i]);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_DataHash_free(shardRoot);
+		shardRoot = NULL;
+		KSI_DataHash_free(root);
+		root = NULL;
+		last = i;
+		count++;
+	}
+
+	if (count == 0) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "No leafs have been added to the shards.");
+		goto cleanup;
+	}
+
+	res = KSI_TreeBuilder_close(top);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(signer->ctx, "Signing the root hash value of the sharded block.");
+	res = KSI_Signature_signAggregated(signer->ctx, top->rootNode->hash, top->rootNode->level, &signer->signature);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < signer->shards_len; i++) {
+		if (roots[i] == NULL) continue;
+
+		/* A single shard is the whole block. */
+		if (count == 1) {
+			sig = KSI_Signature_ref(signer->signature);
+		} else {
+			res = KSI_TreeLeafHandle_getAggregationChain(roots[i], &chain);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			res = createLeafSignature(signer->ctx, signer->signature, chain, levels[i], &sig);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			KSI_AggregationHashChain_free(chain);
+			chain = NULL;
+		}
+
+		res = copySignature(signer->shards[i]->ctx, sig, &signer->shards[i]->signature);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, "Unable to copy the signature to the shard.");
+			goto cleanup;
+		}
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+	}
+
+	if (signer->iv != NULL) {
+		res = copyDataHash(signer->ctx, signer->shards[last]->prevLeaf, &lastLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_DataHash_free(signer->prevLeaf);
+		signer->prevLeaf = lastLeaf;
+		lastLeaf = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (roots != NULL) {
+		for (i = 0; i < signer->shards_len; i++) {
+			KSI_TreeLeafHandle_free(roots[i]);
+		}
 	}
+	KSI_free(roots);
+	KSI_free(levels);
+	KSI_AggregationHashChain_free(chain);
+	KSI_Signature_free(sig);
+	KSI_DataHash_free(lastLeaf);
+	KSI_DataHash_free(shardRoot);
+	KSI_DataHash_free(root);
+	KSI_TreeBuilder_free(top);
+
+	return res;
 }
 
 int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *root = NULL;
+	unsigned level;
 
 	if (signer == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -336,10 +713,23 @@ int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
 
 	KSI_ERR_clearErrors(signer->ctx);
 
+	if (signer->isShard) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The shard is closed together with its block.");
+		goto cleanup;
+	}
+
 	KSI_LOG_debug(signer->ctx, "Closing block signer instance.");
 
+	if (signer->shards_len > 0) {
+		res = closeAndSignShards(signer);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+		}
+		goto cleanup;
+	}
+
 	/* Finalize the tree. */
-	res = KSI_TreeBuilder_close(signer->builder);
+	res = closeTree(signer, &root, &level);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
@@ -347,7 +737,7 @@ int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
 
 	KSI_LOG_debug(signer->ctx, "Signing the root hash value of the block signer.");
 	/* Sign the root hash. */
-	res = KSI_Signature_signAggregated(signer->ctx, signer->builder->rootNode->hash, signer->builder->rootNode->level, &signer->signature);
+	res = KSI_Signature_signAggregated(signer->ctx, root, level, &signer->signature);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
@@ -358,6 +748,8 @@ int KSI_BlockSigner_closeAndSign(KSI_BlockSigner *signer) {
 
 cleanup:
 
+	KSI_DataHash_free(root);
+
 	return res;
 }
 
@@ -385,10 +777,27 @@ int KSI_BlockSigner_reset(KSI_BlockSigner *signer) {
 	KSI_Signature_free(signer->signature);
 	signer->signature = NULL;
 
+	KSI_SignatureBuilder_free(signer->splicer);
+	signer->splicer = NULL;
+
+	freeShards(signer);
+
+	res = KSI_TreeBuilder_setThreadCount(builder, signer->threads);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	KSI_TreeBuilder_free(signer->builder);
 	signer->builder = builder;
 	builder = NULL;
 
+	KSI_CompactTreeBuilder_free(signer->compact);
+	signer->compact = NULL;
+
+	KSI_StreamTreeBuilder_free(signer->stream);
+	signer->stream = NULL;
+
 	/* Add the masking handle. */
 	res = KSI_TreeBuilderLeafProcessorList_append(signer->builder->cbList, &signer->maskingProcessor);
 	if (res != KSI_OK) {
@@ -414,66 +823,424 @@ cleanup:
 	return res;
 }
 
-int KSI_BlockSigner_addLeaf(KSI_BlockSigner *signer, KSI_DataHash *hsh, int level, KSI_MetaData *metaData, KSI_BlockSignerHandle **handle) {
+int KSI_BlockSigner_setThreadCount(KSI_BlockSigner *signer, size_t threads) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_TreeLeafHandle *leafHandle = NULL;
-	KSI_BlockSignerHandle *tmp = NULL;
-	KSI_HashAlgorithm algoId;
 
-	if (signer == NULL || hsh == NULL) {
+	if (signer == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
 	KSI_ERR_clearErrors(signer->ctx);
 
-	/* Make sure the input hash algorithm is still trusted. */
-	res = KSI_DataHash_extract(hsh, &algoId, NULL, NULL);
+	res = KSI_TreeBuilder_setThreadCount(signer->builder, threads);
 	if (res != KSI_OK) {
 		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	if (!KSI_isHashAlgorithmTrusted(algoId)) {
-		KSI_pushError(signer->ctx, res = KSI_UNTRUSTED_HASH_ALGORITHM, "The hash algorithm is no longer trusted as a leaf hash.");
-		goto cleanup;
-	}
+	signer->threads = threads;
 
-	/* Set the pointer to the meta data value. */
-	signer->metaData = metaData;
+	res = KSI_OK;
 
-	res = KSI_TreeBuilder_addDataHash(signer->builder, hsh, level, &leafHandle);
-	if (res != KSI_OK) {
-		KSI_pushError(signer->ctx, res, NULL);
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSigner_setStreaming(KSI_BlockSigner *signer, const char *spillFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	char *tmp = NULL;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	res = KSI_BlockSignerHandle_new(signer->ctx, &tmp);
-	if (res != KSI_OK) {
-		KSI_pushError(signer->ctx, res, NULL);
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->compact != NULL || signer->stream != NULL || signer->signature != NULL || !isTreeBuilderEmpty(signer->builder)) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The streaming mode may not be changed after adding leafs.");
 		goto cleanup;
 	}
 
-	tmp->leafHandle = leafHandle;
-	tmp->signer = signer;
-
-	if (handle != NULL) {
-		*handle = KSI_BlockSignerHandle_ref(tmp);
+	if (spillFile != NULL) {
+		res = KSI_strdup(spillFile, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
 	}
 
-	leafHandle = NULL;
+	KSI_free(signer->spillFile);
+	signer->spillFile = tmp;
+	tmp = NULL;
+
+	signer->streaming = true;
 
 	res = KSI_OK;
 
 cleanup:
 
-	/* Cleanup the value, as this is only a pointer to a memory we do not control. */
-	if (signer != NULL) {
-		signer->metaData = NULL;
-	}
-
-	KSI_BlockSignerHandle_free(tmp);
-	KSI_TreeLeafHandle_free(leafHandle);
+	KSI_free(tmp);
+
+	return res;
+}
+
+int KSI_BlockSigner_openShard(KSI_BlockSigner *signer, KSI_BlockSigner **shard) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *shardCtx = NULL;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHash *seed = NULL;
+	KSI_OctetString *iv = NULL;
+	KSI_BlockSigner *tmp = NULL;
+	const unsigned char *ivDat = NULL;
+	size_t ivDat_len = 0;
+	unsigned char index[4];
+
+	if (signer == NULL || shard == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->isShard || signer->signature != NULL || !isBlockEmpty(signer) || signer->compact != NULL || signer->stream != NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "Shards may only be opened by an empty block signer.");
+		goto cleanup;
+	}
+
+	if (signer->shards_len == signer->shards_size) {
+		size_t size = signer->shards_size == 0 ? 8 : signer->shards_size * 2;
+		KSI_BlockSigner **shards = KSI_calloc(size, sizeof(KSI_BlockSigner *));
+
+		if (shards == NULL) {
+			KSI_pushError(signer->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		if (signer->shards_len > 0) memcpy(shards, signer->shards, signer->shards_len * sizeof(KSI_BlockSigner *));
+		KSI_free(signer->shards);
+		signer->shards = shards;
+		signer->shards_size = size;
+	}
+
+	/* The KSI context is not thread safe, every shard gets its own. */
+	res = KSI_CTX_new(&shardCtx);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (signer->iv != NULL && signer->shards_len == 0) {
+		res = copyDataHash(shardCtx, signer->prevLeaf, &seed);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	} else if (signer->iv != NULL) {
+		/* The first shard continues the masking chain of the block, the chains of the other shards start
+		 * from the previous leaf, the initial value and the shard index. */
+		index[0] = (unsigned char)(signer->shards_len >> 24);
+		index[1] = (unsigned char)(signer->shards_len >> 16);
+		index[2] = (unsigned char)(signer->shards_len >> 8);
+		index[3] = (unsigned char)(signer->shards_len);
+
+		res = KSI_DataHasher_open(shardCtx, signer->builder->algo, &hsr);
+		if (res == KSI_OK) res = KSI_DataHasher_addImprint(hsr, signer->prevLeaf);
+		if (res == KSI_OK) res = KSI_DataHasher_addOctetString(hsr, signer->iv);
+		if (res == KSI_OK) res = KSI_DataHasher_add(hsr, index, sizeof(index));
+		if (res == KSI_OK) res = KSI_DataHasher_close(hsr, &seed);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (signer->iv != NULL) {
+		res = KSI_OctetString_extract(signer->iv, &ivDat, &ivDat_len);
+		if (res == KSI_OK) res = KSI_OctetString_new(shardCtx, ivDat, ivDat_len, &iv);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_BlockSigner_new(shardCtx, signer->builder->algo, seed, iv, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->isShard = true;
+	tmp->shardCtx = shardCtx;
+	shardCtx = NULL;
+
+	signer->shards[signer->shards_len++] = KSI_BlockSigner_ref(tmp);
+
+	*shard = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockSigner_free(tmp);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(seed);
+	KSI_DataHasher_free(hsr);
+	KSI_CTX_free(shardCtx);
+
+	return res;
+}
+
+int KSI_BlockSigner_addLeaf(KSI_BlockSigner *signer, KSI_DataHash *hsh, int level, KSI_MetaData *metaData, KSI_BlockSignerHandle **handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TreeLeafHandle *leafHandle = NULL;
+	KSI_BlockSignerHandle *tmp = NULL;
+	KSI_HashAlgorithm algoId;
+
+	if (signer == NULL || hsh == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->compact != NULL || signer->stream != NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "Leafs with handles may not be mixed with the leafs added in bulk.");
+		goto cleanup;
+	}
+
+	if (signer->shards_len > 0) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The leafs of a sharded block must be added to the shards.");
+		goto cleanup;
+	}
+
+	/* Make sure the input hash algorithm is still trusted. */
+	res = KSI_DataHash_extract(hsh, &algoId, NULL, NULL);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmTrusted(algoId)) {
+		KSI_pushError(signer->ctx, res = KSI_UNTRUSTED_HASH_ALGORITHM, "The hash algorithm is no longer trusted as a leaf hash.");
+		goto cleanup;
+	}
+
+	/* Set the pointer to the meta data value. */
+	signer->metaData = metaData;
+
+	res = KSI_TreeBuilder_addDataHash(signer->builder, hsh, level, &leafHandle);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_BlockSignerHandle_new(signer->ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->leafHandle = leafHandle;
+	tmp->signer = signer;
+
+	if (handle != NULL) {
+		*handle = KSI_BlockSignerHandle_ref(tmp);
+	}
+
+	leafHandle = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	/* Cleanup the value, as this is only a pointer to a memory we do not control. */
+	if (signer != NULL) {
+		signer->metaData = NULL;
+	}
+
+	KSI_BlockSignerHandle_free(tmp);
+	KSI_TreeLeafHandle_free(leafHandle);
+
+	return res;
+}
+
+/**
+ * Calculates the mask for the leaf and updates the previous leaf value, as #maskingProcessor does.
+ */
+static int calculateMask(KSI_BlockSigner *signer, const unsigned char *imprint, size_t imprint_len, int level, KSI_DataHash **mask) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *tmp = NULL;
+	KSI_DataHash *leafHash = NULL;
+	unsigned char tmpLvl;
+
+	if (!KSI_IS_VALID_TREE_LEVEL(level + 1)) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The tree height is too large.");
+		goto cleanup;
+	}
+
+	tmpLvl = (unsigned char)(level + 1);
+
+	res = KSI_DataHasher_reset(signer->hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_addImprint(signer->hsr, signer->prevLeaf);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_addOctetString(signer->hsr, signer->iv);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(signer->hsr, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_reset(signer->hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_addImprint(signer->hsr, tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(signer->hsr, imprint, imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(signer->hsr, &tmpLvl, 1);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(signer->hsr, &leafHash);
+	if (res != KSI_OK) goto cleanup;
+
+	KSI_DataHash_free(signer->prevLeaf);
+	signer->prevLeaf = leafHash;
+	leafHash = NULL;
+
+	*mask = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(leafHash);
+	KSI_DataHash_free(tmp);
+
+	return res;
+}
+
+int KSI_BlockSigner_addLeaves(KSI_BlockSigner *signer, const unsigned char *imprints, const unsigned char *levels, size_t n) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *mask = NULL;
+	size_t offset = 0;
+	size_t i;
+
+	if (signer == NULL || (imprints == NULL && n > 0)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->signature != NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The tree has been finished, new leafs may not be added.");
+		goto cleanup;
+	}
+
+	if (signer->shards_len > 0) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The leafs of a sharded block must be added to the shards.");
+		goto cleanup;
+	}
+
+	if (signer->compact == NULL && signer->stream == NULL) {
+		if (!isTreeBuilderEmpty(signer->builder)) {
+			KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "Leafs added in bulk may not be mixed with the leafs with handles.");
+			goto cleanup;
+		}
+
+		if (signer->streaming) {
+			res = KSI_StreamTreeBuilder_new(signer->ctx, signer->builder->algo, signer->spillFile, &signer->stream);
+		} else {
+			res = KSI_CompactTreeBuilder_new(signer->ctx, signer->builder->algo, &signer->compact);
+			/* The compact builder recalculates the masks instead of keeping them. */
+			if (res == KSI_OK && signer->iv != NULL && signer->prevLeaf != NULL) {
+				res = KSI_CompactTreeBuilder_setMasking(signer->compact, signer->prevLeaf, signer->iv);
+			}
+		}
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		const unsigned char *imprint = imprints + offset;
+		const unsigned char *maskImprint = NULL;
+		size_t imprint_len;
+		int level = levels != NULL ? levels[i] : 0;
+
+		/* Make sure the input hash algorithm is still trusted. */
+		if (!KSI_isHashAlgorithmSupported(imprint[0])) {
+			KSI_pushError(signer->ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+			goto cleanup;
+		}
+
+		if (!KSI_isHashAlgorithmTrusted(imprint[0])) {
+			KSI_pushError(signer->ctx, res = KSI_UNTRUSTED_HASH_ALGORITHM, "The hash algorithm is no longer trusted as a leaf hash.");
+			goto cleanup;
+		}
+
+		imprint_len = KSI_getHashLength(imprint[0]) + 1;
+
+		if (signer->stream != NULL && signer->iv != NULL && signer->prevLeaf != NULL) {
+			size_t mask_len;
+
+			res = calculateMask(signer, imprint, imprint_len, level, &mask);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			res = KSI_DataHash_getImprint(mask, &maskImprint, &mask_len);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		if (signer->stream != NULL) {
+			res = KSI_StreamTreeBuilder_addImprint(signer->stream, imprint, maskImprint, level);
+		} else {
+			res = KSI_CompactTreeBuilder_addImprint(signer->compact, imprint, level);
+		}
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_DataHash_free(mask);
+		mask = NULL;
+
+		offset += imprint_len;
+	}
+
+	if (signer->compact != NULL && signer->iv != NULL && signer->prevLeaf != NULL) {
+		KSI_DataHash *prevLeaf = NULL;
+
+		res = KSI_CompactTreeBuilder_getPrevLeaf(signer->compact, &prevLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_DataHash_free(signer->prevLeaf);
+		signer->prevLeaf = prevLeaf;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(mask);
 
 	return res;
 }
@@ -481,14 +1248,308 @@ cleanup:
 int KSI_BlockSigner_getPrevLeaf(const KSI_BlockSigner *signer, KSI_DataHash **prevLeaf) {
 	int res = KSI_UNKNOWN_ERROR;
 
-	if (signer == NULL || signer->ctx == NULL || prevLeaf == NULL) {
+	if (signer == NULL || signer->ctx == NULL || prevLeaf == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	*prevLeaf = KSI_DataHash_ref(signer->prevLeaf);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSigner_getSignature(const KSI_BlockSigner *signer, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL || signer->ctx == NULL || sig == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->signature == NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The blocksigner is not closed.");
+		goto cleanup;
+	}
+
+	*sig = KSI_Signature_ref(signer->signature);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSignerHandle_getAggregationChain(const KSI_BlockSignerHandle *handle, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (handle == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(handle->ctx);
+
+	if (handle->signer->signature == NULL) {
+		KSI_pushError(handle->ctx, res = KSI_INVALID_STATE, "The blocksigner is not closed.");
+		goto cleanup;
+	}
+
+	res = KSI_TreeLeafHandle_getAggregationChain(handle->leafHandle, chain);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSignerHandle_getSignature(const KSI_BlockSignerHandle *handle, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationHashChain *aggr = NULL;
+
+	if (handle == NULL || sig == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(handle->ctx);
+
+	if (handle->signer->signature == NULL) {
+		KSI_pushError(handle->ctx, res = KSI_INVALID_STATE, "The blocksigner is not closed.");
+		goto cleanup;
+	}
+
+	/* Extract the calculated aggregation hash chain. */
+	res = KSI_TreeLeafHandle_getAggregationChain(handle->leafHandle, &aggr);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = createLeafSignature(handle->ctx, handle->signer->signature, aggr, 0, sig);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AggregationHashChain_free(aggr);
+
+	return res;
+}
+
+/**
+ * Serializes the signature of a leaf by splicing the aggregation hash chain of the leaf with the
+ * common part of the leaf signatures, which is serialized once per block.
+ */
+static int serializeLeafSignature(KSI_BlockSigner *signer, KSI_AggregationHashChain *aggr, unsigned char **raw, size_t *raw_len) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer->splicer == NULL) {
+		res = KSI_SignatureBuilder_openFromSignature(signer->signature, &signer->splicer);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_SignatureBuilder_serializeWithAggregationChain(signer->splicer, aggr, raw, raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSignerHandle_serializeSignature(const KSI_BlockSignerHandle *handle, unsigned char **raw, size_t *raw_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationHashChain *aggr = NULL;
+
+	if (handle == NULL || raw == NULL || raw_len == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(handle->ctx);
+
+	if (handle->signer->signature == NULL) {
+		KSI_pushError(handle->ctx, res = KSI_INVALID_STATE, "The blocksigner is not closed.");
+		goto cleanup;
+	}
+
+	res = KSI_TreeLeafHandle_getAggregationChain(handle->leafHandle, &aggr);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = serializeLeafSignature(handle->signer, aggr, raw, raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(handle->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AggregationHashChain_free(aggr);
+
+	return res;
+}
+
+int KSI_BlockSigner_getAggregationChainAt(KSI_BlockSigner *signer, size_t index, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->stream != NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The leafs of a streaming blocksigner may not be accessed by index.");
+		goto cleanup;
+	}
+
+	if (signer->signature == NULL || signer->compact == NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The blocksigner with leafs added in bulk is not closed.");
+		goto cleanup;
+	}
+
+	res = KSI_CompactTreeBuilder_getAggregationChain(signer->compact, index, chain);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_BlockSigner_getSignatureAt(KSI_BlockSigner *signer, size_t index, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationHashChain *aggr = NULL;
+
+	if (signer == NULL || sig == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	res = KSI_BlockSigner_getAggregationChainAt(signer, index, &aggr);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = createLeafSignature(signer->ctx, signer->signature, aggr, 0, sig);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AggregationHashChain_free(aggr);
+
+	return res;
+}
+
+typedef struct SignatureEmitter_st {
+	KSI_BlockSigner *signer;
+	KSI_BlockSignerCallback cb;
+	void *cbCtx;
+} SignatureEmitter;
+
+static int signatureEmitter_chain(void *c, size_t index, KSI_AggregationHashChain *chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureEmitter *emitter = c;
+	KSI_Signature *sig = NULL;
+
+	res = createLeafSignature(emitter->signer->ctx, emitter->signer->signature, chain, 0, &sig);
+	if (res != KSI_OK) goto cleanup;
+
+	res = emitter->cb(emitter->cbCtx, index, sig);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Signature_free(sig);
+
+	return res;
+}
+
+int KSI_BlockSigner_getSignatures(KSI_BlockSigner *signer, KSI_BlockSignerCallback cb, void *cbCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureEmitter emitter;
+	size_t i;
+
+	if (signer == NULL || cb == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
 	KSI_ERR_clearErrors(signer->ctx);
 
-	*prevLeaf = KSI_DataHash_ref(signer->prevLeaf);
+	if (signer->signature == NULL || (signer->compact == NULL && signer->stream == NULL)) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The blocksigner with leafs added in bulk is not closed.");
+		goto cleanup;
+	}
+
+	emitter.signer = signer;
+	emitter.cb = cb;
+	emitter.cbCtx = cbCtx;
+
+	if (signer->stream != NULL) {
+		res = KSI_StreamTreeBuilder_getAggregationChains(signer->stream, signatureEmitter_chain, &emitter);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	} else {
+		for (i = 0; i < KSI_CompactTreeBuilder_getLeafCount(signer->compact); i++) {
+			KSI_AggregationHashChain *chain = NULL;
+
+			res = KSI_CompactTreeBuilder_getAggregationChain(signer->compact, i, &chain);
+			if (res == KSI_OK) res = signatureEmitter_chain(&emitter, i, chain);
+			KSI_AggregationHashChain_free(chain);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+	}
 
 	res = KSI_OK;
 
@@ -497,60 +1558,556 @@ cleanup:
 	return res;
 }
 
-int KSI_BlockSignerHandle_getSignature(const KSI_BlockSignerHandle *handle, KSI_Signature **sig) {
+typedef struct SignatureWorker_st {
+	const KSI_CompactTreeBuilder *tree;
+	/** KSI context of the worker, all the objects created by the worker belong to it. */
+	KSI_CTX *ctx;
+	/** Serialized block signature, shared between all the workers. */
+	const unsigned char *raw;
+	size_t raw_len;
+	/** Block signature parsed in the context of the worker. */
+	KSI_Signature *signature;
+	/** Output slots of the current batch, shared between all the workers. */
+	KSI_Signature **sigs;
+	/** Index of the first leaf of the current batch. */
+	size_t offset;
+	size_t count;
+	/** The worker creates the signatures \c first, \c first + \c step, ... of the batch. */
+	size_t first;
+	size_t step;
+	/** Set if the worker was run in a separate thread. */
+	bool started;
+	int res;
+#ifdef _WIN32
+	HANDLE thread;
+#elif defined(HAVE_PTHREAD_H)
+	pthread_t thread;
+#endif
+} SignatureWorker;
+
+static void signatureWorker_process(SignatureWorker *worker) {
+	size_t i;
+
+	worker->res = KSI_OK;
+
+	if (worker->signature == NULL) {
+		worker->res = KSI_Signature_parse(worker->ctx, worker->raw, worker->raw_len, &worker->signature);
+	}
+
+	for (i = worker->first; i < worker->count && worker->res == KSI_OK; i += worker->step) {
+		KSI_AggregationHashChain *chain = NULL;
+
+		worker->res = KSI_CompactTreeBuilder_getAggregationChainWithCtx(worker->tree, worker->ctx, worker->offset + i, &chain);
+		if (worker->res == KSI_OK) worker->res = createLeafSignature(worker->ctx, worker->signature, chain, 0, &worker->sigs[i]);
+
+		KSI_AggregationHashChain_free(chain);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI signatureWorker_run(LPVOID arg) {
+	signatureWorker_process(arg);
+	return 0;
+}
+#elif defined(HAVE_PTHREAD_H)
+static void *signatureWorker_run(void *arg) {
+	signatureWorker_process(arg);
+	return NULL;
+}
+#endif
+
+int KSI_BlockSigner_getAllSignatures(KSI_BlockSigner *signer, size_t threads, KSI_BlockSignerCallback cb, void *cbCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	SignatureWorker *workers = NULL;
+	KSI_Signature **sigs = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	size_t leafCount;
+	size_t batch;
+	size_t offset;
+	size_t i;
+
+	if (signer == NULL || cb == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->signature == NULL || signer->compact == NULL) {
+		KSI_pushError(signer->ctx, res = KSI_INVALID_STATE, "The blocksigner with leafs added in bulk is not closed or is in the streaming mode.");
+		goto cleanup;
+	}
+
+	if (threads <= 1) {
+		res = KSI_BlockSigner_getSignatures(signer, cb, cbCtx);
+		goto cleanup;
+	}
+
+	res = KSI_Signature_serialize(signer->signature, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	batch = threads * SIGNATURE_BATCH_PER_THREAD;
+
+	sigs = KSI_calloc(batch, sizeof(KSI_Signature *));
+	workers = KSI_calloc(threads, sizeof(SignatureWorker));
+	if (sigs == NULL || workers == NULL) {
+		KSI_pushError(signer->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	/* The KSI context is not thread safe, every worker gets its own. */
+	for (i = 0; i < threads; i++) {
+		workers[i].tree = signer->compact;
+		workers[i].raw = raw;
+		workers[i].raw_len = raw_len;
+		workers[i].sigs = sigs;
+		workers[i].first = i;
+		workers[i].step = threads;
+
+		res = KSI_CTX_new(&workers[i].ctx);
+		if (res != KSI_OK) {
+			KSI_pushError(signer->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	leafCount = KSI_CompactTreeBuilder_getLeafCount(signer->compact);
+
+	for (offset = 0; offset < leafCount; offset += batch) {
+		size_t count = leafCount - offset < batch ? leafCount - offset : batch;
+
+		for (i = 0; i < threads; i++) {
+			workers[i].offset = offset;
+			workers[i].count = count;
+			workers[i].started = false;
+		}
+
+		/* The caller thread acts as the first worker. */
+		for (i = 1; i < threads && i < count; i++) {
+#ifdef _WIN32
+			workers[i].thread = CreateThread(NULL, 0, signatureWorker_run, &workers[i], 0, NULL);
+			workers[i].started = (workers[i].thread != NULL);
+#elif defined(HAVE_PTHREAD_H)
+			workers[i].started = (pthread_create(&workers[i].thread, NULL, signatureWorker_run, &workers[i]) == 0);
+#endif
+		}
+
+		signatureWorker_process(&workers[0]);
+
+		for (i = 1; i < threads; i++) {
+			if (workers[i].started) {
+#ifdef _WIN32
+				WaitForSingleObject(workers[i].thread, INFINITE);
+				CloseHandle(workers[i].thread);
+#elif defined(HAVE_PTHREAD_H)
+				pthread_join(workers[i].thread, NULL);
+#endif
+			} else {
+				/* Threads are not available, do the work here. */
+				signatureWorker_process(&workers[i]);
+			}
+		}
+
+		for (i = 0; i < threads; i++) {
+			if (workers[i].res != KSI_OK) {
+				KSI_pushError(signer->ctx, res = workers[i].res, "Unable to create the leaf signature.");
+				goto cleanup;
+			}
+		}
+
+		/* The workers are idle, the signatures can be handed out in the leaf order. */
+		for (i = 0; i < count; i++) {
+			res = cb(cbCtx, offset + i, sigs[i]);
+			if (res != KSI_OK) {
+				KSI_pushError(signer->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			KSI_Signature_free(sigs[i]);
+			sigs[i] = NULL;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (sigs != NULL) {
+		for (i = 0; i < batch; i++) {
+			KSI_Signature_free(sigs[i]);
+		}
+	}
+	if (workers != NULL) {
+		for (i = 0; i < threads; i++) {
+			KSI_Signature_free(workers[i].signature);
+			KSI_CTX_free(workers[i].ctx);
+		}
+	}
+	KSI_free(workers);
+	KSI_free(sigs);
+	KSI_free(raw);
+
+	return res;
+}
+
+int KSI_BlockSigner_serializeSignatureAt(KSI_BlockSigner *signer, size_t index, unsigned char **raw, size_t *raw_len) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_Signature *tmp = NULL;
 	KSI_AggregationHashChain *aggr = NULL;
-	KSI_SignatureBuilder *builder = NULL;
 
-	if (handle == NULL || sig == NULL) {
+	if (signer == NULL || raw == NULL || raw_len == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	KSI_ERR_clearErrors(handle->ctx);
+	KSI_ERR_clearErrors(signer->ctx);
 
-	if (handle->signer->signature == NULL) {
-		KSI_pushError(handle->ctx, res = KSI_INVALID_STATE, "The blocksigner is not closed.");
+	res = KSI_BlockSigner_getAggregationChainAt(signer, index, &aggr);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	/* Extract the calculated aggregation hash chain. */
-	res = KSI_TreeLeafHandle_getAggregationChain(handle->leafHandle, &aggr);
+	res = serializeLeafSignature(signer, aggr, raw, raw_len);
 	if (res != KSI_OK) {
-		KSI_pushError(handle->ctx, res, NULL);
+		KSI_pushError(signer->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	/* Build a new signature with the appended aggregation hash chain. */
-	res = KSI_SignatureBuilder_openFromSignature(handle->signer->signature, &builder);
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AggregationHashChain_free(aggr);
+
+	return res;
+}
+
+typedef struct PipelineBlock_st {
+	KSI_BlockSigner *block;
+	/** Signing request of the block root. */
+	KSI_AsyncHandle *handle;
+	/** Set if the request has been accepted by the async service. */
+	bool submitted;
+	/** Set if the request has reached its final state. */
+	bool done;
+	int status;
+} PipelineBlock;
+
+struct KSI_BlockSignerPipeline_st {
+	KSI_CTX *ctx;
+	KSI_AsyncService *service;
+	/** Block signer receiving the leafs. */
+	KSI_BlockSigner *current;
+	/** Closed blocks in the order of closing. */
+	PipelineBlock *blocks;
+	size_t blocks_len;
+	size_t blocks_size;
+	KSI_BlockSignerPipelineCallback cb;
+	void *cbCtx;
+};
+
+int KSI_BlockSignerPipeline_new(KSI_BlockSigner *first, KSI_AsyncService *service, KSI_BlockSignerPipelineCallback cb, void *cbCtx, KSI_BlockSignerPipeline **pipeline) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSignerPipeline *tmp = NULL;
+
+	if (first == NULL || service == NULL || cb == NULL || pipeline == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(first->ctx);
+
+	if (first->signature != NULL) {
+		KSI_pushError(first->ctx, res = KSI_INVALID_STATE, "The blocksigner is already closed.");
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_BlockSignerPipeline);
+	if (tmp == NULL) {
+		KSI_pushError(first->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = first->ctx;
+	tmp->service = service;
+	tmp->current = KSI_BlockSigner_ref(first);
+	tmp->blocks = NULL;
+	tmp->blocks_len = 0;
+	tmp->blocks_size = 0;
+	tmp->cb = cb;
+	tmp->cbCtx = cbCtx;
+
+	*pipeline = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockSignerPipeline_free(tmp);
+
+	return res;
+}
+
+void KSI_BlockSignerPipeline_free(KSI_BlockSignerPipeline *pipeline) {
+	size_t i;
+
+	if (pipeline == NULL) return;
+
+	for (i = 0; i < pipeline->blocks_len; i++) {
+		KSI_AsyncHandle_free(pipeline->blocks[i].handle);
+		KSI_BlockSigner_free(pipeline->blocks[i].block);
+	}
+	KSI_free(pipeline->blocks);
+	KSI_BlockSigner_free(pipeline->current);
+	KSI_free(pipeline);
+}
+
+int KSI_BlockSignerPipeline_getBlockSigner(const KSI_BlockSignerPipeline *pipeline, KSI_BlockSigner **signer) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (pipeline == NULL || signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	*signer = pipeline->current;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Creates an empty block signer for the block following \c prev. The last leaf of \c prev and the
+ * initial value are carried forward, so that the masking chain continues over the block boundary.
+ */
+static int createNextBlock(KSI_BlockSigner *prev, KSI_BlockSigner **next) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *tmp = NULL;
+
+	res = KSI_BlockSigner_new(prev->ctx, prev->builder->algo, prev->prevLeaf, prev->iv, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_BlockSigner_setThreadCount(tmp, prev->threads);
+	if (res != KSI_OK) goto cleanup;
+
+	/* The spill file of the previous block is still in use, the next block uses a temporary file. */
+	if (prev->streaming) {
+		res = KSI_BlockSigner_setStreaming(tmp, NULL);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	*next = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockSigner_free(tmp);
+
+	return res;
+}
+
+int KSI_BlockSignerPipeline_closeBlock(KSI_BlockSignerPipeline *pipeline) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *next = NULL;
+	KSI_DataHash *root = NULL;
+	unsigned level;
+	KSI_AsyncHandle *handle = NULL;
+	PipelineBlock *block = NULL;
+
+	if (pipeline == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(pipeline->ctx);
+
+	if (pipeline->blocks_len == pipeline->blocks_size) {
+		size_t size = pipeline->blocks_size == 0 ? 4 : pipeline->blocks_size * 2;
+		PipelineBlock *tmp = KSI_calloc(size, sizeof(PipelineBlock));
+
+		if (tmp == NULL) {
+			KSI_pushError(pipeline->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		if (pipeline->blocks_len > 0) memcpy(tmp, pipeline->blocks, pipeline->blocks_len * sizeof(PipelineBlock));
+		KSI_free(pipeline->blocks);
+		pipeline->blocks = tmp;
+		pipeline->blocks_size = size;
+	}
+
+	/* Prepare the next block first, so that a failure leaves the current block open. */
+	res = createNextBlock(pipeline->current, &next);
 	if (res != KSI_OK) {
-		KSI_pushError(handle->ctx, res, NULL);
+		KSI_pushError(pipeline->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_SignatureBuilder_appendAggregationChain(builder, aggr);
+	KSI_LOG_debug(pipeline->ctx, "Closing block signer instance in the pipeline.");
+
+	res = closeTree(pipeline->current, &root, &level);
 	if (res != KSI_OK) {
-		KSI_pushError(handle->ctx, res, NULL);
+		KSI_pushError(pipeline->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_SignatureBuilder_close(builder, 0, &tmp);
+	res = KSI_AsyncSigningHandle_new(pipeline->ctx, root, level, &handle);
 	if (res != KSI_OK) {
-		KSI_pushError(handle->ctx, res, NULL);
+		KSI_pushError(pipeline->ctx, res, NULL);
 		goto cleanup;
 	}
+	root = NULL;
+
+	block = &pipeline->blocks[pipeline->blocks_len++];
+	block->block = pipeline->current;
+	block->handle = handle;
+	block->submitted = false;
+	block->done = false;
+	block->status = KSI_OK;
+	handle = NULL;
+
+	pipeline->current = next;
+	next = NULL;
+
+	/* A full request cache is not an error, the request is added by #KSI_BlockSignerPipeline_run. */
+	res = KSI_AsyncService_addRequest(pipeline->service, KSI_AsyncHandle_ref(block->handle));
+	if (res == KSI_OK) {
+		block->submitted = true;
+	} else {
+		KSI_AsyncHandle_free(block->handle);
+		if (res != KSI_ASYNC_REQUEST_CACHE_FULL) {
+			block->done = true;
+			block->status = res;
+		}
+	}
 
-	*sig = tmp;
-	tmp = NULL;
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_AsyncHandle_free(handle);
+	KSI_DataHash_free(root);
+	KSI_BlockSigner_free(next);
+
+	return res;
+}
+
+static void pipeline_completeBlock(KSI_BlockSignerPipeline *pipeline, KSI_AsyncHandle *handle) {
+	size_t i;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	PipelineBlock *block = NULL;
+
+	for (i = 0; i < pipeline->blocks_len; i++) {
+		if (pipeline->blocks[i].handle == handle) {
+			block = &pipeline->blocks[i];
+			break;
+		}
+	}
+
+	/* Not a block root signing request. */
+	if (block == NULL || block->done) return;
+
+	block->status = KSI_AsyncHandle_getState(handle, &state);
+	if (block->status == KSI_OK) {
+		if (state == KSI_ASYNC_STATE_RESPONSE_RECEIVED) {
+			block->status = KSI_AsyncHandle_getSignature(handle, &block->block->signature);
+		} else if (state == KSI_ASYNC_STATE_ERROR) {
+			if (KSI_AsyncHandle_getError(handle, &block->status) != KSI_OK || block->status == KSI_OK) {
+				block->status = KSI_UNKNOWN_ERROR;
+			}
+		} else {
+			/* Not a final state of the request. */
+			return;
+		}
+	}
+
+	block->done = true;
+}
+
+int KSI_BlockSignerPipeline_run(KSI_BlockSignerPipeline *pipeline, size_t *pending) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i;
+	size_t delivered = 0;
+
+	if (pipeline == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(pipeline->ctx);
+
+	/* Add the requests rejected earlier due to the full request cache. */
+	for (i = 0; i < pipeline->blocks_len; i++) {
+		PipelineBlock *block = &pipeline->blocks[i];
+
+		if (block->submitted || block->done) continue;
+
+		res = KSI_AsyncService_addRequest(pipeline->service, KSI_AsyncHandle_ref(block->handle));
+		if (res == KSI_ASYNC_REQUEST_CACHE_FULL) {
+			KSI_AsyncHandle_free(block->handle);
+			break;
+		} else if (res != KSI_OK) {
+			KSI_AsyncHandle_free(block->handle);
+			block->done = true;
+			block->status = res;
+		} else {
+			block->submitted = true;
+		}
+	}
+
+	/* Collect all the responses available without blocking. */
+	do {
+		KSI_AsyncHandle *handle = NULL;
+
+		res = KSI_AsyncService_run(pipeline->service, &handle, NULL);
+		if (res != KSI_OK) {
+			KSI_pushError(pipeline->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (handle == NULL) break;
+
+		pipeline_completeBlock(pipeline, handle);
+		KSI_AsyncHandle_free(handle);
+	} while (1);
+
+	/* Hand out the completed blocks in the order of closing. */
+	while (delivered < pipeline->blocks_len && pipeline->blocks[delivered].done) {
+		PipelineBlock *block = &pipeline->blocks[delivered++];
+
+		res = pipeline->cb(pipeline->cbCtx, block->block, block->status);
+
+		KSI_AsyncHandle_free(block->handle);
+		block->handle = NULL;
+		KSI_BlockSigner_free(block->block);
+		block->block = NULL;
+
+		if (res != KSI_OK) {
+			KSI_pushError(pipeline->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_SignatureBuilder_free(builder);
-	KSI_AggregationHashChain_free(aggr);
-	KSI_Signature_free(tmp);
+	if (pipeline != NULL && delivered > 0) {
+		pipeline->blocks_len -= delivered;
+		memmove(pipeline->blocks, pipeline->blocks + delivered, pipeline->blocks_len * sizeof(PipelineBlock));
+	}
+
+	if (pending != NULL && pipeline != NULL) *pending = pipeline->blocks_len;
 
 	return res;
 }
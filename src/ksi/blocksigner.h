@@ -28,6 +28,27 @@ extern "C" {
 
 typedef struct KSI_BlockSigner_st KSI_BlockSigner;
 typedef struct KSI_BlockSignerHandle_st KSI_BlockSignerHandle;
+typedef struct KSI_BlockSignerPipeline_st KSI_BlockSignerPipeline;
+
+/**
+ * Callback for receiving the signatures of the leafs added by #KSI_BlockSigner_addLeaves.
+ * \param[in]	cbCtx		Callback context.
+ * \param[in]	index		Index of the leaf in the order of adding.
+ * \param[in]	sig			Signature of the leaf.
+ * \return #KSI_OK to continue, any other value stops the iteration and is returned to the caller.
+ * \note The signature is freed after the callback returns, use #KSI_Signature_ref to keep it.
+ */
+typedef int (*KSI_BlockSignerCallback)(void *cbCtx, size_t index, KSI_Signature *sig);
+
+/**
+ * Callback for receiving the blocks closed by #KSI_BlockSignerPipeline_closeBlock.
+ * \param[in]	cbCtx		Callback context.
+ * \param[in]	block		The closed block signer.
+ * \param[in]	status		#KSI_OK if the block root was signed, otherwise the error code of the signing request.
+ * \return #KSI_OK to continue, any other value is returned to the caller of #KSI_BlockSignerPipeline_run.
+ * \note The block signer is freed after the callback returns, use #KSI_BlockSigner_ref to keep it.
+ */
+typedef int (*KSI_BlockSignerPipelineCallback)(void *cbCtx, KSI_BlockSigner *block, int status);
 
 KSI_DEFINE_LIST(KSI_BlockSignerHandle);
 #define KSI_BlockSignerHandleList_append(lst, o) KSI_APPLY_TO_NOT_NULL((lst), append, ((lst), (o)))
@@ -58,6 +79,8 @@ int KSI_BlockSigner_new(KSI_CTX *ctx, KSI_HashAlgorithm algoId, KSI_DataHash *pr
  */
 void KSI_BlockSigner_free(KSI_BlockSigner *signer);
 
+KSI_DEFINE_REF(KSI_BlockSigner);
+
 /**
  * This function finalizes the computation of the tree but does not free the resources.
  * \param[in]	signer		Instance of the #KSI_BlockSigner.
@@ -75,6 +98,53 @@ KSI_FN_DEPRECATED(int KSI_BlockSigner_close(KSI_BlockSigner *signer, void *), Us
  */
 int KSI_BlockSigner_reset(KSI_BlockSigner *signer);
 
+/**
+ * Sets the number of threads used for calculating the aggregation tree of the leafs added by
+ * #KSI_BlockSigner_addLeaf. See #KSI_TreeBuilder_setThreadCount for details. The setting is
+ * kept when the block signer is reset.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	threads		Number of threads, 0 or 1 to calculate the tree by the calling thread.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The thread count may only be set before adding the first leaf.
+ */
+int KSI_BlockSigner_setThreadCount(KSI_BlockSigner *signer, size_t threads);
+
+/**
+ * Switches the block signer to the streaming mode, where the leafs added by #KSI_BlockSigner_addLeaves
+ * are kept in a spill file instead of memory (see #KSI_StreamTreeBuilder). Only the roots of the
+ * complete binary subtrees are kept in memory, thus the memory use does not depend on the size of the
+ * block. After #KSI_BlockSigner_closeAndSign the signatures of the leafs are produced sequentially
+ * by #KSI_BlockSigner_getSignatures. The setting is kept when the block signer is reset.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	spillFile	Path of the spill file, if \c NULL a temporary file is used.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The streaming mode may only be set before adding the first leaf. In the streaming mode the
+ * leafs may not be accessed by index, see #KSI_BlockSigner_getSignatureAt.
+ */
+int KSI_BlockSigner_setStreaming(KSI_BlockSigner *signer, const char *spillFile);
+
+/**
+ * Opens a shard of the block for adding the leafs concurrently from several threads. The shard
+ * is a block signer with its own KSI context and its own subtree, thus the shards may be used by
+ * different threads without locking. The first shard continues the masking chain of the block,
+ * the masking chains of the other shards start from a value derived from the previous leaf, the
+ * initial value and the index of the shard. When the block is closed with
+ * #KSI_BlockSigner_closeAndSign, the roots of the shards are joined in the order of opening into
+ * the root of the block, and the leaf handles of the shards yield the leaf signatures as usual.
+ * The signatures of the shard are created in the context of the shard. With masking, the block
+ * continues the masking chain from the last leaf of the last non-empty shard (see
+ * #KSI_BlockSigner_getPrevLeaf).
+ * \param[in]	signer		Instance of the empty #KSI_BlockSigner.
+ * \param[out]	shard		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note Once a shard is opened, the leafs may only be added to the shards. The shards must not be
+ * used while the block is being closed.
+ * \note The leaf hashes added to a shard must not be shared with other threads, create them with the
+ * \c NULL context (e.g. #KSI_DataHash_fromImprint) or with a context used by the same thread only.
+ * \note The caller is responsible for freeing the output with #KSI_BlockSigner_free.
+ */
+int KSI_BlockSigner_openShard(KSI_BlockSigner *signer, KSI_BlockSigner **shard);
+
 /**
  * Add a new leaf to the tree.
  * \param[in]	signer		Instance of the #KSI_BlockSigner.
@@ -97,6 +167,21 @@ int KSI_BlockSigner_reset(KSI_BlockSigner *signer);
  */
 int KSI_BlockSigner_addLeaf(KSI_BlockSigner *signer, KSI_DataHash *hsh, int level, KSI_MetaData *metaData, KSI_BlockSignerHandle **handle);
 
+/**
+ * Adds leafs to the tree in bulk. Instead of a graph of tree nodes, the leafs added by this
+ * function are kept in a compact form (see #KSI_CompactTreeBuilder) and no per-leaf objects are
+ * created. After #KSI_BlockSigner_closeAndSign the leafs are addressed by their index in the
+ * order of adding, see #KSI_BlockSigner_getSignatureAt and #KSI_BlockSigner_getAggregationChainAt.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	imprints	Imprints of the leaf hash values, one after another.
+ * \param[in]	levels		Levels of the leafs (can be \c NULL, if all the leafs are at level 0).
+ * \param[in]	n			Number of leafs.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note All the leafs of a block must use the same hash algorithm. The leafs added with this
+ * function may not be mixed with the leafs added by #KSI_BlockSigner_addLeaf or with meta-data.
+ */
+int KSI_BlockSigner_addLeaves(KSI_BlockSigner *signer, const unsigned char *imprints, const unsigned char *levels, size_t n);
+
 /**
  * Getter method for \c prevLeaf.
  * \param[in]	signer		Pointer to #KSI_BlockSigner.
@@ -116,12 +201,162 @@ int KSI_BlockSigner_getPrevLeaf(const KSI_BlockSigner *signer, KSI_DataHash **pr
  */
 int KSI_BlockSignerHandle_getSignature(const KSI_BlockSignerHandle *handle, KSI_Signature **sig);
 
+/**
+ * Serializes the signature of the leaf without creating the signature object. The parts of the
+ * signature common to all the leafs of the block are serialized once per block and the output
+ * is produced by joining them with the serialized aggregation hash chain of the leaf. The output
+ * is the same as the serialized output of #KSI_BlockSignerHandle_getSignature, but it is not
+ * verified.
+ * \param[in]	handle		Handle for the block signature.
+ * \param[out]	raw			Pointer to the receiving pointer of the serialized signature.
+ * \param[out]	raw_len		Length of the serialized signature.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_free.
+ */
+int KSI_BlockSignerHandle_serializeSignature(const KSI_BlockSignerHandle *handle, unsigned char **raw, size_t *raw_len);
+
+/**
+ * Getter for the signature of the block root.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[out]	sig			Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_Signature_free.
+ * \see #KSI_BlockVerifier_new.
+ */
+int KSI_BlockSigner_getSignature(const KSI_BlockSigner *signer, KSI_Signature **sig);
+
+/**
+ * Extracts the aggregation hash chain from the leaf to the block root. Together with the
+ * signature of the block root, it is a compact form of the leaf signature.
+ * \param[in]	handle		Handle for the block signature.
+ * \param[out]	chain		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_AggregationHashChain_free.
+ * \see #KSI_BlockVerifier_verifyRecord.
+ */
+int KSI_BlockSignerHandle_getAggregationChain(const KSI_BlockSignerHandle *handle, KSI_AggregationHashChain **chain);
+
+/**
+ * Creates the signature for the leaf added by #KSI_BlockSigner_addLeaves.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	index		Index of the leaf.
+ * \param[out]	sig			Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_Signature_free.
+ */
+int KSI_BlockSigner_getSignatureAt(KSI_BlockSigner *signer, size_t index, KSI_Signature **sig);
+
+/**
+ * Serializes the signature of the leaf added by #KSI_BlockSigner_addLeaves, see
+ * #KSI_BlockSignerHandle_serializeSignature.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	index		Index of the leaf.
+ * \param[out]	raw			Pointer to the receiving pointer of the serialized signature.
+ * \param[out]	raw_len		Length of the serialized signature.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_free.
+ */
+int KSI_BlockSigner_serializeSignatureAt(KSI_BlockSigner *signer, size_t index, unsigned char **raw, size_t *raw_len);
+
+/**
+ * Extracts the aggregation hash chain from the leaf added by #KSI_BlockSigner_addLeaves to the block root.
+ * \param[in]	signer		Instance of the #KSI_BlockSigner.
+ * \param[in]	index		Index of the leaf.
+ * \param[out]	chain		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_AggregationHashChain_free.
+ * \see #KSI_BlockVerifier_verifyRecord.
+ */
+int KSI_BlockSigner_getAggregationChainAt(KSI_BlockSigner *signer, size_t index, KSI_AggregationHashChain **chain);
+
+/**
+ * Creates the signatures of all the leafs added by #KSI_BlockSigner_addLeaves and passes them to
+ * the callback. The leafs at level 0 are passed in the order of adding, see
+ * #KSI_StreamTreeBuilder_getAggregationChains for the leafs with different levels.
+ * \param[in]	signer		Instance of the closed #KSI_BlockSigner.
+ * \param[in]	cb			Callback receiving the signatures.
+ * \param[in]	cbCtx		Callback context.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \see #KSI_BlockSigner_setStreaming.
+ */
+int KSI_BlockSigner_getSignatures(KSI_BlockSigner *signer, KSI_BlockSignerCallback cb, void *cbCtx);
+
+/**
+ * Creates the signatures of all the leafs added by #KSI_BlockSigner_addLeaves using several threads
+ * and passes them to the callback in the order of adding. As the KSI context is not thread safe,
+ * every thread gets its own KSI context and the signatures passed to the callback belong to these
+ * contexts. The callback is called by the calling thread while the workers are idle.
+ * \param[in]	signer		Instance of the closed #KSI_BlockSigner.
+ * \param[in]	threads		Number of threads, 0 or 1 to create the signatures by the calling thread.
+ * \param[in]	cb			Callback receiving the signatures.
+ * \param[in]	cbCtx		Callback context.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The signature passed to the callback must not be kept after the callback returns, serialize
+ * it instead with #KSI_Signature_serialize.
+ * \note Not available in the streaming mode, use #KSI_BlockSigner_getSignatures instead.
+ */
+int KSI_BlockSigner_getAllSignatures(KSI_BlockSigner *signer, size_t threads, KSI_BlockSignerCallback cb, void *cbCtx);
+
 /**
  * Cleanup method for the handle.
  * \param[in]	handle		Instance of the #KSI_BlockSignerHandle
  */
 void KSI_BlockSignerHandle_free(KSI_BlockSignerHandle *handle);
 
+/**
+ * Creates a block signing pipeline, where the root of a closed block is signed by an asynchronous
+ * service while the leafs of the next block are already being added. The first block is the given
+ * block signer, the following blocks are created with the same hash algorithm, initial value and
+ * settings, and the last leaf of a block is carried forward as the previous leaf of the next one.
+ * \param[in]	first		An empty block signer for the first block.
+ * \param[in]	service		Signing async service, see #KSI_SigningAsyncService_new.
+ * \param[in]	cb			Callback receiving the signed blocks.
+ * \param[in]	cbCtx		Callback context.
+ * \param[out]	pipeline	Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The pipeline keeps a reference to \c first. The \c service is not owned by the pipeline
+ * and must not be freed nor used for other requests while the pipeline is in use.
+ * \note In the streaming mode the following blocks use temporary spill files.
+ */
+int KSI_BlockSignerPipeline_new(KSI_BlockSigner *first, KSI_AsyncService *service, KSI_BlockSignerPipelineCallback cb, void *cbCtx, KSI_BlockSignerPipeline **pipeline);
+
+/**
+ * Cleanup method for the #KSI_BlockSignerPipeline. The blocks waiting for the signature are dropped
+ * without calling the callback.
+ * \param[in]	pipeline	Instance of the #KSI_BlockSignerPipeline.
+ */
+void KSI_BlockSignerPipeline_free(KSI_BlockSignerPipeline *pipeline);
+
+/**
+ * Getter for the block signer receiving the leafs of the current block.
+ * \param[in]	pipeline	Instance of the #KSI_BlockSignerPipeline.
+ * \param[out]	signer		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The block signer belongs to the pipeline and changes with every #KSI_BlockSignerPipeline_closeBlock.
+ */
+int KSI_BlockSignerPipeline_getBlockSigner(const KSI_BlockSignerPipeline *pipeline, KSI_BlockSigner **signer);
+
+/**
+ * Closes the current block, adds the signing request of its root to the async service and starts the
+ * next block. The function does not wait for the signature, call #KSI_BlockSignerPipeline_run to
+ * process the responses.
+ * \param[in]	pipeline	Instance of the #KSI_BlockSignerPipeline.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note If the request cache of the service is full, the request is added by a later
+ * #KSI_BlockSignerPipeline_run call.
+ */
+int KSI_BlockSignerPipeline_closeBlock(KSI_BlockSignerPipeline *pipeline);
+
+/**
+ * Runs the async service without blocking and passes the blocks that have received the signature
+ * (or failed) to the callback. The blocks are passed in the order of closing, thus a completed
+ * block may wait for a preceding one.
+ * \param[in]	pipeline	Instance of the #KSI_BlockSignerPipeline.
+ * \param[out]	pending		Number of closed blocks not yet passed to the callback (can be \c NULL).
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_BlockSignerPipeline_run(KSI_BlockSignerPipeline *pipeline, size_t *pending);
+
 #ifdef __cplusplus
 }
 #endif
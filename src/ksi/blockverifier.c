@@ -0,0 +1,165 @@
+/*
+ * Copyright 2013-2015 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include "internal.h"
+#include "blockverifier.h"
+#include "hashchain.h"
+#include "signature_helper.h"
+
+#include "impl/hashchain_impl.h"
+#include "impl/signature_impl.h"
+
+struct KSI_BlockVerifier_st {
+	KSI_CTX *ctx;
+
+	/** Verified signature of the block root. */
+	KSI_Signature *signature;
+	/** Root hash of the block, i.e. the input hash of the signature. */
+	KSI_DataHash *rootHash;
+	/** Aggregation time of the block signature. */
+	KSI_Integer *aggregationTime;
+	/** The highest tree level a record aggregation hash chain may end with. */
+	KSI_uint64_t maxLevel;
+};
+
+void KSI_BlockVerifier_free(KSI_BlockVerifier *verifier) {
+	if (verifier != NULL) {
+		KSI_Signature_free(verifier->signature);
+		KSI_DataHash_free(verifier->rootHash);
+		KSI_Integer_free(verifier->aggregationTime);
+		KSI_free(verifier);
+	}
+}
+
+int KSI_BlockVerifier_new(KSI_CTX *ctx, KSI_Signature *sig, const KSI_Policy *policy, KSI_VerificationContext *context, KSI_BlockVerifier **verifier) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockVerifier *tmp = NULL;
+	KSI_AggregationHashChain *aggr = NULL;
+	KSI_HashChainLink *link = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || sig == NULL || policy == NULL || verifier == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (sig->rfc3161 != NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Legacy signature can not be used as a block signature.");
+		goto cleanup;
+	}
+
+	res = KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, 0, &aggr);
+	if (res != KSI_OK || aggr == NULL) {
+		KSI_pushError(ctx, res != KSI_OK ? res : (res = KSI_INVALID_FORMAT), "Signature does not contain an aggregation hash chain.");
+		goto cleanup;
+	}
+
+	res = KSI_HashChainLinkList_elementAt(aggr->chain, 0, &link);
+	if (res != KSI_OK || link == NULL) {
+		KSI_pushError(ctx, res != KSI_OK ? res : (res = KSI_INVALID_FORMAT), "Aggregation hash chain does not contain any links.");
+		goto cleanup;
+	}
+
+	/* The block root is verified only once, the records are verified against its input hash. */
+	res = KSI_Signature_verifyWithPolicy(sig, NULL, 0, policy, context);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, "Verification of the block signature failed.");
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_BlockVerifier);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->signature = KSI_Signature_ref(sig);
+	tmp->rootHash = KSI_DataHash_ref(aggr->inputHash);
+	tmp->aggregationTime = KSI_Integer_ref(aggr->aggregationTime);
+	/* Prepending a record chain ending at level L reduces the first level correction by L, thus
+	 * any record chain ending at a level not exceeding the level correction yields a valid signature. */
+	tmp->maxLevel = KSI_Integer_getUInt64(link->levelCorrection);
+
+	*verifier = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockVerifier_free(tmp);
+
+	return res;
+}
+
+int KSI_BlockVerifier_verifyRecord(const KSI_BlockVerifier *verifier, const KSI_DataHash *docHash, const KSI_AggregationHashChain *chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = NULL;
+	KSI_DataHash *root = NULL;
+	int level = 0;
+
+	if (verifier == NULL || docHash == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	ctx = chain->ctx;
+	KSI_ERR_clearErrors(ctx);
+
+	if (chain->inputHash == NULL || chain->aggrHashId == NULL || chain->chain == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Incomplete aggregation hash chain.");
+		goto cleanup;
+	}
+
+	if (!KSI_DataHash_equals(docHash, chain->inputHash)) {
+		KSI_pushError(ctx, res = KSI_VERIFICATION_FAILURE, "Record hash does not match the aggregation hash chain input hash.");
+		goto cleanup;
+	}
+
+	/* A chain extracted from a record signature must belong to the same aggregation round. */
+	if (chain->aggregationTime != NULL && !KSI_Integer_equals(chain->aggregationTime, verifier->aggregationTime)) {
+		KSI_pushError(ctx, res = KSI_VERIFICATION_FAILURE, "Aggregation time mismatch.");
+		goto cleanup;
+	}
+
+	/* Aggregate without caching the result in the chain, as it may be shared. */
+	res = KSI_HashChain_aggregate(ctx, chain->chain, chain->inputHash, 0, (KSI_HashAlgorithm)KSI_Integer_getUInt64(chain->aggrHashId), &level, &root);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if ((KSI_uint64_t)level > verifier->maxLevel) {
+		KSI_pushError(ctx, res = KSI_VERIFICATION_FAILURE, "Aggregation hash chain output level exceeds the block signature level.");
+		goto cleanup;
+	}
+
+	if (!KSI_DataHash_equals(root, verifier->rootHash)) {
+		KSI_pushError(ctx, res = KSI_VERIFICATION_FAILURE, "Aggregation hash chain does not lead to the block root hash.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(root);
+
+	return res;
+}
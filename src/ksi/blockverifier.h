@@ -0,0 +1,86 @@
+/*
+ * Copyright 2013-2016 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef BLOCKVERIFIER_H_
+#define BLOCKVERIFIER_H_
+
+#include "ksi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup blockverifier Block Verifier
+ * The block verifier is the counterpart of the #KSI_BlockSigner. All the per-record signatures
+ * of a block share the signature of the block root, the only difference is the aggregation hash
+ * chain from the record to the root (including the masking or meta-data link added by the block
+ * signer). The block verifier verifies the signature of the block root once, after which each
+ * record is verified by aggregating its own hash chain and comparing the result with the verified
+ * root - a few hash computations per record, instead of a full signature verification.
+ * @{
+ */
+
+typedef struct KSI_BlockVerifier_st KSI_BlockVerifier;
+
+/**
+ * Creates a new block verifier and verifies the signature of the block root with the given
+ * verification policy.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	sig			Signature of the block root (e.g. as returned by #KSI_BlockSigner_getSignature).
+ * \param[in]	policy		Verification policy.
+ * \param[in]	context		Verification context, can be \c NULL.
+ * \param[out]	verifier	Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, #KSI_VERIFICATION_FAILURE when the
+ * signature of the block root is not valid, otherwise an error code).
+ * \note The verifier keeps a reference to \c sig.
+ * \see #KSI_BlockVerifier_free, #KSI_Signature_verifyWithPolicy
+ */
+int KSI_BlockVerifier_new(KSI_CTX *ctx, KSI_Signature *sig, const KSI_Policy *policy, KSI_VerificationContext *context, KSI_BlockVerifier **verifier);
+
+/**
+ * Destructor for the #KSI_BlockVerifier object.
+ * \param[in]	verifier	Block verifier.
+ */
+void KSI_BlockVerifier_free(KSI_BlockVerifier *verifier);
+
+/**
+ * Verifies a single record of the block. The record is valid if the aggregation hash chain
+ * (e.g. as returned by #KSI_BlockSignerHandle_getAggregationChain) starts with \c docHash and
+ * ends with the verified root hash of the block at an acceptable tree level.
+ * \param[in]	verifier	Block verifier.
+ * \param[in]	docHash		Hash of the record.
+ * \param[in]	chain		Aggregation hash chain from the record to the block root.
+ * \return status code (#KSI_OK, when the record is valid, #KSI_VERIFICATION_FAILURE when it
+ * is not, otherwise an error code).
+ * \note The verifier is not modified by this function and the errors are reported to the context
+ * of \c chain. Thus the records can be verified in parallel, as long as each thread uses a
+ * separate #KSI_CTX for its hash chains.
+ */
+int KSI_BlockVerifier_verifyRecord(const KSI_BlockVerifier *verifier, const KSI_DataHash *docHash, const KSI_AggregationHashChain *chain);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLOCKVERIFIER_H_ */
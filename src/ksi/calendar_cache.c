@@ -0,0 +1,380 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "calendar_cache.h"
+#include "fast_tlv.h"
+#include "hashchain.h"
+
+#define CAL_CACHE_TLV_BUFFER_SIZE (0xffff + 4)
+#define CAL_CACHE_INITIAL_SIZE 16
+
+typedef struct CalendarCacheEntry_st {
+	KSI_uint64_t aggrTime;
+	KSI_uint64_t pubTime;
+	KSI_CalendarHashChain *chain;
+} CalendarCacheEntry;
+
+struct KSI_CalendarCache_st {
+	KSI_CTX *ctx;
+
+	/** Entries sorted by (aggrTime, pubTime). */
+	CalendarCacheEntry *entries;
+	size_t entries_len;
+	size_t entries_size;
+
+	/** Persistent storage (can be NULL). */
+	char *fileName;
+	FILE *file;
+};
+
+/**
+ * Finds the position of the entry with the given key. If the key is not present, the
+ * position where it should be inserted is returned and \c found is set to 0.
+ */
+static size_t findEntry(const KSI_CalendarCache *cache, KSI_uint64_t aggrTime, KSI_uint64_t pubTime, int *found) {
+	size_t lo = 0;
+	size_t hi = cache->entries_len;
+
+	*found = 0;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const CalendarCacheEntry *e = &cache->entries[mid];
+
+		if (e->aggrTime < aggrTime || (e->aggrTime == aggrTime && e->pubTime < pubTime)) {
+			lo = mid + 1;
+		} else if (e->aggrTime == aggrTime && e->pubTime == pubTime) {
+			*found = 1;
+			return mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int insertEntry(KSI_CalendarCache *cache, KSI_uint64_t aggrTime, KSI_uint64_t pubTime, KSI_CalendarHashChain *chain, int *inserted) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t pos;
+	int found = 0;
+
+	pos = findEntry(cache, aggrTime, pubTime, &found);
+	if (found) {
+		*inserted = 0;
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (cache->entries_len == cache->entries_size) {
+		size_t newSize = cache->entries_size == 0 ? CAL_CACHE_INITIAL_SIZE : cache->entries_size * 2;
+		CalendarCacheEntry *tmp = KSI_calloc(newSize, sizeof(CalendarCacheEntry));
+		if (tmp == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+
+		if (cache->entries_len > 0) memcpy(tmp, cache->entries, cache->entries_len * sizeof(CalendarCacheEntry));
+		KSI_free(cache->entries);
+		cache->entries = tmp;
+		cache->entries_size = newSize;
+	}
+
+	memmove(&cache->entries[pos + 1], &cache->entries[pos], (cache->entries_len - pos) * sizeof(CalendarCacheEntry));
+	cache->entries[pos].aggrTime = aggrTime;
+	cache->entries[pos].pubTime = pubTime;
+	cache->entries[pos].chain = KSI_CalendarHashChain_ref(chain);
+	cache->entries_len++;
+
+	*inserted = 1;
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int getChainTimes(const KSI_CalendarHashChain *chain, KSI_uint64_t *aggrTime, KSI_uint64_t *pubTime) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *aggr = NULL;
+	KSI_Integer *pub = NULL;
+
+	res = KSI_CalendarHashChain_getPublicationTime(chain, &pub);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_getAggregationTime(chain, &aggr);
+	if (res != KSI_OK) goto cleanup;
+
+	if (pub == NULL) {
+		res = KSI_INVALID_FORMAT;
+		goto cleanup;
+	}
+
+	*pubTime = KSI_Integer_getUInt64(pub);
+
+	/* If the aggregation time is missing, it is calculated from the shape of the chain. */
+	if (aggr != NULL) {
+		*aggrTime = KSI_Integer_getUInt64(aggr);
+	} else {
+		time_t calculated = 0;
+
+		res = KSI_CalendarHashChain_calculateAggregationTime(chain, &calculated);
+		if (res != KSI_OK) goto cleanup;
+
+		*aggrTime = (KSI_uint64_t)calculated;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int writeChain(KSI_CalendarCache *cache, KSI_CalendarHashChain *chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_CalendarHashChain_serialize(chain, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(cache->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (fwrite(raw, 1, raw_len, cache->file) != raw_len || fflush(cache->file) != 0) {
+		KSI_pushError(cache->ctx, res = KSI_IO_ERROR, "Unable to write to the calendar cache file.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+
+	return res;
+}
+
+static int loadFile(KSI_CalendarCache *cache, int *truncated) {
+	int res = KSI_UNKNOWN_ERROR;
+	FILE *f = NULL;
+	unsigned char *buf = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+
+	*truncated = 0;
+
+	f = fopen(cache->fileName, "rb");
+	if (f == NULL) {
+		/* Nothing to load yet. */
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	buf = KSI_malloc(CAL_CACHE_TLV_BUFFER_SIZE);
+	if (buf == NULL) {
+		KSI_pushError(cache->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	for (;;) {
+		KSI_FTLV ftlv;
+		size_t consumed = 0;
+		KSI_uint64_t aggrTime = 0;
+		KSI_uint64_t pubTime = 0;
+		int inserted = 0;
+
+		res = KSI_FTLV_fileRead(f, buf, CAL_CACHE_TLV_BUFFER_SIZE, &consumed, &ftlv);
+		if (consumed == 0) break;
+
+		if (res != KSI_OK || ftlv.tag != 0x0802 ||
+				KSI_CalendarHashChain_parse(cache->ctx, buf, ftlv.hdr_len + ftlv.dat_len, &chain) != KSI_OK ||
+				getChainTimes(chain, &aggrTime, &pubTime) != KSI_OK) {
+			KSI_LOG_warn(cache->ctx, "Calendar cache: ignoring corrupt data at the end of '%s'.", cache->fileName);
+			*truncated = 1;
+			break;
+		}
+
+		res = insertEntry(cache, aggrTime, pubTime, chain, &inserted);
+		if (res != KSI_OK) {
+			KSI_pushError(cache->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		KSI_CalendarHashChain_free(chain);
+		chain = NULL;
+	}
+
+	KSI_LOG_debug(cache->ctx, "Calendar cache: loaded %llu calendar hash chains from '%s'.", (unsigned long long)cache->entries_len, cache->fileName);
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CalendarHashChain_free(chain);
+	KSI_free(buf);
+	if (f != NULL) fclose(f);
+
+	return res;
+}
+
+static int openFile(KSI_CalendarCache *cache, const char *fileName) {
+	int res = KSI_UNKNOWN_ERROR;
+	int truncated = 0;
+	size_t i;
+
+	res = KSI_strdup(fileName, &cache->fileName);
+	if (res != KSI_OK) {
+		KSI_pushError(cache->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = loadFile(cache, &truncated);
+	if (res != KSI_OK) goto cleanup;
+
+	if (!truncated) {
+		cache->file = fopen(cache->fileName, "ab");
+	} else {
+		/* Rewrite the file with the valid entries, so new records would not follow the corrupt data. */
+		cache->file = fopen(cache->fileName, "wb");
+		for (i = 0; cache->file != NULL && i < cache->entries_len; i++) {
+			res = writeChain(cache, cache->entries[i].chain);
+			if (res != KSI_OK) goto cleanup;
+		}
+	}
+
+	if (cache->file == NULL) {
+		KSI_pushError(cache->ctx, res = KSI_IO_ERROR, "Unable to open the calendar cache file.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CalendarCache_new(KSI_CTX *ctx, const char *fileName, KSI_CalendarCache **cache) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CalendarCache *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || cache == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_CalendarCache);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->entries = NULL;
+	tmp->entries_len = 0;
+	tmp->entries_size = 0;
+	tmp->fileName = NULL;
+	tmp->file = NULL;
+
+	if (fileName != NULL) {
+		res = openFile(tmp, fileName);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	*cache = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CalendarCache_free(tmp);
+
+	return res;
+}
+
+void KSI_CalendarCache_free(KSI_CalendarCache *cache) {
+	size_t i;
+
+	if (cache != NULL) {
+		for (i = 0; i < cache->entries_len; i++) {
+			KSI_CalendarHashChain_free(cache->entries[i].chain);
+		}
+		KSI_free(cache->entries);
+		if (cache->file != NULL) fclose(cache->file);
+		KSI_free(cache->fileName);
+		KSI_free(cache);
+	}
+}
+
+int KSI_CalendarCache_get(KSI_CalendarCache *cache, const KSI_Integer *aggrTime, const KSI_Integer *pubTime, KSI_CalendarHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t pos;
+	int found = 0;
+
+	if (cache == NULL || aggrTime == NULL || pubTime == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	pos = findEntry(cache, KSI_Integer_getUInt64(aggrTime), KSI_Integer_getUInt64(pubTime), &found);
+	*chain = found ? KSI_CalendarHashChain_ref(cache->entries[pos].chain) : NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CalendarCache_add(KSI_CalendarCache *cache, const KSI_Integer *aggrTime, const KSI_Integer *pubTime, KSI_CalendarHashChain *chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	int inserted = 0;
+
+	if (cache == NULL || aggrTime == NULL || pubTime == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = insertEntry(cache, KSI_Integer_getUInt64(aggrTime), KSI_Integer_getUInt64(pubTime), chain, &inserted);
+	if (res != KSI_OK) {
+		KSI_pushError(cache->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (inserted && cache->file != NULL) {
+		res = writeChain(cache, chain);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+size_t KSI_CalendarCache_size(const KSI_CalendarCache *cache) {
+	return cache != NULL ? cache->entries_len : 0;
+}
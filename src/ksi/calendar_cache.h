@@ -0,0 +1,101 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef CALENDAR_CACHE_H_
+#define CALENDAR_CACHE_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup calendarcache Calendar Cache
+ * The calendar cache keeps the extended calendar hash chains received from the extender,
+ * so that signatures with the same aggregation time do not need to be extended over the
+ * network again to the same publication. As a calendar hash chain never changes once the
+ * publication is made, the cached values do not expire. The cache is consulted only when
+ * the publication time is known, extending to the calendar head is never cached.
+ * @{
+ */
+
+/**
+ * Constructor for the #KSI_CalendarCache object. If \c fileName is not \c NULL, the calendar
+ * hash chains previously stored in the file are loaded into the cache and all the new chains
+ * are appended to the file.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	fileName	Path to the persistent cache file (can be \c NULL).
+ * \param[out]	cache		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note A truncated record at the end of the cache file (e.g. due to an interrupted write) is ignored.
+ * \note The records of the cache file are not authenticated. The chains loaded from the file
+ * are used as if they were received from the extender, also when verifying signatures, so anyone
+ * who can modify the file can make the verification accept forged signatures. The file must be
+ * kept in trusted storage, writable only by the application. If such storage is not available,
+ * use a cache without a file.
+ * \see #KSI_CalendarCache_free, #KSI_CTX_setCalendarCache
+ */
+int KSI_CalendarCache_new(KSI_CTX *ctx, const char *fileName, KSI_CalendarCache **cache);
+
+/**
+ * Destructor for the #KSI_CalendarCache object.
+ * \param[in]	cache		Calendar cache.
+ */
+void KSI_CalendarCache_free(KSI_CalendarCache *cache);
+
+/**
+ * Looks up a calendar hash chain from the aggregation time to the publication time.
+ * \param[in]	cache		Calendar cache.
+ * \param[in]	aggrTime	Aggregation time of the signature.
+ * \param[in]	pubTime		Publication time of the requested calendar hash chain.
+ * \param[out]	chain		Pointer to the receiving pointer, set to \c NULL if the chain is not cached.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_CalendarHashChain_free.
+ */
+int KSI_CalendarCache_get(KSI_CalendarCache *cache, const KSI_Integer *aggrTime, const KSI_Integer *pubTime, KSI_CalendarHashChain **chain);
+
+/**
+ * Adds a calendar hash chain to the cache. If the cache is backed by a file, the chain is
+ * also appended to the file.
+ * \param[in]	cache		Calendar cache.
+ * \param[in]	aggrTime	Aggregation time of the signature.
+ * \param[in]	pubTime		Publication time of the calendar hash chain.
+ * \param[in]	chain		Calendar hash chain.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The cache keeps a reference of the chain, the ownership of \c chain is not taken.
+ */
+int KSI_CalendarCache_add(KSI_CalendarCache *cache, const KSI_Integer *aggrTime, const KSI_Integer *pubTime, KSI_CalendarHashChain *chain);
+
+/**
+ * Returns the number of calendar hash chains in the cache.
+ * \param[in]	cache		Calendar cache.
+ * \return Number of cached calendar hash chains.
+ */
+size_t KSI_CalendarCache_size(const KSI_CalendarCache *cache);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALENDAR_CACHE_H_ */
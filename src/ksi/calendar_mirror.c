@@ -0,0 +1,1340 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "calendar_mirror.h"
+#include "hashchain.h"
+#include "net.h"
+#include "net_file.h"
+#include "publicationsfile.h"
+
+#include "impl/ctx_impl.h"
+#include "impl/net_impl.h"
+#include "impl/net_async_impl.h"
+
+#define CAL_MIRROR_MAGIC "KSICALMR"
+#define CAL_MIRROR_MAGIC_LEN 8
+#define CAL_MIRROR_MAX_LEVELS 64
+#define CAL_MIRROR_INITIAL_SIZE 64
+#define CAL_MIRROR_CALENDAR_LEVEL 0xff
+
+/* The responses are created in-process, the login is needed only to produce a well-formed PDU. */
+#define CAL_MIRROR_CLIENT_LOGIN "calendar-mirror"
+
+/**
+ * Perfect subtrees of the calendar at a single level. The subtree with index \c j covers the
+ * leaves [j * 2^k, (j + 1) * 2^k), where \c k is the level.
+ */
+typedef struct CalendarMirrorLevel_st {
+	/** Root of the subtree (base - 1) received with the feed, if any. */
+	KSI_DataHash *frontier;
+	/** Roots of the subtrees base, base + 1, ... where base is firstTime >> level. */
+	KSI_DataHash **nodes;
+	size_t nodes_len;
+	size_t nodes_size;
+} CalendarMirrorLevel;
+
+struct KSI_CalendarMirror_st {
+	KSI_CTX *ctx;
+
+	/** Time of the first leaf received with the feed. */
+	KSI_uint64_t firstTime;
+	CalendarMirrorLevel levels[CAL_MIRROR_MAX_LEVELS];
+
+	/** Set after a successful verification against the publications file. */
+	bool verified;
+
+	/** Common hasher object and its algorithm. */
+	KSI_DataHasher *hsr;
+	KSI_HashAlgorithm hsrAlgo;
+};
+
+void KSI_CalendarMirror_free(KSI_CalendarMirror *mirror) {
+	size_t i, j;
+
+	if (mirror != NULL) {
+		for (i = 0; i < CAL_MIRROR_MAX_LEVELS; i++) {
+			CalendarMirrorLevel *lvl = &mirror->levels[i];
+
+			KSI_DataHash_free(lvl->frontier);
+			for (j = 0; j < lvl->nodes_len; j++) {
+				KSI_DataHash_free(lvl->nodes[j]);
+			}
+			KSI_free(lvl->nodes);
+		}
+		KSI_DataHasher_free(mirror->hsr);
+		KSI_free(mirror);
+	}
+}
+
+int KSI_CalendarMirror_new(KSI_CTX *ctx, KSI_CalendarMirror **mirror) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CalendarMirror *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || mirror == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_CalendarMirror);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memset(tmp, 0, sizeof(KSI_CalendarMirror));
+	tmp->ctx = ctx;
+	tmp->hsrAlgo = KSI_HASHALG_INVALID_VALUE;
+
+	*mirror = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CalendarMirror_free(tmp);
+
+	return res;
+}
+
+static KSI_uint64_t mirror_lastTime(const KSI_CalendarMirror *mirror) {
+	return mirror->firstTime + mirror->levels[0].nodes_len - 1;
+}
+
+/**
+ * Returns the root of the perfect subtree \c index at \c level, or \c NULL if it is not available.
+ */
+static KSI_DataHash *mirror_node(const KSI_CalendarMirror *mirror, unsigned level, KSI_uint64_t index) {
+	const CalendarMirrorLevel *lvl = NULL;
+	KSI_uint64_t base;
+
+	if (level >= CAL_MIRROR_MAX_LEVELS) return NULL;
+
+	lvl = &mirror->levels[level];
+	base = mirror->firstTime >> level;
+
+	if (index >= base && index - base < lvl->nodes_len) return lvl->nodes[index - base];
+	if (index + 1 == base) return lvl->frontier;
+
+	return NULL;
+}
+
+/**
+ * Calculates the parent node. As in the calendar hash chain aggregation, the hash algorithm
+ * of the right child is used.
+ */
+static int mirror_combine(KSI_CalendarMirror *mirror, const KSI_DataHash *left, const KSI_DataHash *right, KSI_DataHash **out) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HashAlgorithm algo;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char level = CAL_MIRROR_CALENDAR_LEVEL;
+
+	res = KSI_DataHash_extract(right, &algo, NULL, NULL);
+	if (res != KSI_OK) goto cleanup;
+
+	if (mirror->hsr == NULL || mirror->hsrAlgo != algo) {
+		KSI_DataHasher_free(mirror->hsr);
+		mirror->hsr = NULL;
+
+		res = KSI_DataHasher_open(mirror->ctx, algo, &mirror->hsr);
+		if (res != KSI_OK) goto cleanup;
+		mirror->hsrAlgo = algo;
+	} else {
+		res = KSI_DataHasher_reset(mirror->hsr);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_DataHash_getImprint(left, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(mirror->hsr, imprint, imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(right, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(mirror->hsr, imprint, imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(mirror->hsr, &level, 1);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(mirror->hsr, out);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int mirror_appendNode(KSI_CalendarMirror *mirror, unsigned level, KSI_DataHash *hsh) {
+	int res = KSI_UNKNOWN_ERROR;
+	CalendarMirrorLevel *lvl = &mirror->levels[level];
+
+	if (lvl->nodes_len == lvl->nodes_size) {
+		size_t size = lvl->nodes_size == 0 ? CAL_MIRROR_INITIAL_SIZE : lvl->nodes_size * 2;
+		KSI_DataHash **tmp = KSI_calloc(size, sizeof(KSI_DataHash *));
+
+		if (tmp == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+
+		if (lvl->nodes_len > 0) memcpy(tmp, lvl->nodes, lvl->nodes_len * sizeof(KSI_DataHash *));
+		KSI_free(lvl->nodes);
+		lvl->nodes = tmp;
+		lvl->nodes_size = size;
+	}
+
+	lvl->nodes[lvl->nodes_len++] = hsh;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Appends the next leaf and calculates the roots of all the perfect subtrees completed by it.
+ */
+static int mirror_appendLeaf(KSI_CalendarMirror *mirror, KSI_DataHash *leaf) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *parent = NULL;
+	KSI_uint64_t index = mirror->firstTime + mirror->levels[0].nodes_len;
+	unsigned level = 0;
+
+	res = mirror_appendNode(mirror, 0, leaf);
+	if (res != KSI_OK) {
+		KSI_DataHash_free(leaf);
+		goto cleanup;
+	}
+
+	/* Every right child completes its parent. */
+	while ((index & 1) && level + 1 < CAL_MIRROR_MAX_LEVELS) {
+		KSI_DataHash *left = mirror_node(mirror, level, index - 1);
+		KSI_DataHash *right = mirror_node(mirror, level, index);
+
+		if (left == NULL || right == NULL) {
+			res = KSI_INVALID_STATE;
+			goto cleanup;
+		}
+
+		res = mirror_combine(mirror, left, right, &parent);
+		if (res != KSI_OK) goto cleanup;
+
+		res = mirror_appendNode(mirror, level + 1, parent);
+		if (res != KSI_OK) goto cleanup;
+		parent = NULL;
+
+		index >>= 1;
+		level++;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(parent);
+
+	return res;
+}
+
+/**
+ * Calculates the root of the calendar tree over the leaves [offset, offset + last].
+ */
+static int mirror_root(KSI_CalendarMirror *mirror, KSI_uint64_t offset, KSI_uint64_t last, KSI_DataHash **root) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *right = NULL;
+	KSI_DataHash *tmp = NULL;
+	unsigned level = 0;
+
+	/* A perfect subtree is stored as is. */
+	if (((last + 1) & last) == 0) {
+		while ((KSI_uint64_t)1 << level != last + 1) level++;
+
+		tmp = mirror_node(mirror, level, offset >> level);
+		if (tmp == NULL) {
+			KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror does not contain the requested subtree.");
+			goto cleanup;
+		}
+
+		*root = KSI_DataHash_ref(tmp);
+		tmp = NULL;
+	} else {
+		KSI_DataHash *left = NULL;
+
+		/* The left subtree is perfect and covers the highest power of two leaves. */
+		while ((KSI_uint64_t)2 << level <= last) level++;
+
+		left = mirror_node(mirror, level, offset >> level);
+		if (left == NULL) {
+			KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror does not contain the requested subtree.");
+			goto cleanup;
+		}
+
+		res = mirror_root(mirror, offset + ((KSI_uint64_t)1 << level), last - ((KSI_uint64_t)1 << level), &right);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = mirror_combine(mirror, left, right, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		*root = tmp;
+		tmp = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(right);
+	KSI_DataHash_free(tmp);
+
+	return res;
+}
+
+static int mirror_readImprint(KSI_CTX *ctx, FILE *f, KSI_DataHash **hsh, int *eof) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char buf[KSI_MAX_IMPRINT_LEN];
+	unsigned int len;
+	int c;
+
+	c = fgetc(f);
+	if (c == EOF) {
+		if (eof == NULL) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unexpected end of calendar feed.");
+			goto cleanup;
+		}
+		*eof = 1;
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	buf[0] = (unsigned char)c;
+	len = KSI_getHashLength((KSI_HashAlgorithm)c);
+	if (len == 0 || len + 1 > sizeof(buf)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unknown hash algorithm in calendar feed.");
+		goto cleanup;
+	}
+
+	if (fread(buf + 1, 1, len, f) != len) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unexpected end of calendar feed.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_fromImprint(ctx, buf, len + 1, hsh);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CalendarMirror_load(KSI_CalendarMirror *mirror, const char *uri) {
+	int res = KSI_UNKNOWN_ERROR;
+	char *path = NULL;
+	FILE *f = NULL;
+	unsigned char hdr[CAL_MIRROR_MAGIC_LEN + 8];
+	KSI_DataHash *hsh = NULL;
+	int eof = 0;
+	int i;
+
+	if (mirror == NULL || uri == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(mirror->ctx);
+
+	if (mirror->levels[0].nodes_len > 0) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror is already loaded.");
+		goto cleanup;
+	}
+
+	if (strncmp(uri, "file://", 7) == 0) {
+		res = KSI_FsClient_extractPath(uri, &path);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	f = fopen(path != NULL ? path : uri, "rb");
+	if (f == NULL) {
+		KSI_pushError(mirror->ctx, res = KSI_IO_ERROR, "Unable to open calendar feed.");
+		goto cleanup;
+	}
+
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, CAL_MIRROR_MAGIC, CAL_MIRROR_MAGIC_LEN)) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_FORMAT, "Not a calendar feed.");
+		goto cleanup;
+	}
+
+	mirror->firstTime = 0;
+	for (i = 0; i < 8; i++) {
+		mirror->firstTime = (mirror->firstTime << 8) | hdr[CAL_MIRROR_MAGIC_LEN + i];
+	}
+
+	/* Roots of the perfect subtrees preceding the first leaf. */
+	for (i = CAL_MIRROR_MAX_LEVELS - 1; i >= 0; i--) {
+		if ((mirror->firstTime >> i) & 1) {
+			res = mirror_readImprint(mirror->ctx, f, &mirror->levels[i].frontier, NULL);
+			if (res != KSI_OK) {
+				KSI_pushError(mirror->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+	}
+
+	while (1) {
+		res = mirror_readImprint(mirror->ctx, f, &hsh, &eof);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+		if (eof) break;
+
+		res = mirror_appendLeaf(mirror, hsh);
+		hsh = NULL;
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (mirror->levels[0].nodes_len == 0) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_FORMAT, "Calendar feed does not contain any leaves.");
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(mirror->ctx, "Calendar mirror: loaded leaves %llu to %llu.",
+			(unsigned long long)mirror->firstTime, (unsigned long long)mirror_lastTime(mirror));
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+	if (f != NULL) fclose(f);
+	KSI_free(path);
+
+	return res;
+}
+
+int KSI_CalendarMirror_verify(KSI_CalendarMirror *mirror, const KSI_PublicationsFile *pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_PublicationRecord) *publications = NULL;
+	KSI_DataHash *root = NULL;
+	size_t matched = 0;
+	size_t i;
+
+	if (mirror == NULL || pubFile == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(mirror->ctx);
+
+	mirror->verified = false;
+
+	if (mirror->levels[0].nodes_len == 0) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror is not loaded.");
+		goto cleanup;
+	}
+
+	res = KSI_PublicationsFile_getPublications(pubFile, &publications);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < KSI_PublicationRecordList_length(publications); i++) {
+		KSI_PublicationRecord *rec = NULL;
+		KSI_PublicationData *pubData = NULL;
+		KSI_Integer *pubTime = NULL;
+		KSI_DataHash *pubHash = NULL;
+		KSI_uint64_t t;
+
+		res = KSI_PublicationRecordList_elementAt(publications, i, &rec);
+		if (res != KSI_OK || rec == NULL) {
+			KSI_pushError(mirror->ctx, res != KSI_OK ? res : (res = KSI_INVALID_STATE), NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PublicationRecord_getPublishedData(rec, &pubData);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PublicationData_getTime(pubData, &pubTime);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PublicationData_getImprint(pubData, &pubHash);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		t = KSI_Integer_getUInt64(pubTime);
+		if (pubHash == NULL || t < mirror->firstTime || t > mirror_lastTime(mirror)) continue;
+
+		res = mirror_root(mirror, 0, t, &root);
+		if (res != KSI_OK) {
+			KSI_pushError(mirror->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (!KSI_DataHash_equals(root, pubHash)) {
+			KSI_LOG_logDataHash(mirror->ctx, KSI_LOG_DEBUG, "Calendar mirror root :", root);
+			KSI_LOG_logDataHash(mirror->ctx, KSI_LOG_DEBUG, "Published hash       :", pubHash);
+			KSI_pushError(mirror->ctx, res = KSI_VERIFICATION_FAILURE, "Calendar mirror does not match the publication.");
+			goto cleanup;
+		}
+
+		KSI_DataHash_free(root);
+		root = NULL;
+		matched++;
+	}
+
+	if (matched == 0) {
+		KSI_pushError(mirror->ctx, res = KSI_VERIFICATION_FAILURE, "No publications within the calendar mirror time range.");
+		goto cleanup;
+	}
+
+	mirror->verified = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(root);
+
+	return res;
+}
+
+int KSI_CalendarMirror_getTimeRange(const KSI_CalendarMirror *mirror, KSI_uint64_t *firstTime, KSI_uint64_t *lastTime) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (mirror == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(mirror->ctx);
+
+	if (mirror->levels[0].nodes_len == 0) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror is not loaded.");
+		goto cleanup;
+	}
+
+	if (firstTime != NULL) *firstTime = mirror->firstTime;
+	if (lastTime != NULL) *lastTime = mirror_lastTime(mirror);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int mirror_appendLink(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *links, int isLeft, KSI_DataHash *imprint) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HashChainLink *link = NULL;
+
+	res = KSI_HashChainLink_new(ctx, &link);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_HashChainLink_setIsLeft(link, isLeft);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_HashChainLink_setImprint(link, imprint);
+	if (res != KSI_OK) goto cleanup;
+	imprint = NULL;
+
+	/* The links are found from the root towards the leaf. */
+	if (KSI_HashChainLinkList_length(links) == 0) {
+		res = KSI_HashChainLinkList_append(links, link);
+	} else {
+		res = KSI_HashChainLinkList_insertAt(links, 0, link);
+	}
+	if (res != KSI_OK) goto cleanup;
+	link = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(imprint);
+	KSI_HashChainLink_free(link);
+
+	return res;
+}
+
+int KSI_CalendarMirror_getCalendarHashChain(KSI_CalendarMirror *mirror, KSI_uint64_t aggrTime, KSI_uint64_t pubTime, KSI_CalendarHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CalendarHashChain *tmp = NULL;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+	KSI_Integer *aggrTimeInt = NULL;
+	KSI_Integer *pubTimeInt = NULL;
+	KSI_DataHash *sibling = NULL;
+	KSI_DataHash *leaf = NULL;
+	KSI_uint64_t offset = 0;
+	KSI_uint64_t last = pubTime;
+
+	if (mirror == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(mirror->ctx);
+
+	if (mirror->levels[0].nodes_len == 0 || aggrTime < mirror->firstTime || aggrTime > pubTime || pubTime > mirror_lastTime(mirror)) {
+		KSI_pushError(mirror->ctx, res = KSI_INVALID_ARGUMENT, "Requested time range is not within the calendar mirror.");
+		goto cleanup;
+	}
+
+	res = KSI_HashChainLinkList_new(&links);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Descend from the root of the calendar tree to the leaf of the aggregation time. */
+	while (last > 0) {
+		unsigned level = 0;
+		KSI_uint64_t half;
+
+		while ((KSI_uint64_t)2 << level <= last) level++;
+		half = (KSI_uint64_t)1 << level;
+
+		if (aggrTime - offset < half) {
+			/* Left child, the sibling is the root of the right subtree. */
+			res = mirror_root(mirror, offset + half, last - half, &sibling);
+			if (res != KSI_OK) {
+				KSI_pushError(mirror->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			res = mirror_appendLink(mirror->ctx, links, 1, sibling);
+			sibling = NULL;
+			if (res != KSI_OK) {
+				KSI_pushError(mirror->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			last = half - 1;
+		} else {
+			/* Right child, the sibling is the perfect left subtree. */
+			sibling = mirror_node(mirror, level, offset >> level);
+			if (sibling == NULL) {
+				KSI_pushError(mirror->ctx, res = KSI_INVALID_STATE, "Calendar mirror does not contain the requested subtree.");
+				goto cleanup;
+			}
+
+			res = mirror_appendLink(mirror->ctx, links, 0, KSI_DataHash_ref(sibling));
+			sibling = NULL;
+			if (res != KSI_OK) {
+				KSI_pushError(mirror->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			offset += half;
+			last -= half;
+		}
+	}
+
+	leaf = KSI_DataHash_ref(mirror_node(mirror, 0, aggrTime));
+
+	res = KSI_CalendarHashChain_new(mirror->ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Integer_new(mirror->ctx, aggrTime, &aggrTimeInt);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_Integer_new(mirror->ctx, pubTime, &pubTimeInt);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_CalendarHashChain_setAggregationTime(tmp, aggrTimeInt);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+	aggrTimeInt = NULL;
+
+	res = KSI_CalendarHashChain_setPublicationTime(tmp, pubTimeInt);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+	pubTimeInt = NULL;
+
+	res = KSI_CalendarHashChain_setInputHash(tmp, leaf);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+	leaf = NULL;
+
+	res = KSI_CalendarHashChain_setHashChain(tmp, links);
+	if (res != KSI_OK) {
+		KSI_pushError(mirror->ctx, res, NULL);
+		goto cleanup;
+	}
+	links = NULL;
+
+	*chain = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(aggrTimeInt);
+	KSI_Integer_free(pubTimeInt);
+	KSI_DataHash_free(leaf);
+	KSI_HashChainLinkList_free(links);
+	KSI_CalendarHashChain_free(tmp);
+
+	return res;
+}
+
+/**
+ * Checks whether the request can be answered from the mirror. Otherwise returns the status code
+ * and the error message a real extender would respond with.
+ */
+static int mirrorClient_checkRequest(const KSI_CalendarMirror *mirror, const KSI_ExtendReq *req, KSI_uint64_t *statusCode, const char **msg) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *aggrTime = NULL;
+	KSI_Integer *pubTime = NULL;
+
+	res = KSI_ExtendReq_getAggregationTime(req, &aggrTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getPublicationTime(req, &pubTime);
+	if (res != KSI_OK) goto cleanup;
+
+	*statusCode = 0;
+	*msg = NULL;
+
+	if (!mirror->verified) {
+		*statusCode = 0x0201;
+		*msg = "Calendar mirror is not verified.";
+	} else if (aggrTime == NULL) {
+		*statusCode = 0x0101;
+		*msg = "Aggregation time is missing.";
+	} else if (pubTime != NULL && KSI_Integer_compare(aggrTime, pubTime) > 0) {
+		*statusCode = 0x0104;
+		*msg = "Aggregation time is after the publication time.";
+	} else if (KSI_Integer_getUInt64(aggrTime) < mirror->firstTime) {
+		*statusCode = 0x0105;
+		*msg = "Aggregation time is before the calendar mirror.";
+	} else if (KSI_Integer_getUInt64(aggrTime) > mirror_lastTime(mirror) ||
+			(pubTime != NULL && KSI_Integer_getUInt64(pubTime) > mirror_lastTime(mirror))) {
+		*statusCode = 0x0106;
+		*msg = "Requested time is after the calendar mirror.";
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Creates the extend response for the request. Requests which can not be answered from the
+ * mirror get the same status codes a real extender would return.
+ */
+static int mirrorClient_createResponse(KSI_CalendarMirror *mirror, KSI_ExtendReq *req, KSI_ExtendResp **resp) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = mirror->ctx;
+	KSI_ExtendResp *tmp = NULL;
+	KSI_Integer *reqId = NULL;
+	KSI_Integer *aggrTime = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_Integer *status = NULL;
+	KSI_Integer *lastTime = NULL;
+	KSI_Utf8String *errorMsg = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_uint64_t statusCode = 0;
+	const char *msg = NULL;
+
+	res = KSI_ExtendResp_new(ctx, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getRequestId(req, &reqId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setRequestId(tmp, KSI_Integer_ref(reqId));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getAggregationTime(req, &aggrTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getPublicationTime(req, &pubTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = mirrorClient_checkRequest(mirror, req, &statusCode, &msg);
+	if (res != KSI_OK) goto cleanup;
+
+	if (statusCode == 0) {
+		res = KSI_CalendarMirror_getCalendarHashChain(mirror, KSI_Integer_getUInt64(aggrTime),
+				pubTime != NULL ? KSI_Integer_getUInt64(pubTime) : mirror_lastTime(mirror), &chain);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendResp_setCalendarHashChain(tmp, chain);
+		if (res != KSI_OK) goto cleanup;
+		chain = NULL;
+	} else {
+		KSI_LOG_debug(ctx, "Calendar mirror: %s", msg);
+
+		res = KSI_Utf8String_new(ctx, msg, strlen(msg) + 1, &errorMsg);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendResp_setErrorMsg(tmp, errorMsg);
+		if (res != KSI_OK) goto cleanup;
+		errorMsg = NULL;
+	}
+
+	res = KSI_Integer_new(ctx, statusCode, &status);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setStatus(tmp, status);
+	if (res != KSI_OK) goto cleanup;
+	status = NULL;
+
+	res = KSI_Integer_new(ctx, mirror_lastTime(mirror), &lastTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setLastTime(tmp, lastTime);
+	if (res != KSI_OK) goto cleanup;
+	lastTime = NULL;
+
+	*resp = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(status);
+	KSI_Integer_free(lastTime);
+	KSI_Utf8String_free(errorMsg);
+	KSI_CalendarHashChain_free(chain);
+	KSI_ExtendResp_free(tmp);
+
+	return res;
+}
+
+static int mirrorClient_createConfig(KSI_CalendarMirror *mirror, KSI_Config **conf) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Config *tmp = NULL;
+	KSI_Integer *firstTime = NULL;
+	KSI_Integer *lastTime = NULL;
+
+	res = KSI_Config_new(mirror->ctx, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(mirror->ctx, mirror->firstTime, &firstTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Config_setCalendarFirstTime(tmp, firstTime);
+	if (res != KSI_OK) goto cleanup;
+	firstTime = NULL;
+
+	res = KSI_Integer_new(mirror->ctx, mirror_lastTime(mirror), &lastTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Config_setCalendarLastTime(tmp, lastTime);
+	if (res != KSI_OK) goto cleanup;
+	lastTime = NULL;
+
+	*conf = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(firstTime);
+	KSI_Integer_free(lastTime);
+	KSI_Config_free(tmp);
+
+	return res;
+}
+
+static int mirrorClient_readResponse(KSI_RequestHandle *handle) {
+	/* The response is created when the request is sent. */
+	return handle != NULL && handle->response != NULL ? KSI_OK : KSI_INVALID_STATE;
+}
+
+/**
+ * Creates the serialized extend response PDU for the request, authenticated with the given credentials.
+ */
+static int mirrorClient_createPdu(KSI_CalendarMirror *mirror, KSI_ExtendReq *req, const char *user, const char *pass, unsigned char **raw, size_t *raw_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = mirror->ctx;
+	KSI_ExtendPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_Utf8String *loginId = NULL;
+	KSI_ExtendResp *resp = NULL;
+	KSI_Config *reqConf = NULL;
+	KSI_Config *conf = NULL;
+	KSI_DataHash *hmac = NULL;
+	KSI_Integer *aggrTime = NULL;
+	KSI_HashAlgorithm algo;
+
+	res = KSI_ExtendPdu_new(ctx, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_new(ctx, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Utf8String_new(ctx, user, strlen(user) + 1, &loginId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_setLoginId(hdr, loginId);
+	if (res != KSI_OK) goto cleanup;
+	loginId = NULL;
+
+	res = KSI_ExtendPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_ExtendReq_getConfig(req, &reqConf);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_getAggregationTime(req, &aggrTime);
+	if (res != KSI_OK) goto cleanup;
+
+	if (reqConf != NULL && ctx->options[KSI_OPT_EXT_PDU_VER] == KSI_PDU_VERSION_2) {
+		res = mirrorClient_createConfig(mirror, &conf);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendPdu_setConfResponse(pdu, conf);
+		if (res != KSI_OK) goto cleanup;
+		conf = NULL;
+	}
+
+	if (aggrTime != NULL || reqConf == NULL) {
+		res = mirrorClient_createResponse(mirror, req, &resp);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendPdu_setResponse(pdu, resp);
+		if (res != KSI_OK) goto cleanup;
+		resp = NULL;
+	}
+
+	algo = (KSI_HashAlgorithm)ctx->options[KSI_OPT_EXT_HMAC_ALGORITHM];
+
+	res = KSI_DataHash_createZero(ctx, algo, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_ExtendPdu_updateHmac(pdu, algo, pass);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_serialize(pdu, raw, raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Utf8String_free(loginId);
+	KSI_Header_free(hdr);
+	KSI_ExtendResp_free(resp);
+	KSI_Config_free(conf);
+	KSI_DataHash_free(hmac);
+	KSI_ExtendPdu_free(pdu);
+
+	return res;
+}
+
+static int mirrorClient_sendExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, KSI_RequestHandle **handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_RequestHandle *tmp = NULL;
+	KSI_Integer *pReqId = NULL;
+	KSI_Integer *reqId = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	if (client == NULL || client->impl == NULL || req == NULL || handle == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(client->ctx);
+
+	res = KSI_ExtendReq_getRequestId(req, &pReqId);
+	if (res != KSI_OK) goto cleanup;
+
+	if (pReqId == NULL) {
+		res = KSI_Integer_new(client->ctx, ++client->requestCount, &reqId);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_ExtendReq_setRequestId(req, reqId);
+		if (res != KSI_OK) goto cleanup;
+		reqId = NULL;
+	}
+
+	res = mirrorClient_createPdu(client->impl, req, client->extender->ksi_user, client->extender->ksi_pass, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_RequestHandle_new(client->ctx, NULL, 0, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_RequestHandle_setResponse(tmp, raw, raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	tmp->readResponse = mirrorClient_readResponse;
+	tmp->client = client;
+	tmp->reqCtx = (void*)KSI_ExtendReq_ref(req);
+	tmp->reqCtx_free = (void (*)(void *))KSI_ExtendReq_free;
+
+	*handle = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (res != KSI_OK && client != NULL) KSI_pushError(client->ctx, res, NULL);
+
+	KSI_free(raw);
+	KSI_Integer_free(reqId);
+	KSI_RequestHandle_free(tmp);
+
+	return res;
+}
+
+int KSI_CalendarMirrorClient_new(KSI_CTX *ctx, KSI_CalendarMirror *mirror, KSI_NetworkClient **client) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_NetworkClient *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || mirror == NULL || client == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_AbstractNetworkClient_new(ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_NetworkClient_setExtenderUser(tmp, CAL_MIRROR_CLIENT_LOGIN);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_NetworkClient_setExtenderPass(tmp, CAL_MIRROR_CLIENT_LOGIN);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->sendExtendRequest = mirrorClient_sendExtendRequest;
+	tmp->impl = mirror;
+	tmp->implFree = (void (*)(void *))KSI_CalendarMirror_free;
+
+	*client = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_NetworkClient_free(tmp);
+
+	return res;
+}
+
+/**
+ * Transport of an async extending client, which answers the requests from the calendar mirror and
+ * passes the rest on to the transport the client was set up with.
+ */
+typedef struct MirrorAsyncCtx_st {
+	KSI_CalendarMirror *mirror;
+	/** Serialized responses created from the mirror. */
+	KSI_AsyncQueue *respQueue;
+
+	/** Upstream transport and its methods. */
+	void *impl;
+	void (*impl_free)(void *);
+	int (*addRequest)(void *, KSI_AsyncHandle *);
+	int (*getResponse)(void *, KSI_OctetString **, size_t *);
+	int (*getCredentials)(void *, const char **, const char **);
+	int (*dispatch)(void *);
+	int (*getPollFds)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *);
+} MirrorAsyncCtx;
+
+static void MirrorAsyncCtx_free(MirrorAsyncCtx *m) {
+	if (m != NULL) {
+		KSI_AsyncQueue_free(m->respQueue);
+		KSI_CalendarMirror_free(m->mirror);
+		if (m->impl_free != NULL) m->impl_free(m->impl);
+		KSI_free(m);
+	}
+}
+
+static int mirrorAsync_addRequest(MirrorAsyncCtx *m, KSI_AsyncHandle *request) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Config *reqConf = NULL;
+	KSI_OctetString *resp = NULL;
+	KSI_uint64_t statusCode = 0;
+	const char *msg = NULL;
+	const char *user = NULL;
+	const char *pass = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	if (m == NULL || request == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* The configuration requests and the requests the mirror can not answer are sent upstream. */
+	if (request->extReq != NULL) {
+		res = KSI_ExtendReq_getConfig(request->extReq, &reqConf);
+		if (res != KSI_OK) goto cleanup;
+
+		res = mirrorClient_checkRequest(m->mirror, request->extReq, &statusCode, &msg);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (request->extReq == NULL || reqConf != NULL || statusCode != 0) {
+		res = m->addRequest(m->impl, request);
+		goto cleanup;
+	}
+
+	/* The response is authenticated as if it was received from upstream. */
+	res = m->getCredentials(m->impl, &user, &pass);
+	if (res != KSI_OK) goto cleanup;
+
+	res = mirrorClient_createPdu(m->mirror, request->extReq, user != NULL ? user : "", pass, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OctetString_new(m->mirror->ctx, raw, raw_len, &resp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AsyncQueue_push(m->respQueue, resp);
+	if (res != KSI_OK) goto cleanup;
+	resp = NULL;
+
+	KSI_LOG_debug(m->mirror->ctx, "[%p] Async extend request answered from the calendar mirror.", m);
+
+	/* Release the serialized payload. */
+	KSI_free(request->raw);
+	request->raw = NULL;
+	request->len = 0;
+	request->sentCount = 0;
+
+	/* The request is not sent out, thus it does not take from the request quota. */
+	request->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
+	time(&request->reqTime);
+	request->sndTime = request->reqTime;
+	KSI_AsyncHandle_free(request);
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_OctetString_free(resp);
+
+	return res;
+}
+
+static int mirrorAsync_getResponse(MirrorAsyncCtx *m, KSI_OctetString **response, size_t *left) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_OctetString *tmp = NULL;
+	size_t upstreamLeft = 0;
+
+	if (m == NULL || response == NULL || left == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = KSI_AsyncQueue_pop(m->respQueue);
+	if (tmp == NULL) {
+		res = m->getResponse(m->impl, &tmp, &upstreamLeft);
+		if (res != KSI_OK) goto cleanup;
+	} else {
+		/* The upstream queue is checked once the local responses have been processed. */
+		upstreamLeft = 1;
+	}
+
+	*response = tmp;
+	*left = KSI_AsyncQueue_length(m->respQueue) + upstreamLeft;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int mirrorAsync_getCredentials(MirrorAsyncCtx *m, const char **user, const char **pass) {
+	if (m == NULL) return KSI_INVALID_ARGUMENT;
+	return m->getCredentials(m->impl, user, pass);
+}
+
+static int mirrorAsync_dispatch(MirrorAsyncCtx *m) {
+	if (m == NULL) return KSI_INVALID_ARGUMENT;
+	return m->dispatch(m->impl);
+}
+
+static int mirrorAsync_getPollFds(MirrorAsyncCtx *m, KSI_AsyncPollFd *fds, size_t fds_size, size_t *fds_count, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (m == NULL || fds_count == NULL || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = m->getPollFds(m->impl, fds, fds_size, fds_count, timeoutMs);
+	if (res != KSI_OK) goto cleanup;
+
+	/* The responses created from the mirror can be processed without waiting. */
+	if (KSI_AsyncQueue_length(m->respQueue) > 0) *timeoutMs = 0;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CalendarMirrorAsyncClient_attach(KSI_AsyncClient *client, KSI_CalendarMirror *mirror) {
+	int res = KSI_UNKNOWN_ERROR;
+	MirrorAsyncCtx *tmp = NULL;
+
+	if (client == NULL || client->clientImpl == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Replace the mirror of an already attached transport. */
+	if (client->addRequest == (int (*)(void *, KSI_AsyncHandle *))mirrorAsync_addRequest) {
+		MirrorAsyncCtx *m = client->clientImpl;
+
+		if (mirror != NULL) {
+			KSI_CalendarMirror_free(m->mirror);
+			m->mirror = mirror;
+		} else {
+			/* Restore the upstream transport. The responses already created remain unanswered. */
+			client->clientImpl = m->impl;
+			client->clientImpl_free = m->impl_free;
+			client->addRequest = m->addRequest;
+			client->getResponse = m->getResponse;
+			client->getCredentials = m->getCredentials;
+			client->dispatch = m->dispatch;
+			client->getPollFds = m->getPollFds;
+
+			m->impl = NULL;
+			m->impl_free = NULL;
+			MirrorAsyncCtx_free(m);
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (mirror == NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (client->addRequest == NULL || client->getResponse == NULL || client->getCredentials == NULL || client->dispatch == NULL) {
+		res = KSI_INVALID_STATE;
+		goto cleanup;
+	}
+
+	tmp = KSI_new(MirrorAsyncCtx);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	memset(tmp, 0, sizeof(MirrorAsyncCtx));
+
+	res = KSI_AsyncQueue_new((void (*)(void *))KSI_OctetString_free, &tmp->respQueue);
+	if (res != KSI_OK) goto cleanup;
+
+	tmp->impl = client->clientImpl;
+	tmp->impl_free = client->clientImpl_free;
+	tmp->addRequest = client->addRequest;
+	tmp->getResponse = client->getResponse;
+	tmp->getCredentials = client->getCredentials;
+	tmp->dispatch = client->dispatch;
+	tmp->getPollFds = client->getPollFds;
+	tmp->mirror = mirror;
+
+	/* The endpoint id and the options of the client are kept, as the upstream transport refers to them. */
+	client->clientImpl = tmp;
+	client->clientImpl_free = (void (*)(void *))MirrorAsyncCtx_free;
+	client->addRequest = (int (*)(void *, KSI_AsyncHandle *))mirrorAsync_addRequest;
+	client->getResponse = (int (*)(void *, KSI_OctetString **, size_t *))mirrorAsync_getResponse;
+	client->getCredentials = (int (*)(void *, const char **, const char **))mirrorAsync_getCredentials;
+	client->dispatch = (int (*)(void *))mirrorAsync_dispatch;
+	/* Without the sockets of the upstream transport the client is polled regularly. */
+	client->getPollFds = (tmp->getPollFds != NULL ?
+			(int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))mirrorAsync_getPollFds : NULL);
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	MirrorAsyncCtx_free(tmp);
+
+	return res;
+}
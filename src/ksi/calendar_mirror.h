@@ -0,0 +1,123 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef CALENDAR_MIRROR_H_
+#define CALENDAR_MIRROR_H_
+
+#include "types.h"
+#include "publicationsfile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup calendarmirror Calendar Mirror
+ * The calendar mirror is a local copy of the calendar database, i.e. the calendar hash tree
+ * leaves of every second, which is used for answering extending requests without contacting
+ * the extender. The calendar data is loaded once from a feed and verified against the
+ * publications in a publications file, after which any signature within the mirrored time
+ * range can be extended locally - the cost of extending is a few hash computations instead of
+ * a network round-trip.
+ *
+ * The feed is a binary file with the following layout (all integers are big-endian):
+ * - the 8 byte magic \c "KSICALMR";
+ * - the 8 byte time of the first leaf in the feed (\c F);
+ * - for every set bit of \c F, starting from the highest, the imprint of the root hash of the
+ * corresponding perfect subtree covering the leaves before \c F;
+ * - the imprints of the leaves \c F, \c F+1, ... until the end of the file.
+ * @{
+ */
+
+/**
+ * Constructor for the #KSI_CalendarMirror object.
+ * \param[in]	ctx			KSI context.
+ * \param[out]	mirror		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \see #KSI_CalendarMirror_free, #KSI_CalendarMirror_load
+ */
+int KSI_CalendarMirror_new(KSI_CTX *ctx, KSI_CalendarMirror **mirror);
+
+/**
+ * Destructor for the #KSI_CalendarMirror object.
+ * \param[in]	mirror		Calendar mirror.
+ */
+void KSI_CalendarMirror_free(KSI_CalendarMirror *mirror);
+
+/**
+ * Loads the calendar data from a feed into an empty mirror.
+ * \param[in]	mirror		Calendar mirror.
+ * \param[in]	uri			Path or \c file:// URI of the calendar feed.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_CalendarMirror_load(KSI_CalendarMirror *mirror, const char *uri);
+
+/**
+ * Verifies the mirrored calendar data against all the publications in \c pubFile that fall
+ * within the mirrored time range. The mirror answers extending requests only after a successful
+ * verification.
+ * \param[in]	mirror		Calendar mirror.
+ * \param[in]	pubFile		Verified publications file.
+ * \return status code (#KSI_OK, when operation succeeded, #KSI_VERIFICATION_FAILURE if a published
+ * hash does not match or there are no publications within the mirrored time range, otherwise an
+ * error code).
+ */
+int KSI_CalendarMirror_verify(KSI_CalendarMirror *mirror, const KSI_PublicationsFile *pubFile);
+
+/**
+ * Getter for the mirrored time range.
+ * \param[in]	mirror		Calendar mirror.
+ * \param[out]	firstTime	Time of the first mirrored calendar leaf, can be \c NULL.
+ * \param[out]	lastTime	Time of the last mirrored calendar leaf, can be \c NULL.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_CalendarMirror_getTimeRange(const KSI_CalendarMirror *mirror, KSI_uint64_t *firstTime, KSI_uint64_t *lastTime);
+
+/**
+ * Builds the calendar hash chain from the aggregation time to the publication time.
+ * \param[in]	mirror		Calendar mirror.
+ * \param[in]	aggrTime	Aggregation time.
+ * \param[in]	pubTime		Publication time.
+ * \param[out]	chain		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The caller is responsible for freeing the output with #KSI_CalendarHashChain_free.
+ */
+int KSI_CalendarMirror_getCalendarHashChain(KSI_CalendarMirror *mirror, KSI_uint64_t aggrTime, KSI_uint64_t pubTime, KSI_CalendarHashChain **chain);
+
+/**
+ * Creates a network client which answers the extending requests from the calendar mirror.
+ * Signing and publications file requests are not supported by the client.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	mirror		Verified calendar mirror.
+ * \param[out]	client		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note On success the client takes ownership of \c mirror.
+ * \see #KSI_CTX_setCalendarMirror
+ */
+int KSI_CalendarMirrorClient_new(KSI_CTX *ctx, KSI_CalendarMirror *mirror, KSI_NetworkClient **client);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALENDAR_MIRROR_H_ */
@@ -130,3 +130,58 @@ int KSI_strcasecmp(const char *s1, const char *s2) {
 		return strcasecmp(s1, s2);
 	#endif
 }
+
+#ifdef _WIN32
+#include <windows.h>
+
+size_t KSI_atomicIncrement(volatile size_t *value) {
+#  ifdef _WIN64
+	return (size_t)InterlockedIncrement64((volatile LONG64 *)value);
+#  else
+	return (size_t)InterlockedIncrement((volatile LONG *)value);
+#  endif
+}
+
+size_t KSI_atomicDecrement(volatile size_t *value) {
+#  ifdef _WIN64
+	return (size_t)InterlockedDecrement64((volatile LONG64 *)value);
+#  else
+	return (size_t)InterlockedDecrement((volatile LONG *)value);
+#  endif
+}
+
+void *KSI_atomicLoadPtr(void *volatile *ptr) {
+	return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+}
+
+int KSI_atomicCompareAndSwapPtr(void *volatile *ptr, void *expected, void *desired) {
+	return InterlockedCompareExchangePointer(ptr, desired, expected) == expected;
+}
+
+uint64_t KSI_getMonotonicTimeMs(void) {
+	return (uint64_t)GetTickCount64();
+}
+#else
+size_t KSI_atomicIncrement(volatile size_t *value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+size_t KSI_atomicDecrement(volatile size_t *value) {
+	return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+void *KSI_atomicLoadPtr(void *volatile *ptr) {
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+int KSI_atomicCompareAndSwapPtr(void *volatile *ptr, void *expected, void *desired) {
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+uint64_t KSI_getMonotonicTimeMs(void) {
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+#endif
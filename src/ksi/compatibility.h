@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <time.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -89,6 +90,43 @@ time_t KSI_CalendarTimeToUnixTime(struct tm *time);
  */
 int KSI_strcasecmp(const char *s1, const char *s2);
 
+/**
+ * Platform independent atomic increment, used for reference counting of objects shared between threads.
+ * \param[in]	value	Pointer to the value.
+ * \return The incremented value.
+ */
+size_t KSI_atomicIncrement(volatile size_t *value);
+
+/**
+ * Platform independent atomic decrement, used for reference counting of objects shared between threads.
+ * \param[in]	value	Pointer to the value.
+ * \return The decremented value.
+ */
+size_t KSI_atomicDecrement(volatile size_t *value);
+
+/**
+ * Platform independent atomic pointer load.
+ * \param[in]	ptr		Pointer to the pointer.
+ * \return The value of the pointer.
+ */
+void *KSI_atomicLoadPtr(void *volatile *ptr);
+
+/**
+ * Platform independent atomic compare and swap of a pointer. The pointer is set to \c desired only if
+ * its current value is \c expected.
+ * \param[in]	ptr			Pointer to the pointer.
+ * \param[in]	expected	Expected current value.
+ * \param[in]	desired		New value.
+ * \return Non-zero if the value was swapped, 0 otherwise.
+ */
+int KSI_atomicCompareAndSwapPtr(void *volatile *ptr, void *expected, void *desired);
+
+/**
+ * Platform independent monotonic clock for measuring time intervals.
+ * \return Milliseconds elapsed since an unspecified point in the past.
+ */
+uint64_t KSI_getMonotonicTimeMs(void);
+
 /**
  * @}
  */
@@ -225,6 +225,8 @@ extern "C" {
 
 	KSI_DEFINE_REF(KSI_CalendarHashChain);
 	KSI_DEFINE_WRITE_BYTES(KSI_CalendarHashChain);
+	KSI_DEFINE_OBJECT_PARSE(KSI_CalendarHashChain);
+	KSI_DEFINE_OBJECT_SERIALIZE(KSI_CalendarHashChain);
 
 	void KSI_HashChainLinkIdentity_free(KSI_HashChainLinkIdentity *identity);
 	int KSI_HashChainLinkIdentity_getType(const KSI_HashChainLinkIdentity *o, KSI_HashChainLinkIdentityType *v);
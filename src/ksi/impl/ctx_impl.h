@@ -71,11 +71,28 @@ extern "C" {
 
 		/** PKI trust provider. */
 		KSI_PKITruststore *pkiTruststore;
+		/** Cache of successful PKI verification results. */
+		KSI_PKIVerificationCache *pkiVerificationCache;
 
 		/** Pointer to an instance of a publications file. */
 		KSI_PublicationsFile *publicationsFile;
 		/** Publications file cached timestamp. */
 		time_t publicationsFileCachedAt;
+		/** Publications file refresh in progress (can be NULL). */
+		KSI_RequestHandle *publicationsFileRefresh;
+		/** Entity tag of the cached publications file for conditional requests (can be NULL). */
+		char *publicationsFileETag;
+		/** Modification time of the cached publications file for conditional requests (0 if unknown). */
+		time_t publicationsFileLastModified;
+
+		/** Path of the publications file verification snapshot (can be NULL). */
+		char *publicationsFileSnapshot;
+
+		/** Shared trust state the publications file and the PKI truststore are taken from (can be NULL). */
+		KSI_TrustState *trustState;
+
+		/** Cache of extended calendar hash chains (can be NULL). */
+		KSI_CalendarCache *calendarCache;
 
 		/** This field is kept only for compatibility - will be removed in the future. */
 		char *publicationCertEmail_DEPRECATED;
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef LIST_IMPL_H_
+#define LIST_IMPL_H_
+
+#include "../list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/**
+	 * Returns the revision of the list content. The revision changes whenever an element is
+	 * added, removed or replaced or the list is sorted, and two lists never share a revision,
+	 * so an unchanged revision means the list still holds the same elements in the same order.
+	 * \param[in]	list		The list.
+	 * \return The revision, or 0 if the list is \c NULL.
+	 */
+	size_t KSI_List_getRevision(const KSI_List *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIST_IMPL_H_ */
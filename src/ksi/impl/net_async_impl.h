@@ -27,6 +27,55 @@
 extern "C" {
 #endif
 
+	/**
+	 * Returns the smaller of the two poll timeouts, where a negative value stands for no timeout.
+	 */
+#define KSI_ASYNC_POLL_TIMEOUT_MIN(a, b) (((a) < 0) ? (b) : (((b) < 0 || (a) < (b)) ? (a) : (b)))
+
+	/**
+	 * Intrusive doubly linked list of async handles, used by #KSI_AsyncClient for tracking the cached requests.
+	 */
+	typedef struct KSI_AsyncHandleChain_st {
+		KSI_AsyncHandle *first;
+		KSI_AsyncHandle *last;
+		size_t count;
+	} KSI_AsyncHandleChain;
+
+	/**
+	 * FIFO queue implemented as a ring buffer, which grows when full.
+	 */
+	typedef struct KSI_AsyncQueue_st {
+		void **buf;
+		size_t cap;
+		size_t head;
+		size_t len;
+		/** Cleanup method of the queued objects. */
+		void (*obj_free)(void *);
+	} KSI_AsyncQueue;
+
+	/**
+	 * Token bucket pacing the requests sent out by the transport layer. The tokens are refilled continuously at the
+	 * rate of #KSI_ASYNC_OPT_MAX_REQUEST_COUNT requests per #KSI_ASYNC_PRIVOPT_ROUND_DURATION, or at the rate
+	 * received with the server configuration in case of #KSI_ASYNC_OPT_AUTO_PACING.
+	 */
+	typedef struct KSI_AsyncPacer_st {
+		/** Options of the owner async client. */
+		const size_t *options;
+		/** Request count and period in milliseconds received with the server configuration, 0 if not present. */
+		size_t confCount;
+		size_t confPeriodMs;
+		/** Rate the bucket level is measured with, period 0 if the bucket has not been filled yet. */
+		KSI_uint64_t count;
+		KSI_uint64_t periodMs;
+		/** Bucket level in units of 1/periodMs tokens. */
+		KSI_uint64_t level;
+		/** Monotonic time in milliseconds the bucket has been refilled up to. */
+		KSI_uint64_t refillAt;
+		/** The rate is reduced by the factor of 2^backOff after the server has reported too many requests. */
+		unsigned backOff;
+		KSI_uint64_t backOffAt;
+	} KSI_AsyncPacer;
+
 	/**
 	 * Async request wrapper object.
 	 */
@@ -59,6 +108,9 @@ extern "C" {
 		void *userCtx;
 		void (*userCtx_free)(void*);
 
+		/** Request completion callback. */
+		KSI_AsyncServiceCallback_response respCallback;
+
 		/** Handle state. */
 		int state;
 
@@ -76,6 +128,20 @@ extern "C" {
 		time_t sndTime;
 		/** Time when the response has been received. */
 		time_t rcvTime;
+
+		/** Async client whose request cache holds the handle, NULL if the handle is not cached. */
+		KSI_AsyncClient *owner;
+		/** Request cache list of the owner the handle is linked into. */
+		KSI_AsyncHandleChain *chain;
+		KSI_AsyncHandle *chainPrev;
+		KSI_AsyncHandle *chainNext;
+
+		/** Requests aggregated locally into the request of this handle, see #KSI_ASYNC_OPT_BATCH_SIZE. */
+		KSI_AsyncHandleChain batchMembers;
+		/** Aggregation chain from the request hash to the root of the local aggregation tree. */
+		KSI_AggregationHashChain *batchChain;
+		/** Signature of the local aggregation tree root. */
+		KSI_Signature *batchSig;
 	};
 
 	/**
@@ -124,6 +190,8 @@ extern "C" {
 		int (*getResponse)(void *, KSI_OctetString **, size_t *);
 		int (*getCredentials)(void *, const char **, const char **);
 		int (*dispatch)(void *);
+		/** Optional. Returns the transport sockets and timeout, see #KSI_AsyncService_getPollFds. */
+		int (*getPollFds)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *);
 
 		/** PDU header field values: */
 		/** Client instanse id. Is set to current unix time when the #KSI_AsyncClient is constructed. */
@@ -138,18 +206,33 @@ extern "C" {
 
 		/** Request cache. */
 		KSI_AsyncHandle **reqCache;
-		/** Request cache position of the last handle that was returned to the used. */
-		size_t tail;
+		/** Ring buffer of unused request cache positions, in the order of release. */
+		size_t *freeSlots;
+		size_t freeHead;
+		size_t freeCount;
+		/** Cached requests waiting to be dispatched, in the order of adding. */
+		KSI_AsyncHandleChain dispatchList;
+		/** Cached requests waiting for a response, in the order of sending. */
+		KSI_AsyncHandleChain sentList;
+		/** Finalized cached requests, in the order they are returned to the user. */
+		KSI_AsyncHandleChain readyList;
 		/** Nof pending requests (including in error state). */
 		size_t pending;
 		/** Nof received valid responses. */
 		size_t received;
+		/** Signing requests collected into the next local aggregation tree, in the order of adding. */
+		KSI_AsyncHandleChain batchList;
+		/** Time in milliseconds when the first request was added to the batch list. */
+		KSI_uint64_t batchOpenedAt;
 
 		/** Push config is not part of the request cache, as it can not be assigned to a particular request handle. */
 		KSI_AsyncHandle *serverConf;
 
 		/** Array of configuration options. */
 		size_t options[__NOF_KSI_ASYNC_OPT];
+
+		/** Request pacing shared with the transport layer. */
+		KSI_AsyncPacer pacer;
 	};
 
 	/**
@@ -170,6 +253,7 @@ extern "C" {
 		int (*run)(void *, int (*)(void *), KSI_AsyncHandle **, size_t *);
 		int (*getPendingCount)(void *, size_t *);
 		int (*getReceivedCount)(void *, size_t *);
+		int (*getPollFds)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *);
 
 		int (*setOption)(void *, const int, void *);
 		int (*getOption)(void *, const int, void *);
@@ -214,6 +298,8 @@ extern "C" {
 
 		/** Intercepted #KSI_ASYNC_OPT_PUSH_CONF_CALLBACK configuration. */
 		KSI_Config_Callback confCallback;
+		/** Intercepted #KSI_ASYNC_OPT_RESPONSE_CALLBACK configuration. */
+		KSI_AsyncServiceCallback_response respCallback;
 		/** Intercepted #KSI_ASYNC_OPT_CONF_CONSOLIDATE_CALLBACK option for overring default handling. */
 		KSI_AsyncServiceCallback_configConsolidate confConsolidateCallback;
 		/** Consolidated configuration based on the responses from individual subservices. */
@@ -223,6 +309,42 @@ extern "C" {
 		int (*subservice_new)(KSI_CTX *, KSI_AsyncService **);
 	};
 
+	/**
+	 * Moves a cached request into the ready list of its async client. Must be called by the transport layer
+	 * after it has set a dispatched request into a final state, as those are not detected in the order of sending.
+	 * \param[in]	h			Async handle.
+	 */
+	void KSI_AsyncHandle_notifyFinalized(KSI_AsyncHandle *h);
+
+	int KSI_AsyncQueue_new(void (*obj_free)(void *), KSI_AsyncQueue **q);
+	void KSI_AsyncQueue_free(KSI_AsyncQueue *q);
+	/** Appends the object to the end of the queue, the queue takes the ownership. */
+	int KSI_AsyncQueue_push(KSI_AsyncQueue *q, void *o);
+	/** Removes the first object from the queue and returns it, the ownership is passed to the caller. */
+	void *KSI_AsyncQueue_pop(KSI_AsyncQueue *q);
+	/** Returns the object at the given position from the beginning of the queue, the queue keeps the ownership. */
+	void *KSI_AsyncQueue_elementAt(const KSI_AsyncQueue *q, size_t pos);
+	size_t KSI_AsyncQueue_length(const KSI_AsyncQueue *q);
+
+	/** Returns the number of requests that can be sent out at once. */
+	size_t KSI_AsyncPacer_available(KSI_AsyncPacer *p);
+	/** Takes the tokens of the sent out requests from the bucket. */
+	void KSI_AsyncPacer_consume(KSI_AsyncPacer *p, size_t count);
+	/** Returns the time in milliseconds until the next request can be sent out, 0 if it can be sent at once. */
+	long KSI_AsyncPacer_getDelay(KSI_AsyncPacer *p);
+
+	/**
+	 * Makes the async extending client answer the extending requests from the calendar mirror. The
+	 * requests the mirror can not answer, e.g. which are outside of the mirrored time range, and the
+	 * configuration requests are passed on to the transport the client has been set up with.
+	 * \param[in]	client		Async client with the transport set up.
+	 * \param[in]	mirror		Verified calendar mirror, \c NULL to restore the original transport.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On success the client takes ownership of \c mirror.
+	 * \see #KSI_AsyncService_setCalendarMirror
+	 */
+	int KSI_CalendarMirrorAsyncClient_attach(KSI_AsyncClient *client, KSI_CalendarMirror *mirror);
+
 #ifdef __cplusplus
 }
 #endif
@@ -110,6 +110,27 @@ extern "C" {
 		/** Function to retrieve the status of the last perform call. Will return #KSI_REQUEST_PENDING if
 		 * the request has not been performed. */
 		int (*status)(KSI_RequestHandle *);
+
+		/** Function to perform the request without blocking for longer than the given timeout in milliseconds,
+		 * #completed is set when the response has been received. \c NULL if the transport only supports #readResponse. */
+		int (*poll)(KSI_RequestHandle *, int);
+
+		/** Entity tag of the cached resource for a conditional request (can be \c NULL). */
+		char *ifNoneMatch;
+		/** Modification time of the cached resource for a conditional request (0 if not set). */
+		time_t ifModifiedSince;
+
+		/** Entity tag of the received resource (can be \c NULL). */
+		char *etag;
+		/** Modification time of the received resource (0 if unknown). */
+		time_t lastModified;
+		/** Flag indicating that the conditional request was not fulfilled as the resource has not been modified. */
+		bool notModified;
+
+		/** Offset of the first requested byte for receiving only the end of the resource (0 for the whole resource). */
+		size_t rangeStart;
+		/** Flag indicating that the response contains only the bytes starting from #rangeStart. */
+		bool partial;
 	};
 
 
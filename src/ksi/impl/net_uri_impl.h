@@ -42,6 +42,9 @@ extern "C" {
 		KSI_NetworkClient *pExtendClient;
 		KSI_NetworkClient *pAggregationClient;
 		KSI_NetworkClient *pPublicationClient;
+
+		/** Local extender answering from the calendar mirror (can be NULL). */
+		KSI_NetworkClient *mirrorClient;
 	};
 
 #ifdef __cplusplus
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef PKITRUSTSTORE_IMPL_H_
+#define PKITRUSTSTORE_IMPL_H_
+
+#include "../pkitruststore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/** Number of verification results kept in the cache. */
+	#define KSI_PKI_VERIFICATION_CACHE_SIZE 64
+
+	typedef enum {
+		/** Result of a signature verification, keyed by the signature and the signed data. */
+		KSI_PKI_CACHE_SIGNATURE = 0,
+		/** Result of a certificate chain and constraints verification, keyed by the certificate and constraints. */
+		KSI_PKI_CACHE_CERTIFICATE
+	} KSI_PKIVerificationCacheType;
+
+	typedef struct KSI_PKIVerificationCacheEntry_st {
+		KSI_PKIVerificationCacheType type;
+		/** Time bucket the result is valid in (only for #KSI_PKI_CACHE_CERTIFICATE). */
+		time_t bucket;
+		unsigned char key[KSI_MAX_IMPRINT_LEN];
+		size_t key_len;
+	} KSI_PKIVerificationCacheEntry;
+
+	struct KSI_PKIVerificationCache_st {
+		KSI_CTX *ctx;
+		/** Ring buffer of successful verification results. */
+		KSI_PKIVerificationCacheEntry entries[KSI_PKI_VERIFICATION_CACHE_SIZE];
+		/** Number of used entries. */
+		size_t count;
+		/** Position of the next entry to be overwritten. */
+		size_t next;
+		/** Hit and miss counters. */
+		KSI_PKIVerificationCacheStats stats;
+	};
+
+	int KSI_PKIVerificationCache_new(KSI_CTX *ctx, KSI_PKIVerificationCache **cache);
+	void KSI_PKIVerificationCache_free(KSI_PKIVerificationCache *cache);
+	void KSI_PKIVerificationCache_clear(KSI_PKIVerificationCache *cache);
+
+	/**
+	 * Calculates the cache key of a signature verification result.
+	 */
+	int KSI_PKIVerificationCache_signatureKey(KSI_CTX *ctx, const char *algoOid, const unsigned char *signature, size_t signature_len,
+			const unsigned char *data, size_t data_len, const KSI_PKICertificate *cert, KSI_DataHash **key);
+
+	/**
+	 * Calculates the cache key of a certificate verification result.
+	 */
+	int KSI_PKIVerificationCache_certificateKey(KSI_CTX *ctx, const KSI_PKICertificate *cert, const KSI_CertConstraint *certConstraints, KSI_DataHash **key);
+
+	/**
+	 * Looks up a successful verification result. If the cache is disabled, \c found is always set to \c 0.
+	 */
+	int KSI_PKIVerificationCache_find(KSI_PKIVerificationCache *cache, KSI_PKIVerificationCacheType type, const KSI_DataHash *key, int *found);
+
+	/**
+	 * Stores a successful verification result.
+	 */
+	int KSI_PKIVerificationCache_add(KSI_PKIVerificationCache *cache, KSI_PKIVerificationCacheType type, const KSI_DataHash *key);
+
+	/**
+	 * Creates a new truststore object referencing the same underlying certificate store as \c trust.
+	 * The new object is bound to \c ctx, which may be \c NULL for a truststore that is not
+	 * used for error reporting (e.g. the one kept by #KSI_TrustState). Modifying either of
+	 * the objects modifies both.
+	 */
+	int KSI_PKITruststore_share(KSI_CTX *ctx, const KSI_PKITruststore *trust, KSI_PKITruststore **out);
+
+	/**
+	 * Adds the encoded certificates and CRLs currently loaded into the truststore to the hasher.
+	 * \note Certificates in lookup directories are loaded on demand and are included only after
+	 * they have been loaded.
+	 */
+	int KSI_PKITruststore_fingerprint(const KSI_PKITruststore *trust, KSI_DataHasher *hsr);
+
+	/**
+	 * Calculates the key identifying the verification configuration: the contents of the truststore
+	 * and the certificate constraints.
+	 */
+	int KSI_PKIVerificationCache_configurationKey(KSI_CTX *ctx, const KSI_PKITruststore *trust, const KSI_CertConstraint *certConstraints, KSI_DataHash **key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PKITRUSTSTORE_IMPL_H_ */
@@ -24,6 +24,42 @@
 extern "C" {
 #endif
 
+	/** Entry of the publication time index. */
+	typedef struct KSI_PublicationsFileTimeIndexEntry_st {
+		/** Publication time. */
+		KSI_uint64_t time;
+		/** Position of the record in the file. */
+		size_t pos;
+		/** Publication record (not owned by the index), \c NULL in lazy mode. */
+		KSI_PublicationRecord *pubRec;
+	} KSI_PublicationsFileTimeIndexEntry;
+
+	/** Bucket of the certificate ID hash map. */
+	typedef struct KSI_PublicationsFileCertIndexEntry_st {
+		/** Certificate ID (not owned by the index), \c NULL for an empty bucket. */
+		const unsigned char *id;
+		size_t id_len;
+		/** Position of the record in the file. */
+		size_t pos;
+		/** Certificate (not owned by the index), \c NULL in lazy mode. */
+		KSI_PKICertificate *cert;
+	} KSI_PublicationsFileCertIndexEntry;
+
+	/** Location of a publication record in the raw file, for lazy loading. */
+	typedef struct KSI_PublicationsFileLazyPubRec_st {
+		size_t offset;
+		size_t len;
+		/** Location of the published imprint, compared without parsing the record. */
+		size_t imprintOffset;
+		size_t imprint_len;
+	} KSI_PublicationsFileLazyPubRec;
+
+	/** Location of a certificate record in the raw file, for lazy loading. */
+	typedef struct KSI_PublicationsFileLazyCertRec_st {
+		size_t offset;
+		size_t len;
+	} KSI_PublicationsFileLazyCertRec;
+
 	struct KSI_PublicationsFile_st {
 		KSI_CTX *ctx;
 		size_t ref;
@@ -35,6 +71,48 @@ extern "C" {
 		size_t signedDataLength;
 		KSI_PKISignature *signature;
 		KSI_CertConstraint *certConstraints;
+
+		/** Publication records sorted by publication time, built when the file is parsed. */
+		KSI_PublicationsFileTimeIndexEntry *timeIndex;
+		/** Number of entries in #timeIndex, matches the length of the indexed #publications list. */
+		size_t timeIndex_len;
+		/** Revision of the #publications list indexed by #timeIndex, 0 if not indexed. The index
+		 * refers to the records of the list, so it is used only while the list is unchanged. */
+		size_t timeIndexRevision;
+
+		/** Open addressing hash map of certificates by ID, built when the file is parsed. */
+		KSI_PublicationsFileCertIndexEntry *certIndex;
+		/** Number of buckets in #certIndex (a power of two). */
+		size_t certIndex_size;
+		/** Number of certificates in #certIndex, matches the length of the indexed #certificates list. */
+		size_t certIndex_count;
+		/** Revision of the #certificates list indexed by #certIndex, 0 if not indexed. */
+		size_t certIndexRevision;
+
+		/** Flag indicating that #raw is a memory mapping of the file and not an allocated buffer. */
+		bool isMapped;
+		/** Flag indicating that the records are materialized on lookup, see #KSI_PublicationsFile_fromFileLazy. */
+		bool isLazy;
+		/** Publication records of a lazily loaded file, in file order. */
+		KSI_PublicationsFileLazyPubRec *lazyPubRecs;
+		size_t lazyPubRecs_len;
+		/** Certificate records of a lazily loaded file, in file order. */
+		KSI_PublicationsFileLazyCertRec *lazyCertRecs;
+		size_t lazyCertRecs_len;
+		/** Materialized records by position in #lazyPubRecs and #lazyCertRecs, allocated on first lookup. */
+		KSI_PublicationRecord **lazyPubCache;
+		KSI_CertificateRecord **lazyCertCache;
+		/**
+		 * Flag indicating that the indexes and the lazy record locations are borrowed from another
+		 * file and never modified, see #KSI_PublicationsFile_fromSharedIndex.
+		 */
+		bool isIndexShared;
+		/** The trust state that has verified the file (only compared, never dereferenced), see #KSI_PublicationsFile_verify. */
+		const void *verifiedBy;
+
+		/** If set, #raw is not owned by the file and this function is called instead of freeing it. */
+		void (*rawRelease)(void *);
+		void *rawReleaseCtx;
 	};
 
 	struct KSI_PublicationData_st {
@@ -54,6 +132,26 @@ extern "C" {
 		KSI_LIST(KSI_Utf8String) *repositoryUriList;
 	};
 
+	/**
+	 * Creates a lazily loaded publications file (see #KSI_PublicationsFile_fromFileLazy) on top of
+	 * an existing immutable buffer, which may be shared by several publications file objects. The
+	 * buffer is not copied and must remain valid until \c release is called with \c releaseCtx,
+	 * which happens when the publications file is freed. The \c release function is not called
+	 * if the function fails.
+	 */
+	int KSI_PublicationsFile_fromSharedRaw(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len,
+			void (*release)(void *), void *releaseCtx, KSI_PublicationsFile **pubFile);
+
+	/**
+	 * Creates a lazily loaded publications file sharing the raw buffer and the lookup indexes of
+	 * \c index, which must have been created by #KSI_PublicationsFile_fromSharedRaw. Only the
+	 * header and the signature are parsed and the indexes are only read, so \c index may be
+	 * shared by any number of publications files. The \c release function is called with
+	 * \c releaseCtx when the publications file is freed, \c index must remain valid until
+	 * then. The \c release function is not called if the function fails.
+	 */
+	int KSI_PublicationsFile_fromSharedIndex(KSI_CTX *ctx, const KSI_PublicationsFile *index,
+			void (*release)(void *), void *releaseCtx, KSI_PublicationsFile **pubFile);
 
 #ifdef __cplusplus
 }
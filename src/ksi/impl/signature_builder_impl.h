@@ -31,6 +31,14 @@ extern "C" {
 		KSI_CTX *ctx;
 		int noVerify;
 		KSI_Signature *sig;
+		/** Serialized nested elements of \c sig shared by the signatures created by
+		 * #KSI_SignatureBuilder_serializeWithAggregationChain, \c NULL if not calculated. */
+		unsigned char *common;
+		size_t common_len;
+		/** The level of the appended chains the common part was calculated for. */
+		KSI_uint64_t commonLevel;
+		/** Type and tag of the signature TLV header. */
+		unsigned char commonHdr[2];
 	};
 
 
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef TRUST_STATE_IMPL_H_
+#define TRUST_STATE_IMPL_H_
+
+#include "../trust_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	struct KSI_TrustState_st {
+		/** Reference count, modified only atomically. */
+		volatile size_t ref;
+
+		/** Raw publications file, shared by the publications file objects of the attached contexts. */
+		unsigned char *raw;
+		size_t raw_len;
+		/**
+		 * The verified publications file parsed from #raw. It is complete when the state is created
+		 * and only read afterwards: the publications files of the attached contexts borrow its lookup
+		 * indexes, see #KSI_PublicationsFile_fromSharedIndex. Its context is cleared, as it may
+		 * outlive the context that created the state.
+		 */
+		KSI_PublicationsFile *index;
+
+		/** PKI truststore the publications file was verified with (not bound to any context). */
+		KSI_PKITruststore *truststore;
+		/** Publications file certificate constraints, {NULL, NULL} terminated (can be NULL). */
+		KSI_CertConstraint *certConstraints;
+
+		/** Time the publications file was received. */
+		time_t createdAt;
+
+		/** The newer trust state (owns a reference), set only once by #KSI_TrustState_replace. */
+		void *volatile successor;
+		/** The context refreshing the state (only used as a flag, never dereferenced). */
+		void *volatile refreshing;
+	};
+
+	/**
+	 * Returns the newest trust state in the replacement chain of \c state. The result is valid as
+	 * long as a reference to \c state is held.
+	 */
+	KSI_TrustState *KSI_TrustState_latest(KSI_TrustState *state);
+
+	/**
+	 * Claims the right to refresh the trust state. Returns non-zero only for the first caller,
+	 * until the claim is released with #KSI_TrustState_releaseRefresh.
+	 */
+	int KSI_TrustState_claimRefresh(KSI_TrustState *state, KSI_CTX *ctx);
+
+	/**
+	 * Releases the claim of a failed refresh, so it can be retried.
+	 */
+	void KSI_TrustState_releaseRefresh(KSI_TrustState *state, KSI_CTX *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRUST_STATE_IMPL_H_ */
@@ -31,6 +31,9 @@
 #include "signature.h"
 #include "verification.h"
 #include "policy.h"
+#include "calendar_cache.h"
+#include "calendar_mirror.h"
+#include "trust_state.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -342,6 +345,10 @@ enum KSI_StatusCode {
 
 #define KSI_CTX_HA_MAX_SUBSERVICES 3
 
+#define KSI_CTX_PKI_VERIFICATION_CACHE_DEFAULT_TTL (60 * 60)
+
+#define KSI_CTX_PUBFILE_SNAPSHOT_DEFAULT_TTL (24 * 60 * 60)
+
 /**
  * Service configuration receive callback.
  * \param[in]	ctx		KSI context object.
@@ -414,6 +421,56 @@ typedef enum KSI_Option_en {
 	 */
 	KSI_OPT_HA_SAFEGUARD,
 
+	/**
+	 * PKI verification result cache time bucket. Successful PKI signature verification results are
+	 * cached for the lifetime of the context, successful certificate chain and constraints verification
+	 * results are reused only within the same time bucket of the given length.
+	 * \param		timeout		Bucket length in seconds. Paramer of type size_t.
+	 * \see			#KSI_PKITruststore_getCacheStats
+	 * \see			#KSI_CTX_PKI_VERIFICATION_CACHE_DEFAULT_TTL for default value.
+	 * \note		Setting the timeout to 0 disables the cache.
+	 */
+	KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS,
+
+	/**
+	 * Publications file max stale time. When the cache timeout #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS has expired,
+	 * the cached publications file is still returned by #KSI_receivePublicationsFile while the new file is
+	 * being received, as long as the cached file is not older than the cache timeout plus the max stale time.
+	 * The received file is verified before it replaces the cached one; in case of an error the cached file is
+	 * kept and the refresh is retried with the next call.
+	 * \param		timeout		Max stale time in seconds. Paramer of type size_t.
+	 * \see			#KSI_receivePublicationsFile
+	 * \note		Setting the timeout to 0 (default) makes #KSI_receivePublicationsFile block until the new file
+	 * 				has been received.
+	 * \note		The request is performed without blocking only with transports supporting it (cURL), others
+	 * 				receive the file in a single blocking call.
+	 */
+	KSI_OPT_PUBFILE_MAX_STALE_SECONDS,
+
+	/**
+	 * Incremental publications file download. New publication records are only appended to the publications
+	 * file, so when refreshing the file, only the bytes following the signed part of the cached file are
+	 * requested (HTTP range request). The received bytes are appended to the signed part of the cached file
+	 * and the result is verified before it replaces the cached file. If the server does not support range
+	 * requests, the full file is received as usual; if the result can not be parsed or verified (e.g. the
+	 * beginning of the file has changed), the full file is requested again.
+	 * \param		enabled		Non-zero to enable. Paramer of type size_t.
+	 * \see			#KSI_receivePublicationsFile
+	 * \note		Disabled by default, as the verification requires the PKI truststore to be configured.
+	 */
+	KSI_OPT_PUBFILE_INCREMENTAL_DOWNLOAD,
+
+	/**
+	 * Publications file snapshot expiry time. A verification result recorded in the snapshot (see
+	 * #KSI_CTX_setPublicationsFileSnapshot) is accepted only within the given time after the verification,
+	 * as the result depends on the validity period of the certificates. The record index of the snapshot is
+	 * bound only to the file bytes and does not expire.
+	 * \param		timeout		Expiry time in seconds. Paramer of type size_t.
+	 * \see			#KSI_CTX_PUBFILE_SNAPSHOT_DEFAULT_TTL for default value.
+	 * \note		Setting the timeout to 0 disables the snapshot.
+	 */
+	KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS,
+
 	__KSI_NUMBER_OF_OPTIONS,
 } KSI_Option;
 
@@ -578,6 +635,10 @@ int KSI_sendPublicationRequest(KSI_CTX *ctx, const unsigned char *request, size_
  * \note The publications file is not verified, use #KSI_PublicationsFile_verify to do so.
  * \note The downloaded publications file is cached. Sequential calls to this method will return the cached file, except
  * the cache timeout #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS has expired in which case a new download is triggered.
+ * \note A new download is conditional: if the publications file has not been modified since the cached one was
+ * received (according to the HTTP entity tag or last modification time, or the modification time of a local file),
+ * the cached file is kept.
+ * \note If #KSI_OPT_PUBFILE_MAX_STALE_SECONDS is set, the expired file is returned while the download is in progress.
  *
  * \see #KSI_CTX_setPublicationUrl for setting publications file URL.
  * \see #KSI_PublicationsFile_verify for publication file verification.
@@ -772,6 +833,64 @@ int KSI_CTX_setPublicationsFile(KSI_CTX *ctx, KSI_PublicationsFile *var);
  */
 int KSI_CTX_setPKITruststore(KSI_CTX *ctx, KSI_PKITruststore *pki);
 
+/**
+ * Setter for the calendar hash chain cache. When set, the cache is consulted before sending an
+ * extending request to the extender and the received calendar hash chains are added to the cache.
+ * \param[in]	ctx		KSI context.
+ * \param[in]	cache	Calendar cache, \c NULL to disable caching.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The context takes ownership of the cache object.
+ * \note The cached chains are trusted the same way as the responses of the extender. A cache
+ * backed by a file is only as trustworthy as the file, see #KSI_CalendarCache_new.
+ * \see #KSI_CalendarCache_new
+ */
+int KSI_CTX_setCalendarCache(KSI_CTX *ctx, KSI_CalendarCache *cache);
+
+/**
+ * Setter for the calendar mirror. When set, the extending requests are answered locally from
+ * the mirror instead of being sent to the extender, signing and publications file requests
+ * are not affected.
+ * \param[in]	ctx		KSI context.
+ * \param[in]	mirror	Verified calendar mirror, \c NULL to use the extender again.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note On success the context takes ownership of the mirror object.
+ * \note The mirror can not be set after the network provider has been replaced with #KSI_CTX_setNetworkProvider.
+ * \see #KSI_CalendarMirror_new, #KSI_CalendarMirror_verify
+ */
+int KSI_CTX_setCalendarMirror(KSI_CTX *ctx, KSI_CalendarMirror *mirror);
+
+/**
+ * Sets the path of the publications file verification snapshot. After a successful PKI verification
+ * of a publications file, #KSI_PublicationsFile_verify records the digest of the file bytes and the
+ * digest of the verification configuration (the certificates in the PKI truststore and the certificate
+ * constraints) in the snapshot file, together with an index of the publication times, the published
+ * imprints and the certificate IDs of the file. A later verification of the same file with the same
+ * configuration, also by another process, is accepted from the snapshot without repeating the PKI
+ * verification, and #KSI_PublicationsFile_fromFileLazy takes the record index from the snapshot instead
+ * of walking the file. Any mismatch falls back to the full verification, which rewrites the snapshot.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	fileName	Path to the snapshot file, \c NULL to disable the snapshot.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The verification result expires after #KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS, as it depends on
+ * the validity period of the certificates. Setting the option to 0 disables the snapshot.
+ * \note The snapshot must be stored where only trusted users can modify it.
+ */
+int KSI_CTX_setPublicationsFileSnapshot(KSI_CTX *ctx, const char *fileName);
+
+/**
+ * Attaches the context to a shared trust state. The publications file, the PKI truststore and the
+ * publications file certificate constraints of the context are replaced with the ones of the trust
+ * state, and #KSI_receivePublicationsFile follows the replacements of the trust state instead of
+ * receiving the publications file on its own.
+ * \param[in]	ctx		KSI context.
+ * \param[in]	state	Trust state, \c NULL to detach the context.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The ownership of \c state is not taken. Setting the publications file or the PKI truststore of
+ * the context detaches it from the trust state. The shared PKI truststore must not be modified.
+ * \see #KSI_TrustState_new
+ */
+int KSI_CTX_setTrustState(KSI_CTX *ctx, KSI_TrustState *state);
+
 /**
  * Setter for the network provider.
  * \param[in]	ctx		KSI context,.
@@ -816,6 +935,15 @@ int KSI_CTX_setDefaultPubFileCertConstraints(KSI_CTX *ctx, const KSI_CertConstra
  */
 int KSI_CTX_getPKITruststore(KSI_CTX *ctx, KSI_PKITruststore **pki);
 
+/**
+ * Getter function for the calendar hash chain cache.
+ * \param[in]	ctx		KSI context.
+ * \param[out]	cache	Pointer to the receiving pointer to the calendar cache.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The output value belongs to the context and may not be freed by the caller.
+ */
+int KSI_CTX_getCalendarCache(KSI_CTX *ctx, KSI_CalendarCache **cache);
+
 /**
  * Getter function for the publications file.
  * \param[in]	ctx		KSI context.
@@ -22,6 +22,7 @@
 #include "pkitruststore.h"
 
 #include "internal.h"
+#include "impl/list_impl.h"
 
 #define KSI_LIST_SIZE_INCREMENT 10
 
@@ -45,6 +46,9 @@ struct listImpl_st {
 
 	/* The length of the used part of the array. */
 	size_t arr_len;
+
+	/* Revision of the content, see #KSI_List_getRevision. */
+	size_t revision;
 };
 
 struct KSI_List_st {
@@ -56,6 +60,13 @@ struct KSI_RefList_st {
 	int (*refElement)(void *);
 };
 
+/* Source of the list revisions, shared by all the lists so that a revision is never reused. */
+static volatile size_t lastRevision = 0;
+
+static void updateRevision(struct listImpl_st *pImpl) {
+	pImpl->revision = KSI_atomicIncrement(&lastRevision);
+}
+
 static int appendElement(KSI_List *list, void* obj) {
 	int res = KSI_UNKNOWN_ERROR;
 	struct listEl_st *tmp_arr = NULL;
@@ -100,6 +111,7 @@ static int appendElement(KSI_List *list, void* obj) {
 	}
 
 	pImpl->arr[pImpl->arr_len++].ptr = obj;
+	updateRevision(pImpl);
 
 	res = KSI_OK;
 
@@ -210,6 +222,7 @@ static int replaceElementAt(KSI_List *list, size_t pos, void *o) {
 		list->obj_free(pImpl->arr[pos].ptr);
 	}
 	pImpl->arr[pos].ptr = o;
+	updateRevision(pImpl);
 
 	res = KSI_OK;
 
@@ -323,6 +336,7 @@ static int removeElement(KSI_List *list, size_t pos, void **o) {
 	}
 
 	pImpl->arr_len--;
+	updateRevision(pImpl);
 
 	res = KSI_OK;
 
@@ -382,6 +396,7 @@ int KSI_List_new(void (*obj_free)(void *), KSI_List **list) {
 	impl->arr = NULL;
 	impl->arr_len = 0;
 	impl->arr_size = 0;
+	updateRevision(impl);
 
 	tmp->pImpl = impl;
 	impl = NULL;
@@ -615,6 +630,7 @@ int KSI_List_sort(KSI_List *list, int (*cmp)(const void **a, const void **b)) {
 	if (res != KSI_OK) goto cleanup;
 
 	qsort(pImpl->arr, pImpl->arr_len, sizeof(struct listEl_st), (int(*)(const void *, const void *))sortCmp);
+	updateRevision(pImpl);
 
 	res = KSI_OK;
 
@@ -623,6 +639,10 @@ cleanup:
 	return res;
 }
 
+size_t KSI_List_getRevision(const KSI_List *list) {
+	return list == NULL || list->pImpl == NULL ? 0 : ((const struct listImpl_st *) list->pImpl)->revision;
+}
+
 int KSI_List_foldl(KSI_List *list, void *foldCtx, int (*fn)(void *, void *)) {
 	int res = KSI_UNKNOWN_ERROR;
 	void *el;
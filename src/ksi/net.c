@@ -379,6 +379,15 @@ int KSI_RequestHandle_new(KSI_CTX *ctx, const unsigned char *request, size_t req
 	memset(tmp->err.errm, 0, sizeof(tmp->err.errm));
 	tmp->err.res = KSI_UNKNOWN_ERROR;
 	tmp->status = NULL;
+	tmp->poll = NULL;
+
+	tmp->ifNoneMatch = NULL;
+	tmp->ifModifiedSince = 0;
+	tmp->etag = NULL;
+	tmp->lastModified = 0;
+	tmp->notModified = false;
+	tmp->rangeStart = 0;
+	tmp->partial = false;
 
 	tmp->client = NULL;
 
@@ -416,6 +425,8 @@ void KSI_RequestHandle_free(KSI_RequestHandle *handle) {
 		}
 		KSI_free(handle->request);
 		KSI_free(handle->response);
+		KSI_free(handle->ifNoneMatch);
+		KSI_free(handle->etag);
 		KSI_free(handle);
 	}
 }
@@ -1340,6 +1351,7 @@ int KSI_AbstractAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 	tmp->run = NULL;
 	tmp->getPendingCount = NULL;
 	tmp->getReceivedCount = NULL;
+	tmp->getPollFds = NULL;
 	tmp->setOption = NULL;
 
 	tmp->setEndpoint = NULL;
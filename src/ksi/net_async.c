@@ -20,9 +20,12 @@
 #include "net_async.h"
 
 #include <string.h>
+#include <limits.h>
 
 #include "internal.h"
 #include "signature_builder.h"
+#include "tree_builder.h"
+#include "calendar_mirror.h"
 #include "impl/signature_builder_impl.h"
 #include "net.h"
 #include "net_tcp.h"
@@ -30,6 +33,7 @@
 #include "impl/net_async_impl.h"
 #include "impl/net_uri_impl.h"
 #include "impl/ctx_impl.h"
+#include "impl/net_sock_impl.h"
 
 #define KSI_ASYNC_REQUEST_ID_OFFSET 32
 #define KSI_ASYNC_REQUEST_ID_OFFSET_MAX 0xff
@@ -39,7 +43,18 @@
 #define KSI_ASYNC_DEFAULT_ROUND_MAX_COUNT 1
 #define KSI_ASYNC_DEFAULT_REQUEST_CACHE_SIZE 1
 #define KSI_ASYNC_DEFAULT_TIMEOUT_SEC 10
+#define KSI_ASYNC_DEFAULT_HTTP_HANDLE_POOL_SIZE 16
 #define KSI_ASYNC_ROUND_DURATION_SEC 1
+/* Poll interval for transports that do not expose their sockets. */
+#define KSI_ASYNC_DEFAULT_POLL_INTERVAL_MS 10
+/* Time window in milliseconds the request tokens can be accumulated for sending out at once. */
+#define KSI_ASYNC_PACER_BURST_MS 100
+/* Maximum rate reduction as a power of two after the server has reported too many requests. */
+#define KSI_ASYNC_PACER_BACK_OFF_MAX 6
+/* Upper limit of the request count and the period, keeps the bucket arithmetics within 64 bits. */
+#define KSI_ASYNC_PACER_RATE_MAX 0xffffffffULL
+/* Nof descriptors polled without allocating memory. */
+#define KSI_ASYNC_WAIT_LOCAL_FD_COUNT 16
 
 #define KSI_ASYNC_CACHE_START_POS 1
 
@@ -51,6 +66,8 @@ static void KSI_AsyncHandle_cleanup(KSI_AsyncHandle *o) {
 		if (o->userCtx_free) o->userCtx_free(o->userCtx);
 		KSI_free(o->raw);
 		KSI_Utf8String_free(o->errMsg);
+		KSI_AggregationHashChain_free(o->batchChain);
+		KSI_Signature_free(o->batchSig);
 
 		KSI_nofree(o->signature);
 		KSI_nofree(o->pubRec);
@@ -119,6 +136,8 @@ int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 	tmp->userCtx = NULL;
 	tmp->userCtx_free = NULL;
 
+	tmp->respCallback = NULL;
+
 	tmp->state = KSI_ASYNC_STATE_UNDEFINED;
 
 	tmp->err = KSI_OK;
@@ -127,6 +146,15 @@ int KSI_AbstractAsyncHandle_new(KSI_CTX *ctx, KSI_AsyncHandle **o) {
 
 	tmp->parentId = 0;
 
+	tmp->owner = NULL;
+	tmp->chain = NULL;
+	tmp->chainPrev = NULL;
+	tmp->chainNext = NULL;
+
+	memset(&tmp->batchMembers, 0, sizeof(tmp->batchMembers));
+	tmp->batchChain = NULL;
+	tmp->batchSig = NULL;
+
 	*o = tmp;
 	tmp = NULL;
 
@@ -361,64 +389,131 @@ cleanup:
 	return res;
 }
 
-static int createSignature(const KSI_AsyncHandle *h, KSI_Signature **sig) {
+static int createRespSignature(KSI_CTX *ctx, KSI_AggregationResp *resp, KSI_DataHash *reqHash, KSI_uint64_t reqLevel, KSI_Signature **sig) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_Signature *tmp = NULL;
-	KSI_DataHash *rootHash = NULL;
-	KSI_Integer *rootLevel = NULL;
-	KSI_AggregationResp *resp = NULL;
 	KSI_SignatureBuilder *builder = NULL;
 
-	if (h == NULL || sig == NULL) {
-		res = KSI_INVALID_ARGUMENT;
+	res = KSI_SignatureBuilder_openFromAggregationResp(resp, &builder);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
-	KSI_ERR_clearErrors(h->ctx);
 
-	if (h->aggrReq == NULL || h->respCtx == NULL) {
-		res = KSI_INVALID_STATE;
+	/* Turn off the verification. */
+	builder->noVerify = 1;
+	res = KSI_SignatureBuilder_close(builder, reqLevel, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
-	resp = (KSI_AggregationResp *)h->respCtx;
 
-	res = KSI_SignatureBuilder_openFromAggregationResp(resp, &builder);
+	res = KSI_Signature_verifyWithPolicy(tmp, reqHash, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
 	if (res != KSI_OK) {
-		KSI_pushError(h->ctx, res, NULL);
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_AggregationReq_getRequestLevel(h->aggrReq, &rootLevel);
-	if (res != KSI_OK) {
-		KSI_pushError(h->ctx, res, NULL);
+	*sig = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+cleanup:
+	KSI_SignatureBuilder_free(builder);
+	KSI_Signature_free(tmp);
+	return res;
+}
+
+static int createSignature(const KSI_AsyncHandle *h, KSI_Signature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Signature *tmp = NULL;
+	KSI_DataHash *reqHash = NULL;
+	KSI_Integer *reqLevel = NULL;
+	KSI_DataHash *batchRoot = NULL;
+	KSI_Signature *batchSig = NULL;
+	KSI_SignatureBuilder *builder = NULL;
+
+	if (h == NULL || sig == NULL) {
+		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
+	KSI_ERR_clearErrors(h->ctx);
 
-	/* Turn off the verification. */
-	builder->noVerify = 1;
-	res = KSI_SignatureBuilder_close(builder, KSI_Integer_getUInt64(rootLevel), &tmp);
-	if (res != KSI_OK) {
-		KSI_pushError(h->ctx, res, NULL);
+	if (h->aggrReq == NULL || h->respCtx == NULL) {
+		res = KSI_INVALID_STATE;
 		goto cleanup;
 	}
 
-	res = KSI_AggregationReq_getRequestHash(h->aggrReq, &rootHash);
+	res = KSI_AggregationReq_getRequestHash(h->aggrReq, &reqHash);
 	if (res != KSI_OK) {
 		KSI_pushError(h->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_Signature_verifyWithPolicy(tmp, rootHash, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+	res = KSI_AggregationReq_getRequestLevel(h->aggrReq, &reqLevel);
 	if (res != KSI_OK) {
 		KSI_pushError(h->ctx, res, NULL);
 		goto cleanup;
 	}
 
+	if (h->batchChain == NULL) {
+		res = createRespSignature(h->ctx, (KSI_AggregationResp *)h->respCtx, reqHash, KSI_Integer_getUInt64(reqLevel), &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(h->ctx, res, NULL);
+			goto cleanup;
+		}
+	} else {
+		/* The request has been aggregated locally, extend the signature of the local tree root. */
+		if ((batchSig = KSI_Signature_ref(h->batchSig)) == NULL) {
+			int rootLevel = 0;
+
+			res = KSI_AggregationHashChain_aggregate(h->batchChain, 0, &rootLevel, &batchRoot);
+			if (res != KSI_OK) {
+				KSI_pushError(h->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			res = createRespSignature(h->ctx, (KSI_AggregationResp *)h->respCtx, batchRoot, (KSI_uint64_t)rootLevel, &batchSig);
+			if (res != KSI_OK) {
+				KSI_pushError(h->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		res = KSI_SignatureBuilder_openFromSignature(batchSig, &builder);
+		if (res != KSI_OK) {
+			KSI_pushError(h->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_SignatureBuilder_appendAggregationChain(builder, h->batchChain);
+		if (res != KSI_OK) {
+			KSI_pushError(h->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		builder->noVerify = 1;
+		res = KSI_SignatureBuilder_close(builder, KSI_Integer_getUInt64(reqLevel), &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(h->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_Signature_verifyWithPolicy(tmp, reqHash, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+		if (res != KSI_OK) {
+			KSI_pushError(h->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
 	*sig = tmp;
 	tmp = NULL;
 
 	res = KSI_OK;
 cleanup:
 	KSI_SignatureBuilder_free(builder);
+	KSI_Signature_free(batchSig);
+	KSI_DataHash_free(batchRoot);
 	KSI_Signature_free(tmp);
 	return res;
 }
@@ -575,26 +670,367 @@ cleanup:
 	return res;
 }
 
+int KSI_AsyncHandle_setResponseCallback(KSI_AsyncHandle *o, KSI_AsyncServiceCallback_response callback) {
+	int res = KSI_UNKNOWN_ERROR;
 
-static int asyncClient_calculateRequestId(KSI_AsyncClient *c, KSI_uint64_t *id, KSI_uint64_t *offset) {
+	if (o == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	o->respCallback = callback;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
+
+static void asyncHandleChain_unlink(KSI_AsyncHandle *h) {
+	KSI_AsyncHandleChain *chain = NULL;
+
+	if (h == NULL || (chain = h->chain) == NULL) return;
+
+	if (h->chainPrev != NULL) h->chainPrev->chainNext = h->chainNext;
+	else chain->first = h->chainNext;
+	if (h->chainNext != NULL) h->chainNext->chainPrev = h->chainPrev;
+	else chain->last = h->chainPrev;
+	chain->count--;
+
+	h->chain = NULL;
+	h->chainPrev = NULL;
+	h->chainNext = NULL;
+}
+
+static void asyncHandleChain_append(KSI_AsyncHandleChain *chain, KSI_AsyncHandle *h) {
+	if (chain == NULL || h == NULL) return;
+
+	/* A handle can be linked into a single list at a time. */
+	asyncHandleChain_unlink(h);
+
+	h->chain = chain;
+	h->chainPrev = chain->last;
+	h->chainNext = NULL;
+	if (chain->last != NULL) chain->last->chainNext = h;
+	else chain->first = h;
+	chain->last = h;
+	chain->count++;
+}
+
+void KSI_AsyncHandle_notifyFinalized(KSI_AsyncHandle *h) {
+	if (h == NULL || h->owner == NULL) return;
+	asyncHandleChain_append(&h->owner->readyList, h);
+}
+
+int KSI_AsyncQueue_new(void (*obj_free)(void *), KSI_AsyncQueue **q) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncQueue *tmp = NULL;
 
-	if (c == NULL || c->reqCache == NULL || id == NULL || offset == NULL) {
+	if (q == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	do {
-		/* Check if the cache is full. */
-		if ((c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]) == (c->pending + c->received + 1)) {
-			res = KSI_ASYNC_REQUEST_CACHE_FULL;
+	tmp = KSI_new(KSI_AsyncQueue);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	tmp->buf = NULL;
+	tmp->cap = 0;
+	tmp->head = 0;
+	tmp->len = 0;
+	tmp->obj_free = obj_free;
+
+	*q = tmp;
+	tmp = NULL;
+	res = KSI_OK;
+cleanup:
+	KSI_AsyncQueue_free(tmp);
+	return res;
+}
+
+void KSI_AsyncQueue_free(KSI_AsyncQueue *q) {
+	if (q != NULL) {
+		void *o = NULL;
+
+		while ((o = KSI_AsyncQueue_pop(q)) != NULL) {
+			if (q->obj_free != NULL) q->obj_free(o);
+		}
+		KSI_free(q->buf);
+		KSI_free(q);
+	}
+}
+
+int KSI_AsyncQueue_push(KSI_AsyncQueue *q, void *o) {
+	int res = KSI_UNKNOWN_ERROR;
+	void **tmp = NULL;
+
+	if (q == NULL || o == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (q->len == q->cap) {
+		size_t cap = (q->cap == 0) ? 16 : q->cap * 2;
+		size_t i;
+
+		if (cap < q->cap) {
+			res = KSI_BUFFER_OVERFLOW;
 			goto cleanup;
 		}
-		if (++c->requestCount == c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]) {
-			c->requestCountOffset =  (c->requestCountOffset + 1) % KSI_ASYNC_REQUEST_ID_OFFSET_MAX;
-			c->requestCount = KSI_ASYNC_CACHE_START_POS;
+
+		tmp = KSI_calloc(cap, sizeof(void *));
+		if (tmp == NULL) {
+			res = KSI_OUT_OF_MEMORY;
+			goto cleanup;
 		}
-	} while (c->reqCache[c->requestCount] != NULL);
+		/* Unwrap the ring into the beginning of the new buffer. */
+		for (i = 0; i < q->len; i++) tmp[i] = q->buf[(q->head + i) % q->cap];
+
+		KSI_free(q->buf);
+		q->buf = tmp;
+		q->cap = cap;
+		q->head = 0;
+		tmp = NULL;
+	}
+
+	q->buf[(q->head + q->len) % q->cap] = o;
+	q->len++;
+
+	res = KSI_OK;
+cleanup:
+	KSI_free(tmp);
+	return res;
+}
+
+void *KSI_AsyncQueue_pop(KSI_AsyncQueue *q) {
+	void *o = NULL;
+
+	if (q == NULL || q->len == 0) return NULL;
+
+	o = q->buf[q->head];
+	q->buf[q->head] = NULL;
+	q->head = (q->head + 1) % q->cap;
+	q->len--;
+
+	return o;
+}
+
+void *KSI_AsyncQueue_elementAt(const KSI_AsyncQueue *q, size_t pos) {
+	if (q == NULL || pos >= q->len) return NULL;
+	return q->buf[(q->head + pos) % q->cap];
+}
+
+size_t KSI_AsyncQueue_length(const KSI_AsyncQueue *q) {
+	return (q != NULL) ? q->len : 0;
+}
+
+static void asyncPacer_init(KSI_AsyncPacer *p, const size_t *options) {
+	memset(p, 0, sizeof(KSI_AsyncPacer));
+	p->options = options;
+}
+
+static void asyncPacer_getRate(const KSI_AsyncPacer *p, KSI_uint64_t *count, KSI_uint64_t *periodMs) {
+	KSI_uint64_t cnt = p->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT];
+	KSI_uint64_t period = p->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION];
+
+	period = (period < KSI_ASYNC_PACER_RATE_MAX / 1000) ? period * 1000 : KSI_ASYNC_PACER_RATE_MAX;
+	if (p->options[KSI_ASYNC_OPT_AUTO_PACING] && p->confCount != 0) {
+		cnt = p->confCount;
+		if (p->confPeriodMs != 0) period = p->confPeriodMs;
+	}
+
+	*count = (cnt < KSI_ASYNC_PACER_RATE_MAX) ? cnt : KSI_ASYNC_PACER_RATE_MAX;
+	*periodMs = (period == 0) ? 1 : ((period < KSI_ASYNC_PACER_RATE_MAX) ? period : KSI_ASYNC_PACER_RATE_MAX);
+}
+
+static KSI_uint64_t asyncPacer_getCapacity(const KSI_AsyncPacer *p) {
+	/* Allow a burst of requests worth of the burst window, but at least one request and at most a full round. */
+	KSI_uint64_t tokens = p->count * KSI_ASYNC_PACER_BURST_MS / p->periodMs;
+
+	if (tokens == 0) tokens = 1;
+	if (tokens > p->count) tokens = p->count;
+	return tokens * p->periodMs;
+}
+
+static KSI_uint64_t asyncPacer_refill(KSI_AsyncPacer *p) {
+	KSI_uint64_t now = KSI_getMonotonicTimeMs();
+	KSI_uint64_t count = 0;
+	KSI_uint64_t periodMs = 0;
+	KSI_uint64_t capacity;
+	KSI_uint64_t elapsed;
+
+	asyncPacer_getRate(p, &count, &periodMs);
+	if (p->periodMs == 0) {
+		/* Start with a full bucket. */
+		p->count = count;
+		p->periodMs = periodMs;
+		p->level = asyncPacer_getCapacity(p);
+		p->refillAt = now;
+		return now;
+	}
+	if (count != p->count || periodMs != p->periodMs) {
+		/* Keep the whole tokens in the bucket when the rate has been reconfigured. */
+		p->level = p->level / p->periodMs * periodMs;
+		p->count = count;
+		p->periodMs = periodMs;
+	}
+	capacity = asyncPacer_getCapacity(p);
+
+	/* Restore the rate gradually, a step per every reduced period without the server complaining. */
+	if (p->backOff > 0 && now - p->backOffAt >= (p->periodMs << p->backOff)) {
+		p->backOff--;
+		p->backOffAt = now;
+	}
+
+	/* While backing off, the bucket is refilled slower by the back-off factor. */
+	elapsed = (now - p->refillAt) >> p->backOff;
+	p->refillAt += elapsed << p->backOff;
+
+	if (p->level >= capacity || elapsed >= p->periodMs || p->count * elapsed >= capacity - p->level) {
+		p->level = capacity;
+	} else {
+		p->level += p->count * elapsed;
+	}
+
+	return now;
+}
+
+static void asyncPacer_setServerRate(KSI_AsyncPacer *p, const KSI_Config *config) {
+	KSI_Integer *maxRequests = NULL;
+	KSI_Integer *aggrPeriod = NULL;
+
+	KSI_Config_getMaxRequests(config, &maxRequests);
+	KSI_Config_getAggrPeriod(config, &aggrPeriod);
+
+	if (maxRequests != NULL) p->confCount = (size_t)KSI_Integer_getUInt64(maxRequests);
+	if (aggrPeriod != NULL) p->confPeriodMs = (size_t)KSI_Integer_getUInt64(aggrPeriod);
+}
+
+static void asyncPacer_backOff(KSI_AsyncPacer *p) {
+	KSI_uint64_t now = asyncPacer_refill(p);
+
+	/* The requests sent out before the previous back-off are expected to fail as well. */
+	if (p->backOff > 0 && now - p->backOffAt < p->periodMs) return;
+
+	if (p->backOff < KSI_ASYNC_PACER_BACK_OFF_MAX) p->backOff++;
+	p->backOffAt = now;
+	p->level = 0;
+}
+
+size_t KSI_AsyncPacer_available(KSI_AsyncPacer *p) {
+	KSI_uint64_t tokens;
+
+	if (p == NULL || p->options == NULL) return 0;
+
+	asyncPacer_refill(p);
+	tokens = p->level / p->periodMs;
+	return (tokens < (size_t)-1) ? (size_t)tokens : (size_t)-1;
+}
+
+void KSI_AsyncPacer_consume(KSI_AsyncPacer *p, size_t count) {
+	KSI_uint64_t units;
+
+	if (p == NULL || p->periodMs == 0 || count == 0) return;
+
+	units = (count < p->level / p->periodMs) ? count * p->periodMs : p->level;
+	p->level -= units;
+}
+
+long KSI_AsyncPacer_getDelay(KSI_AsyncPacer *p) {
+	KSI_uint64_t now;
+	KSI_uint64_t delay;
+
+	if (p == NULL || p->options == NULL) return 0;
+
+	now = asyncPacer_refill(p);
+	if (p->level >= p->periodMs) return 0;
+
+	if (p->count == 0) {
+		/* Nothing can be sent, recheck the configuration after a round. */
+		delay = p->periodMs;
+	} else {
+		delay = ((p->periodMs - p->level + p->count - 1) / p->count) << p->backOff;
+		delay -= now - p->refillAt;
+	}
+	return (delay < LONG_MAX) ? (long)delay : LONG_MAX;
+}
+
+static int asyncClient_initFreeSlots(KSI_AsyncClient *c, size_t cacheSize) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t *tmp = NULL;
+	size_t oldSize = 0;
+	size_t i;
+
+	if (c == NULL || cacheSize <= KSI_ASYNC_CACHE_START_POS) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = KSI_calloc(cacheSize, sizeof(size_t));
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	/* Keep the order of the already released positions. */
+	if (c->freeSlots != NULL) {
+		oldSize = c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE];
+		for (i = 0; i < c->freeCount; i++) tmp[i] = c->freeSlots[(c->freeHead + i) % oldSize];
+	} else {
+		oldSize = KSI_ASYNC_CACHE_START_POS;
+		c->freeCount = 0;
+	}
+	/* Append the new positions. */
+	for (i = oldSize; i < cacheSize; i++) tmp[c->freeCount++] = i;
+
+	KSI_free(c->freeSlots);
+	c->freeSlots = tmp;
+	c->freeHead = 0;
+	tmp = NULL;
+
+	res = KSI_OK;
+cleanup:
+	KSI_free(tmp);
+	return res;
+}
+
+static void asyncClient_releaseSlot(KSI_AsyncClient *c, KSI_AsyncHandle *h) {
+	size_t slot;
+
+	if (c == NULL || h == NULL || h->owner != c) return;
+
+	asyncHandleChain_unlink(h);
+	h->owner = NULL;
+
+	/* The locally aggregated requests share the id of the request sent out, but do not hold a position. */
+	slot = (size_t)(h->id & KSI_ASYNC_REQUEST_ID_MASK);
+	if (slot >= c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE] || c->reqCache[slot] != h) return;
+	c->reqCache[slot] = NULL;
+	c->freeSlots[(c->freeHead + c->freeCount) % c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]] = slot;
+	c->freeCount++;
+}
+
+static int asyncClient_calculateRequestId(KSI_AsyncClient *c, KSI_uint64_t *id, KSI_uint64_t *offset) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (c == NULL || c->reqCache == NULL || c->freeSlots == NULL || id == NULL || offset == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Check if the cache is full. */
+	if ((c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]) == (c->pending + c->received + 1) || c->freeCount == 0) {
+		res = KSI_ASYNC_REQUEST_CACHE_FULL;
+		goto cleanup;
+	}
+	/* Take the position that has been unused for the longest time. The position is reserved when the request
+	 * is added to the cache. Increase the id offset each time the positions wrap around. */
+	if (c->freeSlots[c->freeHead] <= c->requestCount) {
+		c->requestCountOffset =  (c->requestCountOffset + 1) % KSI_ASYNC_REQUEST_ID_OFFSET_MAX;
+	}
+	c->requestCount = c->freeSlots[c->freeHead];
 
 	*id = c->requestCount;
 	*offset = c->requestCountOffset;
@@ -663,6 +1099,21 @@ cleanup:
 	return res;
 }
 
+static void asyncHandle_reset(KSI_AsyncHandle *handle) {
+	KSI_free(handle->raw);
+	handle->raw = NULL;
+	KSI_Utf8String_free(handle->errMsg);
+	handle->errMsg = NULL;
+	if (handle->respCtx_free) handle->respCtx_free(handle->respCtx);
+	handle->respCtx_free = NULL;
+	handle->respCtx = NULL;
+	KSI_AggregationHashChain_free(handle->batchChain);
+	handle->batchChain = NULL;
+	KSI_Signature_free(handle->batchSig);
+	handle->batchSig = NULL;
+	handle->id = 0;
+}
+
 static int addRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle, void *req,
 			bool hasRequest, bool hasConfig,
 			int (*req_new)(KSI_CTX *ctx, void **req),
@@ -702,15 +1153,14 @@ static int addRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle, void *req,
 		goto cleanup;
 	}
 
+	/* A handle can not be added while its previous request is still in the cache. */
+	if (handle->owner != NULL) {
+		KSI_pushError(c->ctx, res = KSI_INVALID_STATE, "Async handle is already in progress.");
+		goto cleanup;
+	}
+
 	/* Cleanup the handle in case it has been added repeteadly. */
-	KSI_free(handle->raw);
-	handle->raw = NULL;
-	KSI_Utf8String_free(handle->errMsg);
-	handle->errMsg = NULL;
-	if (handle->respCtx_free) handle->respCtx_free(handle->respCtx);
-	handle->respCtx_free = NULL;
-	handle->respCtx = NULL;
-	handle->id = 0;
+	asyncHandle_reset(handle);
 
 	/* Update the request handler. */
 	handle->parentId = c->options[KSI_ASYNC_PRIVOPT_ENDPOINT_ID];
@@ -769,66 +1219,371 @@ static int addRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle, void *req,
 		goto cleanup;
 	}
 
-	/* Set request into local cache. */
-	if (hasRequest) {
-		c->reqCache[id] = handle;
-		c->pending++;
-	}
+	/* Set request into local cache. The position has been taken from the head of the free positions. */
+	if (hasRequest) {
+		c->freeHead = (c->freeHead + 1) % c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE];
+		c->freeCount--;
+		c->reqCache[id] = handle;
+		handle->owner = c;
+		asyncHandleChain_append(&c->dispatchList, handle);
+		c->pending++;
+	}
+
+	/* Cache the config request separatelly, as the response can not be assigned to any request in the common cache. */
+	if (hasConfig) {
+		/* Check if this is a multy-payload request. */
+		if (hasRequest) {
+			KSI_Config *reqConf = NULL;
+			KSI_Config *confRef = NULL;
+
+			/* Create a separate conf request handle. */
+			res = req_new(c->ctx, &tmpReq);
+			if (res != KSI_OK) goto cleanup;
+
+			res = req_getConfig(req, &reqConf);
+			if (res != KSI_OK) goto cleanup;
+
+			res = req_setConfig(tmpReq, (confRef = KSI_Config_ref(reqConf)));
+			if (res != KSI_OK) {
+				KSI_Config_free(confRef);
+				goto cleanup;
+			}
+
+			res = asyncHandle_new(c->ctx, tmpReq, &confHandle);
+			if (res != KSI_OK) goto cleanup;
+			tmpReq = NULL;
+
+			/* Copy the send state from the initial handle. */
+			confHandle->state = handle->state;
+			confHandle->reqTime = handle->reqTime;
+		} else {
+			/* This is a server conf request. */
+			confHandle = handle;
+		}
+
+		KSI_AsyncHandle_free(c->serverConf);
+		c->serverConf = confHandle;
+		confHandle = NULL;
+		c->pending++;
+	}
+
+	res = KSI_OK;
+cleanup:
+	req_free(tmpReq);
+	KSI_AsyncHandle_free(confHandle);
+	KSI_Header_free(hdr);
+	KSI_free(raw);
+	KSI_Integer_free(reqId);
+	pdu_free(pdu);
+
+	return res;
+}
+
+static int asyncClient_sendAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle, bool hasRequest, bool hasConfig) {
+	return addRequest(c, handle, handle->aggrReq, hasRequest, hasConfig,
+			(int (*)(KSI_CTX *ctx, void **req))KSI_AggregationReq_new,
+			(void (*)(void *req))KSI_AggregationReq_free,
+			(int (*)(const void *req, KSI_Integer **requestId))KSI_AggregationReq_getRequestId,
+			(int (*)(void *req, KSI_Integer *requestId))KSI_AggregationReq_setRequestId,
+			(int (*)(const void *req, KSI_Config **config))KSI_AggregationReq_getConfig,
+			(int (*)(void *req, KSI_Config *config))KSI_AggregationReq_setConfig,
+			(void* (*)(void *req))KSI_AggregationReq_ref,
+			(int (*)(void *req, KSI_Header *hdr, const char *key, void **pdu))KSI_AggregationReq_encloseWithHeader,
+			(int (*)(const void *pdu, unsigned char **raw, size_t *len))KSI_AggregationPdu_serialize,
+			(void (*)(void *pdu))KSI_AggregationPdu_free,
+			(int (*)(KSI_CTX *ctx, void *req, KSI_AsyncHandle **handle))KSI_AsyncAggregationHandle_new);
+}
+
+static void asyncClient_failBatch(KSI_AsyncClient *c, KSI_AsyncHandleChain *members, int err, long errExt, KSI_Utf8String *errMsg) {
+	KSI_AsyncHandle *h = NULL;
+
+	/* The requests stay in the cache until they are returned to the user. */
+	while ((h = members->first) != NULL) {
+		KSI_AggregationHashChain_free(h->batchChain);
+		h->batchChain = NULL;
+
+		h->state = KSI_ASYNC_STATE_ERROR;
+		h->err = err;
+		h->errExt = errExt;
+		h->errMsg = KSI_Utf8String_ref(errMsg);
+		asyncHandleChain_append(&c->readyList, h);
+	}
+}
+
+/**
+ * Aggregates the requests of the batch list into a local tree and sends out a single request for the root
+ * of the tree. The collected requests are moved to the root handle, which is not counted as pending. In case
+ * of a failure the collected requests are set into error state.
+ */
+static int asyncClient_closeBatch(KSI_AsyncClient *c) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CompactTreeBuilder *tree = NULL;
+	KSI_DataHash *reqHash = NULL;
+	KSI_DataHash *rootHash = NULL;
+	unsigned rootLevel = 0;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	KSI_AsyncHandle *root = NULL;
+	KSI_AsyncHandle *h = NULL;
+	size_t count;
+	size_t i;
+
+	if (c == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(c->ctx);
+
+	count = c->batchList.count;
+	if (count == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (count == 1) {
+		/* Nothing to aggregate, send the request as it is. */
+		h = c->batchList.first;
+		asyncHandleChain_unlink(h);
+		h->owner = NULL;
+		c->pending--;
+
+		res = asyncClient_sendAggregatorRequest(c, h, true, false);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			h->owner = c;
+			asyncHandleChain_append(&c->batchList, h);
+			c->pending++;
+		}
+		goto cleanup;
+	}
+
+	res = KSI_AggregationReq_getRequestHash(c->batchList.first->aggrReq, &reqHash);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_getHashAlg(reqHash, &algo);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_CompactTreeBuilder_new(c->ctx, algo, &tree);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (h = c->batchList.first; h != NULL; h = h->chainNext) {
+		const unsigned char *imprint = NULL;
+		size_t imprint_len = 0;
+
+		res = KSI_AggregationReq_getRequestHash(h->aggrReq, &reqHash);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_DataHash_getImprint(reqHash, &imprint, &imprint_len);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_CompactTreeBuilder_addImprint(tree, imprint, 0);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_CompactTreeBuilder_close(tree);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (h = c->batchList.first, i = 0; h != NULL; h = h->chainNext, i++) {
+		res = KSI_CompactTreeBuilder_getAggregationChain(tree, i, &h->batchChain);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_CompactTreeBuilder_getRoot(tree, &rootHash, &rootLevel);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_AsyncSigningHandle_new(c->ctx, rootHash, rootLevel, &root);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+	rootHash = NULL;
+
+	/* The collected requests have already reserved a position in the cache, release them for the root. */
+	c->pending -= count;
+	res = asyncClient_sendAggregatorRequest(c, root, true, false);
+	c->pending += count;
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, NULL);
+		goto cleanup;
+	}
+	/* Only the collected requests are counted as pending. */
+	c->pending--;
+
+	KSI_LOG_debug(c->ctx, "Async client aggregated %llu requests locally.", (unsigned long long)count);
+	while ((h = c->batchList.first) != NULL) asyncHandleChain_append(&root->batchMembers, h);
+	/* The root is held by the request cache. */
+	root = NULL;
+
+	res = KSI_OK;
+cleanup:
+	if (c != NULL && c->batchList.count > 0) asyncClient_failBatch(c, &c->batchList, res, 0L, NULL);
+
+	KSI_AsyncHandle_free(root);
+	KSI_DataHash_free(rootHash);
+	KSI_CompactTreeBuilder_free(tree);
+
+	return res;
+}
+
+static bool asyncClient_isBatchDue(const KSI_AsyncClient *c) {
+	return (c->batchList.count > 0 && (c->options[KSI_ASYNC_OPT_BATCH_SIZE] <= 1 ||
+			c->options[KSI_ASYNC_OPT_BATCH_WINDOW] == 0 ||
+			KSI_getMonotonicTimeMs() - c->batchOpenedAt >= c->options[KSI_ASYNC_OPT_BATCH_WINDOW]));
+}
+
+static int asyncClient_addToBatch(KSI_AsyncClient *c, KSI_AsyncHandle *handle, KSI_DataHash *reqHash) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (c == NULL || handle == NULL || reqHash == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(c->ctx);
+
+	if (c->clientImpl == NULL || c->addRequest == NULL || c->getCredentials == NULL) {
+		KSI_pushError(c->ctx, res = KSI_INVALID_STATE, "Async client is not initialized properly.");
+		goto cleanup;
+	}
+
+	if (handle->owner != NULL) {
+		KSI_pushError(c->ctx, res = KSI_INVALID_STATE, "Async handle is already in progress.");
+		goto cleanup;
+	}
+
+	/* The leafs of a tree have to be of the same hash algorithm. */
+	if (c->batchList.count > 0) {
+		KSI_DataHash *firstHash = NULL;
+		KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+		KSI_HashAlgorithm firstAlgo = KSI_HASHALG_INVALID_VALUE;
+
+		res = KSI_AggregationReq_getRequestHash(c->batchList.first->aggrReq, &firstHash);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_DataHash_getHashAlg(firstHash, &firstAlgo);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_DataHash_getHashAlg(reqHash, &algo);
+		if (res != KSI_OK) goto cleanup;
+
+		if (algo != firstAlgo && asyncClient_closeBatch(c) != KSI_OK) {
+			KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+		}
+	}
+
+	/* Every collected request takes a place in the request cache, just as a request sent out separately. */
+	if (c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE] <= (c->pending + c->received + 1)) {
+		res = KSI_ASYNC_REQUEST_CACHE_FULL;
+		goto cleanup;
+	}
+
+	asyncHandle_reset(handle);
+	handle->parentId = c->options[KSI_ASYNC_PRIVOPT_ENDPOINT_ID];
+	handle->state = KSI_ASYNC_STATE_WAITING_FOR_DISPATCH;
+	time(&handle->reqTime);
+
+	if (c->batchList.count == 0) c->batchOpenedAt = KSI_getMonotonicTimeMs();
+	handle->owner = c;
+	asyncHandleChain_append(&c->batchList, handle);
+	c->pending++;
+
+	/* A failure to send the tree is reported via the states of the collected requests. */
+	if (c->batchList.count >= c->options[KSI_ASYNC_OPT_BATCH_SIZE] && asyncClient_closeBatch(c) != KSI_OK) {
+		KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+	}
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
+/**
+ * Completes the requests that have been aggregated into the finalized root requests. The collected requests
+ * take the place of the root in the ready list.
+ */
+static void asyncClient_completeBatches(KSI_AsyncClient *c) {
+	size_t count;
 
-	/* Cache the config request separatelly, as the response can not be assigned to any request in the common cache. */
-	if (hasConfig) {
-		/* Check if this is a multy-payload request. */
-		if (hasRequest) {
-			KSI_Config *reqConf = NULL;
-			KSI_Config *confRef = NULL;
+	if (c == NULL) return;
 
-			/* Create a separate conf request handle. */
-			res = req_new(c->ctx, &tmpReq);
-			if (res != KSI_OK) goto cleanup;
+	count = c->readyList.count;
+	while (count-- > 0 && c->readyList.first != NULL) {
+		KSI_AsyncHandle *root = c->readyList.first;
+		KSI_AsyncHandle *h = NULL;
+		KSI_Signature *sig = NULL;
 
-			res = req_getConfig(req, &reqConf);
-			if (res != KSI_OK) goto cleanup;
+		if (root->batchMembers.count == 0 ||
+				(root->state != KSI_ASYNC_STATE_RESPONSE_RECEIVED && root->state != KSI_ASYNC_STATE_ERROR)) {
+			asyncHandleChain_append(&c->readyList, root);
+			continue;
+		}
 
-			res = req_setConfig(tmpReq, (confRef = KSI_Config_ref(reqConf)));
-			if (res != KSI_OK) {
-				KSI_Config_free(confRef);
-				goto cleanup;
-			}
+		for (h = root->batchMembers.first; h != NULL; h = h->chainNext) {
+			h->id = root->id;
+			h->sndTime = root->sndTime;
+			h->rcvTime = root->rcvTime;
+		}
 
-			res = asyncHandle_new(c->ctx, tmpReq, &confHandle);
-			if (res != KSI_OK) goto cleanup;
-			tmpReq = NULL;
+		if (root->state == KSI_ASYNC_STATE_RESPONSE_RECEIVED) {
+			/* The root is not counted, the collected requests are. */
+			c->received--;
+			c->pending++;
 
-			/* Copy the send state from the initial handle. */
-			confHandle->state = handle->state;
-			confHandle->reqTime = handle->reqTime;
+			/* Create the signature of the root once for all the collected requests. In case of a failure,
+			 * the error is reported when the signatures of the collected requests are requested. */
+			if (createSignature(root, &sig) != KSI_OK) {
+				KSI_LOG_debug(c->ctx, "Unable to create signature for the local aggregation tree.");
+			}
+
+			while ((h = root->batchMembers.first) != NULL) {
+				h->respCtx = KSI_AggregationResp_ref((KSI_AggregationResp *)root->respCtx);
+				h->respCtx_free = root->respCtx_free;
+				h->batchSig = KSI_Signature_ref(sig);
+				h->state = KSI_ASYNC_STATE_RESPONSE_RECEIVED;
+				c->pending--;
+				c->received++;
+				asyncHandleChain_append(&c->readyList, h);
+			}
 		} else {
-			/* This is a server conf request. */
-			confHandle = handle;
+			asyncClient_failBatch(c, &root->batchMembers, root->err, root->errExt, root->errMsg);
 		}
 
-		KSI_AsyncHandle_free(c->serverConf);
-		c->serverConf = confHandle;
-		confHandle = NULL;
-		c->pending++;
+		KSI_Signature_free(sig);
+		asyncClient_releaseSlot(c, root);
+		KSI_AsyncHandle_free(root);
 	}
-
-	res = KSI_OK;
-cleanup:
-	req_free(tmpReq);
-	KSI_AsyncHandle_free(confHandle);
-	KSI_Header_free(hdr);
-	KSI_free(raw);
-	KSI_Integer_free(reqId);
-	pdu_free(pdu);
-
-	return res;
 }
 
 static int asyncClient_addAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle *handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_DataHash *reqHash = NULL;
 	KSI_Config *reqConfig = NULL;
+	KSI_Integer *reqLevel = NULL;
 
 	if (c == NULL || handle == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -841,18 +1596,16 @@ static int asyncClient_addAggregatorRequest(KSI_AsyncClient *c, KSI_AsyncHandle
 	res = KSI_AggregationReq_getConfig(handle->aggrReq, &reqConfig);
 	if (res != KSI_OK) goto cleanup;
 
-	res = addRequest(c, handle, handle->aggrReq, (reqHash != NULL), (reqConfig != NULL),
-			(int (*)(KSI_CTX *ctx, void **req))KSI_AggregationReq_new,
-			(void (*)(void *req))KSI_AggregationReq_free,
-			(int (*)(const void *req, KSI_Integer **requestId))KSI_AggregationReq_getRequestId,
-			(int (*)(void *req, KSI_Integer *requestId))KSI_AggregationReq_setRequestId,
-			(int (*)(const void *req, KSI_Config **config))KSI_AggregationReq_getConfig,
-			(int (*)(void *req, KSI_Config *config))KSI_AggregationReq_setConfig,
-			(void* (*)(void *req))KSI_AggregationReq_ref,
-			(int (*)(void *req, KSI_Header *hdr, const char *key, void **pdu))KSI_AggregationReq_encloseWithHeader,
-			(int (*)(const void *pdu, unsigned char **raw, size_t *len))KSI_AggregationPdu_serialize,
-			(void (*)(void *pdu))KSI_AggregationPdu_free,
-			(int (*)(KSI_CTX *ctx, void *req, KSI_AsyncHandle **handle))KSI_AsyncAggregationHandle_new);
+	res = KSI_AggregationReq_getRequestLevel(handle->aggrReq, &reqLevel);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Only the plain signing requests of the leaf level are aggregated locally. */
+	if (reqHash != NULL && reqConfig == NULL && KSI_Integer_getUInt64(reqLevel) == 0 &&
+			c->options[KSI_ASYNC_OPT_BATCH_SIZE] > 1) {
+		res = asyncClient_addToBatch(c, handle, reqHash);
+	} else {
+		res = asyncClient_sendAggregatorRequest(c, handle, (reqHash != NULL), (reqConfig != NULL));
+	}
 	if (res != KSI_OK) goto cleanup;
 
 	res = KSI_OK;
@@ -896,16 +1649,28 @@ cleanup:
 }
 
 static void asyncClient_setResponseError(KSI_AsyncClient *c, int state, int err, long extErr, KSI_Utf8String *errMsg) {
+	KSI_AsyncHandleChain *lists[2];
 	size_t i;
 
 	if (c == NULL) return;
 
-	for (i = KSI_ASYNC_CACHE_START_POS; i < c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]; i++) {
-		if (c->reqCache[i] != NULL && c->reqCache[i]->state == state) {
-			c->reqCache[i]->state = KSI_ASYNC_STATE_ERROR;
-			c->reqCache[i]->err = err;
-			c->reqCache[i]->errExt = extErr;
-			c->reqCache[i]->errMsg = KSI_Utf8String_ref(errMsg);
+	/* Only the requests that have not been finalized yet are examined. */
+	lists[0] = &c->dispatchList;
+	lists[1] = &c->sentList;
+	for (i = 0; i < sizeof(lists) / sizeof(*lists); i++) {
+		KSI_AsyncHandle *h = lists[i]->first;
+
+		while (h != NULL) {
+			KSI_AsyncHandle *next = h->chainNext;
+
+			if (h->state == state) {
+				h->state = KSI_ASYNC_STATE_ERROR;
+				h->err = err;
+				h->errExt = extErr;
+				h->errMsg = KSI_Utf8String_ref(errMsg);
+				asyncHandleChain_append(&c->readyList, h);
+			}
+			h = next;
 		}
 	}
 
@@ -986,6 +1751,8 @@ static int handleResponse(KSI_AsyncClient *c, void *resp,
 			handle->err = res;
 			handle->errExt = (long)KSI_Integer_getUInt64(status);
 			handle->errMsg = KSI_Utf8String_ref(errorMsg);
+
+			if (res == KSI_SERVICE_AGGR_TOO_MANY_REQUESTS) asyncPacer_backOff(&c->pacer);
 		} else {
 			handle->respCtx = resp_ref(resp);
 			handle->respCtx_free = resp_free;
@@ -994,6 +1761,7 @@ static int handleResponse(KSI_AsyncClient *c, void *resp,
 			c->pending--;
 			c->received++;
 		}
+		asyncHandleChain_append(&c->readyList, handle);
 	}
 
 	res = KSI_OK;
@@ -1087,6 +1855,9 @@ static int asyncClient_handleServerConfig(KSI_AsyncClient *c, KSI_Config *config
 	}
 	KSI_ERR_clearErrors(c->ctx);
 
+	/* Keep the server limits for pacing the requests. */
+	asyncPacer_setServerRate(&c->pacer, config);
+
 	if (c->serverConf != NULL) {
 
 		c->serverConf->state = KSI_ASYNC_STATE_PUSH_CONFIG_RECEIVED;
@@ -1271,6 +2042,8 @@ static int processResponseQueue(KSI_AsyncClient *c,
 		KSI_LOG_error(c->ctx, "Async received error PDU: [%x:%llx] %s",
 				(unsigned)convertStatusCode(status), (unsigned long long)KSI_Integer_getUInt64(status), KSI_Utf8String_cstr(errorMsg));
 
+		if (convertStatusCode(status) == KSI_SERVICE_AGGR_TOO_MANY_REQUESTS) asyncPacer_backOff(&c->pacer);
+
 		/* Set all handles that are still in response wait state into error state. */
 		asyncClient_setResponseError(c, KSI_ASYNC_STATE_WAITING_FOR_RESPONSE,
 				convertStatusCode(status), (long)KSI_Integer_getUInt64(status), errorMsg);
@@ -1345,9 +2118,35 @@ static bool asyncClient_finalizeRequest(KSI_AsyncClient *c, KSI_AsyncHandle *han
 	}
 }
 
+static void asyncClient_updateRequestLists(KSI_AsyncClient *c) {
+	KSI_AsyncHandle *h = NULL;
+	time_t curTime;
+
+	if (c == NULL) return;
+
+	/* The transport layer dispatches the requests in the order of adding. */
+	while ((h = c->dispatchList.first) != NULL && h->state != KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
+		asyncHandleChain_append((h->state == KSI_ASYNC_STATE_WAITING_FOR_RESPONSE ? &c->sentList : &c->readyList), h);
+	}
+
+	/* The receive timeouts elapse in the order of sending. */
+	time(&curTime);
+	while ((h = c->sentList.first) != NULL) {
+		if (h->state == KSI_ASYNC_STATE_WAITING_FOR_RESPONSE) {
+			/* Verify that the handle has not been waiting a response for too long. */
+			if (!(c->options[KSI_ASYNC_OPT_RCV_TIMEOUT] == 0 ||
+					difftime(curTime, h->sndTime) > c->options[KSI_ASYNC_OPT_RCV_TIMEOUT])) break;
+
+			h->state = KSI_ASYNC_STATE_ERROR;
+			h->err = KSI_NETWORK_RECIEVE_TIMEOUT;
+		}
+		asyncHandleChain_append(&c->readyList, h);
+	}
+}
+
 static int asyncClient_findNextResponse(KSI_AsyncClient *c, KSI_AsyncHandle **handle) {
 	int res;
-	size_t last;
+	KSI_AsyncHandle *h = NULL;
 
 	if (c == NULL || handle == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -1375,22 +2174,14 @@ static int asyncClient_findNextResponse(KSI_AsyncClient *c, KSI_AsyncHandle **ha
 		goto cleanup;
 	}
 
-	/* Search cache for finalized requests. */
-	last = c->tail;
-	for (;;) {
-		if (asyncClient_finalizeRequest(c, c->reqCache[c->tail]) == true) {
-			*handle = c->reqCache[c->tail];
-			c->reqCache[c->tail] = NULL;
-			res = KSI_OK;
-			goto cleanup;
-		}
-
-		if (++c->tail == c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]) c->tail = KSI_ASYNC_CACHE_START_POS;
-		if (c->tail == last) {
-			/* We are back at where we began the search. There are no finalized requests to return yet. */
-			break;
-		}
+	/* Return the first finalized request. */
+	if ((h = c->readyList.first) != NULL && asyncClient_finalizeRequest(c, h) == true) {
+		asyncClient_releaseSlot(c, h);
+		*handle = h;
+		res = KSI_OK;
+		goto cleanup;
 	}
+
 	/* Nothing to return. */
 	*handle = NULL;
 	res = KSI_OK;
@@ -1398,6 +2189,73 @@ cleanup:
 	return res;
 }
 
+static KSI_AsyncServiceCallback_response asyncClient_getResponseCallback(KSI_AsyncClient *c, KSI_AsyncHandle *handle) {
+	return (handle->respCallback != NULL ? handle->respCallback :
+			(KSI_AsyncServiceCallback_response)c->options[KSI_ASYNC_OPT_RESPONSE_CALLBACK]);
+}
+
+static int asyncClient_invokeResponseCallback(KSI_AsyncClient *c, KSI_AsyncServiceCallback_response callback, KSI_AsyncHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	/* The ownership of the handle is passed to the callback. */
+	res = callback(c->ctx, (void *)c->options[KSI_ASYNC_OPT_CALLBACK_USERDATA], handle);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, "Async response callback returned error.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
+static int asyncClient_invokeResponseCallbacks(KSI_AsyncClient *c) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncServiceCallback_response callback = NULL;
+	size_t count;
+
+	if (c == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(c->ctx);
+
+	if (c->pending == 0 && c->received == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (c->serverConf != NULL && (callback = asyncClient_getResponseCallback(c, c->serverConf)) != NULL &&
+			asyncClient_finalizeRequest(c, c->serverConf) == true) {
+		KSI_AsyncHandle *tmp = c->serverConf;
+
+		c->serverConf = NULL;
+		res = asyncClient_invokeResponseCallback(c, callback, tmp);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* Go through the ready list once. The handles without a callback are moved to the end of the list, which
+	 * keeps their order, as the callback might add new handles. */
+	count = c->readyList.count;
+	while (count-- > 0 && c->readyList.first != NULL) {
+		KSI_AsyncHandle *h = c->readyList.first;
+
+		if ((callback = asyncClient_getResponseCallback(c, h)) == NULL || asyncClient_finalizeRequest(c, h) == false) {
+			asyncHandleChain_append(&c->readyList, h);
+			continue;
+		}
+
+		/* Remove the handle from the cache before passing the ownership to the callback. */
+		asyncClient_releaseSlot(c, h);
+		res = asyncClient_invokeResponseCallback(c, callback, h);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient *), KSI_AsyncHandle **handle, size_t *waiting) {
 	int res = KSI_UNKNOWN_ERROR;
 	bool connClosed = false;
@@ -1413,6 +2271,11 @@ static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient
 		goto cleanup;
 	}
 
+	/* Send out the locally aggregated requests, the failures are reported via the request states. */
+	if (asyncClient_isBatchDue(c) && asyncClient_closeBatch(c) != KSI_OK) {
+		KSI_LOG_logCtxError(c->ctx, KSI_LOG_ERROR);
+	}
+
 	KSI_ERR_clearErrors(c->ctx);
 	res = c->dispatch(c->clientImpl);
 	if (res == KSI_ASYNC_CONNECTION_CLOSED) {
@@ -1435,6 +2298,9 @@ static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient
 		asyncClient_setResponseError(c, KSI_ASYNC_STATE_WAITING_FOR_RESPONSE, res, 0L, NULL);
 	}
 
+	/* Move the dispatched and the timed out requests to the corresponding lists. */
+	asyncClient_updateRequestLists(c);
+
 	/* Update request state if connection has been closed remotely. */
 	if (connClosed) {
 		/* Set all handles that are still in response wait state into error state. */
@@ -1442,6 +2308,16 @@ static int asyncClient_run(KSI_AsyncClient *c, int (*handleResp)(KSI_AsyncClient
 				KSI_ASYNC_CONNECTION_CLOSED, 0L, NULL);
 	}
 
+	/* Replace the finalized local aggregation tree roots with the requests aggregated into them. */
+	asyncClient_completeBatches(c);
+
+	/* Pass the finalized requests to the response callbacks. */
+	res = asyncClient_invokeResponseCallbacks(c);
+	if (res != KSI_OK) {
+		KSI_pushError(c->ctx, res, "Async client failed to invoke response callbacks.");
+		goto cleanup;
+	}
+
 	if (handle != NULL) {
 		KSI_ERR_clearErrors(c->ctx);
 		res = asyncClient_findNextResponse(c, handle);
@@ -1487,6 +2363,53 @@ cleanup:
 	return res;
 }
 
+static int asyncClient_getPollFds(KSI_AsyncClient *c, KSI_AsyncPollFd *fds, size_t fds_size, size_t *fds_count, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t count = 0;
+	long timeout = -1;
+
+	if (c == NULL || fds_count == NULL || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(c->ctx);
+
+	if (c->clientImpl == NULL) {
+		KSI_pushError(c->ctx, res = KSI_INVALID_STATE, "Async client is not properly initialized.");
+		goto cleanup;
+	}
+
+	if (c->getPollFds != NULL) {
+		res = c->getPollFds(c->clientImpl, fds, fds_size, &count, &timeout);
+		if (res != KSI_OK) {
+			KSI_pushError(c->ctx, res, "Async client impl failed to return poll descriptors.");
+			goto cleanup;
+		}
+	} else if (c->pending > 0) {
+		/* The transport does not expose its sockets, thus it has to be polled regularly. */
+		timeout = KSI_ASYNC_DEFAULT_POLL_INTERVAL_MS;
+	}
+
+	/* The request timeouts are checked during run, with a second precision. */
+	if (c->pending > 0) timeout = KSI_ASYNC_POLL_TIMEOUT_MIN(timeout, 1000);
+	/* The local aggregation tree is closed by run when its time window has elapsed. */
+	if (c->batchList.count > 0) {
+		KSI_uint64_t elapsed = KSI_getMonotonicTimeMs() - c->batchOpenedAt;
+
+		timeout = KSI_ASYNC_POLL_TIMEOUT_MIN(timeout, (asyncClient_isBatchDue(c) ? 0 :
+				(long)(c->options[KSI_ASYNC_OPT_BATCH_WINDOW] - elapsed)));
+	}
+	/* Received responses can be extracted without waiting. */
+	if (c->received > 0) timeout = 0;
+
+	*fds_count = count;
+	*timeoutMs = timeout;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_AsyncHandle **tmpCache = NULL;
@@ -1502,7 +2425,6 @@ static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param)
 				size_t count = KSI_ASYNC_CACHE_START_POS + (size_t)param; /* Cache at pos=0 is reserved. */
 
 				if (c->reqCache != NULL) {
-					size_t i;
 					if (count < c->options[opt]) {
 						res = KSI_INVALID_ARGUMENT;
 						goto cleanup;
@@ -1515,9 +2437,11 @@ static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param)
 							goto cleanup;
 						}
 
-						for (i = 0; i < c->options[opt]; i++) {
-							tmpCache[i] = c->reqCache[i];
-						}
+						/* Append the new positions to the free positions. */
+						res = asyncClient_initFreeSlots(c, count);
+						if (res != KSI_OK) goto cleanup;
+
+						memcpy(tmpCache, c->reqCache, c->options[opt] * sizeof(KSI_AsyncHandle *));
 						KSI_free(c->reqCache);
 						c->reqCache = tmpCache;
 						tmpCache = NULL;
@@ -1532,11 +2456,19 @@ static int asyncClient_setOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_OPT_SND_TIMEOUT:
 		case KSI_ASYNC_OPT_MAX_REQUEST_COUNT:
 		case KSI_ASYNC_OPT_CALLBACK_USERDATA:
+		case KSI_ASYNC_OPT_HTTP_KEEP_ALIVE:
+		case KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE:
+		case KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS:
+		case KSI_ASYNC_OPT_HTTP_MULTIPLEX:
+		case KSI_ASYNC_OPT_AUTO_PACING:
+		case KSI_ASYNC_OPT_BATCH_SIZE:
+		case KSI_ASYNC_OPT_BATCH_WINDOW:
 			c->options[opt] = (size_t)param;
 			break;
 
 		case KSI_ASYNC_OPT_PUSH_CONF_CALLBACK:
 		case KSI_ASYNC_OPT_CONNECTION_STATE_CALLBACK:
+		case KSI_ASYNC_OPT_RESPONSE_CALLBACK:
 			c->options[opt] = (size_t)param;
 			break;
 
@@ -1577,10 +2509,18 @@ static int asyncClient_getOption(KSI_AsyncClient *c, const int opt, void *param)
 		case KSI_ASYNC_OPT_SND_TIMEOUT:
 		case KSI_ASYNC_OPT_MAX_REQUEST_COUNT:
 		case KSI_ASYNC_OPT_CALLBACK_USERDATA:
+		case KSI_ASYNC_OPT_HTTP_KEEP_ALIVE:
+		case KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE:
+		case KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS:
+		case KSI_ASYNC_OPT_HTTP_MULTIPLEX:
+		case KSI_ASYNC_OPT_AUTO_PACING:
+		case KSI_ASYNC_OPT_BATCH_SIZE:
+		case KSI_ASYNC_OPT_BATCH_WINDOW:
 			*(size_t*)param = c->options[opt];
 			break;
 		case KSI_ASYNC_OPT_PUSH_CONF_CALLBACK:
 		case KSI_ASYNC_OPT_CONNECTION_STATE_CALLBACK:
+		case KSI_ASYNC_OPT_RESPONSE_CALLBACK:
 			*(size_t*)param = c->options[opt];
 			break;
 		case KSI_ASYNC_OPT_REQUEST_CACHE_SIZE:
@@ -1617,6 +2557,14 @@ static int asyncClient_setDefaultOptions(KSI_AsyncClient *c) {
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_PUSH_CONF_CALLBACK, (void *)NULL)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_CONNECTION_STATE_CALLBACK, (void *)NULL)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)NULL)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_HTTP_KEEP_ALIVE, (void *)false)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE, (void *)KSI_ASYNC_DEFAULT_HTTP_HANDLE_POOL_SIZE)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS, (void *)0)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_HTTP_MULTIPLEX, (void *)false)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_RESPONSE_CALLBACK, (void *)NULL)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_AUTO_PACING, (void *)false)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_BATCH_SIZE, (void *)0)) != KSI_OK) goto cleanup;
+	if ((res = asyncClient_setOption(c, KSI_ASYNC_OPT_BATCH_WINDOW, (void *)0)) != KSI_OK) goto cleanup;
 	/* Private options. */
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_ROUND_DURATION, (void *)KSI_ASYNC_ROUND_DURATION_SEC)) != KSI_OK) goto cleanup;
 	if ((res = asyncClient_setOption(c, KSI_ASYNC_PRIVOPT_INVOKE_CONF_RECEIVED_CALLBACK, (void *)true)) != KSI_OK) goto cleanup;
@@ -1624,16 +2572,43 @@ cleanup:
 	return res;
 }
 
+static void asyncClient_freeBatch(KSI_AsyncClient *c, KSI_AsyncHandleChain *chain) {
+	KSI_AsyncHandle *h = chain->first;
+
+	while (h != NULL) {
+		KSI_AsyncHandle *next = h->chainNext;
+		size_t slot = (size_t)(h->id & KSI_ASYNC_REQUEST_ID_MASK);
+
+		if (c->reqCache == NULL || slot >= c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE] || c->reqCache[slot] != h) {
+			asyncHandleChain_unlink(h);
+			h->owner = NULL;
+			KSI_AsyncHandle_free(h);
+		}
+		h = next;
+	}
+}
+
 void KSI_AsyncClient_free(KSI_AsyncClient *c) {
 	if (c != NULL) {
 		if (c->clientImpl_free) c->clientImpl_free(c->clientImpl);
 
+		/* Clear the locally aggregated handles, these do not hold a position in the cache. */
+		asyncClient_freeBatch(c, &c->batchList);
+		asyncClient_freeBatch(c, &c->readyList);
+
 		/* Clear cached handles. */
 		if (c->reqCache != NULL) {
 			size_t i;
-			for (i = 0; i < c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]; i++) KSI_AsyncHandle_free(c->reqCache[i]);
+			for (i = 0; i < c->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]; i++) {
+				if (c->reqCache[i] == NULL) continue;
+				asyncClient_freeBatch(c, &c->reqCache[i]->batchMembers);
+				asyncHandleChain_unlink(c->reqCache[i]);
+				c->reqCache[i]->owner = NULL;
+				KSI_AsyncHandle_free(c->reqCache[i]);
+			}
 			KSI_free(c->reqCache);
 		}
+		KSI_free(c->freeSlots);
 		KSI_AsyncHandle_free(c->serverConf);
 
 		KSI_free(c);
@@ -1660,17 +2635,26 @@ int KSI_AbstractAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 
 	tmp->requestCountOffset = 0;
 	tmp->requestCount = 0;
-	tmp->tail = 1;
 
 	tmp->reqCache = NULL;
+	tmp->freeSlots = NULL;
+	tmp->freeHead = 0;
+	tmp->freeCount = 0;
+	memset(&tmp->dispatchList, 0, sizeof(tmp->dispatchList));
+	memset(&tmp->sentList, 0, sizeof(tmp->sentList));
+	memset(&tmp->readyList, 0, sizeof(tmp->readyList));
+	memset(&tmp->batchList, 0, sizeof(tmp->batchList));
+	tmp->batchOpenedAt = 0;
 	tmp->pending = 0;
 	tmp->received = 0;
 	tmp->serverConf = NULL;
+	asyncPacer_init(&tmp->pacer, tmp->options);
 
 	tmp->addRequest = NULL;
 	tmp->getResponse = NULL;
 	tmp->dispatch = NULL;
 	tmp->getCredentials = NULL;
+	tmp->getPollFds = NULL;
 
 	tmp->instanceId = time(NULL);
 	tmp->messageId = 0;
@@ -1684,6 +2668,9 @@ int KSI_AbstractAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 		goto cleanup;
 	}
 
+	res = asyncClient_initFreeSlots(tmp, tmp->options[KSI_ASYNC_OPT_REQUEST_CACHE_SIZE]);
+	if (res != KSI_OK) goto cleanup;
+
 	*c = tmp;
 	tmp = NULL;
 	res = KSI_OK;
@@ -1881,6 +2868,37 @@ cleanup:
 	return res;
 }
 
+int KSI_AsyncService_setCalendarMirror(KSI_AsyncService *service, KSI_CalendarMirror *mirror) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (service == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(service->ctx);
+
+	/* Only a single endpoint extending service can be backed by the mirror. */
+	if (service->addRequest != (int (*)(void *, KSI_AsyncHandle *))asyncClient_addExtenderRequest) {
+		KSI_pushError(service->ctx, res = KSI_INVALID_STATE, "Calendar mirror is supported only by the extending async service.");
+		goto cleanup;
+	}
+
+	if (service->impl == NULL) {
+		KSI_pushError(service->ctx, res = KSI_INVALID_STATE, "Async service endpoint is not set.");
+		goto cleanup;
+	}
+
+	res = KSI_CalendarMirrorAsyncClient_attach(service->impl, mirror);
+	if (res != KSI_OK) {
+		KSI_pushError(service->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 void KSI_AsyncService_free(KSI_AsyncService *service) {
 	if (service != NULL) {
 		size_t len;
@@ -1919,6 +2937,7 @@ int KSI_SigningAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))asyncClient_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))asyncClient_getReceivedCount;
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))asyncClient_getPollFds;
 
 	tmp->setOption = (int (*)(void *, int, void *))asyncClient_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))asyncClient_getOption;
@@ -1957,6 +2976,7 @@ int KSI_ExtendingAsyncService_new(KSI_CTX *ctx, KSI_AsyncService **service) {
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))asyncClient_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))asyncClient_getReceivedCount;
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))asyncClient_getPollFds;
 
 	tmp->setOption = (int (*)(void *, int, void *))asyncClient_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))asyncClient_getOption;
@@ -1983,6 +3003,108 @@ int KSI_AsyncService_getReceivedCount(KSI_AsyncService *s, size_t *count) {
 	return s->getReceivedCount(s->impl, count);
 }
 
+int KSI_AsyncService_getPollFds(KSI_AsyncService *s, KSI_AsyncPollFd *fds, size_t *fds_len, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t count = 0;
+	long timeout = -1;
+
+	if (s == NULL || fds_len == NULL || (fds == NULL && *fds_len != 0) || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(s->ctx);
+
+	if (s->impl == NULL || s->getPollFds == NULL) {
+		KSI_pushError(s->ctx, res = KSI_INVALID_STATE, "Async service client is not properly initialized.");
+		goto cleanup;
+	}
+
+	res = s->getPollFds(s->impl, fds, *fds_len, &count, &timeout);
+	if (res != KSI_OK) {
+		KSI_pushError(s->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (count > *fds_len) {
+		*fds_len = count;
+		KSI_pushError(s->ctx, res = KSI_BUFFER_OVERFLOW, "Poll descriptor array is too small.");
+		goto cleanup;
+	}
+
+	*fds_len = count;
+	*timeoutMs = timeout;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
+int KSI_AsyncService_wait(KSI_AsyncService *s, long timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncPollFd localFds[KSI_ASYNC_WAIT_LOCAL_FD_COUNT];
+	struct pollfd localPfds[KSI_ASYNC_WAIT_LOCAL_FD_COUNT];
+	KSI_AsyncPollFd *fds = localFds;
+	struct pollfd *pfds = localPfds;
+	size_t count = KSI_ASYNC_WAIT_LOCAL_FD_COUNT;
+	long timeout = -1;
+	size_t i;
+
+	if (s == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(s->ctx);
+
+	res = KSI_AsyncService_getPollFds(s, fds, &count, &timeout);
+	if (res == KSI_BUFFER_OVERFLOW) {
+		fds = KSI_calloc(count, sizeof(KSI_AsyncPollFd));
+		pfds = KSI_calloc(count, sizeof(struct pollfd));
+		if (fds == NULL || pfds == NULL) {
+			KSI_pushError(s->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+		res = KSI_AsyncService_getPollFds(s, fds, &count, &timeout);
+	}
+	if (res != KSI_OK) {
+		KSI_pushError(s->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	timeout = KSI_ASYNC_POLL_TIMEOUT_MIN(timeout, timeoutMs);
+	/* Nothing to wait for. */
+	if (timeout == 0 || (count == 0 && timeout < 0)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+	if (timeout > INT_MAX) timeout = INT_MAX;
+
+	for (i = 0; i < count; i++) {
+		pfds[i].fd = fds[i].fd;
+		pfds[i].events = ((fds[i].events & KSI_ASYNC_POLL_IN) ? POLLIN : 0) | ((fds[i].events & KSI_ASYNC_POLL_OUT) ? POLLOUT : 0);
+		pfds[i].revents = 0;
+	}
+
+#ifdef _WIN32
+	/* WSAPoll does not accept an empty descriptor set. */
+	if (count == 0) {
+		Sleep((DWORD)timeout);
+		res = KSI_OK;
+		goto cleanup;
+	}
+#endif
+
+	if (poll(pfds, count, (int)timeout) == KSI_SCK_SOCKET_ERROR && KSI_SCK_errno != KSI_SCK_EINTR) {
+		KSI_ERR_push(s->ctx, res = KSI_NETWORK_ERROR, KSI_SCK_errno, __FILE__, __LINE__, "Async service unable to poll sockets.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+cleanup:
+	if (fds != localFds) KSI_free(fds);
+	if (pfds != localPfds) KSI_free(pfds);
+	return res;
+}
+
 int KSI_AsyncService_setOption(KSI_AsyncService *s, const int option, void *value) {
 	if ((s == NULL || s->impl == NULL || s->setOption == NULL) || (size_t)option >= __NOF_KSI_ASYNC_OPT) return KSI_INVALID_ARGUMENT;
 	return s->setOption(s->impl, option, value);
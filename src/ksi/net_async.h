@@ -126,6 +126,30 @@ extern "C" {
 	 */
 	int KSI_AsyncHandle_setRequestCtx(KSI_AsyncHandle *o, void *reqCtx, void (*reqCtx_free)(void*));
 
+	/**
+	 * Async request completion callback.
+	 * \param[in]		ctx				KSI context object.
+	 * \param[in]		userp			Contains whatever user-defined value set using the KSI_ASYNC_OPT_CALLBACK_USERDATA.
+	 * \param[in]		handle			Async handle that has reached a final state.
+	 * \return Implementation must return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The ownership of the \c handle is passed to the callback, the same way as for the handles returned
+	 *       by #KSI_AsyncService_run.
+	 * \note The callback may add new requests to the service, but must not call #KSI_AsyncService_run.
+	 * \see #KSI_ASYNC_OPT_RESPONSE_CALLBACK for setting up the callback for all requests of a service.
+	 * \see #KSI_AsyncHandle_setResponseCallback for setting up the callback for a single request.
+	 */
+	typedef int (*KSI_AsyncServiceCallback_response)(KSI_CTX *ctx, void *userp, KSI_AsyncHandle *handle);
+
+	/**
+	 * Setter for the request completion callback. When the request reaches a final state, the handle is passed
+	 * to the callback during #KSI_AsyncService_run instead of being returned by it.
+	 * \param[in]		o				Async handle object.
+	 * \param[in]		callback		Completion callback, \c NULL to return the handle by #KSI_AsyncService_run.
+	 * \return Status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The request callback takes precedence over the service callback #KSI_ASYNC_OPT_RESPONSE_CALLBACK.
+	 */
+	int KSI_AsyncHandle_setResponseCallback(KSI_AsyncHandle *o, KSI_AsyncServiceCallback_response callback);
+
 	/**
 	 * Getter for the request specific context.
 	 * \param[in]		o				Async handle object.
@@ -430,6 +454,60 @@ extern "C" {
 	 */
 	int KSI_AsyncService_getReceivedCount(KSI_AsyncService *s, size_t *count);
 
+	/**
+	 * Enum defining the events of a #KSI_AsyncPollFd.
+	 */
+	typedef enum KSI_AsyncPollEvent_en {
+		/** The descriptor should be polled for reading. */
+		KSI_ASYNC_POLL_IN = 0x01,
+		/** The descriptor should be polled for writing. */
+		KSI_ASYNC_POLL_OUT = 0x02
+	} KSI_AsyncPollEvent;
+
+	/**
+	 * Descriptor of a socket used by the async service.
+	 * \see #KSI_AsyncService_getPollFds
+	 */
+	typedef struct KSI_AsyncPollFd_st {
+		/** Socket descriptor. */
+		int fd;
+		/** Events of interest, a combination of #KSI_AsyncPollEvent values. */
+		int events;
+	} KSI_AsyncPollFd;
+
+	/**
+	 * Get the sockets the async service \c s is waiting on and the time after which #KSI_AsyncService_run
+	 * has to be called regardless of socket activity. This can be used for integrating the service into
+	 * an external event loop (e.g. \c poll, \c epoll or \c select). #KSI_AsyncService_run should be called
+	 * when any of the sockets becomes ready, or when the timeout has elapsed.
+	 * \param[in]		s				Async service instance.
+	 * \param[out]		fds				Array of socket descriptors (can be \c NULL if \c fds_len is 0).
+	 * \param[in,out]	fds_len			Size of the \c fds array in, number of socket descriptors out.
+	 * \param[out]		timeoutMs		Timeout in milliseconds, -1 if the service has nothing to wait for.
+	 * \return #KSI_OK, when operation succeeded;
+	 * \return #KSI_BUFFER_OVERFLOW, if the \c fds array is too small. In this case \c fds_len is set to
+	 *         the required size;
+	 * \return otherwise an error code.
+	 * \note The set of sockets changes as the connections are opened and closed, thus it should be queried
+	 *       again after each call to #KSI_AsyncService_run.
+	 * \note The timeout is at most a second while there are requests in process, as the request timeouts are
+	 *       measured in seconds.
+	 * \see #KSI_AsyncService_wait for a blocking wait on the sockets.
+	 */
+	int KSI_AsyncService_getPollFds(KSI_AsyncService *s, KSI_AsyncPollFd *fds, size_t *fds_len, long *timeoutMs);
+
+	/**
+	 * Blocks until any of the sockets of the async service \c s becomes ready, the service timeout elapses
+	 * or \c timeoutMs milliseconds have passed, whichever happens first. The function returns immediately
+	 * if the service has nothing to wait for.
+	 * \param[in]		s				Async service instance.
+	 * \param[in]		timeoutMs		Maximum time to wait in milliseconds, a negative value for no limit.
+	 * \return Status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The function does not process any data, call #KSI_AsyncService_run after it returns.
+	 * \see #KSI_AsyncService_getPollFds for the sockets and the service timeout.
+	 */
+	int KSI_AsyncService_wait(KSI_AsyncService *s, long timeoutMs);
+
 	/**
 	 * Async service network connection establishment listener callback.
 	 * \param[in]		ctx				KSI context object.
@@ -509,8 +587,9 @@ extern "C" {
 		 * Maximum number of request permitted per round.
 		 * Default setting is 1.
 		 * \param		count			Paramer of type size_t.
-		 * \note In case the maximum number of request is allready sent out during a round interval,
-		 * additional request will be buffered in intenal cache.
+		 * \note The requests are paced evenly over the round interval, additional requests are buffered
+		 * in intenal cache until they can be sent out.
+		 * \see #KSI_ASYNC_OPT_AUTO_PACING for using the limits of the server configuration instead.
 		 */
 		KSI_ASYNC_OPT_MAX_REQUEST_COUNT,
 
@@ -563,6 +642,97 @@ extern "C" {
 		 */
 		KSI_ASYNC_OPT_CALLBACK_USERDATA,
 
+		/**
+		 * Keeps the HTTP connection open after a response has been received, so that the following requests
+		 * to the same endpoint do not need a new TCP and TLS handshake.
+		 * Default setting is 0 (the connection is closed after each request).
+		 * \param		enable			Paramer of type size_t, 0 to disable.
+		 * \note Only applicable in case of HTTP client using libcurl.
+		 */
+		KSI_ASYNC_OPT_HTTP_KEEP_ALIVE,
+
+		/**
+		 * Maximum number of idle HTTP transfer handles kept for reuse. A reused handle keeps its TLS session
+		 * cache, thus a new connection to the same endpoint can resume the previous TLS session.
+		 * Default setting is 16.
+		 * \param		count			Paramer of type size_t.
+		 * \note Only applicable in case of HTTP client using libcurl.
+		 */
+		KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE,
+
+		/**
+		 * Maximum number of simultaneously open connections to a single host. Requests exceeding the limit are
+		 * queued until a connection becomes available.
+		 * Default setting is 0 (no limit).
+		 * \param		count			Paramer of type size_t.
+		 * \note Only applicable in case of HTTP client using libcurl.
+		 * \note The connection pool is shared by all the HTTP async services of the same #KSI_CTX, thus the last
+		 * applied value is in effect for all of them.
+		 */
+		KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS,
+
+		/**
+		 * Uses HTTP/2 over TLS and multiplexes the requests over a single connection instead of opening a new
+		 * connection for every parallel request. Implies #KSI_ASYNC_OPT_HTTP_KEEP_ALIVE.
+		 * Default setting is 0.
+		 * \param		enable			Paramer of type size_t, 0 to disable.
+		 * \note Only applicable in case of HTTP client using libcurl. If libcurl has been built without HTTP/2
+		 * support or the server does not support it, HTTP/1.1 with keep-alive is used.
+		 * \note The connection pool is shared by all the HTTP async services of the same #KSI_CTX, thus the last
+		 * applied value is in effect for all of them.
+		 */
+		KSI_ASYNC_OPT_HTTP_MULTIPLEX,
+
+		/**
+		 * If configured, the requests that have reached a final state are passed to the callback during
+		 * #KSI_AsyncService_run instead of being returned one by one. A single call to #KSI_AsyncService_run
+		 * delivers all the finalized requests.
+		 * \param		p_func			Paramer of type #KSI_AsyncServiceCallback_response.
+		 * \note For reading the stored value via #KSI_AsyncService_getOption a parameter of type size_t should be used,
+		 * and casted to #KSI_AsyncServiceCallback_response before use.
+		 * \note If the callback returns an error, #KSI_AsyncService_run returns the same error. The remaining
+		 * finalized requests are delivered on the next call.
+		 * \see #KSI_AsyncHandle_setResponseCallback for setting up the callback for a single request.
+		 */
+		KSI_ASYNC_OPT_RESPONSE_CALLBACK,
+
+		/**
+		 * Paces the requests according to the maximum request count and the aggregation period received with the
+		 * server configuration (see #KSI_Config_getMaxRequests and #KSI_Config_getAggrPeriod), instead of
+		 * #KSI_ASYNC_OPT_MAX_REQUEST_COUNT. Until the configuration has been received, #KSI_ASYNC_OPT_MAX_REQUEST_COUNT
+		 * is used.
+		 * Default setting is 0.
+		 * \param		enable			Paramer of type size_t, 0 to disable.
+		 * \note Regardless of this option, the request rate is reduced when the server responds with
+		 * #KSI_SERVICE_AGGR_TOO_MANY_REQUESTS, and restored gradually afterwards.
+		 */
+		KSI_ASYNC_OPT_AUTO_PACING,
+
+		/**
+		 * Maximum number of signing requests aggregated locally into a single request. The request hashes are
+		 * collected into an aggregation tree and only the root of the tree is sent to the aggregator. When the
+		 * response is received, each of the collected requests is completed with a signature of its own.
+		 * Default setting is 0.
+		 * \param		count			Paramer of type size_t, 0 or 1 to disable.
+		 * \note Only applicable in case of signing service. Requests with a non-zero request level or with a server
+		 * configuration request are not aggregated locally.
+		 * \note The requests of the same tree share the request id, the aggregation response and the error state.
+		 * The aggregation chain of each request is longer by about log2(count) levels.
+		 * \see #KSI_ASYNC_OPT_BATCH_WINDOW for limiting the time the requests are collected.
+		 */
+		KSI_ASYNC_OPT_BATCH_SIZE,
+
+		/**
+		 * Time window for collecting the requests into a local aggregation tree, measured from adding the
+		 * first request of the tree. The tree is closed when the window elapses or #KSI_ASYNC_OPT_BATCH_SIZE
+		 * is reached, whichever comes first.
+		 * Default setting is 0.
+		 * \param		timeout			Time window in milliseconds. Paramer of type size_t, 0 to close the tree
+		 * 								on every call to #KSI_AsyncService_run.
+		 * \see #KSI_ASYNC_OPT_BATCH_SIZE for enabling the local aggregation.
+		 */
+		KSI_ASYNC_OPT_BATCH_WINDOW,
+
 		__KSI_ASYNC_OPT_COUNT
 	} KSI_AsyncOption;
 
@@ -624,6 +794,19 @@ extern "C" {
 	 */
 	int KSI_AsyncService_addEndpoint(KSI_AsyncService *service, const char *uri, const char *loginId, const char *key);
 
+	/**
+	 * Calendar mirror setter for the extending async service. The requests within the mirrored time range are
+	 * answered locally and do not count towards #KSI_ASYNC_OPT_MAX_REQUEST_COUNT, the rest of the requests are sent
+	 * to the endpoint of the \c service.
+	 * \param[in]	service		Pointer to the async service constructed via #KSI_ExtendingAsyncService_new.
+	 * \param[in]	mirror		Verified calendar mirror, \c NULL to send all the requests to the endpoint.
+	 * \return Status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The endpoint has to be set before the mirror.
+	 * \note On success the \c service takes ownership of \c mirror.
+	 * \see #KSI_CalendarMirror_verify for verifying the mirror.
+	 */
+	int KSI_AsyncService_setCalendarMirror(KSI_AsyncService *service, KSI_CalendarMirror *mirror);
+
 	/**
 	 * @}
 	 */
@@ -19,6 +19,7 @@
 
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include "net_file.h"
 #include "fast_tlv.h"
@@ -347,6 +348,7 @@ static int publicationFileReceive(KSI_RequestHandle *handle) {
 	long int tmp_size = 0;
 	unsigned char *buffer = NULL;
 	FILE *f = NULL;
+	struct stat st;
 
 	if (handle == NULL) {
 		res = KSI_INVALID_ARGUMENT;
@@ -357,6 +359,18 @@ static int publicationFileReceive(KSI_RequestHandle *handle) {
 
 	fs = handle->implCtx;
 
+	/* The modification time is used as the validator for conditional requests. */
+	if (stat(fs->path, &st) == 0) {
+		handle->lastModified = st.st_mtime;
+
+		if (handle->ifModifiedSince != 0 && handle->ifModifiedSince == st.st_mtime) {
+			KSI_LOG_debug(handle->ctx, "File: Publications file '%s' has not been modified.", fs->path);
+			handle->notModified = true;
+			res = KSI_OK;
+			goto cleanup;
+		}
+	}
+
 	KSI_LOG_debug(handle->ctx, "File: Read publication file response from '%s'.", fs->path);
 	f = fopen(fs->path, "rb");
 	if (f == NULL) {
@@ -385,7 +399,14 @@ static int publicationFileReceive(KSI_RequestHandle *handle) {
 		goto cleanup;
 	}
 
-	res = fseek(f, 0, SEEK_SET);
+	/* Only the end of the file is read if requested, unless the file is not longer than the offset. */
+	if (handle->rangeStart > 0 && handle->rangeStart < size) {
+		KSI_LOG_debug(handle->ctx, "File: Reading publications file from offset %llu.", (unsigned long long)handle->rangeStart);
+		size -= handle->rangeStart;
+		handle->partial = true;
+	}
+
+	res = fseek(f, (long)(handle->partial ? handle->rangeStart : 0), SEEK_SET);
 	if (res != 0) {
 		KSI_pushError(handle->ctx, res = KSI_IO_ERROR, NULL);
 		goto cleanup;
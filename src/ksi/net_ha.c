@@ -683,6 +683,60 @@ cleanup:
 	return res;
 }
 
+static int KSI_HighAvailabilityService_getPollFds(KSI_HighAvailabilityService *has, KSI_AsyncPollFd *fds, size_t fds_size, size_t *fds_count, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i = 0;
+	size_t count = 0;
+	long timeout = -1;
+
+	if (has == NULL || fds_count == NULL || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(has->ctx);
+
+	if (KSI_AsyncServiceList_length(has->services) == 0) {
+		KSI_pushError(has->ctx, res = KSI_INVALID_STATE, "High availability service is not properly initialized.");
+		goto cleanup;
+	}
+
+	for (i = 0; i < KSI_AsyncServiceList_length(has->services); i++) {
+		KSI_AsyncService *as = NULL;
+		size_t srvCount = 0;
+		long srvTimeout = -1;
+
+		res = KSI_AsyncServiceList_elementAt(has->services, i, &as);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (as == NULL || as->impl == NULL || as->getPollFds == NULL) {
+			KSI_pushError(has->ctx, res = KSI_INVALID_STATE, "High availability subservice is not properly initialized.");
+			goto cleanup;
+		}
+
+		/* Collect the descriptors of all subservices, count also the ones that do not fit. */
+		res = as->getPollFds(as->impl, (count < fds_size ? fds + count : NULL), (count < fds_size ? fds_size - count : 0), &srvCount, &srvTimeout);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		count += srvCount;
+		timeout = KSI_ASYNC_POLL_TIMEOUT_MIN(timeout, srvTimeout);
+	}
+	/* Consolidated responses can be extracted without waiting. */
+	if (KSI_AsyncHandleList_length(has->respQueue) > 0) timeout = 0;
+
+	*fds_count = count;
+	*timeoutMs = timeout;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int KSI_HighAvailabilityService_reportErrorNotice(KSI_HighAvailabilityService *has,
 		KSI_AsyncHandle *reqHndl, size_t origin,
 		int err, long errExt, KSI_Utf8String *errMsg) {
@@ -1063,6 +1117,66 @@ static int KSI_HighAvailabilityService_extRespHandler(KSI_HighAvailabilityServic
 			(KSI_Config_Callback)has->ctx->options[KSI_OPT_EXT_CONF_RECEIVED_CALLBACK]));
 }
 
+static int KSI_HighAvailabilityService_invokeResponseCallbacks(KSI_HighAvailabilityService *has) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i = 0;
+	void *userp = NULL;
+	KSI_AsyncService *as = NULL;
+
+	if (has == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(has->ctx);
+
+	/* The callback user data is shared by all the subservices. */
+	res = KSI_AsyncServiceList_elementAt(has->services, 0, &as);
+	if (res != KSI_OK) {
+		KSI_pushError(has->ctx, res, NULL);
+		goto cleanup;
+	}
+	res = KSI_AsyncService_getOption(as, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)&userp);
+	if (res != KSI_OK) {
+		KSI_pushError(has->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	while (i < KSI_AsyncHandleList_length(has->respQueue)) {
+		KSI_AsyncHandle *hndl = NULL;
+		KSI_AsyncServiceCallback_response callback = NULL;
+
+		res = KSI_AsyncHandleList_elementAt(has->respQueue, i, &hndl);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		callback = (hndl->respCallback != NULL ? hndl->respCallback : has->respCallback);
+		if (callback == NULL) {
+			/* Leave the handle to be returned by run. */
+			i++;
+			continue;
+		}
+
+		/* Remove the handle from the queue before passing the ownership to the callback. */
+		res = KSI_AsyncHandleList_remove(has->respQueue, i, &hndl);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = callback(has->ctx, userp, hndl);
+		if (res != KSI_OK) {
+			KSI_pushError(has->ctx, res, "Async response callback returned error.");
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int KSI_HighAvailabilityService_run(KSI_HighAvailabilityService *has,
 		int (*respHandler)(KSI_HighAvailabilityService *), KSI_AsyncHandle **handle, size_t *waiting) {
 	int res = KSI_UNKNOWN_ERROR;
@@ -1084,6 +1198,12 @@ static int KSI_HighAvailabilityService_run(KSI_HighAvailabilityService *has,
 		goto cleanup;
 	}
 
+	res = KSI_HighAvailabilityService_invokeResponseCallbacks(has);
+	if (res != KSI_OK) {
+		KSI_pushError(has->ctx, res, NULL);
+		goto cleanup;
+	}
+
 	if (handle != NULL && KSI_AsyncHandleList_length(has->respQueue) > 0) {
 		res = KSI_AsyncHandleList_remove(has->respQueue, 0, handle);
 		if (res != KSI_OK) {
@@ -1132,6 +1252,10 @@ static int KSI_HighAvailabilityService_setOption(KSI_HighAvailabilityService *ha
 		case KSI_ASYNC_OPT_PUSH_CONF_CALLBACK:
 			has->confCallback = (KSI_Config_Callback)value;
 			break;
+		/* The subservice responses are consolidated before they can be passed to the response callback. */
+		case KSI_ASYNC_OPT_RESPONSE_CALLBACK:
+			has->respCallback = (KSI_AsyncServiceCallback_response)value;
+			break;
 		case KSI_ASYNC_OPT_CONF_CONSOLIDATE_CALLBACK:
 			has->confConsolidateCallback = (KSI_AsyncServiceCallback_configConsolidate)value;
 			break;
@@ -1186,6 +1310,9 @@ static int KSI_HighAvailabilityService_getOption(const KSI_HighAvailabilityServi
 		case KSI_ASYNC_OPT_PUSH_CONF_CALLBACK:
 			tmp = (size_t)has->confCallback;
 			break;
+		case KSI_ASYNC_OPT_RESPONSE_CALLBACK:
+			tmp = (size_t)has->respCallback;
+			break;
 		case KSI_ASYNC_OPT_CONF_CONSOLIDATE_CALLBACK:
 			tmp = (size_t)has->confConsolidateCallback;
 			break;
@@ -1259,6 +1386,7 @@ static int KSI_AbstractHighAvailabilityService_new(KSI_CTX *ctx, KSI_HighAvailab
 	tmp->respQueue = NULL;
 	tmp->consolidatedConfig = NULL;
 	tmp->confCallback = NULL;
+	tmp->respCallback = NULL;
 	tmp->confConsolidateCallback = NULL;
 
 	tmp->subservice_new = NULL;
@@ -1418,6 +1546,7 @@ int KSI_SigningHighAvailabilityService_new(KSI_CTX *ctx, KSI_AsyncService **serv
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getReceivedCount;
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))KSI_HighAvailabilityService_getPollFds;
 
 	tmp->setOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_getOption;
@@ -1469,6 +1598,7 @@ int KSI_ExtendingHighAvailabilityService_new(KSI_CTX *ctx, KSI_AsyncService **se
 
 	tmp->getPendingCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getPendingCount;
 	tmp->getReceivedCount = (int (*)(void *, size_t *))KSI_HighAvailabilityService_getReceivedCount;
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))KSI_HighAvailabilityService_getPollFds;
 
 	tmp->setOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_setOption;
 	tmp->getOption = (int (*)(void *, int, void *))KSI_HighAvailabilityService_getOption;
@@ -34,11 +34,22 @@ typedef struct CurlNetHandleCtx_st {
 	size_t len;
 	struct curl_slist *httpHeaders;
 	char curlErr[CURL_ERROR_SIZE];
+	/** Multi handle for non-blocking transfers, created on the first poll. */
+	CURLM *multi;
+	/** Entity tag from the response headers. */
+	char *etag;
+	/** Flag indicating that the conditional request headers have been applied. */
+	bool conditionsApplied;
 } CurlNetHandleCtx;
 
 static void CurlNetHandleCtx_free(CurlNetHandleCtx *handleCtx) {
 	if (handleCtx != NULL) {
 		KSI_free(handleCtx->raw);
+		KSI_free(handleCtx->etag);
+		if (handleCtx->multi != NULL) {
+			curl_multi_remove_handle(handleCtx->multi, handleCtx->curl);
+			curl_multi_cleanup(handleCtx->multi);
+		}
 		if (handleCtx->httpHeaders != NULL) curl_slist_free_all(handleCtx->httpHeaders);
 		if (handleCtx->curl != NULL) curl_easy_cleanup(handleCtx->curl);
 		KSI_free(handleCtx);
@@ -66,7 +77,9 @@ static int CurlNetHandleCtx_new(KSI_CTX *ctx, CurlNetHandleCtx **handleCtx) {
 	tmp->raw = NULL;
 	tmp->curlErr[0] = '\0';
 	tmp->httpHeaders = NULL;
-
+	tmp->multi = NULL;
+	tmp->etag = NULL;
+	tmp->conditionsApplied = false;
 
 	*handleCtx = tmp;
 	tmp = NULL;
@@ -110,6 +123,83 @@ cleanup:
 	return bytesCount;
 }
 
+static size_t receiveHeaderFromLibCurl(char *ptr, size_t size, size_t nmemb, void *stream) {
+	CurlNetHandleCtx *nc = (CurlNetHandleCtx *) stream;
+	size_t len = size * nmemb;
+	static const char name[] = "ETag:";
+	char prefix[sizeof(name)];
+	size_t i;
+
+	if (len < sizeof(name)) return len;
+
+	memcpy(prefix, ptr, sizeof(name) - 1);
+	prefix[sizeof(name) - 1] = '\0';
+
+	if (KSI_strcasecmp(prefix, name) == 0) {
+		const char *val = ptr + sizeof(name) - 1;
+		size_t val_len = len - (sizeof(name) - 1);
+
+		while (val_len > 0 && (*val == ' ' || *val == '\t')) {
+			val++;
+			val_len--;
+		}
+		while (val_len > 0 && (val[val_len - 1] == '\r' || val[val_len - 1] == '\n' || val[val_len - 1] == ' ')) {
+			val_len--;
+		}
+
+		KSI_free(nc->etag);
+		nc->etag = KSI_calloc(val_len + 1, 1);
+		if (nc->etag != NULL) {
+			for (i = 0; i < val_len; i++) nc->etag[i] = val[i];
+		}
+	}
+
+	return len;
+}
+
+/* Adds the conditional request headers, the validators are set on the handle after it has been prepared. */
+static int applyConditions(KSI_RequestHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlNetHandleCtx *implCtx = handle->implCtx;
+	char header[1024];
+
+	if (implCtx->conditionsApplied) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (handle->ifModifiedSince != 0) {
+		curl_easy_setopt(implCtx->curl, CURLOPT_TIMECONDITION, (long)CURL_TIMECOND_IFMODSINCE);
+		curl_easy_setopt(implCtx->curl, CURLOPT_TIMEVALUE, (long)handle->ifModifiedSince);
+	}
+
+	if (handle->rangeStart > 0) {
+		KSI_snprintf(header, sizeof(header), "%llu-", (unsigned long long)handle->rangeStart);
+		curl_easy_setopt(implCtx->curl, CURLOPT_RANGE, header);
+	}
+
+	if (handle->ifNoneMatch != NULL) {
+		struct curl_slist *tmp = NULL;
+
+		KSI_snprintf(header, sizeof(header), "If-None-Match: %s", handle->ifNoneMatch);
+		tmp = curl_slist_append(implCtx->httpHeaders, header);
+		if (tmp == NULL) {
+			KSI_pushError(handle->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+		implCtx->httpHeaders = tmp;
+		curl_easy_setopt(implCtx->curl, CURLOPT_HTTPHEADER, implCtx->httpHeaders);
+	}
+
+	implCtx->conditionsApplied = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 static int updateStatus(KSI_RequestHandle *handle) {
 	int res = KSI_UNKNOWN_ERROR;
 	CurlNetHandleCtx *impl = NULL;
@@ -142,22 +232,13 @@ cleanup:
 	return res;
 }
 
-static int curlReceive(KSI_RequestHandle *handle) {
+/* Finalizes the handle after the transfer has finished with the given result. */
+static int curlComplete(KSI_RequestHandle *handle, CURLcode cc) {
 	int res = KSI_UNKNOWN_ERROR;
-	CurlNetHandleCtx *implCtx = NULL;
-	long httpCode;
-
-	if (handle == NULL || handle->client == NULL || handle->implCtx == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-	KSI_ERR_clearErrors(handle->ctx);
-
-	implCtx = handle->implCtx;
-
-	KSI_LOG_debug(handle->ctx, "Sending request.");
+	CurlNetHandleCtx *implCtx = handle->implCtx;
+	long httpCode = 0;
+	long fileTime = -1;
 
-	res = curl_easy_perform(implCtx->curl);
 	KSI_LOG_debug(handle->ctx, "Received %llu bytes.", (unsigned long long)implCtx->len);
 
 	if (curl_easy_getinfo(implCtx->curl, CURLINFO_HTTP_CODE, &httpCode) == CURLE_OK) {
@@ -165,16 +246,31 @@ static int curlReceive(KSI_RequestHandle *handle) {
 		KSI_LOG_debug(handle->ctx, "Received HTTP code %ld.", httpCode);
 	}
 
-	if (res != CURLE_OK) {
-		KSI_LOG_debug(handle->ctx, "Curl error: httpCode=%ld, code=%d, message='%s'.", httpCode, res, implCtx->curlErr);
+	if (cc != CURLE_OK) {
+		KSI_LOG_debug(handle->ctx, "Curl error: httpCode=%ld, code=%d, message='%s'.", httpCode, cc, implCtx->curlErr);
 		KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, implCtx->curlErr);
 		goto cleanup;
 	}
 
-	res = KSI_RequestHandle_setResponse(handle, implCtx->raw, implCtx->len);
-	if (res != KSI_OK) {
-		KSI_pushError(handle->ctx, res, NULL);
-		goto cleanup;
+	if (curl_easy_getinfo(implCtx->curl, CURLINFO_FILETIME, &fileTime) == CURLE_OK && fileTime >= 0) {
+		handle->lastModified = (time_t)fileTime;
+	}
+
+	KSI_free(handle->etag);
+	handle->etag = implCtx->etag;
+	implCtx->etag = NULL;
+
+	if (httpCode == 304) {
+		handle->notModified = true;
+	} else {
+		/* A server not supporting ranges responds with the whole resource. */
+		handle->partial = (httpCode == 206 && handle->rangeStart > 0);
+
+		res = KSI_RequestHandle_setResponse(handle, implCtx->raw, implCtx->len);
+		if (res != KSI_OK) {
+			KSI_pushError(handle->ctx, res, NULL);
+			goto cleanup;
+		}
 	}
 
 	/* Cleanup on success. */
@@ -190,6 +286,113 @@ cleanup:
 	return res;
 }
 
+static int curlPoll(KSI_RequestHandle *handle, int timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlNetHandleCtx *implCtx = NULL;
+	CURLMcode mc;
+	CURLMsg *msg = NULL;
+	int running = 0;
+	int left = 0;
+
+	if (handle == NULL || handle->client == NULL || handle->implCtx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(handle->ctx);
+
+	implCtx = handle->implCtx;
+
+	if (handle->completed) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (implCtx->multi == NULL) {
+		res = applyConditions(handle);
+		if (res != KSI_OK) goto cleanup;
+
+		implCtx->multi = curl_multi_init();
+		if (implCtx->multi == NULL) {
+			KSI_pushError(handle->ctx, res = KSI_OUT_OF_MEMORY, "Unable to init CURL multi handle.");
+			goto cleanup;
+		}
+
+		mc = curl_multi_add_handle(implCtx->multi, implCtx->curl);
+		if (mc != CURLM_OK) {
+			KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, curl_multi_strerror(mc));
+			goto cleanup;
+		}
+
+		KSI_LOG_debug(handle->ctx, "Sending request (non-blocking).");
+	}
+
+	mc = curl_multi_perform(implCtx->multi, &running);
+	if (mc == CURLM_OK && running > 0 && timeoutMs > 0) {
+		mc = curl_multi_wait(implCtx->multi, NULL, 0, timeoutMs, NULL);
+		if (mc == CURLM_OK) mc = curl_multi_perform(implCtx->multi, &running);
+	}
+
+	if (mc != CURLM_OK) {
+		KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, curl_multi_strerror(mc));
+		goto cleanup;
+	}
+
+	if (running == 0) {
+		while ((msg = curl_multi_info_read(implCtx->multi, &left)) != NULL) {
+			if (msg->msg == CURLMSG_DONE && msg->easy_handle == implCtx->curl) break;
+		}
+
+		if (msg == NULL) {
+			KSI_pushError(handle->ctx, res = KSI_NETWORK_ERROR, "Transfer finished without a result.");
+			goto cleanup;
+		}
+
+		res = curlComplete(handle, msg->data.result);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int curlReceive(KSI_RequestHandle *handle) {
+	int res = KSI_UNKNOWN_ERROR;
+	CurlNetHandleCtx *implCtx = NULL;
+
+	if (handle == NULL || handle->client == NULL || handle->implCtx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(handle->ctx);
+
+	implCtx = handle->implCtx;
+
+	/* Finish a transfer started with #curlPoll. */
+	if (implCtx->multi != NULL) {
+		while (!handle->completed) {
+			res = curlPoll(handle, 1000);
+			if (res != KSI_OK) goto cleanup;
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = applyConditions(handle);
+	if (res != KSI_OK) goto cleanup;
+
+	KSI_LOG_debug(handle->ctx, "Sending request.");
+
+	res = curlComplete(handle, curl_easy_perform(implCtx->curl));
+
+cleanup:
+
+	return res;
+}
+
 static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, char *url) {
 	int res = KSI_UNKNOWN_ERROR;
 	CurlNetHandleCtx *implCtx = NULL;
@@ -249,12 +452,18 @@ static int sendRequest(KSI_NetworkClient *client, KSI_RequestHandle *handle, cha
 
 	curl_easy_setopt(implCtx->curl, CURLOPT_WRITEDATA, implCtx);
 
+	/* Collect the validators for conditional requests. */
+	curl_easy_setopt(implCtx->curl, CURLOPT_HEADERFUNCTION, receiveHeaderFromLibCurl);
+	curl_easy_setopt(implCtx->curl, CURLOPT_HEADERDATA, implCtx);
+	curl_easy_setopt(implCtx->curl, CURLOPT_FILETIME, 1L);
+
 	curl_easy_setopt(implCtx->curl, CURLOPT_CONNECTTIMEOUT, http->connectionTimeoutSeconds);
 	curl_easy_setopt(implCtx->curl, CURLOPT_TIMEOUT, http->readTimeoutSeconds);
 
 	curl_easy_setopt(implCtx->curl, CURLOPT_URL, url);
 
 	handle->readResponse = curlReceive;
+	handle->poll = curlPoll;
 	handle->client = client;
 
 	res = KSI_RequestHandle_setImplContext(handle, implCtx, (void (*)(void *))CurlNetHandleCtx_free);
@@ -66,17 +66,16 @@ struct HttpAsyncCtx_st {
 	const CurlMulti *curl;
 
 	/* Output queue. */
-	KSI_LIST(KSI_AsyncHandle) *reqQueue;
+	KSI_AsyncQueue *reqQueue;
 	/* Input queue. */
-	KSI_LIST(KSI_OctetString) *respQueue;
+	KSI_AsyncQueue *respQueue;
 
 	/* HTTP header fields. */
 	char *userAgent;
 	struct curl_slist *httpHeaders;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing of the owner async client. */
+	KSI_AsyncPacer *pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -109,7 +108,10 @@ static void CurlAsyncRequest_free(CurlAsyncRequest *t) {
 	if (t == NULL) return;
 	if (t->ref == 0) goto cleanup;
 	if (--t->ref == 0) {
-		if (t->client == NULL || CurlAsyncRequestList_append(t->client->reqRecycle, t) != KSI_OK) goto cleanup;
+		/* Keep the handle for reuse, unless the pool is full. */
+		if (t->client == NULL || t->client->options == NULL ||
+				CurlAsyncRequestList_length(t->client->reqRecycle) >= t->client->options[KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE] ||
+				CurlAsyncRequestList_append(t->client->reqRecycle, t) != KSI_OK) goto cleanup;
 		return;
 	}
 cleanup:
@@ -203,6 +205,7 @@ static int CurlAsyncRequest_processResponse(CurlAsyncRequest *curlResponse) {
 						clientCtx, curlResponse);
 				handle->state = KSI_ASYNC_STATE_ERROR;
 				handle->err = KSI_NETWORK_ERROR;
+				KSI_AsyncHandle_notifyFinalized(handle);
 				break;
 			}
 			tlvSize = ftlv.hdr_len + ftlv.dat_len;
@@ -221,7 +224,7 @@ static int CurlAsyncRequest_processResponse(CurlAsyncRequest *curlResponse) {
 				goto cleanup;
 			}
 
-			res = KSI_OctetStringList_append(clientCtx->respQueue, resp);
+			res = KSI_AsyncQueue_push(clientCtx->respQueue, resp);
 			if (res != KSI_OK) {
 				KSI_LOG_error(clientCtx->ctx,
 						"[%p] Async Curl HTTP: unable to add new response to queue. Error: 0x%x.",
@@ -291,18 +294,12 @@ cleanup:
 	return totalCount;
 }
 
-static void reqQueue_clearWithError(KSI_AsyncHandleList *reqQueue, int err, long ext, const char *msg) {
-	size_t size = 0;
+static void reqQueue_clearWithError(KSI_AsyncQueue *reqQueue, int err, long ext, const char *msg) {
+	KSI_AsyncHandle *req = NULL;
 
 	if (reqQueue == NULL) return;
 
-	while ((size = KSI_AsyncHandleList_length(reqQueue)) > 0) {
-		int res;
-		KSI_AsyncHandle *req = NULL;
-
-		res = KSI_AsyncHandleList_remove(reqQueue, size - 1, &req);
-		if (res != KSI_OK || req == NULL) return;
-
+	while ((req = KSI_AsyncQueue_pop(reqQueue)) != NULL) {
 		/* Update request state. */
 		req->state = KSI_ASYNC_STATE_ERROR;
 		req->err = err;
@@ -313,6 +310,15 @@ static void reqQueue_clearWithError(KSI_AsyncHandleList *reqQueue, int err, long
 	}
 }
 
+static void CurlMulti_applyOptions(const CurlMulti *multi, const size_t *options) {
+#if LIBCURL_VERSION_NUM >= 0x071e00
+	curl_multi_setopt(multi->handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long)options[KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS]);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	curl_multi_setopt(multi->handle, CURLMOPT_PIPELINING, options[KSI_ASYNC_OPT_HTTP_MULTIPLEX] ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#endif
+}
+
 static int dispatch(HttpAsyncCtx *clientCtx) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_OctetString *resp = NULL;
@@ -334,24 +340,15 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 		goto cleanup;
 	}
 
+	/* The multi handle is shared, apply the connection options of the current client. */
+	if (KSI_AsyncQueue_length(clientCtx->reqQueue) > 0) {
+		CurlMulti_applyOptions(clientCtx->curl, clientCtx->options);
+	}
+
 	/* Handle output. */
 	/* Add all requests to the curl multi handle. */
-	while (KSI_AsyncHandleList_length(clientCtx->reqQueue) > 0 &&
-				KSI_AsyncHandleList_elementAt(clientCtx->reqQueue, 0, &req) == KSI_OK && req != NULL) {
-		time_t curTime = 0;
-
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "[%p] Async Curl HTTP: round request count: %u", clientCtx,
-					(unsigned)clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "[%p] Async Curl HTTP: round max request count reached.", clientCtx);
-			break;
-		}
+	while ((req = KSI_AsyncQueue_elementAt(clientCtx->reqQueue, 0)) != NULL) {
+		time_t curTime = time(NULL);
 
 		if (req->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
 			/* Verify that the send timeout has not elapsed. */
@@ -361,8 +358,14 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				req->state = KSI_ASYNC_STATE_ERROR;
 				req->err = KSI_NETWORK_SEND_TIMEOUT;
 				/* Just remove the request from the request queue. */
-				KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
+				KSI_AsyncHandle_free(KSI_AsyncQueue_pop(clientCtx->reqQueue));
 			} else {
+				/* Check if more requests can be sent within the given timeframe. */
+				if (KSI_AsyncPacer_available(clientCtx->pacer) == 0) {
+					KSI_LOG_debug(clientCtx->ctx, "[%p] Async Curl HTTP: max request rate reached.", clientCtx);
+					break;
+				}
+
 				KSI_LOG_logBlob(clientCtx->ctx, KSI_LOG_DEBUG,
 						"[%p] Async Curl HTTP: Preparing request", req->raw, req->len, clientCtx);
 
@@ -379,8 +382,22 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				curl_easy_setopt(curlRequest->easyHandle, CURLOPT_WRITEFUNCTION, curlCallback_receive);
 				curl_easy_setopt(curlRequest->easyHandle, CURLOPT_NOPROGRESS, 1);
 
-				/* Make connection get closed at once after use. */
-				curl_easy_setopt(curlRequest->easyHandle, CURLOPT_FORBID_REUSE, 1L);
+				if (clientCtx->options[KSI_ASYNC_OPT_HTTP_KEEP_ALIVE] || clientCtx->options[KSI_ASYNC_OPT_HTTP_MULTIPLEX]) {
+					/* Leave the connection open for the following requests. */
+					curl_easy_setopt(curlRequest->easyHandle, CURLOPT_FORBID_REUSE, 0L);
+					curl_easy_setopt(curlRequest->easyHandle, CURLOPT_TCP_KEEPALIVE, 1L);
+				} else {
+					/* Make connection get closed at once after use. */
+					curl_easy_setopt(curlRequest->easyHandle, CURLOPT_FORBID_REUSE, 1L);
+				}
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+				if (clientCtx->options[KSI_ASYNC_OPT_HTTP_MULTIPLEX]) {
+					/* Negotiate HTTP/2 for TLS connections and wait for a connection to multiplex on. */
+					curl_easy_setopt(curlRequest->easyHandle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+					curl_easy_setopt(curlRequest->easyHandle, CURLOPT_PIPEWAIT, 1L);
+				}
+#endif
 
 				/* Make sure cURL won't use signals. */
 				curl_easy_setopt(curlRequest->easyHandle, CURLOPT_NOSIGNAL, 1);
@@ -423,18 +440,18 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				}
 
 				curlRequest = NULL;
-				clientCtx->roundCount++;
+				KSI_AsyncPacer_consume(clientCtx->pacer, 1);
 
 				/* Update state. */
 				req->state = KSI_ASYNC_STATE_WAITING_FOR_RESPONSE;
 				/* Start receive timeout. */
 				req->sndTime = curTime;
 				/* The request has been successfully dispatched. Remove it from the request queue. */
-				KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
+				KSI_AsyncHandle_free(KSI_AsyncQueue_pop(clientCtx->reqQueue));
 			}
 		} else {
 			/* The state could have been changed in application layer. Just remove the request from the request queue. */
-			KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
+			KSI_AsyncHandle_free(KSI_AsyncQueue_pop(clientCtx->reqQueue));
 		}
 	}
 
@@ -474,6 +491,7 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				handle->err = KSI_NETWORK_ERROR;
 				handle->errExt = curlMsg->data.result;
 				if (len) KSI_Utf8String_new(clientCtx->ctx, curlResponse->errMsg, len + 1, &handle->errMsg);
+				KSI_AsyncHandle_notifyFinalized(handle);
 			} else {
 				long httpCode = 0;
 
@@ -491,6 +509,7 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 					handle->err = KSI_HTTP_ERROR;
 					handle->errExt = httpCode;
 					if (len) KSI_Utf8String_new(clientCtx->ctx, curlResponse->errMsg, len + 1, &handle->errMsg);
+					KSI_AsyncHandle_notifyFinalized(handle);
 				} else {
 					/* Process responses for all active clients. */
 					res = CurlAsyncRequest_processResponse(curlResponse);
@@ -522,6 +541,79 @@ cleanup:
 	return res;
 }
 
+static void addPollFd(KSI_AsyncPollFd *fds, size_t fds_size, size_t *count, int fd, int events) {
+	/* Count also the descriptors that do not fit, so the caller knows the required size. */
+	if (*count < fds_size) {
+		fds[*count].fd = fd;
+		fds[*count].events = events;
+	}
+	(*count)++;
+}
+
+static int getPollFds(HttpAsyncCtx *clientCtx, KSI_AsyncPollFd *fds, size_t fds_size, size_t *fds_count, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	fd_set fdRead;
+	fd_set fdWrite;
+	fd_set fdExcep;
+	int maxFd = -1;
+	int fd;
+	size_t count = 0;
+	long timeout = -1;
+	CURLMcode curlmCode;
+
+	if (clientCtx == NULL || fds_count == NULL || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+	KSI_ERR_clearErrors(clientCtx->ctx);
+
+	if (clientCtx->curl == NULL) {
+		KSI_pushError(clientCtx->ctx, res = KSI_INVALID_STATE, "Curl multi handle is not initialized.");
+		goto cleanup;
+	}
+
+	FD_ZERO(&fdRead);
+	FD_ZERO(&fdWrite);
+	FD_ZERO(&fdExcep);
+
+	curlmCode = curl_multi_fdset(clientCtx->curl->handle, &fdRead, &fdWrite, &fdExcep, &maxFd);
+	if (curlmCode == CURLM_OK) curlmCode = curl_multi_timeout(clientCtx->curl->handle, &timeout);
+	if (curlmCode != CURLM_OK) {
+		KSI_ERR_push(clientCtx->ctx, res = KSI_NETWORK_ERROR, curlmCode, __FILE__, __LINE__, curl_multi_strerror(curlmCode));
+		goto cleanup;
+	}
+
+	/* Note that the multi handle is shared, thus the sockets of all the clients of the context are returned. */
+#ifdef _WIN32
+	KSI_UNUSED(maxFd);
+	for (fd = 0; fd < (int)fdRead.fd_count; fd++) {
+		addPollFd(fds, fds_size, &count, (int)fdRead.fd_array[fd], KSI_ASYNC_POLL_IN);
+	}
+	for (fd = 0; fd < (int)fdWrite.fd_count; fd++) {
+		addPollFd(fds, fds_size, &count, (int)fdWrite.fd_array[fd], KSI_ASYNC_POLL_OUT);
+	}
+#else
+	for (fd = 0; fd <= maxFd; fd++) {
+		int events = ((FD_ISSET(fd, &fdRead) || FD_ISSET(fd, &fdExcep)) ? KSI_ASYNC_POLL_IN : 0) |
+				(FD_ISSET(fd, &fdWrite) ? KSI_ASYNC_POLL_OUT : 0);
+		if (events != 0) addPollFd(fds, fds_size, &count, fd, events);
+	}
+#endif
+
+	/* Requests are added to the multi handle during dispatch. */
+	if (KSI_AsyncQueue_length(clientCtx->reqQueue) > 0) {
+		/* Wait for the next request token. */
+		timeout = KSI_ASYNC_POLL_TIMEOUT_MIN(timeout, KSI_AsyncPacer_getDelay(clientCtx->pacer));
+	}
+
+	*fds_count = count;
+	*timeoutMs = timeout;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int addToSendQueue(HttpAsyncCtx *clientCtx, KSI_AsyncHandle *request) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -534,7 +626,7 @@ static int addToSendQueue(HttpAsyncCtx *clientCtx, KSI_AsyncHandle *request) {
 	/* Start send timeout. */
 	time(&request->reqTime);
 
-	res = KSI_AsyncHandleList_append(clientCtx->reqQueue, request);
+	res = KSI_AsyncQueue_push(clientCtx->reqQueue, request);
 	if (res != KSI_OK) goto cleanup;
 
 	res = KSI_OK;
@@ -551,14 +643,11 @@ static int getResponse(HttpAsyncCtx *clientCtx, KSI_OctetString **response, size
 		goto cleanup;
 	}
 
-	if (KSI_OctetStringList_length(clientCtx->respQueue)) {
-		/* Responses should be processed in the same order as received. */
-		res = KSI_OctetStringList_remove(clientCtx->respQueue, 0, &tmp);
-		if (res != KSI_OK) goto cleanup;
-	}
+	/* Responses should be processed in the same order as received. */
+	tmp = KSI_AsyncQueue_pop(clientCtx->respQueue);
 
 	*response = tmp;
-	*left = KSI_OctetStringList_length(clientCtx->respQueue);
+	*left = KSI_AsyncQueue_length(clientCtx->respQueue);
 
 	res = KSI_OK;
 cleanup:
@@ -660,8 +749,8 @@ static int CurlMulti_init(KSI_CTX *ctx, const CurlMulti **multi) {
 static void HttpAsyncCtx_free(HttpAsyncCtx *o) {
 	if (o != NULL) {
 		/* Cleanup queues. */
-		KSI_AsyncHandleList_free(o->reqQueue);
-		KSI_OctetStringList_free(o->respQueue);
+		KSI_AsyncQueue_free(o->reqQueue);
+		KSI_AsyncQueue_free(o->respQueue);
 
 		KSI_nofree(o->curl);
 		KSI_nofree(o->userAgent);
@@ -698,8 +787,7 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	tmp->options = NULL;
 	tmp->userAgent = NULL;
 	tmp->httpHeaders = NULL;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	tmp->pacer = NULL;
 
 	/* Queues. */
 	tmp->reqQueue = NULL;
@@ -723,10 +811,10 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	if (res != KSI_OK) goto cleanup;
 
 	/* Initialize io queues. */
-	res = KSI_AsyncHandleList_new(&tmp->reqQueue);
+	res = KSI_AsyncQueue_new((void (*)(void *))KSI_AsyncHandle_free, &tmp->reqQueue);
 	if (res != KSI_OK) goto cleanup;
 
-	res = KSI_OctetStringList_new(&tmp->respQueue);
+	res = KSI_AsyncQueue_new((void (*)(void *))KSI_OctetString_free, &tmp->respQueue);
 	if (res != KSI_OK) goto cleanup;
 
 	tmp->userAgent = "KSI HTTP Client";
@@ -765,11 +853,13 @@ int KSI_HttpAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 	tmp->getResponse = (int (*)(void *, KSI_OctetString **, size_t *))getResponse;
 	tmp->dispatch = (int (*)(void *))dispatch;
 	tmp->getCredentials = (int (*)(void *, const char **, const char **))getCredentials;
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))getPollFds;
 
 	res = HttpAsyncCtx_new(ctx, &netImpl);
 	if (res != KSI_OK) goto cleanup;
 
 	netImpl->options = tmp->options;
+	netImpl->pacer = &tmp->pacer;
 
 	tmp->clientImpl_free = (void (*)(void*))HttpAsyncCtx_free;
 	tmp->clientImpl = netImpl;
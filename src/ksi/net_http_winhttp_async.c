@@ -64,9 +64,8 @@ typedef struct {
 	LPWSTR userAgent;
 	LPWSTR mimeType;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing of the owner async client. */
+	KSI_AsyncPacer *pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -590,6 +589,7 @@ static int WinHTTP_handleResponse(HttpAsyncCtx *clientCtx) {
 			handle->state = KSI_ASYNC_STATE_ERROR;
 			handle->err = httpReq->status;
 			handle->errExt = httpReq->errExt;
+			KSI_AsyncHandle_notifyFinalized(handle);
 		} else {
 			size_t count = 0;
 
@@ -610,6 +610,7 @@ static int WinHTTP_handleResponse(HttpAsyncCtx *clientCtx) {
 							httpReq->raw, httpReq->len, clientCtx);
 					handle->state = KSI_ASYNC_STATE_ERROR;
 					handle->err = KSI_NETWORK_ERROR;
+					KSI_AsyncHandle_notifyFinalized(handle);
 					break;
 				}
 				tlvSize = ftlv.hdr_len + ftlv.dat_len;
@@ -681,19 +682,7 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 	/* Handle output. */
 	while (KSI_AsyncHandleList_length(clientCtx->reqQueue) > 0 &&
 				KSI_AsyncHandleList_elementAt(clientCtx->reqQueue, 0, &req) == KSI_OK && req != NULL) {
-		time_t curTime = 0;
-
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "[%p] Async WinHTTP round request count: %u.", clientCtx, clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinHTTP round max request count reached.", clientCtx);
-			break;
-		}
+		time_t curTime = time(NULL);
 
 		if (req->state == KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
 			/* Verify that the send timeout has not elapsed. */
@@ -705,6 +694,12 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 				/* Just remove the request from the request queue. */
 				KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
 			} else {
+				/* Check if more requests can be sent within the given timeframe. */
+				if (KSI_AsyncPacer_available(clientCtx->pacer) == 0) {
+					KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinHTTP max request rate reached.", clientCtx);
+					break;
+				}
+
 				KSI_LOG_logBlob(clientCtx->ctx, KSI_LOG_DEBUG, "[%p] Async WinHTTP: Preparing request",
 						req->raw, req->len, clientCtx);
 
@@ -729,7 +724,7 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 
 				/* The request has been successfully dispatched. Remove it from the request queue. */
 				KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
-				clientCtx->roundCount++;
+				KSI_AsyncPacer_consume(clientCtx->pacer, 1);
 			}
 		} else {
 			/* The state could have been changed in application layer. Just remove the request from the queue. */
@@ -918,8 +913,7 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	tmp->connectHandle = NULL;
 
 	tmp->options = NULL;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	tmp->pacer = NULL;
 
 	/* Queues. */
 	tmp->reqQueue = NULL;
@@ -987,6 +981,7 @@ int KSI_HttpAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 	if (res != KSI_OK) goto cleanup;
 
 	netImpl->options = tmp->options;
+	netImpl->pacer = &tmp->pacer;
 
 	tmp->clientImpl_free = (void (*)(void*))HttpAsyncCtx_free;
 	tmp->clientImpl = netImpl;
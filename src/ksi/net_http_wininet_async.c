@@ -69,9 +69,8 @@ typedef struct {
 	char *userAgent;
 	char *mimeType;
 
-	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
+	/* Request pacing of the owner async client. */
+	KSI_AsyncPacer *pacer;
 
 	/* Poiter to the async options. */
 	size_t *options;
@@ -633,6 +632,7 @@ static int WinINet_handleResponse(HttpAsyncCtx *clientCtx) {
 			handle->state = KSI_ASYNC_STATE_ERROR;
 			handle->err = httpReq->status;
 			handle->errExt = httpReq->errExt;
+			KSI_AsyncHandle_notifyFinalized(handle);
 		} else {
 			size_t count = 0;
 
@@ -654,6 +654,7 @@ static int WinINet_handleResponse(HttpAsyncCtx *clientCtx) {
 							clientCtx);
 					handle->state = KSI_ASYNC_STATE_ERROR;
 					handle->err = KSI_NETWORK_ERROR;
+					KSI_AsyncHandle_notifyFinalized(handle);
 					break;
 				}
 				tlvSize = ftlv.hdr_len + ftlv.dat_len;
@@ -750,15 +751,9 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 			continue;
 		}
 
-		/* Check if the request count can be restarted. */
-		if (difftime(curTime, clientCtx->roundStartAt) >= clientCtx->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(clientCtx->ctx, "[%p] Async WinINet: round request count: %u", clientCtx, clientCtx->roundCount);
-			clientCtx->roundCount = 0;
-			clientCtx->roundStartAt = curTime;
-		}
 		/* Check if more requests can be sent within the given timeframe. */
-		if (!(clientCtx->roundCount < clientCtx->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinINet: round max request count reached.", clientCtx);
+		if (KSI_AsyncPacer_available(clientCtx->pacer) == 0) {
+			KSI_LOG_debug(clientCtx->ctx, "[%p] Async WinINet: max request rate reached.", clientCtx);
 			break;
 		}
 
@@ -784,7 +779,7 @@ static int dispatch(HttpAsyncCtx *clientCtx) {
 
 		/* The request has been successfully dispatched. Remove it from the request queue. */
 		KSI_AsyncHandleList_remove(clientCtx->reqQueue, 0, NULL);
-		clientCtx->roundCount++;
+		KSI_AsyncPacer_consume(clientCtx->pacer, 1);
 	}
 
 	/* Handle input. */
@@ -953,8 +948,7 @@ static int HttpAsyncCtx_new(KSI_CTX *ctx, HttpAsyncCtx **clientCtx) {
 	tmp->connectHandle = NULL;
 
 	tmp->options = NULL;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
+	tmp->pacer = NULL;
 
 	/* Queues. */
 	tmp->reqQueue = NULL;
@@ -1022,6 +1016,7 @@ int KSI_HttpAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 	if (res != KSI_OK) goto cleanup;
 
 	netImpl->options = tmp->options;
+	netImpl->pacer = &tmp->pacer;
 
 	tmp->clientImpl_free = (void (*)(void*))HttpAsyncCtx_free;
 	tmp->clientImpl = netImpl;
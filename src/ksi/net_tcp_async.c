@@ -19,6 +19,10 @@
 
 #include <string.h>
 #include <sys/types.h>
+#include <limits.h>
+#ifndef _WIN32
+#  include <sys/uio.h>
+#endif
 
 #include "internal.h"
 #include "net_tcp.h"
@@ -34,21 +38,27 @@
 
 #define KSI_TLV_MAX_SIZE (0xffff + 4)
 
+/* Maximum number of requests written with a single system call. */
+#define KSI_TCP_SEND_BATCH_MAX 64
+#if defined(IOV_MAX) && IOV_MAX < KSI_TCP_SEND_BATCH_MAX
+#  undef KSI_TCP_SEND_BATCH_MAX
+#  define KSI_TCP_SEND_BATCH_MAX IOV_MAX
+#endif
+
 typedef struct TcpClientCtx_st {
 	KSI_CTX *ctx;
 	/* Socket descriptor. */
 	int sockfd;
 	/* Output queue. */
-	KSI_LIST(KSI_AsyncHandle) *reqQueue;
+	KSI_AsyncQueue *reqQueue;
 	/* Input queue. */
-	KSI_LIST(KSI_OctetString) *respQueue;
-	/* Input read buffer. */
+	KSI_AsyncQueue *respQueue;
+	/* Input read buffer. The unprocessed data starts at offset inStart and is inLen bytes long. */
 	unsigned char inBuf[KSI_TLV_MAX_SIZE * 2];
+	size_t inStart;
 	size_t inLen;
 
 	/* Round throttling. */
-	time_t roundStartAt;
-	size_t roundCount;
 
 	/* Connect timeout. */
 	time_t connectedAt;
@@ -95,6 +105,7 @@ static int openSocket(TcpAsyncCtx *tcpCtx, int *sockfd) {
 
 	for (pr = result; pr != NULL; pr = pr->ai_next) {
 		unsigned nbMode = 1;
+		int noDelay = 1;
 
 		if (pr->ai_protocol != IPPROTO_TCP) continue;
 
@@ -111,6 +122,13 @@ static int openSocket(TcpAsyncCtx *tcpCtx, int *sockfd) {
 			goto cleanup;
 		}
 
+		/* The requests are already coalesced by the dispatcher, do not delay the segments. */
+		res = setsockopt(tmpfd, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+		if (res == KSI_SCK_SOCKET_ERROR) {
+			KSI_ERR_push(tcpCtx->ctx, res = KSI_IO_ERROR, KSI_SCK_errno, __FILE__, __LINE__, "Async TCP unable to disable Nagle's algorithm.");
+			goto cleanup;
+		}
+
 #ifdef _WIN32
 		res = connect(tmpfd, pr->ai_addr, (int) pr->ai_addrlen);
 #else
@@ -165,22 +183,46 @@ static void closeSocket(TcpAsyncCtx *tcpCtx, unsigned int lineNr) {
 		if (tcpCtx->socketReady) connectionStateListener(tcpCtx, false);
 		tcpCtx->socketReady = false;
 		/* Clear input buffer. */
+		tcpCtx->inStart = 0;
 		tcpCtx->inLen = 0;
 	}
 }
 
-static void reqQueue_clearWithError(KSI_LIST(KSI_AsyncHandle) *reqQueue, int err, long ext, char *msg) {
-	size_t size = 0;
+#ifdef _WIN32
+typedef WSABUF TcpIoVec;
+#  define TcpIoVec_set(v, p, l) ((v).buf = (char *)(p), (v).len = (ULONG)(l))
+#else
+typedef struct iovec TcpIoVec;
+#  define TcpIoVec_set(v, p, l) ((v).iov_base = (void *)(p), (v).iov_len = (l))
+#endif
 
-	if (reqQueue == NULL) return;
+/* Writes the buffers with a single system call. Returns the number of bytes written or KSI_SCK_SOCKET_ERROR. */
+static int sendBatch(int sockfd, TcpIoVec *iov, size_t iovLen) {
+#ifdef _WIN32
+	DWORD c = 0;
 
-	while ((size = KSI_AsyncHandleList_length(reqQueue)) > 0) {
-		int res;
-		KSI_AsyncHandle *req = NULL;
+	if (WSASend(sockfd, iov, (DWORD)iovLen, &c, 0, NULL, NULL) == SOCKET_ERROR) return KSI_SCK_SOCKET_ERROR;
+	return (c > INT_MAX) ? INT_MAX : (int)c;
+#else
+	struct msghdr msg;
+	ssize_t c;
 
-		res = KSI_AsyncHandleList_remove(reqQueue, size - 1, &req);
-		if (res != KSI_OK || req == NULL) return;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovLen;
 
+	KSI_SCK_TEMP_FAILURE_RETRY(c, sendmsg(sockfd, &msg, 0));
+	if (c < 0) return KSI_SCK_SOCKET_ERROR;
+	return (c > INT_MAX) ? INT_MAX : (int)c;
+#endif
+}
+
+static void reqQueue_clearWithError(KSI_AsyncQueue *reqQueue, int err, long ext, char *msg) {
+	KSI_AsyncHandle *req = NULL;
+
+	if (reqQueue == NULL) return;
+
+	while ((req = KSI_AsyncQueue_pop(reqQueue)) != NULL) {
 		/* Update request state. */
 		req->state = KSI_ASYNC_STATE_ERROR;
 		req->err = err;
@@ -207,7 +249,7 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 	/* Check connection. */
 	if (tcpCtx->sockfd == KSI_INVALID_SOCKET) {
 		/* Only open connection if there is anything in request queue. */
-		if (KSI_AsyncHandleList_length(tcpCtx->reqQueue) == 0) {
+		if (KSI_AsyncQueue_length(tcpCtx->reqQueue) == 0) {
 			KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP: not ready, request queue is empty.", tcpCtx);
 			res = KSI_OK;
 			goto cleanup;
@@ -275,10 +317,16 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 	do {
 		if (pfd.revents & POLLIN) {
 			inputProcessed = false;
-			if ((tcpCtx->inLen + KSI_TLV_MAX_SIZE) <= sizeof(tcpCtx->inBuf)) {
+			/* Move the remainder of a partially received PDU to the beginning of the buffer only if a complete PDU would not fit after it. */
+			if (tcpCtx->inStart > 0 && (tcpCtx->inStart + tcpCtx->inLen + KSI_TLV_MAX_SIZE) > sizeof(tcpCtx->inBuf)) {
+				memmove(tcpCtx->inBuf, tcpCtx->inBuf + tcpCtx->inStart, tcpCtx->inLen);
+				tcpCtx->inStart = 0;
+			}
+			if ((tcpCtx->inStart + tcpCtx->inLen + KSI_TLV_MAX_SIZE) <= sizeof(tcpCtx->inBuf)) {
 				int c = 0;
-				/* Read data from socket. */
-				c = recv(tcpCtx->sockfd, (tcpCtx->inBuf + tcpCtx->inLen), KSI_TLV_MAX_SIZE, 0);
+				size_t tail = tcpCtx->inStart + tcpCtx->inLen;
+				/* Read as much data from socket as fits into the buffer. */
+				c = recv(tcpCtx->sockfd, (tcpCtx->inBuf + tail), (int)(sizeof(tcpCtx->inBuf) - tail), 0);
 				if (c == 0) {
 					/* Connection has been closed unexpectedly. */
 					KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP connection closed.", tcpCtx);
@@ -300,7 +348,7 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 					}
 				} else {
 					tcpCtx->inLen += c;
-					if (tcpCtx->inLen > sizeof(tcpCtx->inBuf)) {
+					if (tcpCtx->inStart + tcpCtx->inLen > sizeof(tcpCtx->inBuf)) {
 						KSI_pushError(tcpCtx->ctx, res = KSI_BUFFER_OVERFLOW, "Too much data read from socket.");
 						goto cleanup;
 					}
@@ -315,15 +363,16 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 		while (tcpCtx->inLen > 0) {
 			KSI_FTLV ftlv;
 			size_t count = 0;
+			unsigned char *pdu = tcpCtx->inBuf + tcpCtx->inStart;
 
 			/* Traverse through the input stream and verify that a complete TLV is present. */
 			memset(&ftlv, 0, sizeof(KSI_FTLV));
-			res = KSI_FTLV_memRead(tcpCtx->inBuf, tcpCtx->inLen, &ftlv);
+			res = KSI_FTLV_memRead(pdu, tcpCtx->inLen, &ftlv);
 			count = ftlv.hdr_len + ftlv.dat_len;
 			/* Verify if the input byte stream is long enought for extacting a PDU. */
 			if (count != 0 && tcpCtx->inLen >= count) {
 				if (res != KSI_OK) {
-					KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_ERROR, "[%p] Async TCP closing connection. Unable to extract TLV from input stream", tcpCtx->inBuf, tcpCtx->inLen, tcpCtx);
+					KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_ERROR, "[%p] Async TCP closing connection. Unable to extract TLV from input stream", pdu, tcpCtx->inLen, tcpCtx);
 					closeSocket(tcpCtx, __LINE__);
 					res = KSI_ASYNC_CONNECTION_CLOSED;
 					goto cleanup;
@@ -338,17 +387,17 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 				goto cleanup;
 			}
 
-			KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_DEBUG, "[%p] Async TCP received response", tcpCtx->inBuf, count, tcpCtx);
+			KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_DEBUG, "[%p] Async TCP received response", pdu, count, tcpCtx);
 
 			/* A complete PDU is in cache. Move it into the receive queue. */
-			res = KSI_OctetString_new(tcpCtx->ctx, tcpCtx->inBuf, count, &resp);
+			res = KSI_OctetString_new(tcpCtx->ctx, pdu, count, &resp);
 			if (res != KSI_OK) {
 				KSI_LOG_error(tcpCtx->ctx, "[%p] Async TCP unable to create new KSI_OctetString object. Error: 0x%x.", tcpCtx, res);
 				res = KSI_OK;
 				goto cleanup;
 			}
 
-			res = KSI_OctetStringList_append(tcpCtx->respQueue, resp);
+			res = KSI_AsyncQueue_push(tcpCtx->respQueue, resp);
 			if (res != KSI_OK) {
 				KSI_LOG_error(tcpCtx->ctx, "[%p] Async TCP unable to add new response to queue. Error: 0x%x.", tcpCtx, res);
 				res = KSI_OK;
@@ -356,9 +405,10 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 			}
 			resp = NULL;
 
-			/* The response has been successfully moved to the input queue. Remove the data from the input stream. */
+			/* The response has been successfully moved to the input queue. Skip the data in the input stream. */
+			tcpCtx->inStart += count;
 			tcpCtx->inLen -= count;
-			memmove(tcpCtx->inBuf, tcpCtx->inBuf + count, tcpCtx->inLen);
+			if (tcpCtx->inLen == 0) tcpCtx->inStart = 0;
 		}
 	} while (!inputProcessed);
 
@@ -368,72 +418,85 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 		res = KSI_OK;
 		goto cleanup;
 	}
-	while (KSI_AsyncHandleList_length(tcpCtx->reqQueue) > 0 &&
-			KSI_AsyncHandleList_elementAt(tcpCtx->reqQueue, 0, &req) == KSI_OK && req != NULL) {
-		time_t curTime = 0;
-
-		/* Check if the request count can be restarted. */
-		if (difftime(time(&curTime), tcpCtx->roundStartAt) >= tcpCtx->parent->options[KSI_ASYNC_PRIVOPT_ROUND_DURATION]) {
-			KSI_LOG_info(tcpCtx->ctx, "[%p] Async TCP round request count: %llu.", tcpCtx, (unsigned long long)tcpCtx->roundCount);
-			tcpCtx->roundCount = 0;
-			tcpCtx->roundStartAt = curTime;
-		}
-		/* Check if more requests can be sent within the given timeframe. */
-		if (!(tcpCtx->roundCount < tcpCtx->parent->options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT])) {
-			KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP round max request count reached.", tcpCtx);
-			break;
-		}
+	for (;;) {
+		KSI_AsyncHandle *batch[KSI_TCP_SEND_BATCH_MAX];
+		TcpIoVec iov[KSI_TCP_SEND_BATCH_MAX];
+		size_t batchLen = 0;
+		size_t i = 0;
+		time_t curTime = time(NULL);
+		/* Number of new requests that can be started without exceeding the request rate. A partially
+		 * sent request has already been charged, thus it is completed regardless of the rate. */
+		size_t allowed = KSI_AsyncPacer_available(&tcpCtx->parent->pacer);
+		size_t started = 0;
+		int c;
+
+		/* Collect the requests from the head of the queue into a single write. The requests are removed only from
+		 * the head of the queue, thus the collecting stops at a request that is not going to be sent. */
+		while (batchLen < KSI_TCP_SEND_BATCH_MAX && (req = KSI_AsyncQueue_elementAt(tcpCtx->reqQueue, i)) != NULL) {
+			/* Check if more requests can be sent within the given timeframe. */
+			if (req->sentCount == 0 && !(started < allowed)) {
+				KSI_LOG_debug(tcpCtx->ctx, "[%p] Async TCP max request rate reached.", tcpCtx);
+				break;
+			}
 
-		if (req->state != KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
-			/* The state could have been changed in application layer. Just remove the request from the request queue. */
-			KSI_AsyncHandleList_remove(tcpCtx->reqQueue, 0, NULL);
-			continue;
-		}
+			if (req->state != KSI_ASYNC_STATE_WAITING_FOR_DISPATCH) {
+				if (batchLen > 0) break;
+				/* The state could have been changed in application layer. Just remove the request from the request queue. */
+				KSI_AsyncHandle_free(KSI_AsyncQueue_pop(tcpCtx->reqQueue));
+				continue;
+			}
 
-		/* Verify that the send timeout has not elapsed. */
-		if (tcpCtx->parent->options[KSI_ASYNC_OPT_SND_TIMEOUT] == 0 ||
-			(difftime(curTime, req->reqTime) > tcpCtx->parent->options[KSI_ASYNC_OPT_SND_TIMEOUT])) {
-			/* Set error. */
-			req->state = KSI_ASYNC_STATE_ERROR;
-			req->err = KSI_NETWORK_SEND_TIMEOUT;
-			/* Just remove the request from the request queue. */
-			KSI_AsyncHandleList_remove(tcpCtx->reqQueue, 0, NULL);
-			continue;
-		}
+			/* Verify that the send timeout has not elapsed. A partially sent request has to be completed. */
+			if (req->sentCount == 0 && (tcpCtx->parent->options[KSI_ASYNC_OPT_SND_TIMEOUT] == 0 ||
+					(difftime(curTime, req->reqTime) > tcpCtx->parent->options[KSI_ASYNC_OPT_SND_TIMEOUT]))) {
+				if (batchLen > 0) break;
+				/* Set error. */
+				req->state = KSI_ASYNC_STATE_ERROR;
+				req->err = KSI_NETWORK_SEND_TIMEOUT;
+				/* Just remove the request from the request queue. */
+				KSI_AsyncHandle_free(KSI_AsyncQueue_pop(tcpCtx->reqQueue));
+				continue;
+			}
 
-		KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_DEBUG, "[%p] Async TCP: sending request.", req->raw, req->len, tcpCtx);
+			KSI_LOG_logBlob(tcpCtx->ctx, KSI_LOG_DEBUG, "[%p] Async TCP: sending request.", req->raw, req->len, tcpCtx);
 
-		while (req->sentCount < req->len) {
-			int c;
-#ifdef _WIN32
-			if (req->len - req->sentCount > INT_MAX) {
-				c = send(tcpCtx->sockfd, (char *) req->raw + req->sentCount, (int) (INT_MAX), 0);
+			TcpIoVec_set(iov[batchLen], req->raw + req->sentCount, req->len - req->sentCount);
+			batch[batchLen++] = req;
+			if (req->sentCount == 0) started++;
+			i++;
+		}
+		if (batchLen == 0) break;
+
+		c = sendBatch(tcpCtx->sockfd, iov, batchLen);
+		if (c == KSI_SCK_SOCKET_ERROR) {
+			if (KSI_SCK_errno == KSI_SCK_EWOULDBLOCK || KSI_SCK_errno == KSI_SCK_EAGAIN) {
+				KSI_LOG_info(tcpCtx->ctx, "[%p] Async TCP send would block. Error: %d (%s).", tcpCtx,
+						KSI_SCK_errno, KSI_SCK_strerror(KSI_SCK_errno));
+				break;
 			} else {
-				c = send(tcpCtx->sockfd, (char *) req->raw + req->sentCount, (int) (req->len - req->sentCount), 0);
-			}
-#else
-			c = send(tcpCtx->sockfd, (char *) req->raw + req->sentCount, req->len - req->sentCount, 0);
-#endif
-			if (c == KSI_SCK_SOCKET_ERROR) {
-				if (KSI_SCK_errno == KSI_SCK_EWOULDBLOCK || KSI_SCK_errno == KSI_SCK_EAGAIN) {
-					KSI_LOG_info(tcpCtx->ctx,
-							"[%p] Async TCP send would block. Bytes sent so far %d/%d. Error: %d (%s).", tcpCtx,
-							(unsigned)req->sentCount, (unsigned)req->len, KSI_SCK_errno, KSI_SCK_strerror(KSI_SCK_errno));
-					goto cleanup;
-				} else {
-					KSI_LOG_error(tcpCtx->ctx,
-							"[%p] Async TCP closing connection. Unable to write to socket. Error: %d (%s).", tcpCtx,
-							KSI_SCK_errno, KSI_SCK_strerror(KSI_SCK_errno));
-					closeSocket(tcpCtx, __LINE__);
-					res = KSI_ASYNC_CONNECTION_CLOSED;
-					goto cleanup;
-				}
+				KSI_LOG_error(tcpCtx->ctx,
+						"[%p] Async TCP closing connection. Unable to write to socket. Error: %d (%s).", tcpCtx,
+						KSI_SCK_errno, KSI_SCK_strerror(KSI_SCK_errno));
+				closeSocket(tcpCtx, __LINE__);
+				res = KSI_ASYNC_CONNECTION_CLOSED;
+				goto cleanup;
 			}
-			req->sentCount += c;
 		}
 
-		if (req->sentCount == req->len) {
-			tcpCtx->roundCount++;
+		/* Distribute the written bytes over the batch. The batched requests are at the head of the queue. */
+		for (i = 0; i < batchLen && c > 0; i++) {
+			size_t remaining;
+
+			req = batch[i];
+			/* The request is charged when its first bytes are written. */
+			if (req->sentCount == 0) KSI_AsyncPacer_consume(&tcpCtx->parent->pacer, 1);
+
+			remaining = req->len - req->sentCount;
+			if ((size_t)c < remaining) {
+				req->sentCount += c;
+				break;
+			}
+			c -= (int)remaining;
 
 			/* Release the serialized payload. */
 			KSI_free(req->raw);
@@ -446,8 +509,11 @@ static int dispatch(TcpAsyncCtx *tcpCtx) {
 			/* Start receive timeout. */
 			req->sndTime = curTime;
 			/* The request has been successfully dispatched. Remove it from the request queue. */
-			KSI_AsyncHandleList_remove(tcpCtx->reqQueue, 0, NULL);
+			KSI_AsyncHandle_free(KSI_AsyncQueue_pop(tcpCtx->reqQueue));
 		}
+
+		/* The socket buffer is full, continue on the next dispatch. */
+		if (i < batchLen) break;
 	}
 
 	res = KSI_OK;
@@ -456,6 +522,59 @@ cleanup:
 	return res;
 }
 
+static int getPollFds(TcpAsyncCtx *tcpCtx, KSI_AsyncPollFd *fds, size_t fds_size, size_t *fds_count, long *timeoutMs) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t count = 0;
+	long timeout = -1;
+	bool hasOutput;
+
+	if (tcpCtx == NULL || fds_count == NULL || timeoutMs == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	hasOutput = (KSI_AsyncQueue_length(tcpCtx->reqQueue) > 0);
+
+	if (tcpCtx->sockfd == KSI_INVALID_SOCKET) {
+		/* The connection is opened during dispatch. */
+		if (hasOutput) timeout = 0;
+	} else {
+		int events = 0;
+
+		if (!tcpCtx->socketReady) {
+			/* The socket becomes writable when the connection has been established. */
+			events = KSI_ASYNC_POLL_OUT;
+		} else {
+			events = KSI_ASYNC_POLL_IN;
+			if (hasOutput) {
+				KSI_AsyncHandle *head = KSI_AsyncQueue_elementAt(tcpCtx->reqQueue, 0);
+				/* A partially sent request is completed without waiting for a token. */
+				long delay = (head->sentCount > 0) ? 0 : KSI_AsyncPacer_getDelay(&tcpCtx->parent->pacer);
+
+				if (delay == 0) {
+					events |= KSI_ASYNC_POLL_OUT;
+				} else {
+					/* Wait for the next request token. */
+					timeout = delay;
+				}
+			}
+		}
+
+		if (count < fds_size) {
+			fds[count].fd = tcpCtx->sockfd;
+			fds[count].events = events;
+		}
+		count++;
+	}
+
+	*fds_count = count;
+	*timeoutMs = timeout;
+
+	res = KSI_OK;
+cleanup:
+	return res;
+}
+
 static int addToSendQueue(TcpAsyncCtx *tcpCtx, KSI_AsyncHandle *request) {
 	int res = KSI_UNKNOWN_ERROR;
 
@@ -464,7 +583,7 @@ static int addToSendQueue(TcpAsyncCtx *tcpCtx, KSI_AsyncHandle *request) {
 		goto cleanup;
 	}
 
-	res = KSI_AsyncHandleList_append(tcpCtx->reqQueue, request);
+	res = KSI_AsyncQueue_push(tcpCtx->reqQueue, request);
 	if (res != KSI_OK) goto cleanup;
 
 	request->state = KSI_ASYNC_STATE_WAITING_FOR_DISPATCH;
@@ -485,14 +604,11 @@ static int getResponse(TcpAsyncCtx *tcpCtx, KSI_OctetString **response, size_t *
 		goto cleanup;
 	}
 
-	if (KSI_OctetStringList_length(tcpCtx->respQueue)) {
-		/* Responses should be processed in the same order as received. */
-		res = KSI_OctetStringList_remove(tcpCtx->respQueue, 0, &tmp);
-		if (res != KSI_OK) goto cleanup;
-	}
+	/* Responses should be processed in the same order as received. */
+	tmp = KSI_AsyncQueue_pop(tcpCtx->respQueue);
 
 	*response = tmp;
-	*left = KSI_OctetStringList_length(tcpCtx->respQueue);
+	*left = KSI_AsyncQueue_length(tcpCtx->respQueue);
 
 	res = KSI_OK;
 cleanup:
@@ -536,8 +652,8 @@ static int getCredentials(TcpAsyncCtx *tcpCtx, const char **user, const char **p
 
 static void TcpAsyncCtx_free(TcpAsyncCtx *t) {
 	if (t != NULL) {
-		KSI_AsyncHandleList_free(t->reqQueue);
-		KSI_OctetStringList_free(t->respQueue);
+		KSI_AsyncQueue_free(t->reqQueue);
+		KSI_AsyncQueue_free(t->respQueue);
 
 		if (t->sockfd != KSI_INVALID_SOCKET) close(t->sockfd);
 
@@ -569,6 +685,7 @@ static int TcpAsyncCtx_new(KSI_CTX *ctx, TcpAsyncCtx **tcpCtx) {
 	tmp->reqQueue = NULL;
 	tmp->respQueue = NULL;
 
+	tmp->inStart = 0;
 	tmp->inLen = 0;
 
 	tmp->ksi_user = NULL;
@@ -578,15 +695,13 @@ static int TcpAsyncCtx_new(KSI_CTX *ctx, TcpAsyncCtx **tcpCtx) {
 
 	tmp->socketReady = false;
 	tmp->connectedAt = 0;
-	tmp->roundStartAt = 0;
-	tmp->roundCount = 0;
 
 	tmp->parent = NULL;
 
 	/* Initialize io queues. */
-	res = KSI_AsyncHandleList_new(&tmp->reqQueue);
+	res = KSI_AsyncQueue_new((void (*)(void *))KSI_AsyncHandle_free, &tmp->reqQueue);
 	if (res != KSI_OK) goto cleanup;
-	res = KSI_OctetStringList_new(&tmp->respQueue);
+	res = KSI_AsyncQueue_new((void (*)(void *))KSI_OctetString_free, &tmp->respQueue);
 	if (res != KSI_OK) goto cleanup;
 
 	*tcpCtx = tmp;
@@ -615,7 +730,7 @@ int KSI_TcpAsyncClient_new(KSI_CTX *ctx, KSI_AsyncClient **c) {
 	tmp->getResponse = (int (*)(void *, KSI_OctetString **, size_t *))getResponse;
 	tmp->dispatch = (int (*)(void *))dispatch;
 	tmp->getCredentials = (int (*)(void *, const char **, const char **))getCredentials;
-
+	tmp->getPollFds = (int (*)(void *, KSI_AsyncPollFd *, size_t, size_t *, long *))getPollFds;
 
 	res = TcpAsyncCtx_new(ctx, &netImpl);
 	if (res != KSI_OK) goto cleanup;
@@ -23,6 +23,7 @@
 #include "net_tcp.h"
 #include "net_http.h"
 #include "net_file.h"
+#include "calendar_mirror.h"
 #include "http_parser.h"
 
 #include "internal.h"
@@ -40,7 +41,7 @@ static int prepareExtendRequest(KSI_NetworkClient *client, KSI_ExtendReq *req, K
 	}
 	uriClient = client->impl;
 
-	res = KSI_NetworkClient_sendExtendRequest(uriClient->pExtendClient, req, handle);
+	res = KSI_NetworkClient_sendExtendRequest(uriClient->mirrorClient != NULL ? uriClient->mirrorClient : uriClient->pExtendClient, req, handle);
 	if (res != KSI_OK) goto cleanup;
 
 	res = KSI_OK;
@@ -91,6 +92,7 @@ static void uriClient_free(KSI_UriClient *client) {
 		KSI_NetworkClient_free(client->httpClient);
 		KSI_NetworkClient_free(client->tcpClient);
 		KSI_NetworkClient_free(client->fsClient);
+		KSI_NetworkClient_free(client->mirrorClient);
 		KSI_free(client);
 	}
 }
@@ -125,6 +127,7 @@ int KSI_UriClient_new(KSI_CTX *ctx, KSI_NetworkClient **client) {
 	u->pAggregationClient = NULL;
 	u->pExtendClient = NULL;
 	u->pPublicationClient = NULL;
+	u->mirrorClient = NULL;
 
 	res = KSI_HttpClient_new(ctx, &u->httpClient);
 	if (res != KSI_OK) {
@@ -380,6 +383,33 @@ int KSI_UriClient_setAggregator(KSI_NetworkClient *client, const char *uri, cons
 			&((KSI_UriClient*)(client->impl))->pAggregationClient);
 }
 
+int KSI_UriClient_setCalendarMirror(KSI_NetworkClient *client, KSI_CalendarMirror *mirror) {
+	int res;
+	KSI_UriClient *uri = NULL;
+	KSI_NetworkClient *mirrorClient = NULL;
+
+	if (client == NULL || client->impl == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	uri = client->impl;
+
+	if (mirror != NULL) {
+		res = KSI_CalendarMirrorClient_new(client->ctx, mirror, &mirrorClient);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	KSI_NetworkClient_free(uri->mirrorClient);
+	uri->mirrorClient = mirrorClient;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_UriClient_setConnectionTimeoutSeconds(KSI_NetworkClient *client, int timeout) {
 	int res;
 	KSI_UriClient *uri = NULL;
@@ -49,6 +49,17 @@ extern "C" {
 	int KSI_UriClient_setExtender(KSI_NetworkClient *client, const char *uri, const char *loginId, const char *key);
 	int KSI_UriClient_setAggregator(KSI_NetworkClient *client, const char *uri, const char *loginId, const char *key);
 
+	/**
+	 * Setter for the calendar mirror. When set, the extending requests are answered by the mirror
+	 * instead of the extender.
+	 * \param[in]	client		Pointer to the uri client.
+	 * \param[in]	mirror		Calendar mirror, \c NULL to send the extending requests to the extender again.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note On success the client takes ownership of \c mirror.
+	 * \see #KSI_CalendarMirrorClient_new
+	 */
+	int KSI_UriClient_setCalendarMirror(KSI_NetworkClient *client, KSI_CalendarMirror *mirror);
+
 	int KSI_UriClient_setTransferTimeoutSeconds(KSI_NetworkClient *client, int timeout);
 	int KSI_UriClient_setConnectionTimeoutSeconds(KSI_NetworkClient *client, int timeout);
 
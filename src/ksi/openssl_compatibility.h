@@ -35,10 +35,24 @@ extern "C" {
 	#  define KSI_EVP_MD_CTX_create() EVP_MD_CTX_create()
 	#  define KSI_EVP_MD_CTX_destroy(md) EVP_MD_CTX_destroy((md))
 	#  define KSI_EVP_MD_CTX_cleanup(md) EVP_MD_CTX_cleanup((md))
+	#  define KSI_X509_STORE_up_ref(store) (CRYPTO_add(&(store)->references, 1, CRYPTO_LOCK_X509_STORE) > 1)
+	#  define KSI_X509_STORE_get0_objects(store) ((store)->objs)
+	#  define KSI_X509_STORE_lock(store) CRYPTO_w_lock(CRYPTO_LOCK_X509_STORE)
+	#  define KSI_X509_STORE_unlock(store) CRYPTO_w_unlock(CRYPTO_LOCK_X509_STORE)
+	#  define KSI_X509_OBJECT_get_type(obj) ((obj)->type)
+	#  define KSI_X509_OBJECT_get0_X509(obj) ((obj)->data.x509)
+	#  define KSI_X509_OBJECT_get0_X509_CRL(obj) ((obj)->data.crl)
 	#else
 	#  define KSI_EVP_MD_CTX_create() EVP_MD_CTX_new()
 	#  define KSI_EVP_MD_CTX_destroy(md) EVP_MD_CTX_free((md))
 	#  define KSI_EVP_MD_CTX_cleanup(md) EVP_MD_CTX_reset((md))
+	#  define KSI_X509_STORE_up_ref(store) X509_STORE_up_ref((store))
+	#  define KSI_X509_STORE_get0_objects(store) X509_STORE_get0_objects((store))
+	#  define KSI_X509_STORE_lock(store) X509_STORE_lock((store))
+	#  define KSI_X509_STORE_unlock(store) X509_STORE_unlock((store))
+	#  define KSI_X509_OBJECT_get_type(obj) X509_OBJECT_get_type((obj))
+	#  define KSI_X509_OBJECT_get0_X509(obj) X509_OBJECT_get0_X509((obj))
+	#  define KSI_X509_OBJECT_get0_X509_CRL(obj) X509_OBJECT_get0_X509_CRL((obj))
 	#endif
 
 
@@ -18,10 +18,14 @@
  */
 
 #include <string.h>
+#include <time.h>
 #include "internal.h"
 #include "pkitruststore.h"
 #include "tlv.h"
 
+#include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
+
 
 int KSI_PKISignature_fromTlv(KSI_TLV *tlv, KSI_PKISignature **sig) {
 	int res;
@@ -212,3 +216,331 @@ cleanup:
 
 KSI_IMPLEMENT_LIST(KSI_PKICertificate, KSI_PKICertificate_free);
 
+
+int KSI_PKIVerificationCache_new(KSI_CTX *ctx, KSI_PKIVerificationCache **cache) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PKIVerificationCache *tmp = NULL;
+
+	if (ctx == NULL || cache == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_PKIVerificationCache);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->count = 0;
+	tmp->next = 0;
+	memset(&tmp->stats, 0, sizeof(tmp->stats));
+
+	*cache = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PKIVerificationCache_free(tmp);
+
+	return res;
+}
+
+void KSI_PKIVerificationCache_free(KSI_PKIVerificationCache *cache) {
+	KSI_free(cache);
+}
+
+void KSI_PKIVerificationCache_clear(KSI_PKIVerificationCache *cache) {
+	if (cache != NULL) {
+		cache->count = 0;
+		cache->next = 0;
+	}
+}
+
+static time_t pki_verificationCache_currentBucket(const KSI_PKIVerificationCache *cache, KSI_PKIVerificationCacheType type) {
+	size_t ttl = cache->ctx->options[KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS];
+
+	/* Signature verification does not depend on the current time. */
+	if (type == KSI_PKI_CACHE_SIGNATURE || ttl == 0) return 0;
+
+	return time(NULL) / (time_t)ttl;
+}
+
+static int pki_verificationCache_isEnabled(const KSI_PKIVerificationCache *cache) {
+	return cache != NULL && cache->ctx->options[KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS] > 0;
+}
+
+int KSI_PKIVerificationCache_find(KSI_PKIVerificationCache *cache, KSI_PKIVerificationCacheType type, const KSI_DataHash *key, int *found) {
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	time_t bucket;
+	size_t i;
+
+	if (key == NULL || found == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	*found = 0;
+
+	if (!pki_verificationCache_isEnabled(cache)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_getImprint(key, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	bucket = pki_verificationCache_currentBucket(cache, type);
+
+	for (i = 0; i < cache->count; i++) {
+		const KSI_PKIVerificationCacheEntry *entry = &cache->entries[i];
+
+		if (entry->type == type && entry->bucket == bucket && entry->key_len == imprint_len && !memcmp(entry->key, imprint, imprint_len)) {
+			*found = 1;
+			break;
+		}
+	}
+
+	if (type == KSI_PKI_CACHE_SIGNATURE) {
+		if (*found) cache->stats.signatureHits++;
+		else cache->stats.signatureMisses++;
+	} else {
+		if (*found) cache->stats.certificateHits++;
+		else cache->stats.certificateMisses++;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_PKIVerificationCache_add(KSI_PKIVerificationCache *cache, KSI_PKIVerificationCacheType type, const KSI_DataHash *key) {
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	KSI_PKIVerificationCacheEntry *entry = NULL;
+
+	if (key == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (!pki_verificationCache_isEnabled(cache)) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_getImprint(key, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (imprint_len > sizeof(entry->key)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Overwrite the oldest entry when the cache is full. */
+	entry = &cache->entries[cache->next];
+	entry->type = type;
+	entry->bucket = pki_verificationCache_currentBucket(cache, type);
+	memcpy(entry->key, imprint, imprint_len);
+	entry->key_len = imprint_len;
+
+	cache->next = (cache->next + 1) % KSI_PKI_VERIFICATION_CACHE_SIZE;
+	if (cache->count < KSI_PKI_VERIFICATION_CACHE_SIZE) cache->count++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int pki_verificationCache_addCertificate(KSI_DataHasher *hsr, const KSI_PKICertificate *cert) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	res = KSI_PKICertificate_serialize(cert, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, raw, raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+
+	return res;
+}
+
+static int pki_verificationCache_addConstraints(KSI_DataHasher *hsr, const KSI_CertConstraint *certConstraints) {
+	int res = KSI_UNKNOWN_ERROR;
+	const char *val = NULL;
+	size_t i;
+
+	/* The strings are added with the terminating zero to keep the key unambiguous. */
+	for (i = 0; certConstraints != NULL && certConstraints[i].oid != NULL; i++) {
+		res = KSI_DataHasher_add(hsr, certConstraints[i].oid, strlen(certConstraints[i].oid) + 1);
+		if (res != KSI_OK) goto cleanup;
+
+		val = certConstraints[i].val != NULL ? certConstraints[i].val : "";
+		res = KSI_DataHasher_add(hsr, val, strlen(val) + 1);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_PKIVerificationCache_signatureKey(KSI_CTX *ctx, const char *algoOid, const unsigned char *signature, size_t signature_len,
+		const unsigned char *data, size_t data_len, const KSI_PKICertificate *cert, KSI_DataHash **key) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+	unsigned char buf[8];
+	size_t i;
+
+	if (ctx == NULL || signature == NULL || data == NULL || key == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Length prefix the variable length fields to keep the key unambiguous. */
+	for (i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)((KSI_uint64_t)signature_len >> (8 * i));
+	res = KSI_DataHasher_add(hsr, buf, sizeof(buf));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, signature, signature_len);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)((KSI_uint64_t)data_len >> (8 * i));
+	res = KSI_DataHasher_add(hsr, buf, sizeof(buf));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, data, data_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (algoOid != NULL) {
+		res = KSI_DataHasher_add(hsr, algoOid, strlen(algoOid) + 1);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (cert != NULL) {
+		res = pki_verificationCache_addCertificate(hsr, cert);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_DataHasher_close(hsr, key);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+int KSI_PKIVerificationCache_certificateKey(KSI_CTX *ctx, const KSI_PKICertificate *cert, const KSI_CertConstraint *certConstraints, KSI_DataHash **key) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+
+	if (ctx == NULL || cert == NULL || key == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = pki_verificationCache_addCertificate(hsr, cert);
+	if (res != KSI_OK) goto cleanup;
+
+	res = pki_verificationCache_addConstraints(hsr, certConstraints);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(hsr, key);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+int KSI_PKIVerificationCache_configurationKey(KSI_CTX *ctx, const KSI_PKITruststore *trust, const KSI_CertConstraint *certConstraints, KSI_DataHash **key) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+	/* Separates the truststore contents from the constraints. */
+	static const unsigned char separator[] = { 0xff };
+
+	if (ctx == NULL || trust == NULL || key == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PKITruststore_fingerprint(trust, hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, separator, sizeof(separator));
+	if (res != KSI_OK) goto cleanup;
+
+	res = pki_verificationCache_addConstraints(hsr, certConstraints);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(hsr, key);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+int KSI_PKITruststore_getCacheStats(KSI_CTX *ctx, KSI_PKIVerificationCacheStats *stats) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (ctx == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (stats == NULL || ctx->pkiVerificationCache == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	*stats = ctx->pkiVerificationCache->stats;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
@@ -213,6 +213,15 @@ extern "C" {
 	 */
 	int KSI_PKICertificate_getValidityNotAfter(const KSI_PKICertificate *cert, KSI_uint64_t *time);
 
+	/**
+	 * Returns the hit and miss counters of the PKI verification result cache of the context.
+	 * \param[in]	ctx			KSI context.
+	 * \param[out]	stats		Pointer to the receiving counters.
+	 * \return status code (\c #KSI_OK, when operation succeeded, otherwise an error code).
+	 * \see #KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS
+	 */
+	int KSI_PKITruststore_getCacheStats(KSI_CTX *ctx, KSI_PKIVerificationCacheStats *stats);
+
 /**
  * @}
  */
@@ -31,6 +31,7 @@
 #include "crc32.h"
 
 #include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
 
 const char* getMSError(DWORD error, char *buf, size_t len){
 	LPVOID lpMsgBuf = NULL;
@@ -118,6 +119,59 @@ void KSI_PKITruststore_free(KSI_PKITruststore *trust) {
 	}
 }
 
+int KSI_PKITruststore_share(KSI_CTX *ctx, const KSI_PKITruststore *trust, KSI_PKITruststore **out) {
+	int res;
+	KSI_PKITruststore *tmp = NULL;
+
+	if (trust == NULL || out == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_PKITruststore);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->collectionStore = CertDuplicateStore(trust->collectionStore);
+
+	*out = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PKITruststore_free(tmp);
+
+	return res;
+}
+
+int KSI_PKITruststore_fingerprint(const KSI_PKITruststore *trust, KSI_DataHasher *hsr) {
+	int res = KSI_UNKNOWN_ERROR;
+	PCCERT_CONTEXT cert = NULL;
+
+	if (trust == NULL || hsr == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	while ((cert = CertEnumCertificatesInStore(trust->collectionStore, cert)) != NULL) {
+		res = KSI_DataHasher_add(hsr, cert->pbCertEncoded, cert->cbCertEncoded);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (cert != NULL) CertFreeCertificateContext(cert);
+
+	return res;
+}
+
 /* TODO: Not supported. */
 int KSI_PKITruststore_addLookupDir(const KSI_PKITruststore *trust, const char *path) {
 	KSI_LOG_debug(trust->ctx, "CryptoAPI: Not implemented.");
@@ -1093,28 +1147,108 @@ cleanup:
 
 int KSI_PKITruststore_verifyPKISignature(const KSI_PKITruststore *pki, const unsigned char *data, size_t data_len, const KSI_PKISignature *signature, KSI_CertConstraint *certConstraints) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_PKIVerificationCache *cache = NULL;
+	KSI_PKICertificate *cert = NULL;
+	KSI_DataHash *sigKey = NULL;
+	KSI_DataHash *certKey = NULL;
+	int sigFound = 0;
+	int certFound = 0;
 
 	if (pki == NULL || pki->ctx == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	res = pki_truststore_verifySignature(pki, data, data_len, signature);
-	if (res != KSI_OK) {
-		KSI_pushError(pki->ctx, res, "Publications file not trusted.");
+	KSI_ERR_clearErrors(pki->ctx);
+
+	if (data == NULL || signature == NULL) {
+		KSI_pushError(pki->ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = pki_truststore_verifyCertificateConstraints(pki, signature, certConstraints);
-	if (res != KSI_OK) {
-		KSI_pushError(pki->ctx, res, "PKI certificates not trusted.");
-		goto cleanup;
+	/* If publications file does not have certificate constraints configured, use context based constraints. */
+	if (certConstraints == NULL) {
+		certConstraints = pki->ctx->certConstraints;
+	}
+
+	/* The results are cached only for the truststore of the context. */
+	if (pki == pki->ctx->pkiTruststore) {
+		cache = pki->ctx->pkiVerificationCache;
+	}
+
+	if (cache != NULL) {
+		res = KSI_PKIVerificationCache_signatureKey(pki->ctx, NULL, signature->pkcs7.pbData, signature->pkcs7.cbData, data, data_len, NULL, &sigKey);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(cache, KSI_PKI_CACHE_SIGNATURE, sigKey, &sigFound);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKISignature_extractCertificate(signature, &cert);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_certificateKey(pki->ctx, cert, certConstraints, &certKey);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(cache, KSI_PKI_CACHE_CERTIFICATE, certKey, &certFound);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* CryptoAPI verifies the signature and the certificate chain in a single step. */
+	if (!sigFound || !certFound) {
+		res = pki_truststore_verifySignature(pki, data, data_len, signature);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, "Publications file not trusted.");
+			goto cleanup;
+		}
+
+		if (cache != NULL && !sigFound) {
+			res = KSI_PKIVerificationCache_add(cache, KSI_PKI_CACHE_SIGNATURE, sigKey);
+			if (res != KSI_OK) {
+				KSI_pushError(pki->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+	}
+
+	if (!certFound) {
+		res = pki_truststore_verifyCertificateConstraints(pki, signature, certConstraints);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, "PKI certificates not trusted.");
+			goto cleanup;
+		}
+
+		if (cache != NULL) {
+			res = KSI_PKIVerificationCache_add(cache, KSI_PKI_CACHE_CERTIFICATE, certKey);
+			if (res != KSI_OK) {
+				KSI_pushError(pki->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
 	}
 
 	res = KSI_OK;
 
 cleanup:
 
+	KSI_PKICertificate_free(cert);
+	KSI_DataHash_free(sigKey);
+	KSI_DataHash_free(certKey);
+
 	return res;
 }
 
@@ -1122,7 +1256,7 @@ int KSI_PKITruststore_verifySignature(KSI_PKITruststore *pki, const unsigned cha
 	return KSI_PKITruststore_verifyPKISignature(pki, data, data_len, signature, NULL);
 }
 
-int KSI_PKITruststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
+static int pki_truststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
 	int res = KSI_UNKNOWN_ERROR;
 	ALG_ID algorithm = 0;
 	HCRYPTPROV hCryptProv = 0;
@@ -1230,6 +1364,61 @@ cleanup:
 	return res;
 }
 
+int KSI_PKITruststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *key = NULL;
+	int found = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || data == NULL || signature == NULL || algoOid == NULL || certificate == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->pkiVerificationCache != NULL) {
+		res = KSI_PKIVerificationCache_signatureKey(ctx, algoOid, signature, signature_len, data, data_len, certificate, &key);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(ctx->pkiVerificationCache, KSI_PKI_CACHE_SIGNATURE, key, &found);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (found) {
+		KSI_LOG_debug(ctx, "PKI signature verification result found in cache.");
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = pki_truststore_verifyRawSignature(ctx, data, data_len, algoOid, signature, signature_len, certificate);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->pkiVerificationCache != NULL) {
+		res = KSI_PKIVerificationCache_add(ctx->pkiVerificationCache, KSI_PKI_CACHE_SIGNATURE, key);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(key);
+
+	return res;
+}
+
 /**
  * OID description array must have the following format:
  * [OID][short name][long name][alias 1][..][alias N][NULL]
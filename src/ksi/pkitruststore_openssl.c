@@ -35,6 +35,7 @@
 #include "openssl_compatibility.h"
 
 #include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
 
 static const char *defaultCaFile =
 #ifdef OPENSSL_CA_FILE
@@ -114,6 +115,97 @@ void KSI_PKITruststore_free(KSI_PKITruststore *trust) {
 	}
 }
 
+int KSI_PKITruststore_share(KSI_CTX *ctx, const KSI_PKITruststore *trust, KSI_PKITruststore **out) {
+	int res;
+	KSI_PKITruststore *tmp = NULL;
+
+	if (trust == NULL || out == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_PKITruststore);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->store = NULL;
+
+	if (!KSI_X509_STORE_up_ref(trust->store)) {
+		KSI_pushError(ctx, res = KSI_CRYPTO_FAILURE, "Unable to reference the PKI truststore.");
+		goto cleanup;
+	}
+	tmp->store = trust->store;
+
+	*out = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PKITruststore_free(tmp);
+
+	return res;
+}
+
+int KSI_PKITruststore_fingerprint(const KSI_PKITruststore *trust, KSI_DataHasher *hsr) {
+	int res = KSI_UNKNOWN_ERROR;
+	STACK_OF(X509_OBJECT) *objs = NULL;
+	X509_OBJECT *obj = NULL;
+	unsigned char *der = NULL;
+	int der_len;
+	int locked = 0;
+	int i;
+
+	if (trust == NULL || hsr == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_X509_STORE_lock(trust->store);
+	locked = 1;
+
+	/* The objects are kept sorted by the store, so the order does not depend on the order of loading. */
+	objs = KSI_X509_STORE_get0_objects(trust->store);
+	for (i = 0; objs != NULL && i < sk_X509_OBJECT_num(objs); i++) {
+		obj = sk_X509_OBJECT_value(objs, i);
+
+		switch (KSI_X509_OBJECT_get_type(obj)) {
+			case X509_LU_X509:
+				der_len = i2d_X509(KSI_X509_OBJECT_get0_X509(obj), &der);
+				break;
+			case X509_LU_CRL:
+				der_len = i2d_X509_CRL(KSI_X509_OBJECT_get0_X509_CRL(obj), &der);
+				break;
+			default:
+				continue;
+		}
+
+		if (der_len < 0) {
+			res = KSI_CRYPTO_FAILURE;
+			goto cleanup;
+		}
+
+		res = KSI_DataHasher_add(hsr, der, (size_t)der_len);
+		if (res != KSI_OK) goto cleanup;
+
+		OPENSSL_free(der);
+		der = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (locked) KSI_X509_STORE_unlock(trust->store);
+	OPENSSL_free(der);
+
+	return res;
+}
+
 int KSI_PKITruststore_addLookupFile(const KSI_PKITruststore *trust, const char *path) {
 	int res;
 	X509_LOOKUP *lookup = NULL;
@@ -917,12 +1009,6 @@ static int pki_truststore_verifySignature(const KSI_PKITruststore *pki, const un
 
 	KSI_LOG_debug(pki->ctx, "Signature verified.");
 
-	res = KSI_PKITruststore_verifySignatureCertificate(pki, signature);
-	if (res != KSI_OK) {
-		KSI_pushError(pki->ctx, res, NULL);
-		goto cleanup;
-	}
-
 	res = KSI_OK;
 
 cleanup:
@@ -934,28 +1020,128 @@ cleanup:
 
 int KSI_PKITruststore_verifyPKISignature(const KSI_PKITruststore *pki, const unsigned char *data, size_t data_len, const KSI_PKISignature *signature, KSI_CertConstraint *certConstraints) {
 	int res = KSI_UNKNOWN_ERROR;
+	KSI_PKIVerificationCache *cache = NULL;
+	KSI_PKICertificate *cert = NULL;
+	KSI_DataHash *sigKey = NULL;
+	KSI_DataHash *certKey = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	int found = 0;
 
 	if (pki == NULL || pki->ctx == NULL) {
 		res = KSI_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	res = pki_truststore_verifySignature(pki, data, data_len, signature);
-	if (res != KSI_OK) {
-		KSI_pushError(pki->ctx, res, "Publications file not trusted.");
+	KSI_ERR_clearErrors(pki->ctx);
+
+	if (data == NULL || signature == NULL) {
+		KSI_pushError(pki->ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = pki_truststore_verifyCertificateConstraints(pki, signature, certConstraints);
-	if (res != KSI_OK) {
-		KSI_pushError(pki->ctx, res, "PKI certificates not trusted.");
-		goto cleanup;
+	/* The results are cached only for the truststore of the context. */
+	if (pki == pki->ctx->pkiTruststore) {
+		cache = pki->ctx->pkiVerificationCache;
+	}
+
+	if (cache != NULL) {
+		res = KSI_PKISignature_serialize(signature, &raw, &raw_len);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_signatureKey(pki->ctx, NULL, raw, raw_len, data, data_len, NULL, &sigKey);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(cache, KSI_PKI_CACHE_SIGNATURE, sigKey, &found);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (found) {
+		KSI_LOG_debug(pki->ctx, "PKI signature verification result found in cache.");
+	} else {
+		res = pki_truststore_verifySignature(pki, data, data_len, signature);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, "Publications file not trusted.");
+			goto cleanup;
+		}
+
+		if (cache != NULL) {
+			res = KSI_PKIVerificationCache_add(cache, KSI_PKI_CACHE_SIGNATURE, sigKey);
+			if (res != KSI_OK) {
+				KSI_pushError(pki->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+	}
+
+	/* If publications file does not have certificate constraints configured, use context based constraints. */
+	if (certConstraints == NULL) {
+		certConstraints = pki->ctx->certConstraints;
+	}
+
+	found = 0;
+	if (cache != NULL) {
+		res = KSI_PKISignature_extractCertificate(signature, &cert);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_certificateKey(pki->ctx, cert, certConstraints, &certKey);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(cache, KSI_PKI_CACHE_CERTIFICATE, certKey, &found);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (found) {
+		KSI_LOG_debug(pki->ctx, "PKI certificate verification result found in cache.");
+	} else {
+		res = KSI_PKITruststore_verifySignatureCertificate(pki, signature);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, "Publications file not trusted.");
+			goto cleanup;
+		}
+
+		res = pki_truststore_verifyCertificateConstraints(pki, signature, certConstraints);
+		if (res != KSI_OK) {
+			KSI_pushError(pki->ctx, res, "PKI certificates not trusted.");
+			goto cleanup;
+		}
+
+		if (cache != NULL) {
+			res = KSI_PKIVerificationCache_add(cache, KSI_PKI_CACHE_CERTIFICATE, certKey);
+			if (res != KSI_OK) {
+				KSI_pushError(pki->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
 	}
 
 	res = KSI_OK;
 
 cleanup:
 
+	KSI_PKICertificate_free(cert);
+	KSI_DataHash_free(sigKey);
+	KSI_DataHash_free(certKey);
+	KSI_free(raw);
+
 	return res;
 }
 
@@ -1020,7 +1206,7 @@ cleanup:
 	return res;
 }
 
-int KSI_PKITruststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
+static int pki_truststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
 	int res;
 	ASN1_OBJECT* algorithm = NULL;
 	EVP_MD_CTX *md_ctx = NULL;
@@ -1111,6 +1297,61 @@ cleanup:
 	return res;
 }
 
+int KSI_PKITruststore_verifyRawSignature(KSI_CTX *ctx, const unsigned char *data, size_t data_len, const char *algoOid, const unsigned char *signature, size_t signature_len, const KSI_PKICertificate *certificate) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *key = NULL;
+	int found = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || data == NULL || signature == NULL || algoOid == NULL || certificate == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->pkiVerificationCache != NULL) {
+		res = KSI_PKIVerificationCache_signatureKey(ctx, algoOid, signature, signature_len, data, data_len, certificate, &key);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_PKIVerificationCache_find(ctx->pkiVerificationCache, KSI_PKI_CACHE_SIGNATURE, key, &found);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (found) {
+		KSI_LOG_debug(ctx, "PKI signature verification result found in cache.");
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = pki_truststore_verifyRawSignature(ctx, data, data_len, algoOid, signature, signature_len, certificate);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->pkiVerificationCache != NULL) {
+		res = KSI_PKIVerificationCache_add(ctx->pkiVerificationCache, KSI_PKI_CACHE_SIGNATURE, key);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(key);
+
+	return res;
+}
+
 /**
  * OID description array must have the following format:
  * [OID][short name][long name][alias 1][..][alias N][NULL]
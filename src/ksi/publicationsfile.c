@@ -33,10 +33,22 @@
 #include "internal.h"
 
 #include "impl/ctx_impl.h"
+#include "impl/list_impl.h"
+#include "impl/pkitruststore_impl.h"
 #include "impl/publicationsfile_impl.h"
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#  include <sys/mman.h>
+#  define PUBFILE_USE_MMAP
+#endif
+
 #define PUB_FILE_HEADER_ID "KSIPUBLF"
 
+#define PUB_FILE_SNAPSHOT_ID "KSIPFSNP"
+#define PUB_FILE_SNAPSHOT_VERSION 2
+/* Header, version and verification time, followed by the keys and the record index. */
+#define PUB_FILE_SNAPSHOT_HDR_LEN (8 + 1 + 8)
+
 KSI_IMPORT_TLV_TEMPLATE(KSI_PublicationsHeader);
 KSI_IMPORT_TLV_TEMPLATE(KSI_CertificateRecord);
 KSI_IMPORT_TLV_TEMPLATE(KSI_PublicationRecord);
@@ -65,300 +77,2037 @@ struct generator_st {
 
 KSI_IMPLEMENT_REF(KSI_PublicationsFile);
 
-static int generateNextTlv(struct generator_st *gen, KSI_TLV **tlv) {
-	int res = KSI_UNKNOWN_ERROR;
-	unsigned char *buf = NULL;
-	size_t consumed = 0;
-	KSI_FTLV ftlv;
+static void publicationsFile_freeIndex(KSI_PublicationsFile *pubFile) {
+	/* A shared index is owned by the file it was borrowed from. */
+	if (!pubFile->isIndexShared) {
+		KSI_free(pubFile->timeIndex);
+		KSI_free(pubFile->certIndex);
+	}
 
-	if (gen == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
+	pubFile->timeIndex = NULL;
+	pubFile->timeIndex_len = 0;
+	pubFile->timeIndexRevision = 0;
+
+	pubFile->certIndex = NULL;
+	pubFile->certIndex_size = 0;
+	pubFile->certIndex_count = 0;
+	pubFile->certIndexRevision = 0;
+}
+
+static void publicationsFile_freeLazyRecords(KSI_PublicationsFile *pubFile) {
+	size_t i;
+
+	if (pubFile->lazyPubCache != NULL) {
+		for (i = 0; i < pubFile->lazyPubRecs_len; i++) {
+			KSI_PublicationRecord_free(pubFile->lazyPubCache[i]);
+		}
+		KSI_free(pubFile->lazyPubCache);
+		pubFile->lazyPubCache = NULL;
 	}
 
+	if (pubFile->lazyCertCache != NULL) {
+		for (i = 0; i < pubFile->lazyCertRecs_len; i++) {
+			KSI_CertificateRecord_free(pubFile->lazyCertCache[i]);
+		}
+		KSI_free(pubFile->lazyCertCache);
+		pubFile->lazyCertCache = NULL;
+	}
 
-	if (gen->tlv != NULL) {
-		KSI_TLV_free(gen->tlv);
-		gen->tlv = NULL;
+	if (pubFile->isIndexShared) {
+		/* Drop the borrowed indexes along with the record locations. */
+		publicationsFile_freeIndex(pubFile);
+		pubFile->isIndexShared = false;
+	} else {
+		KSI_free(pubFile->lazyPubRecs);
+		KSI_free(pubFile->lazyCertRecs);
 	}
 
-	/* Try to parse only when there is something left to parse. */
-	if (gen->len > 0) {
-		memset(&ftlv, 0, sizeof(ftlv));
-		res = KSI_FTLV_memRead(gen->ptr, gen->len, &ftlv);
-		if (res != KSI_OK) {
-			KSI_pushError(gen->ctx, res, NULL);
+	pubFile->lazyPubRecs = NULL;
+	pubFile->lazyPubRecs_len = 0;
+	pubFile->lazyCertRecs = NULL;
+	pubFile->lazyCertRecs_len = 0;
+
+	pubFile->isLazy = false;
+}
+
+/* Insertion sort is stable and linear, as the records are usually in chronological order. */
+static void publicationsFile_timeIndexInsert(KSI_PublicationsFileTimeIndexEntry *index, size_t len, const KSI_PublicationsFileTimeIndexEntry *entry) {
+	size_t j;
+
+	for (j = len; j > 0 && index[j - 1].time > entry->time; j--) {
+		index[j] = index[j - 1];
+	}
+	index[j] = *entry;
+}
+
+static int publicationsFile_buildTimeIndex(KSI_PublicationsFile *pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFileTimeIndexEntry *tmp = NULL;
+	size_t len;
+	size_t i;
+
+	len = KSI_PublicationRecordList_length(pubFile->publications);
+	if (len > 0) {
+		tmp = KSI_calloc(len, sizeof(KSI_PublicationsFileTimeIndexEntry));
+		if (tmp == NULL) {
+			KSI_pushError(pubFile->ctx, res = KSI_OUT_OF_MEMORY, NULL);
 			goto cleanup;
 		}
+	}
 
-		consumed = ftlv.hdr_len + ftlv.dat_len;
+	for (i = 0; i < len; i++) {
+		KSI_PublicationRecord *pr = NULL;
+		KSI_PublicationsFileTimeIndexEntry entry;
 
-		buf = KSI_malloc(consumed);
-		if (buf == NULL) {
-			KSI_pushError(gen->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		res = KSI_PublicationRecordList_elementAt(pubFile->publications, i, &pr);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		memcpy(buf, gen->ptr, consumed);
+		/* Leave malformed records to the linear lookups, which report the errors. */
+		if (pr == NULL || pr->publishedData == NULL || pr->publishedData->time == NULL) {
+			res = KSI_OK;
+			goto cleanup;
+		}
 
-		gen->ptr += consumed;
-		gen->len -= consumed;
+		entry.time = KSI_Integer_getUInt64(pr->publishedData->time);
+		entry.pos = i;
+		entry.pubRec = pr;
 
-		/* Make sure the buffer is not overflowing. */
-		if (consumed > UINT_MAX){
-			KSI_pushError(gen->ctx, res = KSI_INVALID_FORMAT, "Input too large.");
+		publicationsFile_timeIndexInsert(tmp, i, &entry);
+	}
+
+	pubFile->timeIndex = tmp;
+	pubFile->timeIndex_len = len;
+	pubFile->timeIndexRevision = KSI_List_getRevision((KSI_List *)pubFile->publications);
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmp);
+
+	return res;
+}
+
+static size_t publicationsFile_certIndexBucket(const unsigned char *id, size_t id_len, size_t size) {
+	return (size_t)KSI_crc32(id, id_len, 0) & (size - 1);
+}
+
+static int publicationsFile_newCertIndex(KSI_PublicationsFile *pubFile, size_t count, KSI_PublicationsFileCertIndexEntry **index, size_t *size) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t tmp = 4;
+
+	/* Keep the load factor at or below one half. */
+	while (tmp < 2 * count) tmp <<= 1;
+
+	*index = KSI_calloc(tmp, sizeof(KSI_PublicationsFileCertIndexEntry));
+	if (*index == NULL) {
+		KSI_pushError(pubFile->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	*size = tmp;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static void publicationsFile_certIndexInsert(KSI_PublicationsFileCertIndexEntry *index, size_t size, const unsigned char *id, size_t id_len, size_t pos, KSI_PKICertificate *cert) {
+	size_t bucket = publicationsFile_certIndexBucket(id, id_len, size);
+
+	while (index[bucket].id != NULL) {
+		/* In case of duplicate IDs the first record wins. */
+		if (index[bucket].id_len == id_len && !memcmp(index[bucket].id, id, id_len)) return;
+		bucket = (bucket + 1) & (size - 1);
+	}
+
+	index[bucket].id = id;
+	index[bucket].id_len = id_len;
+	index[bucket].pos = pos;
+	index[bucket].cert = cert;
+}
+
+static int publicationsFile_buildCertIndex(KSI_PublicationsFile *pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFileCertIndexEntry *tmp = NULL;
+	size_t size = 0;
+	size_t count;
+	size_t i;
+
+	count = KSI_CertificateRecordList_length(pubFile->certificates);
+
+	res = publicationsFile_newCertIndex(pubFile, count, &tmp, &size);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < count; i++) {
+		KSI_CertificateRecord *certRec = NULL;
+		KSI_OctetString *certId = NULL;
+		KSI_PKICertificate *cert = NULL;
+		const unsigned char *id = NULL;
+		size_t id_len = 0;
+
+		res = KSI_CertificateRecordList_elementAt(pubFile->certificates, i, &certRec);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		if (consumed > 0) {
-			if (gen->hasSignature) {
-				/* The signature must be the last element. */
-				KSI_pushError(gen->ctx, res = KSI_INVALID_FORMAT, "The signature must be the last element.");
-				goto cleanup;
-			}
+		res = KSI_CertificateRecord_getCertId(certRec, &certId);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
 
-			res = KSI_TLV_parseBlob2(gen->ctx, buf, (unsigned)consumed, 1, &gen->tlv);
-			if (res != KSI_OK) {
-				KSI_pushError(gen->ctx, res, NULL);
-				goto cleanup;
-			}
+		/* Records without an ID can not be found by ID. */
+		if (certId == NULL) continue;
 
-			buf = NULL;
+		res = KSI_CertificateRecord_getCert(certRec, &cert);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
 
-			if (KSI_TLV_getTag(gen->tlv) == 0x0704) {
-				gen->sig_offset = gen->offset;
-				gen->hasSignature = true;
-			}
+		res = KSI_OctetString_extract(certId, &id, &id_len);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		/* An empty ID would be indistinguishable from an empty bucket. */
+		if (id == NULL) {
+			res = KSI_OK;
+			goto cleanup;
 		}
 
+		publicationsFile_certIndexInsert(tmp, size, id, id_len, i, cert);
 	}
 
-	gen->offset += consumed;
-	*tlv = gen->tlv;
+	pubFile->certIndex = tmp;
+	pubFile->certIndex_size = size;
+	pubFile->certIndex_count = count;
+	pubFile->certIndexRevision = KSI_List_getRevision((KSI_List *)pubFile->certificates);
+	tmp = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_free(buf);
+	KSI_free(tmp);
 
 	return res;
 }
 
-/*
- * FIXME! At the moment the users may not create publications files, as there are
- * missing functions to manipulate its contents.
- */
-int KSI_PublicationsFile_new(KSI_CTX *ctx, KSI_PublicationsFile **t) {
+static int publicationsFile_buildIndex(KSI_PublicationsFile *pubFile) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_PublicationsFile *tmp = NULL;
-	tmp = KSI_new(KSI_PublicationsFile);
-	if (tmp == NULL) {
-		res = KSI_OUT_OF_MEMORY;
-		goto cleanup;
-	}
 
-	tmp->ctx = ctx;
-	tmp->ref = 1;
-	tmp->raw = NULL;
-	tmp->raw_len = 0;
-	tmp->header = NULL;
-	tmp->certificates = NULL;
-	tmp->publications = NULL;
-	tmp->signature = NULL;
-	tmp->certConstraints = NULL;
-	*t = tmp;
-	tmp = NULL;
+	publicationsFile_freeIndex(pubFile);
+
+	res = publicationsFile_buildTimeIndex(pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFile_buildCertIndex(pubFile);
+	if (res != KSI_OK) goto cleanup;
+
 	res = KSI_OK;
+
 cleanup:
-	KSI_PublicationsFile_free(tmp);
+
 	return res;
 }
 
-int KSI_PublicationsFile_parse(KSI_CTX *ctx, const void *raw, size_t raw_len, KSI_PublicationsFile **pubFile) {
-	int res;
-	KSI_PublicationsFile *tmp = NULL;
-	struct generator_st gen = {ctx, raw, raw_len, NULL, 0, 0, false};
-	unsigned char *tmpRaw = NULL;
-	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+/* The index is not used if the lists have been replaced or modified after it was built. */
+static bool publicationsFile_hasTimeIndex(const KSI_PublicationsFile *pubFile) {
+	/* Records of a lazily loaded file are reachable only through the index. */
+	if (pubFile->isLazy) return true;
 
-	KSI_ERR_clearErrors(ctx);
+	return pubFile->timeIndexRevision != 0 &&
+			pubFile->timeIndexRevision == KSI_List_getRevision((KSI_List *)pubFile->publications);
+}
 
-	if (ctx == NULL || raw == NULL || raw_len == 0 || pubFile == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
+static bool publicationsFile_hasCertIndex(const KSI_PublicationsFile *pubFile) {
+	if (pubFile->isLazy) return true;
+
+	return pubFile->certIndex != NULL && pubFile->certIndexRevision != 0 &&
+			pubFile->certIndexRevision == KSI_List_getRevision((KSI_List *)pubFile->certificates);
+}
+
+/* Returns the position of the first entry with time not less than the given time. */
+static size_t publicationsFile_timeIndexLowerBound(const KSI_PublicationsFile *pubFile, KSI_uint64_t time) {
+	size_t lo = 0;
+	size_t hi = pubFile->timeIndex_len;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (pubFile->timeIndex[mid].time < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
 	}
 
-	/* Check the header. */
-	if (gen.len < hdrLen || memcmp(gen.ptr, PUB_FILE_HEADER_ID, hdrLen)) {
-		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
-		goto cleanup;
+	return lo;
+}
+
+/* Returns the position of the first entry with time greater than the given time. */
+static size_t publicationsFile_timeIndexUpperBound(const KSI_PublicationsFile *pubFile, KSI_uint64_t time) {
+	size_t lo = 0;
+	size_t hi = pubFile->timeIndex_len;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (pubFile->timeIndex[mid].time <= time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
 	}
 
-	/* Header verification ok - create the store object. */
-	res = KSI_PublicationsFile_new(ctx, &tmp);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
+	return lo;
+}
+
+static int publicationsFile_materializePublication(KSI_PublicationsFile *pubFile, size_t pos, KSI_PublicationRecord **pubRec) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFileLazyPubRec *lazy = &pubFile->lazyPubRecs[pos];
+	KSI_PublicationRecord *tmp = NULL;
+
+	if (pubFile->lazyPubCache == NULL) {
+		pubFile->lazyPubCache = KSI_calloc(pubFile->lazyPubRecs_len, sizeof(KSI_PublicationRecord *));
+		if (pubFile->lazyPubCache == NULL) {
+			KSI_pushError(pubFile->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
 	}
 
-	tmp->signedDataLength = hdrLen;
+	if (pubFile->lazyPubCache[pos] == NULL) {
+		res = KSI_PublicationRecord_new(pubFile->ctx, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
 
-	/* Initialize generator. */
-	gen.ptr += hdrLen;
-	gen.len -= hdrLen;
+		res = KSI_TlvTemplate_parse(pubFile->ctx, pubFile->raw + lazy->offset, lazy->len, KSI_TLV_TEMPLATE(KSI_PublicationRecord), tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, "Unable to parse publication record.");
+			goto cleanup;
+		}
+
+		pubFile->lazyPubCache[pos] = tmp;
+		tmp = NULL;
+	}
+
+	*pubRec = pubFile->lazyPubCache[pos];
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationRecord_free(tmp);
+
+	return res;
+}
+
+static int publicationsFile_materializeCertificate(KSI_PublicationsFile *pubFile, size_t pos, KSI_CertificateRecord **certRec) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFileLazyCertRec *lazy = &pubFile->lazyCertRecs[pos];
+	KSI_CertificateRecord *tmp = NULL;
+
+	if (pubFile->lazyCertCache == NULL) {
+		pubFile->lazyCertCache = KSI_calloc(pubFile->lazyCertRecs_len, sizeof(KSI_CertificateRecord *));
+		if (pubFile->lazyCertCache == NULL) {
+			KSI_pushError(pubFile->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (pubFile->lazyCertCache[pos] == NULL) {
+		res = KSI_CertificateRecord_new(pubFile->ctx, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_TlvTemplate_parse(pubFile->ctx, pubFile->raw + lazy->offset, lazy->len, KSI_TLV_TEMPLATE(KSI_CertificateRecord), tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, "Unable to parse certificate record.");
+			goto cleanup;
+		}
+
+		pubFile->lazyCertCache[pos] = tmp;
+		tmp = NULL;
+	}
+
+	*certRec = pubFile->lazyCertCache[pos];
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CertificateRecord_free(tmp);
+
+	return res;
+}
+
+/* Compares the imprint of a lazily loaded publication record without parsing the record. */
+static int publicationsFile_lazyImprintEquals(const KSI_PublicationsFile *pubFile, size_t pos, const KSI_DataHash *hash, int *equals) {
+	int res = KSI_UNKNOWN_ERROR;
+	const KSI_PublicationsFileLazyPubRec *lazy = &pubFile->lazyPubRecs[pos];
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	res = KSI_DataHash_getImprint(hash, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	*equals = imprint_len == lazy->imprint_len && !memcmp(pubFile->raw + lazy->imprintOffset, imprint, imprint_len);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/* Returns the publication record of the given time index entry, materializing it in lazy mode. */
+static int publicationsFile_timeIndexRecord(const KSI_PublicationsFile *pubFile, size_t i, KSI_PublicationRecord **pubRec) {
+	int res = KSI_UNKNOWN_ERROR;
+	const KSI_PublicationsFileTimeIndexEntry *entry = &pubFile->timeIndex[i];
+
+	if (pubFile->isLazy) {
+		/* The lookup functions take a const object, the lazily created records are a cache. */
+		res = publicationsFile_materializePublication((KSI_PublicationsFile *)pubFile, entry->pos, pubRec);
+		if (res != KSI_OK) goto cleanup;
+	} else {
+		*pubRec = entry->pubRec;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/* Returns the certificate of the given certificate index bucket, materializing it in lazy mode. */
+static int publicationsFile_certIndexCertificate(const KSI_PublicationsFile *pubFile, size_t bucket, KSI_PKICertificate **cert) {
+	int res = KSI_UNKNOWN_ERROR;
+	const KSI_PublicationsFileCertIndexEntry *entry = &pubFile->certIndex[bucket];
+	KSI_CertificateRecord *certRec = NULL;
+
+	if (pubFile->isLazy) {
+		res = publicationsFile_materializeCertificate((KSI_PublicationsFile *)pubFile, entry->pos, &certRec);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_CertificateRecord_getCert(certRec, cert);
+		if (res != KSI_OK) goto cleanup;
+	} else {
+		*cert = entry->cert;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/* Materializes all the records of a lazily loaded file into the regular lists. */
+static int publicationsFile_materializeLists(KSI_PublicationsFile *pubFile) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_PublicationRecord) *pubList = NULL;
+	KSI_LIST(KSI_CertificateRecord) *certList = NULL;
+	size_t i;
+
+	if (!pubFile->isLazy) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(pubFile->ctx, "Materializing all records of the lazily loaded publications file.");
+
+	res = KSI_PublicationRecordList_new(&pubList);
+	if (res != KSI_OK) {
+		KSI_pushError(pubFile->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_CertificateRecordList_new(&certList);
+	if (res != KSI_OK) {
+		KSI_pushError(pubFile->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < pubFile->lazyPubRecs_len; i++) {
+		KSI_PublicationRecord *pubRec = NULL;
+
+		res = publicationsFile_materializePublication(pubFile, i, &pubRec);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_PublicationRecordList_append(pubList, pubRec);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
+		/* The list has taken over the ownership. */
+		pubFile->lazyPubCache[i] = NULL;
+	}
+
+	for (i = 0; i < pubFile->lazyCertRecs_len; i++) {
+		KSI_CertificateRecord *certRec = NULL;
+
+		res = publicationsFile_materializeCertificate(pubFile, i, &certRec);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_CertificateRecordList_append(certList, certRec);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
+		pubFile->lazyCertCache[i] = NULL;
+	}
+
+	KSI_PublicationRecordList_free(pubFile->publications);
+	pubFile->publications = pubList;
+	pubList = NULL;
+
+	KSI_CertificateRecordList_free(pubFile->certificates);
+	pubFile->certificates = certList;
+	certList = NULL;
+
+	publicationsFile_freeLazyRecords(pubFile);
+
+	res = publicationsFile_buildIndex(pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationRecordList_free(pubList);
+	KSI_CertificateRecordList_free(certList);
+
+	return res;
+}
+
+static int generateNextTlv(struct generator_st *gen, KSI_TLV **tlv) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *buf = NULL;
+	size_t consumed = 0;
+	KSI_FTLV ftlv;
+
+	if (gen == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+
+	if (gen->tlv != NULL) {
+		KSI_TLV_free(gen->tlv);
+		gen->tlv = NULL;
+	}
+
+	/* Try to parse only when there is something left to parse. */
+	if (gen->len > 0) {
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(gen->ptr, gen->len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(gen->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		consumed = ftlv.hdr_len + ftlv.dat_len;
+
+		buf = KSI_malloc(consumed);
+		if (buf == NULL) {
+			KSI_pushError(gen->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		memcpy(buf, gen->ptr, consumed);
+
+		gen->ptr += consumed;
+		gen->len -= consumed;
+
+		/* Make sure the buffer is not overflowing. */
+		if (consumed > UINT_MAX){
+			KSI_pushError(gen->ctx, res = KSI_INVALID_FORMAT, "Input too large.");
+			goto cleanup;
+		}
+
+		if (consumed > 0) {
+			if (gen->hasSignature) {
+				/* The signature must be the last element. */
+				KSI_pushError(gen->ctx, res = KSI_INVALID_FORMAT, "The signature must be the last element.");
+				goto cleanup;
+			}
+
+			res = KSI_TLV_parseBlob2(gen->ctx, buf, (unsigned)consumed, 1, &gen->tlv);
+			if (res != KSI_OK) {
+				KSI_pushError(gen->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			buf = NULL;
+
+			if (KSI_TLV_getTag(gen->tlv) == 0x0704) {
+				gen->sig_offset = gen->offset;
+				gen->hasSignature = true;
+			}
+		}
+
+	}
+
+	gen->offset += consumed;
+	*tlv = gen->tlv;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(buf);
+
+	return res;
+}
+
+/*
+ * FIXME! At the moment the users may not create publications files, as there are
+ * missing functions to manipulate its contents.
+ */
+int KSI_PublicationsFile_new(KSI_CTX *ctx, KSI_PublicationsFile **t) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFile *tmp = NULL;
+	tmp = KSI_new(KSI_PublicationsFile);
+	if (tmp == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->ref = 1;
+	tmp->raw = NULL;
+	tmp->raw_len = 0;
+	tmp->header = NULL;
+	tmp->certificates = NULL;
+	tmp->publications = NULL;
+	tmp->signature = NULL;
+	tmp->certConstraints = NULL;
+	tmp->timeIndex = NULL;
+	tmp->timeIndex_len = 0;
+	tmp->timeIndexRevision = 0;
+	tmp->certIndex = NULL;
+	tmp->certIndex_size = 0;
+	tmp->certIndex_count = 0;
+	tmp->certIndexRevision = 0;
+	tmp->isMapped = false;
+	tmp->isLazy = false;
+	tmp->lazyPubRecs = NULL;
+	tmp->lazyPubRecs_len = 0;
+	tmp->lazyCertRecs = NULL;
+	tmp->lazyCertRecs_len = 0;
+	tmp->lazyPubCache = NULL;
+	tmp->lazyCertCache = NULL;
+	tmp->isIndexShared = false;
+	tmp->verifiedBy = NULL;
+	tmp->rawRelease = NULL;
+	tmp->rawReleaseCtx = NULL;
+	*t = tmp;
+	tmp = NULL;
+	res = KSI_OK;
+cleanup:
+	KSI_PublicationsFile_free(tmp);
+	return res;
+}
+
+int KSI_PublicationsFile_parse(KSI_CTX *ctx, const void *raw, size_t raw_len, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	struct generator_st gen = {ctx, raw, raw_len, NULL, 0, 0, false};
+	unsigned char *tmpRaw = NULL;
+	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || raw == NULL || raw_len == 0 || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/* Check the header. */
+	if (gen.len < hdrLen || memcmp(gen.ptr, PUB_FILE_HEADER_ID, hdrLen)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
+		goto cleanup;
+	}
+
+	/* Header verification ok - create the store object. */
+	res = KSI_PublicationsFile_new(ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->signedDataLength = hdrLen;
+
+	/* Initialize generator. */
+	gen.ptr += hdrLen;
+	gen.len -= hdrLen;
+
+	/* Read the payload of the file, and make no assumptions with the ordering. */
+	res = KSI_TlvTemplate_extractGenerator(ctx, tmp, (void *)&gen, KSI_TLV_TEMPLATE(KSI_PublicationsFile), (int (*)(void *, KSI_TLV **))generateNextTlv);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	tmp->signedDataLength += gen.sig_offset;
+
+	res = publicationsFile_buildIndex(tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Copy the raw value. */
+	tmpRaw = KSI_malloc(raw_len);
+	if (tmpRaw == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	memcpy(tmpRaw, raw, raw_len);
+
+	tmp->raw = tmpRaw;
+	tmp->raw_len = raw_len;
+	tmpRaw = NULL;
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+
+	KSI_free(tmpRaw);
+	KSI_TLV_free(gen.tlv);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/* Calculates the digest of the publications file bytes and of the verification configuration the snapshot is bound to. */
+static int publicationsFileSnapshot_keys(const KSI_PublicationsFile *pubFile, KSI_CTX *ctx, const KSI_PKITruststore *pki, KSI_DataHash **fileKey, KSI_DataHash **configKey) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *tmpFile = NULL;
+	KSI_DataHash *tmpConfig = NULL;
+
+	res = KSI_DataHash_create(ctx, pubFile->raw, pubFile->raw_len, KSI_HASHALG_SHA2_256, &tmpFile);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PKIVerificationCache_configurationKey(ctx, pki, pubFile->certConstraints != NULL ? pubFile->certConstraints : ctx->certConstraints, &tmpConfig);
+	if (res != KSI_OK) goto cleanup;
+
+	*fileKey = tmpFile;
+	tmpFile = NULL;
+	*configKey = tmpConfig;
+	tmpConfig = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(tmpFile);
+	KSI_DataHash_free(tmpConfig);
+
+	return res;
+}
+
+static void publicationsFileSnapshot_putUint(unsigned char *buf, size_t *pos, KSI_uint64_t val, size_t width) {
+	size_t i;
+
+	for (i = 0; i < width; i++) {
+		buf[*pos + i] = (unsigned char)(val >> (8 * (width - 1 - i)));
+	}
+	*pos += width;
+}
+
+static bool publicationsFileSnapshot_getUint(const unsigned char *buf, size_t buf_len, size_t *pos, size_t width, KSI_uint64_t *val) {
+	KSI_uint64_t tmp = 0;
+	size_t i;
+
+	if (*pos > buf_len || buf_len - *pos < width) return false;
+
+	for (i = 0; i < width; i++) {
+		tmp = (tmp << 8) | buf[*pos + i];
+	}
+	*pos += width;
+	*val = tmp;
+
+	return true;
+}
+
+/* Compares a length prefixed imprint of the snapshot with the expected hash, a \c NULL hash is only skipped. */
+static bool publicationsFileSnapshot_readImprint(const unsigned char *buf, size_t buf_len, size_t *pos, const KSI_DataHash *expected) {
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	bool matches;
+
+	if (*pos >= buf_len || buf[*pos] > buf_len - *pos - 1) return false;
+
+	if (expected == NULL) {
+		matches = true;
+	} else {
+		matches = KSI_DataHash_getImprint(expected, &imprint, &imprint_len) == KSI_OK &&
+				buf[*pos] == imprint_len && !memcmp(buf + *pos + 1, imprint, imprint_len);
+	}
+	*pos += 1 + buf[*pos];
+
+	return matches;
+}
+
+/* Reads the whole snapshot file. A missing file is not an error, the output buffer is left \c NULL. */
+static int publicationsFileSnapshot_read(KSI_CTX *ctx, const char *fileName, unsigned char **buf, size_t *buf_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	FILE *f = NULL;
+	long len = 0;
+	unsigned char *tmp = NULL;
+
+	f = fopen(fileName, "rb");
+	if (f == NULL) {
+		KSI_LOG_debug(ctx, "Publications file snapshot '%s' not found.", fileName);
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to read the publications file snapshot.");
+		goto cleanup;
+	}
+
+	if (len < PUB_FILE_SNAPSHOT_HDR_LEN || len > UINT_MAX) {
+		KSI_LOG_debug(ctx, "Ignoring invalid publications file snapshot '%s'.", fileName);
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	tmp = KSI_malloc((size_t)len);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	if (fread(tmp, 1, (size_t)len, f) != (size_t)len) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to read the publications file snapshot.");
+		goto cleanup;
+	}
+
+	*buf = tmp;
+	*buf_len = (size_t)len;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(tmp);
+
+	return res;
+}
+
+/* Checks the header of the snapshot and that it was made of the same file bytes. Outputs the verification time. */
+static bool publicationsFileSnapshot_header(const unsigned char *buf, size_t buf_len, const KSI_DataHash *fileKey, KSI_uint64_t *verifiedAt, size_t *pos) {
+	*pos = 9;
+
+	if (buf_len < PUB_FILE_SNAPSHOT_HDR_LEN || memcmp(buf, PUB_FILE_SNAPSHOT_ID, 8) || buf[8] != PUB_FILE_SNAPSHOT_VERSION) return false;
+
+	return publicationsFileSnapshot_getUint(buf, buf_len, pos, 8, verifiedAt) &&
+			publicationsFileSnapshot_readImprint(buf, buf_len, pos, fileKey);
+}
+
+/* Checks if the snapshot file records a successful verification of the same file with the same configuration. */
+static int publicationsFileSnapshot_matches(KSI_CTX *ctx, const char *fileName, const KSI_DataHash *fileKey, const KSI_DataHash *configKey, int *matches) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *buf = NULL;
+	size_t buf_len = 0;
+	size_t pos = 0;
+	KSI_uint64_t verifiedAt = 0;
+	time_t now = time(NULL);
+
+	*matches = 0;
+
+	res = publicationsFileSnapshot_read(ctx, fileName, &buf, &buf_len);
+	if (res != KSI_OK || buf == NULL) goto cleanup;
+
+	if (!publicationsFileSnapshot_header(buf, buf_len, fileKey, &verifiedAt, &pos) ||
+			!publicationsFileSnapshot_readImprint(buf, buf_len, &pos, configKey)) {
+		KSI_LOG_debug(ctx, "Publications file snapshot '%s' does not match the publications file or the truststore.", fileName);
+		goto cleanup;
+	}
+
+	/* The verification result depends on the current time (certificate validity), so it expires. */
+	if ((KSI_uint64_t)now < verifiedAt || (KSI_uint64_t)now - verifiedAt >= ctx->options[KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS]) {
+		KSI_LOG_debug(ctx, "Publications file snapshot '%s' has expired.", fileName);
+		goto cleanup;
+	}
+
+	*matches = 1;
+
+cleanup:
+
+	KSI_free(buf);
+
+	return res;
+}
+
+/*
+ * Writes the verification result, followed by the record index of the lazily parsed view of the
+ * file: the publication records with their imprints, the time index, the certificate records and
+ * the certificate IDs. All locations are offsets in the file bytes.
+ */
+static int publicationsFileSnapshot_write(KSI_CTX *ctx, const char *fileName, const KSI_PublicationsFile *index, const KSI_DataHash *fileKey, const KSI_DataHash *configKey) {
+	int res = KSI_UNKNOWN_ERROR;
+	FILE *f = NULL;
+	unsigned char *buf = NULL;
+	size_t buf_size = 0;
+	size_t buf_len = 0;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	const KSI_DataHash *keys[2];
+	size_t idCount = 0;
+	size_t i;
+
+	keys[0] = fileKey;
+	keys[1] = configKey;
+
+	buf_size = PUB_FILE_SNAPSHOT_HDR_LEN + 2 * (1 + KSI_MAX_IMPRINT_LEN) + 4 * 5;
+	for (i = 0; i < index->lazyPubRecs_len; i++) {
+		buf_size += 12 + 1 + index->lazyPubRecs[i].imprint_len + 12;
+	}
+	buf_size += index->lazyCertRecs_len * 8;
+	for (i = 0; i < index->certIndex_size; i++) {
+		if (index->certIndex[i].id == NULL) continue;
+		if (index->certIndex[i].id_len > 0xffff) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Certificate ID too long for the publications file snapshot.");
+			goto cleanup;
+		}
+		buf_size += 10 + index->certIndex[i].id_len;
+		idCount++;
+	}
+
+	buf = KSI_malloc(buf_size);
+	if (buf == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memcpy(buf, PUB_FILE_SNAPSHOT_ID, 8);
+	buf[8] = PUB_FILE_SNAPSHOT_VERSION;
+	buf_len = 9;
+	publicationsFileSnapshot_putUint(buf, &buf_len, (KSI_uint64_t)time(NULL), 8);
+
+	for (i = 0; i < 2; i++) {
+		res = KSI_DataHash_getImprint(keys[i], &imprint, &imprint_len);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		buf[buf_len++] = (unsigned char)imprint_len;
+		memcpy(buf + buf_len, imprint, imprint_len);
+		buf_len += imprint_len;
+	}
+
+	publicationsFileSnapshot_putUint(buf, &buf_len, index->signedDataLength, 4);
+
+	publicationsFileSnapshot_putUint(buf, &buf_len, index->lazyPubRecs_len, 4);
+	for (i = 0; i < index->lazyPubRecs_len; i++) {
+		const KSI_PublicationsFileLazyPubRec *rec = &index->lazyPubRecs[i];
+
+		publicationsFileSnapshot_putUint(buf, &buf_len, rec->offset, 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, rec->len, 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, rec->imprintOffset, 4);
+		buf[buf_len++] = (unsigned char)rec->imprint_len;
+		memcpy(buf + buf_len, index->raw + rec->imprintOffset, rec->imprint_len);
+		buf_len += rec->imprint_len;
+	}
+
+	publicationsFileSnapshot_putUint(buf, &buf_len, index->timeIndex_len, 4);
+	for (i = 0; i < index->timeIndex_len; i++) {
+		publicationsFileSnapshot_putUint(buf, &buf_len, index->timeIndex[i].pos, 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, index->timeIndex[i].time, 8);
+	}
+
+	publicationsFileSnapshot_putUint(buf, &buf_len, index->lazyCertRecs_len, 4);
+	for (i = 0; i < index->lazyCertRecs_len; i++) {
+		publicationsFileSnapshot_putUint(buf, &buf_len, index->lazyCertRecs[i].offset, 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, index->lazyCertRecs[i].len, 4);
+	}
+
+	publicationsFileSnapshot_putUint(buf, &buf_len, idCount, 4);
+	for (i = 0; i < index->certIndex_size; i++) {
+		const KSI_PublicationsFileCertIndexEntry *entry = &index->certIndex[i];
+
+		if (entry->id == NULL) continue;
+
+		publicationsFileSnapshot_putUint(buf, &buf_len, entry->pos, 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, (size_t)(entry->id - index->raw), 4);
+		publicationsFileSnapshot_putUint(buf, &buf_len, entry->id_len, 2);
+		memcpy(buf + buf_len, entry->id, entry->id_len);
+		buf_len += entry->id_len;
+	}
+
+	f = fopen(fileName, "wb");
+	if (f == NULL || fwrite(buf, 1, buf_len, f) != buf_len) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to write the publications file snapshot.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(buf);
+
+	return res;
+}
+
+/* The raw buffer of the temporary lazy view is owned by the viewed file. */
+static void publicationsFileSnapshot_keepRaw(void *unused) {
+	(void)unused;
+}
+
+/* Writes the snapshot of the verified file, the index is taken from a lazily parsed view of the file. */
+static int publicationsFileSnapshot_writeFile(KSI_CTX *ctx, const KSI_PublicationsFile *pubFile, const KSI_DataHash *fileKey, const KSI_DataHash *configKey) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsFile *view = NULL;
+
+	if (!pubFile->isLazy) {
+		res = KSI_PublicationsFile_fromSharedRaw(ctx, pubFile->raw, pubFile->raw_len, publicationsFileSnapshot_keepRaw, NULL, &view);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = publicationsFileSnapshot_write(ctx, ctx->publicationsFileSnapshot, view != NULL ? view : pubFile, fileKey, configKey);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsFile_free(view);
+
+	return res;
+}
+
+int KSI_PublicationsFile_verify(const KSI_PublicationsFile *pubFile, KSI_CTX *ctx) {
+	int res;
+	KSI_CTX *useCtx = ctx;
+	KSI_PKITruststore *pki = NULL;
+	KSI_DataHash *fileKey = NULL;
+	KSI_DataHash *configKey = NULL;
+	KSI_DataHash *verifiedConfigKey = NULL;
+	int matches = 0;
+
+	if (pubFile == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (useCtx == NULL) {
+		useCtx = pubFile->ctx;
+	}
+
+	KSI_ERR_clearErrors(useCtx);
+
+	/* Make sure the signature exists. */
+	if (pubFile->signature == NULL) {
+		KSI_pushError(useCtx, res = KSI_PUBLICATIONS_FILE_NOT_SIGNED_WITH_PKI, NULL);
+		goto cleanup;
+	}
+
+	/* The file has been verified when the trust state of the context was created. */
+	if (pubFile->verifiedBy != NULL && pubFile->verifiedBy == useCtx->trustState) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	/* Do we need to serialize the publications file? */
+	if (pubFile->raw == NULL) {
+		/* FIXME! At the moment the creation of publications file is not supported,
+		 * thus this error can not occur under normal conditions. */
+		KSI_pushError(useCtx, res = KSI_UNKNOWN_ERROR, "Not implemented.");
+		goto cleanup;
+	}
+
+	res = KSI_CTX_getPKITruststore(useCtx, &pki);
+	if (res != KSI_OK) {
+		KSI_pushError(useCtx, res, NULL);
+		goto cleanup;
+	}
+
+	if (useCtx->publicationsFileSnapshot != NULL && useCtx->options[KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS] > 0) {
+		res = publicationsFileSnapshot_keys(pubFile, useCtx, pki, &fileKey, &configKey);
+		if (res != KSI_OK) {
+			KSI_pushError(useCtx, res, NULL);
+			goto cleanup;
+		}
+
+		res = publicationsFileSnapshot_matches(useCtx, useCtx->publicationsFileSnapshot, fileKey, configKey, &matches);
+		if (res != KSI_OK) {
+			KSI_pushError(useCtx, res, NULL);
+			goto cleanup;
+		}
+
+		if (matches) {
+			KSI_LOG_debug(useCtx, "Publications file verified by snapshot '%s'.", useCtx->publicationsFileSnapshot);
+			res = KSI_OK;
+			goto cleanup;
+		}
+	}
+
+	res = KSI_PKITruststore_verifyPKISignature(pki, pubFile->raw, pubFile->signedDataLength, pubFile->signature, pubFile->certConstraints);
+	if (res != KSI_OK) {
+		KSI_pushError(useCtx, res, "Signature not verified.");
+		goto cleanup;
+	}
+
+	if (configKey != NULL) {
+		/* Certificates loaded on demand during the verification are not part of the configuration key. */
+		res = KSI_PKIVerificationCache_configurationKey(useCtx, pki, pubFile->certConstraints != NULL ? pubFile->certConstraints : useCtx->certConstraints, &verifiedConfigKey);
+		if (res != KSI_OK) {
+			KSI_pushError(useCtx, res, NULL);
+			goto cleanup;
+		}
+
+		if (!KSI_DataHash_equals(configKey, verifiedConfigKey)) {
+			KSI_LOG_debug(useCtx, "Truststore was modified during verification, publications file snapshot not written.");
+		} else if (publicationsFileSnapshot_writeFile(useCtx, pubFile, fileKey, configKey) != KSI_OK) {
+			/* The snapshot is only an optimization. */
+			KSI_LOG_warn(useCtx, "Unable to write publications file snapshot '%s'.", useCtx->publicationsFileSnapshot);
+			KSI_ERR_clearErrors(useCtx);
+		}
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(fileKey);
+	KSI_DataHash_free(configKey);
+	KSI_DataHash_free(verifiedConfigKey);
+	KSI_nofree(useCtx);
+	KSI_nofree(pki);
+
+	return res;
+}
+
+int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	long raw_size = 0;
+	FILE *f = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || fileName == NULL || pubFile == 0) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+
+	f = fopen(fileName, "rb");
+	if (f == NULL) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open publications file.");
+		goto cleanup;
+	}
+
+	res = fseek(f, 0, SEEK_END);
+	if (res != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	raw_size = ftell(f);
+	if (raw_size < 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	if (raw_size > UINT_MAX) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file exceeds max size.");
+		goto cleanup;
+	}
+
+	res = fseek(f, 0, SEEK_SET);
+	if (res != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	raw = KSI_calloc((unsigned)raw_size, 1);
+	if (raw == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	raw_len = fread(raw, 1, (unsigned)raw_size, f);
+	if (raw_len != (unsigned)raw_size) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PublicationsFile_parse(ctx, raw, (unsigned)raw_len, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(raw);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/*
+ * Frees the constraints copied by #KSI_PublicationsFile_setCertConstraints. They are allocated
+ * here and not by the context, as the file may outlive its context (see #KSI_TrustState).
+ */
+static void publicationsFile_freeCertConstraints(KSI_CertConstraint *arr) {
+	size_t i;
+
+	if (arr != NULL) {
+		for (i = 0; arr[i].oid != NULL; i++) {
+			KSI_free(arr[i].oid);
+			KSI_free(arr[i].val);
+		}
+
+		KSI_free(arr);
+	}
+}
+
+static void publicationsFile_freeRaw(KSI_PublicationsFile *pubFile) {
+	if (pubFile->raw == NULL) return;
+	if (pubFile->rawRelease != NULL) {
+		pubFile->rawRelease(pubFile->rawReleaseCtx);
+	} else
+#ifdef PUBFILE_USE_MMAP
+	if (pubFile->isMapped) {
+		munmap(pubFile->raw, pubFile->raw_len);
+	} else
+#endif
+	{
+		KSI_free(pubFile->raw);
+	}
+	pubFile->raw = NULL;
+	pubFile->raw_len = 0;
+	pubFile->isMapped = false;
+	pubFile->rawRelease = NULL;
+	pubFile->rawReleaseCtx = NULL;
+}
+
+/*
+ * Reads the whole file into memory, mapping it if the platform supports it. The mapping
+ * is only valid as long as the file is not modified, see #KSI_PublicationsFile_fromFileLazy.
+ */
+static int publicationsFile_loadRaw(KSI_PublicationsFile *pubFile, const char *fileName) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = pubFile->ctx;
+	FILE *f = NULL;
+	long raw_size = 0;
+	unsigned char *tmp = NULL;
+	size_t tmp_len = 0;
+
+	f = fopen(fileName, "rb");
+	if (f == NULL) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open publications file.");
+		goto cleanup;
+	}
+
+	if (fseek(f, 0, SEEK_END) != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	raw_size = ftell(f);
+	if (raw_size < 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	if (raw_size > UINT_MAX) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file exceeds max size.");
+		goto cleanup;
+	}
+
+	if ((size_t)raw_size < strlen(PUB_FILE_HEADER_ID)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
+		goto cleanup;
+	}
+
+#ifdef PUBFILE_USE_MMAP
+	{
+		tmp = mmap(NULL, (size_t)raw_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (tmp != MAP_FAILED) {
+			pubFile->raw = tmp;
+			pubFile->raw_len = (size_t)raw_size;
+			pubFile->isMapped = true;
+			tmp = NULL;
+
+			res = KSI_OK;
+			goto cleanup;
+		}
+		/* Fall back to reading the file. */
+		KSI_LOG_debug(ctx, "Unable to map the publications file, reading it instead.");
+		tmp = NULL;
+	}
+#endif
+
+	if (fseek(f, 0, SEEK_SET) != 0) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_malloc((unsigned)raw_size);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp_len = fread(tmp, 1, (unsigned)raw_size, f);
+	if (tmp_len != (unsigned)raw_size) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+		goto cleanup;
+	}
+
+	pubFile->raw = tmp;
+	pubFile->raw_len = tmp_len;
+	pubFile->isMapped = false;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(tmp);
+
+	return res;
+}
+
+/* Finds the value of the first nested TLV with the given tag. */
+static int publicationsFile_findNested(KSI_CTX *ctx, const unsigned char *ptr, size_t len, unsigned tag, const unsigned char **val, size_t *val_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_FTLV ftlv;
+
+	while (len > 0) {
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(ptr, len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (ftlv.tag == tag) {
+			*val = ptr + ftlv.hdr_len;
+			*val_len = ftlv.dat_len;
+			res = KSI_OK;
+			goto cleanup;
+		}
+
+		ptr += ftlv.hdr_len + ftlv.dat_len;
+		len -= ftlv.hdr_len + ftlv.dat_len;
+	}
+
+	KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Mandatory element missing.");
+
+cleanup:
+
+	return res;
+}
+
+/* Reads the publication time of a raw publication record without parsing the record. */
+static int publicationsFile_peekPublicationTime(KSI_CTX *ctx, const unsigned char *ptr, size_t len, KSI_uint64_t *time) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_FTLV ftlv;
+	const unsigned char *pubData = NULL;
+	size_t pubData_len = 0;
+	const unsigned char *val = NULL;
+	size_t val_len = 0;
+	KSI_uint64_t tmp = 0;
+	size_t i;
+
+	memset(&ftlv, 0, sizeof(ftlv));
+	res = KSI_FTLV_memRead(ptr, len, &ftlv);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = publicationsFile_findNested(ctx, ptr + ftlv.hdr_len, ftlv.dat_len, 0x10, &pubData, &pubData_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFile_findNested(ctx, pubData, pubData_len, 0x02, &val, &val_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (val_len > 8) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publication time too large.");
+		goto cleanup;
+	}
+
+	for (i = 0; i < val_len; i++) {
+		tmp = (tmp << 8) | val[i];
+	}
+
+	*time = tmp;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/*
+ * Checks the framing of the nested elements and that no unknown critical elements are
+ * present. Bit \c i of \c mandatory marks \c tags[i] as a mandatory element.
+ */
+static int publicationsFile_checkNested(KSI_CTX *ctx, const unsigned char *ptr, size_t len, const unsigned *tags, size_t tags_len, unsigned mandatory) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_FTLV ftlv;
+	unsigned found = 0;
+	size_t i;
+
+	while (len > 0) {
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(ptr, len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		for (i = 0; i < tags_len && tags[i] != ftlv.tag; i++);
+		if (i < tags_len) {
+			found |= 1u << i;
+		} else if (!ftlv.is_nc) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unknown critical element in publications file record.");
+			goto cleanup;
+		}
+
+		ptr += ftlv.hdr_len + ftlv.dat_len;
+		len -= ftlv.hdr_len + ftlv.dat_len;
+	}
+
+	if ((found & mandatory) != mandatory) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Mandatory element missing.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/* Validates a raw publication record without parsing it, see the KSI_PublicationRecord template. Outputs the location of the imprint. */
+static int publicationsFile_checkPublicationRecord(KSI_CTX *ctx, const unsigned char *ptr, size_t len, const unsigned char **outImprint, size_t *outImprint_len) {
+	static const unsigned recTags[] = { 0x10, 0x09, 0x0a };
+	static const unsigned dataTags[] = { 0x02, 0x04 };
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *pubData = NULL;
+	size_t pubData_len = 0;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	res = publicationsFile_checkNested(ctx, ptr, len, recTags, sizeof(recTags) / sizeof(*recTags), 0x01);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFile_findNested(ctx, ptr, len, 0x10, &pubData, &pubData_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFile_checkNested(ctx, pubData, pubData_len, dataTags, sizeof(dataTags) / sizeof(*dataTags), 0x03);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFile_findNested(ctx, pubData, pubData_len, 0x04, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (imprint_len < 2 || KSI_getHashLength(imprint[0]) != imprint_len - 1) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Invalid published imprint.");
+		goto cleanup;
+	}
+
+	*outImprint = imprint;
+	*outImprint_len = imprint_len;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int publicationsFile_parseLazySignature(KSI_CTX *ctx, const unsigned char *ptr, size_t len, KSI_PKISignature **sig) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TLV *tlv = NULL;
+
+	/* The memory is not owned by the TLV, the signature makes its own copy. */
+	res = KSI_TLV_parseBlob2(ctx, (unsigned char *)ptr, len, 0, &tlv);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PKISignature_fromTlv(tlv, sig);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_TLV_free(tlv);
+
+	return res;
+}
+
+/*
+ * Walks the top level elements of the file without parsing the certificate and
+ * publication records, only their locations and lookup keys are stored. The structure
+ * of every record is validated, so malformed records are reported here and not on
+ * first lookup; the certificates themselves are decoded when materialized.
+ */
+static int publicationsFile_parseLazy(KSI_PublicationsFile *pubFile) {
+	static const unsigned certTags[] = { 0x01, 0x02 };
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = pubFile->ctx;
+	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+	const unsigned char *ptr = NULL;
+	size_t len;
+	size_t offset;
+	unsigned lastTag = 0;
+	size_t pubCount = 0;
+	size_t certCount = 0;
+	KSI_PublicationsHeader *header = NULL;
+	KSI_PKISignature *signature = NULL;
+	KSI_FTLV ftlv;
+
+	if (pubFile->raw_len < hdrLen || memcmp(pubFile->raw, PUB_FILE_HEADER_ID, hdrLen)) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unrecognized header.");
+		goto cleanup;
+	}
+
+	/* First pass - validate the structure and count the records. */
+	for (offset = hdrLen; offset < pubFile->raw_len; offset += ftlv.hdr_len + ftlv.dat_len) {
+		ptr = pubFile->raw + offset;
+		len = pubFile->raw_len - offset;
+
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(ptr, len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (signature != NULL) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "The signature must be the last element.");
+			goto cleanup;
+		}
+
+		if (ftlv.tag < 0x0701 || ftlv.tag > 0x0704) {
+			if (!ftlv.is_nc) {
+				KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Unknown critical element in publications file.");
+				goto cleanup;
+			}
+			continue;
+		}
+
+		if (ftlv.tag < lastTag || (ftlv.tag == lastTag && (ftlv.tag == 0x0701 || ftlv.tag == 0x0704))) {
+			KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file elements out of order.");
+			goto cleanup;
+		}
+		lastTag = ftlv.tag;
+
+		switch (ftlv.tag) {
+			case 0x0701:
+				res = KSI_PublicationsHeader_new(ctx, &header);
+				if (res != KSI_OK) {
+					KSI_pushError(ctx, res, NULL);
+					goto cleanup;
+				}
+
+				res = KSI_TlvTemplate_parse(ctx, ptr, ftlv.hdr_len + ftlv.dat_len, KSI_TLV_TEMPLATE(KSI_PublicationsHeader), header);
+				if (res != KSI_OK) {
+					KSI_pushError(ctx, res, "Unable to parse publications file header.");
+					goto cleanup;
+				}
+				break;
+			case 0x0702:
+				certCount++;
+				break;
+			case 0x0703:
+				pubCount++;
+				break;
+			case 0x0704:
+				res = publicationsFile_parseLazySignature(ctx, ptr, ftlv.hdr_len + ftlv.dat_len, &signature);
+				if (res != KSI_OK) goto cleanup;
+
+				pubFile->signedDataLength = offset;
+				break;
+		}
+	}
+
+	if (header == NULL || signature == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Mandatory element missing.");
+		goto cleanup;
+	}
+
+	if (pubCount > 0) {
+		pubFile->lazyPubRecs = KSI_calloc(pubCount, sizeof(KSI_PublicationsFileLazyPubRec));
+		pubFile->timeIndex = KSI_calloc(pubCount, sizeof(KSI_PublicationsFileTimeIndexEntry));
+		if (pubFile->lazyPubRecs == NULL || pubFile->timeIndex == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (certCount > 0) {
+		pubFile->lazyCertRecs = KSI_calloc(certCount, sizeof(KSI_PublicationsFileLazyCertRec));
+		if (pubFile->lazyCertRecs == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+	}
+
+	res = publicationsFile_newCertIndex(pubFile, certCount, &pubFile->certIndex, &pubFile->certIndex_size);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Second pass - build the indexes from the keys of the records. */
+	for (offset = hdrLen; offset < pubFile->signedDataLength; offset += ftlv.hdr_len + ftlv.dat_len) {
+		ptr = pubFile->raw + offset;
+		len = pubFile->raw_len - offset;
+
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(ptr, len, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (ftlv.tag == 0x0702) {
+			KSI_PublicationsFileLazyCertRec *rec = &pubFile->lazyCertRecs[pubFile->lazyCertRecs_len];
+			const unsigned char *id = NULL;
+			size_t id_len = 0;
+
+			rec->offset = offset;
+			rec->len = ftlv.hdr_len + ftlv.dat_len;
+
+			res = publicationsFile_checkNested(ctx, ptr + ftlv.hdr_len, ftlv.dat_len, certTags, sizeof(certTags) / sizeof(*certTags), 0x03);
+			if (res != KSI_OK) goto cleanup;
+
+			res = publicationsFile_findNested(ctx, ptr + ftlv.hdr_len, ftlv.dat_len, 0x01, &id, &id_len);
+			if (res != KSI_OK) goto cleanup;
+
+			/* Empty IDs are not indexed, such certificates can not be found by ID. */
+			if (id_len > 0) {
+				publicationsFile_certIndexInsert(pubFile->certIndex, pubFile->certIndex_size, id, id_len, pubFile->lazyCertRecs_len, NULL);
+			}
+			pubFile->lazyCertRecs_len++;
+		} else if (ftlv.tag == 0x0703) {
+			KSI_PublicationsFileLazyPubRec *rec = &pubFile->lazyPubRecs[pubFile->lazyPubRecs_len];
+			KSI_PublicationsFileTimeIndexEntry entry;
+			const unsigned char *imprint = NULL;
+
+			rec->offset = offset;
+			rec->len = ftlv.hdr_len + ftlv.dat_len;
+
+			res = publicationsFile_checkPublicationRecord(ctx, ptr + ftlv.hdr_len, ftlv.dat_len, &imprint, &rec->imprint_len);
+			if (res != KSI_OK) goto cleanup;
+			rec->imprintOffset = (size_t)(imprint - pubFile->raw);
+
+			res = publicationsFile_peekPublicationTime(ctx, ptr, rec->len, &entry.time);
+			if (res != KSI_OK) goto cleanup;
+
+			entry.pos = pubFile->lazyPubRecs_len;
+			entry.pubRec = NULL;
+
+			publicationsFile_timeIndexInsert(pubFile->timeIndex, pubFile->lazyPubRecs_len, &entry);
+			pubFile->lazyPubRecs_len++;
+		}
+	}
+
+	pubFile->timeIndex_len = pubFile->lazyPubRecs_len;
+	pubFile->certIndex_count = pubFile->lazyCertRecs_len;
+
+	pubFile->header = header;
+	header = NULL;
+	pubFile->signature = signature;
+	signature = NULL;
+
+	pubFile->isLazy = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsHeader_free(header);
+	KSI_PKISignature_free(signature);
+
+	return res;
+}
+
+/* Parses the header and the signature of an already validated file, the signature starts at \c signedDataLength. */
+static int publicationsFile_parseHeaderAndSignature(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len, size_t signedDataLength,
+		KSI_PublicationsHeader **header, KSI_PKISignature **signature) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_PublicationsHeader *tmpHeader = NULL;
+	KSI_PKISignature *tmpSignature = NULL;
+	size_t offset;
+	KSI_FTLV ftlv;
+
+	for (offset = strlen(PUB_FILE_HEADER_ID); tmpHeader == NULL && offset < signedDataLength; offset += ftlv.hdr_len + ftlv.dat_len) {
+		memset(&ftlv, 0, sizeof(ftlv));
+		res = KSI_FTLV_memRead(raw + offset, raw_len - offset, &ftlv);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (ftlv.tag != 0x0701) continue;
+
+		res = KSI_PublicationsHeader_new(ctx, &tmpHeader);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_TlvTemplate_parse(ctx, raw + offset, ftlv.hdr_len + ftlv.dat_len, KSI_TLV_TEMPLATE(KSI_PublicationsHeader), tmpHeader);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, "Unable to parse publications file header.");
+			goto cleanup;
+		}
+	}
+
+	if (tmpHeader == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Mandatory element missing.");
+		goto cleanup;
+	}
+
+	res = publicationsFile_parseLazySignature(ctx, raw + signedDataLength, raw_len - signedDataLength, &tmpSignature);
+	if (res != KSI_OK) goto cleanup;
+
+	*header = tmpHeader;
+	tmpHeader = NULL;
+	*signature = tmpSignature;
+	tmpSignature = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsHeader_free(tmpHeader);
+	KSI_PKISignature_free(tmpSignature);
+
+	return res;
+}
+
+/* Reads a location from the snapshot, which must lie within the given range of the file. */
+static bool publicationsFileSnapshot_getRange(const unsigned char *buf, size_t buf_len, size_t *pos, size_t min, size_t max, size_t *offset, size_t *len) {
+	KSI_uint64_t o = 0;
+	KSI_uint64_t l = 0;
+
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, pos, 4, &o) || !publicationsFileSnapshot_getUint(buf, buf_len, pos, 4, &l)) return false;
+	if (o < min || o > max || l == 0 || l > max - o) return false;
+
+	*offset = (size_t)o;
+	*len = (size_t)l;
+
+	return true;
+}
+
+/* Reads the record index from the snapshot buffer, returns false if it is inconsistent with the file. */
+static bool publicationsFileSnapshot_parseIndex(KSI_PublicationsFile *pubFile, const unsigned char *buf, size_t buf_len, size_t pos) {
+	const size_t hdrLen = strlen(PUB_FILE_HEADER_ID);
+	KSI_uint64_t signedDataLength = 0;
+	KSI_uint64_t count = 0;
+	KSI_uint64_t val = 0;
+	size_t i;
+
+	/* The configuration key is only used by the verification. */
+	if (!publicationsFileSnapshot_readImprint(buf, buf_len, &pos, NULL)) return false;
+
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &signedDataLength) ||
+			signedDataLength < hdrLen || signedDataLength >= pubFile->raw_len) return false;
+	pubFile->signedDataLength = (size_t)signedDataLength;
+
+	/* Publication records with their imprints. */
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &count) || count > buf_len) return false;
+	if (count > 0) {
+		pubFile->lazyPubRecs = KSI_calloc((size_t)count, sizeof(KSI_PublicationsFileLazyPubRec));
+		if (pubFile->lazyPubRecs == NULL) return false;
+	}
+	for (i = 0; i < count; i++) {
+		KSI_PublicationsFileLazyPubRec *rec = &pubFile->lazyPubRecs[i];
+		KSI_uint64_t imprintOffset = 0;
+
+		if (!publicationsFileSnapshot_getRange(buf, buf_len, &pos, hdrLen, pubFile->signedDataLength, &rec->offset, &rec->len)) return false;
+		if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &imprintOffset) || pos >= buf_len) return false;
+
+		rec->imprintOffset = (size_t)imprintOffset;
+		rec->imprint_len = buf[pos++];
+		if (rec->imprintOffset < rec->offset || rec->imprint_len > rec->offset + rec->len - rec->imprintOffset ||
+				rec->imprint_len > buf_len - pos || memcmp(buf + pos, pubFile->raw + rec->imprintOffset, rec->imprint_len)) return false;
+		pos += rec->imprint_len;
+	}
+	pubFile->lazyPubRecs_len = (size_t)count;
+
+	/* The time index, sorted by time. */
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &count) || count != pubFile->lazyPubRecs_len) return false;
+	if (count > 0) {
+		pubFile->timeIndex = KSI_calloc((size_t)count, sizeof(KSI_PublicationsFileTimeIndexEntry));
+		if (pubFile->timeIndex == NULL) return false;
+	}
+	for (i = 0; i < count; i++) {
+		KSI_PublicationsFileTimeIndexEntry *entry = &pubFile->timeIndex[i];
+
+		if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &val) || val >= count) return false;
+		entry->pos = (size_t)val;
+		if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 8, &entry->time)) return false;
+		if (i > 0 && entry->time < pubFile->timeIndex[i - 1].time) return false;
+		entry->pubRec = NULL;
+	}
+	pubFile->timeIndex_len = (size_t)count;
+
+	/* Certificate records. */
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &count) || count > buf_len) return false;
+	if (count > 0) {
+		pubFile->lazyCertRecs = KSI_calloc((size_t)count, sizeof(KSI_PublicationsFileLazyCertRec));
+		if (pubFile->lazyCertRecs == NULL) return false;
+	}
+	for (i = 0; i < count; i++) {
+		if (!publicationsFileSnapshot_getRange(buf, buf_len, &pos, hdrLen, pubFile->signedDataLength, &pubFile->lazyCertRecs[i].offset, &pubFile->lazyCertRecs[i].len)) return false;
+	}
+	pubFile->lazyCertRecs_len = (size_t)count;
+	pubFile->certIndex_count = (size_t)count;
+
+	if (publicationsFile_newCertIndex(pubFile, pubFile->lazyCertRecs_len, &pubFile->certIndex, &pubFile->certIndex_size) != KSI_OK) return false;
+
+	/* Certificate IDs. */
+	if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &count) || count > pubFile->lazyCertRecs_len) return false;
+	for (i = 0; i < count; i++) {
+		KSI_uint64_t certPos = 0;
+		KSI_uint64_t idOffset = 0;
+		KSI_uint64_t id_len = 0;
+
+		if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &certPos) || certPos >= pubFile->lazyCertRecs_len) return false;
+		if (!publicationsFileSnapshot_getUint(buf, buf_len, &pos, 4, &idOffset) || !publicationsFileSnapshot_getUint(buf, buf_len, &pos, 2, &id_len)) return false;
+		if (id_len == 0 || idOffset > pubFile->signedDataLength || id_len > pubFile->signedDataLength - idOffset ||
+				id_len > buf_len - pos || memcmp(buf + pos, pubFile->raw + idOffset, (size_t)id_len)) return false;
+		pos += (size_t)id_len;
+
+		publicationsFile_certIndexInsert(pubFile->certIndex, pubFile->certIndex_size, pubFile->raw + idOffset, (size_t)id_len, (size_t)certPos, NULL);
+	}
+
+	return pos == buf_len;
+}
+
+/*
+ * Takes the record index of a lazily loaded file from the snapshot, if the snapshot was made of
+ * the same file bytes. Otherwise \c indexed is set to false and the file must be parsed.
+ */
+static int publicationsFileSnapshot_readIndex(KSI_PublicationsFile *pubFile, bool *indexed) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = pubFile->ctx;
+	unsigned char *buf = NULL;
+	size_t buf_len = 0;
+	size_t pos = 0;
+	KSI_uint64_t verifiedAt = 0;
+	KSI_DataHash *fileKey = NULL;
+
+	*indexed = false;
+
+	if (ctx->publicationsFileSnapshot == NULL || ctx->options[KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS] == 0) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = publicationsFileSnapshot_read(ctx, ctx->publicationsFileSnapshot, &buf, &buf_len);
+	if (res != KSI_OK || buf == NULL) goto cleanup;
 
-	/* Read the payload of the file, and make no assumptions with the ordering. */
-	res = KSI_TlvTemplate_extractGenerator(ctx, tmp, (void *)&gen, KSI_TLV_TEMPLATE(KSI_PublicationsFile), (int (*)(void *, KSI_TLV **))generateNextTlv);
+	res = KSI_DataHash_create(ctx, pubFile->raw, pubFile->raw_len, KSI_HASHALG_SHA2_256, &fileKey);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	tmp->signedDataLength += gen.sig_offset;
-
-	/* Copy the raw value. */
-	tmpRaw = KSI_malloc(raw_len);
-	if (tmpRaw == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+	/* The index is bound to the file bytes only, it does not expire. */
+	if (!publicationsFileSnapshot_header(buf, buf_len, fileKey, &verifiedAt, &pos) ||
+			!publicationsFileSnapshot_parseIndex(pubFile, buf, buf_len, pos)) {
+		KSI_LOG_debug(ctx, "Publications file snapshot '%s' does not match the publications file, parsing the file.", ctx->publicationsFileSnapshot);
+		publicationsFile_freeIndex(pubFile);
+		publicationsFile_freeLazyRecords(pubFile);
+		pubFile->signedDataLength = 0;
+		res = KSI_OK;
 		goto cleanup;
 	}
-	memcpy(tmpRaw, raw, raw_len);
 
-	tmp->raw = tmpRaw;
-	tmp->raw_len = raw_len;
-	tmpRaw = NULL;
+	res = publicationsFile_parseHeaderAndSignature(ctx, pubFile->raw, pubFile->raw_len, pubFile->signedDataLength, &pubFile->header, &pubFile->signature);
+	if (res != KSI_OK) goto cleanup;
 
-	*pubFile = tmp;
-	tmp = NULL;
+	KSI_LOG_debug(ctx, "Publications file index taken from snapshot '%s'.", ctx->publicationsFileSnapshot);
+
+	pubFile->isLazy = true;
+	*indexed = true;
 
 	res = KSI_OK;
 
 cleanup:
 
-
-	KSI_free(tmpRaw);
-	KSI_TLV_free(gen.tlv);
-	KSI_PublicationsFile_free(tmp);
+	KSI_DataHash_free(fileKey);
+	KSI_free(buf);
 
 	return res;
 }
 
-int KSI_PublicationsFile_verify(const KSI_PublicationsFile *pubFile, KSI_CTX *ctx) {
+int KSI_PublicationsFile_fromFileLazy(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile) {
 	int res;
-	KSI_CTX *useCtx = ctx;
-	KSI_PKITruststore *pki = NULL;
-
-	if (pubFile == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-
-	if (useCtx == NULL) {
-		useCtx = pubFile->ctx;
-	}
-
-	KSI_ERR_clearErrors(useCtx);
+	KSI_PublicationsFile *tmp = NULL;
+	bool indexed = false;
 
-	/* Make sure the signature exists. */
-	if (pubFile->signature == NULL) {
-		KSI_pushError(useCtx, res = KSI_PUBLICATIONS_FILE_NOT_SIGNED_WITH_PKI, NULL);
-		goto cleanup;
-	}
+	KSI_ERR_clearErrors(ctx);
 
-	/* Do we need to serialize the publications file? */
-	if (pubFile->raw == NULL) {
-		/* FIXME! At the moment the creation of publications file is not supported,
-		 * thus this error can not occur under normal conditions. */
-		KSI_pushError(useCtx, res = KSI_UNKNOWN_ERROR, "Not implemented.");
+	if (ctx == NULL || fileName == NULL || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_CTX_getPKITruststore(useCtx, &pki);
+	res = KSI_PublicationsFile_new(ctx, &tmp);
 	if (res != KSI_OK) {
-		KSI_pushError(useCtx, res, NULL);
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_PKITruststore_verifyPKISignature(pki, pubFile->raw, pubFile->signedDataLength, pubFile->signature, pubFile->certConstraints);
-	if (res != KSI_OK) {
-		KSI_pushError(useCtx, res, "Signature not verified.");
-		goto cleanup;
+	res = publicationsFile_loadRaw(tmp, fileName);
+	if (res != KSI_OK) goto cleanup;
+
+	res = publicationsFileSnapshot_readIndex(tmp, &indexed);
+	if (res != KSI_OK) goto cleanup;
+
+	if (!indexed) {
+		res = publicationsFile_parseLazy(tmp);
+		if (res != KSI_OK) goto cleanup;
 	}
 
+	*pubFile = tmp;
+	tmp = NULL;
+
 	res = KSI_OK;
 
 cleanup:
 
-	KSI_nofree(useCtx);
-	KSI_nofree(pki);
+	KSI_PublicationsFile_free(tmp);
 
 	return res;
 }
 
-int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile) {
+int KSI_PublicationsFile_fromSharedRaw(KSI_CTX *ctx, const unsigned char *raw, size_t raw_len,
+		void (*release)(void *), void *releaseCtx, KSI_PublicationsFile **pubFile) {
 	int res;
 	KSI_PublicationsFile *tmp = NULL;
-	unsigned char *raw = NULL;
-	size_t raw_len = 0;
-	long raw_size = 0;
-	FILE *f = NULL;
 
 	KSI_ERR_clearErrors(ctx);
 
-	if (ctx == NULL || fileName == NULL || pubFile == 0) {
+	if (ctx == NULL || raw == NULL || raw_len == 0 || pubFile == NULL) {
 		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-
-	f = fopen(fileName, "rb");
-	if (f == NULL) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to open publications file.");
+	res = KSI_PublicationsFile_new(ctx, &tmp);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
-	res = fseek(f, 0, SEEK_END);
-	if (res != 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
-		goto cleanup;
-	}
+	/* The buffer is never modified by the publications file, only released. */
+	tmp->raw = (unsigned char *)raw;
+	tmp->raw_len = raw_len;
 
-	raw_size = ftell(f);
-	if (raw_size < 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+	res = publicationsFile_parseLazy(tmp);
+	if (res != KSI_OK) {
+		/* Do not release the buffer on failure. */
+		tmp->raw = NULL;
+		tmp->raw_len = 0;
 		goto cleanup;
 	}
 
-	if (raw_size > UINT_MAX) {
-		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Publications file exceeds max size.");
-		goto cleanup;
-	}
+	tmp->rawRelease = release;
+	tmp->rawReleaseCtx = releaseCtx;
 
-	res = fseek(f, 0, SEEK_SET);
-	if (res != 0) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
-		goto cleanup;
-	}
+	*pubFile = tmp;
+	tmp = NULL;
 
-	raw = KSI_calloc((unsigned)raw_size, 1);
-	if (raw == NULL) {
-		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
-		goto cleanup;
-	}
+	res = KSI_OK;
 
-	raw_len = fread(raw, 1, (unsigned)raw_size, f);
-	if (raw_len != (unsigned)raw_size) {
-		KSI_pushError(ctx, res = KSI_IO_ERROR, NULL);
+cleanup:
+
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+int KSI_PublicationsFile_fromSharedIndex(KSI_CTX *ctx, const KSI_PublicationsFile *index,
+		void (*release)(void *), void *releaseCtx, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || index == NULL || !index->isLazy || pubFile == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = KSI_PublicationsFile_parse(ctx, raw, (unsigned)raw_len, &tmp);
+	res = KSI_PublicationsFile_new(ctx, &tmp);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
+	/* Only the header and the signature are bound to the context, everything else is borrowed. */
+	res = publicationsFile_parseHeaderAndSignature(ctx, index->raw, index->raw_len, index->signedDataLength, &tmp->header, &tmp->signature);
+	if (res != KSI_OK) goto cleanup;
+
+	tmp->isIndexShared = true;
+	tmp->isLazy = true;
+	tmp->signedDataLength = index->signedDataLength;
+	tmp->timeIndex = index->timeIndex;
+	tmp->timeIndex_len = index->timeIndex_len;
+	tmp->certIndex = index->certIndex;
+	tmp->certIndex_size = index->certIndex_size;
+	tmp->certIndex_count = index->certIndex_count;
+	tmp->lazyPubRecs = index->lazyPubRecs;
+	tmp->lazyPubRecs_len = index->lazyPubRecs_len;
+	tmp->lazyCertRecs = index->lazyCertRecs;
+	tmp->lazyCertRecs_len = index->lazyCertRecs_len;
+
+	tmp->raw = index->raw;
+	tmp->raw_len = index->raw_len;
+	tmp->rawRelease = release;
+	tmp->rawReleaseCtx = releaseCtx;
+
 	*pubFile = tmp;
 	tmp = NULL;
 
@@ -366,8 +2115,11 @@ int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_Public
 
 cleanup:
 
-	if (f != NULL) fclose(f);
-	KSI_free(raw);
+	if (tmp != NULL) {
+		/* Do not release the buffer on failure. */
+		tmp->raw = NULL;
+		tmp->raw_len = 0;
+	}
 	KSI_PublicationsFile_free(tmp);
 
 	return res;
@@ -485,7 +2237,7 @@ int KSI_PublicationsFile_serialize(KSI_CTX *ctx, KSI_PublicationsFile *pubFile,
 
 	memcpy(tmp + sizeof(PUB_FILE_HEADER_ID) - 1, buf, buf_len);
 
-	if (pubFile->raw != NULL) KSI_free(pubFile->raw);
+	publicationsFile_freeRaw(pubFile);
 	pubFile->raw = tmp;
 	pubFile->raw_len = tmp_len;
 	pubFile->signedDataLength = tmp_len - sig_len;
@@ -517,26 +2269,107 @@ void KSI_PublicationsFile_free(KSI_PublicationsFile *t) {
 		KSI_CertificateRecordList_free(t->certificates);
 		KSI_PublicationRecordList_free(t->publications);
 		KSI_PKISignature_free(t->signature);
-		KSI_free(t->raw);
-		if(t->ctx->freeCertConstraintsArray != NULL) {
-			t->ctx->freeCertConstraintsArray(t->certConstraints);
-		}
+		publicationsFile_freeIndex(t);
+		publicationsFile_freeLazyRecords(t);
+		publicationsFile_freeRaw(t);
+		publicationsFile_freeCertConstraints(t->certConstraints);
 		KSI_free(t);
 	}
 }
 
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_PublicationsHeader*, header, Header);
-KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_LIST(KSI_CertificateRecord)*, certificates, Certificates);
-KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_LIST(KSI_PublicationRecord)*, publications, Publications);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_PKISignature *, signature, Signature);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, size_t, signedDataLength, SignedDataLength);
 KSI_IMPLEMENT_GETTER(KSI_PublicationsFile, KSI_CertConstraint*, certConstraints, CertConstraints);
 
 KSI_IMPLEMENT_SETTER(KSI_PublicationsFile, KSI_PublicationsHeader*, header, Header);
-KSI_IMPLEMENT_SETTER(KSI_PublicationsFile, KSI_LIST(KSI_CertificateRecord)*, certificates, Certificates);
-KSI_IMPLEMENT_SETTER(KSI_PublicationsFile, KSI_LIST(KSI_PublicationRecord)*, publications, Publications);
 KSI_IMPLEMENT_SETTER(KSI_PublicationsFile, KSI_PKISignature *, signature, Signature);
 
+int KSI_PublicationsFile_getCertificates(const KSI_PublicationsFile *pubFile, KSI_LIST(KSI_CertificateRecord) **certificates) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (pubFile == NULL || certificates == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* The list of a lazily loaded file is created on first access. */
+	res = publicationsFile_materializeLists((KSI_PublicationsFile *)pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	*certificates = pubFile->certificates;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_PublicationsFile_getPublications(const KSI_PublicationsFile *pubFile, KSI_LIST(KSI_PublicationRecord) **publications) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (pubFile == NULL || publications == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = publicationsFile_materializeLists((KSI_PublicationsFile *)pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	*publications = pubFile->publications;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_PublicationsFile_setCertificates(KSI_PublicationsFile *pubFile, KSI_LIST(KSI_CertificateRecord) *certificates) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (pubFile == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = publicationsFile_materializeLists(pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	pubFile->certificates = certificates;
+	/* The index is rebuilt after parsing, drop the stale one. */
+	publicationsFile_freeIndex(pubFile);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_PublicationsFile_setPublications(KSI_PublicationsFile *pubFile, KSI_LIST(KSI_PublicationRecord) *publications) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (pubFile == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	res = publicationsFile_materializeLists(pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	pubFile->publications = publications;
+	/* The index is rebuilt after parsing, drop the stale one. */
+	publicationsFile_freeIndex(pubFile);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
 int KSI_PublicationsFile_getPKICertificateById(const KSI_PublicationsFile *pubFile, const KSI_OctetString *id, KSI_PKICertificate **cert) {
 	int res;
 	size_t i;
@@ -554,6 +2387,35 @@ int KSI_PublicationsFile_getPKICertificateById(const KSI_PublicationsFile *pubFi
 		goto cleanup;
 	}
 
+	if (publicationsFile_hasCertIndex(pubFile)) {
+		const unsigned char *raw = NULL;
+		size_t raw_len = 0;
+		size_t pos;
+
+		res = KSI_OctetString_extract(id, &raw, &raw_len);
+		if (res != KSI_OK) {
+			KSI_pushError(pubFile->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (raw != NULL) {
+			pos = publicationsFile_certIndexBucket(raw, raw_len, pubFile->certIndex_size);
+			while (pubFile->certIndex[pos].id != NULL) {
+				if (pubFile->certIndex[pos].id_len == raw_len && !memcmp(pubFile->certIndex[pos].id, raw, raw_len)) {
+					res = publicationsFile_certIndexCertificate(pubFile, pos, cert);
+					if (res != KSI_OK) {
+						KSI_pushError(pubFile->ctx, res, NULL);
+						goto cleanup;
+					}
+					break;
+				}
+				pos = (pos + 1) & (pubFile->certIndex_size - 1);
+			}
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
 
 	for (i = 0; i < KSI_CertificateRecordList_length(pubFile->certificates); i++) {
 		KSI_OctetString *cId = NULL;
@@ -607,6 +2469,24 @@ int KSI_PublicationsFile_getPublicationDataByTime(const KSI_PublicationsFile *tr
 		goto cleanup;
 	}
 
+	if (publicationsFile_hasTimeIndex(trust)) {
+		KSI_uint64_t tm = KSI_Integer_getUInt64(pubTime);
+
+		i = publicationsFile_timeIndexLowerBound(trust, tm);
+		if (i < trust->timeIndex_len && trust->timeIndex[i].time == tm) {
+			res = publicationsFile_timeIndexRecord(trust, i, &result);
+			if (res != KSI_OK) {
+				KSI_pushError(trust->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		*pubRec = result;
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
 		KSI_PublicationData *pd = NULL;
@@ -757,6 +2637,23 @@ int KSI_PublicationsFile_getNearestPublication(const KSI_PublicationsFile *trust
 		goto cleanup;
 	}
 
+	if (publicationsFile_hasTimeIndex(trust)) {
+		i = publicationsFile_timeIndexLowerBound(trust, KSI_Integer_getUInt64(pubTime));
+		if (i < trust->timeIndex_len) {
+			/* Of the records with equal time, the last one in the file is returned. */
+			size_t end = publicationsFile_timeIndexUpperBound(trust, trust->timeIndex[i].time);
+			res = publicationsFile_timeIndexRecord(trust, end - 1, &result);
+			if (res != KSI_OK) {
+				KSI_pushError(trust->ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+
+		*pubRec = KSI_PublicationRecord_ref(result);
+
+		res = KSI_OK;
+		goto cleanup;
+	}
 
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
@@ -824,6 +2721,24 @@ int KSI_PublicationsFile_getLatestPublication(const KSI_PublicationsFile *trust,
 		goto cleanup;
 	}
 
+	if (publicationsFile_hasTimeIndex(trust)) {
+		if (trust->timeIndex_len > 0) {
+			size_t last = trust->timeIndex_len - 1;
+
+			if (pubTime == NULL || KSI_Integer_getUInt64(pubTime) <= trust->timeIndex[last].time) {
+				res = publicationsFile_timeIndexRecord(trust, last, &result);
+				if (res != KSI_OK) {
+					KSI_pushError(trust->ctx, res, NULL);
+					goto cleanup;
+				}
+			}
+		}
+
+		*pubRec = result;
+
+		res = KSI_OK;
+		goto cleanup;
+	}
 
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
@@ -889,6 +2804,41 @@ static int findPublication(const KSI_PublicationsFile *trust, const KSI_Integer
 		goto cleanup;
 	}
 
+	if (publicationsFile_hasTimeIndex(trust)) {
+		KSI_uint64_t tm = KSI_Integer_getUInt64(time);
+
+		for (i = publicationsFile_timeIndexLowerBound(trust, tm); i < trust->timeIndex_len && trust->timeIndex[i].time == tm; i++) {
+			KSI_PublicationRecord *pr = NULL;
+
+			if (imprint != NULL && trust->isLazy) {
+				int equals = 0;
+
+				/* Records with another imprint are not materialized. */
+				res = publicationsFile_lazyImprintEquals(trust, trust->timeIndex[i].pos, imprint, &equals);
+				if (res != KSI_OK) {
+					KSI_pushError(trust->ctx, res, NULL);
+					goto cleanup;
+				}
+				if (!equals) continue;
+			}
+
+			res = publicationsFile_timeIndexRecord(trust, i, &pr);
+			if (res != KSI_OK) {
+				KSI_pushError(trust->ctx, res, NULL);
+				goto cleanup;
+			}
+
+			if (imprint != NULL && !KSI_DataHash_equals(pr->publishedData->imprint, imprint)) {
+				continue;
+			}
+			*outRec = KSI_PublicationRecord_ref(pr);
+			break;
+		}
+
+		res = KSI_OK;
+		goto cleanup;
+	}
+
 	for (i = 0; i < KSI_PublicationRecordList_length(trust->publications); i++) {
 		KSI_PublicationRecord *pr = NULL;
 
@@ -992,20 +2942,18 @@ int KSI_PublicationsFile_setCertConstraints(KSI_PublicationsFile *pubFile, const
 		tmp[i].val = NULL;
 	}
 	/* Free the existing constraints. */
-	if (pubFile->ctx->freeCertConstraintsArray != NULL) {
-		pubFile->ctx->freeCertConstraintsArray(pubFile->certConstraints);
-	}
+	publicationsFile_freeCertConstraints(pubFile->certConstraints);
 
 	pubFile->certConstraints = tmp;
 	tmp = NULL;
+	/* The file was verified with other constraints. */
+	pubFile->verifiedBy = NULL;
 
 	res = KSI_OK;
 
 cleanup:
 
-	if (pubFile != NULL && pubFile->ctx != NULL && pubFile->ctx->freeCertConstraintsArray != NULL) {
-		pubFile->ctx->freeCertConstraintsArray(tmp);
-	}
+	publicationsFile_freeCertConstraints(tmp);
 
 	return res;
 }
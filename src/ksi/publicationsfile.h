@@ -70,6 +70,27 @@ extern "C" {
 	 */
 	int KSI_PublicationsFile_fromFile(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile);
 
+	/**
+	 * Loads a publications file lazily. The file is memory mapped (or read into memory
+	 * when mapping is not supported) and only the header, the signature and the lookup
+	 * keys of the records are read. The certificate and publication records are parsed
+	 * when they are looked up for the first time, which makes loading a large file and
+	 * verifying a single signature considerably cheaper than with #KSI_PublicationsFile_fromFile.
+	 * \param[in]		ctx			KSI context.
+	 * \param[in]		fileName	Publications file filename.
+	 * \param[out]		pubFile		Pointer to the receiving pointer.
+	 *
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 * \note The structure of every record is validated when the file is loaded, only the
+	 * certificates are decoded on lookup. Calling #KSI_PublicationsFile_getPublications or
+	 * #KSI_PublicationsFile_getCertificates parses all the records.
+	 * \note The file must not be modified or truncated while the returned object is in use,
+	 * as the records that have not been parsed yet are read from the mapping. The library
+	 * does not detect such changes. To update the file, write the new version into a
+	 * separate file and rename it over the old one.
+	 */
+	int KSI_PublicationsFile_fromFileLazy(KSI_CTX *ctx, const char *fileName, KSI_PublicationsFile **pubFile);
+
 	/**
 	 * This function serializes the publications file object into raw data.
 	 * \param[in]		ctx			KSI context.
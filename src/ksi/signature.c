@@ -680,29 +680,12 @@ cleanup:
 	return res;
 }
 
-static int KSI_signature_extendToWithoutVerification(const KSI_Signature *sig, KSI_CTX *ctx, KSI_Integer *to, KSI_Signature **extended) {
+static int requestCalendarHashChain(KSI_CTX *ctx, KSI_Integer *signTime, KSI_Integer *to, KSI_CalendarHashChain **calHashChain) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_ExtendReq *req = NULL;
-	KSI_Integer *signTime = NULL;
 	KSI_RequestHandle *handle = NULL;
 	KSI_ExtendResp *resp = NULL;
-	KSI_CalendarHashChain *calHashChain = NULL;
-	KSI_Signature *tmp = NULL;
-	KSI_SignatureBuilder *builder = NULL;
-
-
-	KSI_ERR_clearErrors(ctx);
-	if (sig == NULL || ctx == NULL || extended == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
-		goto cleanup;
-	}
-
-	/* Request the calendar hash chain from this moment on. */
-	res = KSI_Signature_getSigningTime(sig, &signTime);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
+	KSI_CalendarHashChain *tmp = NULL;
 
 	/* Create request. */
 	res = KSI_createExtendRequest(ctx, signTime, to, &req);
@@ -739,12 +722,62 @@ static int KSI_signature_extendToWithoutVerification(const KSI_Signature *sig, K
 	}
 
 	/* Extract the calendar hash chain. */
-	res = KSI_ExtendResp_getCalendarHashChain(resp, &calHashChain);
+	res = KSI_ExtendResp_getCalendarHashChain(resp, &tmp);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
 		goto cleanup;
 	}
 
+	*calHashChain = KSI_CalendarHashChain_ref(tmp);
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_ExtendReq_free(req);
+	KSI_ExtendResp_free(resp);
+	KSI_RequestHandle_free(handle);
+
+	return res;
+}
+
+static int KSI_signature_extendToWithoutVerification(const KSI_Signature *sig, KSI_CTX *ctx, KSI_Integer *to, KSI_Signature **extended) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Integer *signTime = NULL;
+	KSI_CalendarHashChain *calHashChain = NULL;
+	KSI_Signature *tmp = NULL;
+	KSI_SignatureBuilder *builder = NULL;
+	int isCached = 1;
+
+
+	KSI_ERR_clearErrors(ctx);
+	if (sig == NULL || ctx == NULL || extended == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/* Request the calendar hash chain from this moment on. */
+	res = KSI_Signature_getSigningTime(sig, &signTime);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Extending to the calendar head can not be served from the cache. */
+	if (ctx->calendarCache != NULL && to != NULL) {
+		res = KSI_CalendarCache_get(ctx->calendarCache, signTime, to, &calHashChain);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (calHashChain == NULL) {
+		res = requestCalendarHashChain(ctx, signTime, to, &calHashChain);
+		if (res != KSI_OK) goto cleanup;
+		isCached = 0;
+	}
+
 	res = KSI_SignatureBuilder_openFromSignature(sig, &builder);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
@@ -760,6 +793,15 @@ static int KSI_signature_extendToWithoutVerification(const KSI_Signature *sig, K
 		}
 	}
 
+	/* Only keep the chains that have passed the compatibility check. */
+	if (!isCached && ctx->calendarCache != NULL && to != NULL) {
+		res = KSI_CalendarCache_add(ctx->calendarCache, signTime, to, calHashChain);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
 	res = KSI_SignatureBuilder_applyCalendarHashChain(builder, calHashChain);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx, res, NULL);
@@ -780,9 +822,7 @@ static int KSI_signature_extendToWithoutVerification(const KSI_Signature *sig, K
 
 cleanup:
 
-	KSI_ExtendReq_free(req);
-	KSI_ExtendResp_free(resp);
-	KSI_RequestHandle_free(handle);
+	KSI_CalendarHashChain_free(calHashChain);
 	KSI_Signature_free(tmp);
 	KSI_SignatureBuilder_free(builder);
 
@@ -16,6 +16,8 @@
  * Guardtime, Inc., and no license to trademarks is granted; Guardtime
  * reserves and retains all trademark rights.
  */
+#include <string.h>
+
 #include "signature_builder.h"
 #include "tlv.h"
 #include "tlv_template.h"
@@ -421,56 +423,57 @@ cleanup:
 	return res;
 }
 
-static int appendAggregationChain(KSI_Signature *sig, KSI_AggregationHashChain *aggr) {
+/**
+ * Updates the aggregation time and the chain index of the aggregation hash chain to be appended
+ * to the signature.
+ */
+static int prepareAggregationChain(KSI_Signature *sig, KSI_AggregationHashChain *aggr) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_Integer *pAggrTm = NULL;
 	KSI_AggregationHashChain *pCurrent = NULL;
 	size_t listLen;
 	size_t i;
-	KSI_TLV *tlv = NULL;
-	KSI_LIST(KSI_HashChainLink) *pList = NULL;
 	KSI_LIST(KSI_Integer) *pIndex = NULL;
 	KSI_LIST(KSI_Integer) *pCurrentIndex = NULL;
 
-	if (sig == NULL || aggr == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-
-	KSI_ERR_clearErrors(sig->ctx);
-
-	res = KSI_AggregationHashChain_getChain(aggr, &pList);
+	/* Get and update the aggregation time. */
+	res = KSI_Signature_getSigningTime(sig, &pAggrTm);
 	if (res != KSI_OK) {
 		KSI_pushError(sig->ctx, res, NULL);
 		goto cleanup;
 	}
 
-	if (KSI_HashChainLinkList_length(pList) > 0) {
-		/* Get and update the aggregation time. */
-		res = KSI_Signature_getSigningTime(sig, &pAggrTm);
+	{
+		KSI_Integer *ref = NULL;
+		res = KSI_AggregationHashChain_setAggregationTime(aggr, ref = KSI_Integer_ref(pAggrTm));
 		if (res != KSI_OK) {
+			KSI_Integer_free(ref);
 			KSI_pushError(sig->ctx, res, NULL);
 			goto cleanup;
 		}
+	}
 
-		{
-			KSI_Integer *ref = NULL;
-			res = KSI_AggregationHashChain_setAggregationTime(aggr, ref = KSI_Integer_ref(pAggrTm));
-			if (res != KSI_OK) {
-				KSI_Integer_free(ref);
-				KSI_pushError(sig->ctx, res, NULL);
-				goto cleanup;
-			}
-		}
+	/* Update the aggregation hash chain. */
+	listLen = KSI_AggregationHashChainList_length(sig->aggregationChainList);
+	if (listLen == 0) {
+		KSI_pushError(sig->ctx, res = KSI_INVALID_STATE, "Signature does not contain any aggregation hash chains.");
+		goto cleanup;
+	}
 
-		/* Update the aggregation hash chain. */
-		listLen = KSI_AggregationHashChainList_length(sig->aggregationChainList);
-		if (listLen == 0) {
-			KSI_pushError(sig->ctx, res = KSI_INVALID_STATE, "Signature does not contain any aggregation hash chains.");
+	/* Just make sure there is a chain index present. */
+	res = KSI_AggregationHashChain_getChainIndex(aggr, &pIndex);
+	if (res != KSI_OK) {
+		KSI_pushError(sig->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (pIndex == NULL) {
+		res = addChainIndex(sig->ctx, aggr);
+		if (res != KSI_OK) {
+			KSI_pushError(sig->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		/* Just make sure there is a chain index present. */
 		res = KSI_AggregationHashChain_getChainIndex(aggr, &pIndex);
 		if (res != KSI_OK) {
 			KSI_pushError(sig->ctx, res, NULL);
@@ -478,63 +481,81 @@ static int appendAggregationChain(KSI_Signature *sig, KSI_AggregationHashChain *
 		}
 
 		if (pIndex == NULL) {
-			res = addChainIndex(sig->ctx, aggr);
-			if (res != KSI_OK) {
-				KSI_pushError(sig->ctx, res, NULL);
-				goto cleanup;
-			}
+			KSI_pushError(sig->ctx, res = KSI_INVALID_STATE, NULL);
+			goto cleanup;
+		}
+	}
 
-			res = KSI_AggregationHashChain_getChainIndex(aggr, &pIndex);
-			if (res != KSI_OK) {
-				KSI_pushError(sig->ctx, res, NULL);
-				goto cleanup;
-			}
+	/* We assume the aggregation hash chain is ordered and the first aggregation hash chain is the one
+	 * with the longest chain index.
+	 */
+	res = KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, 0, &pCurrent);
+	if (res != KSI_OK || pCurrent == NULL) {
+		KSI_pushError(sig->ctx, res != KSI_OK ? res : (res = KSI_INVALID_STATE), NULL);
+		goto cleanup;
+	}
 
-			if (pIndex == NULL) {
-				KSI_pushError(sig->ctx, res = KSI_INVALID_STATE, NULL);
-				goto cleanup;
-			}
-		}
+	/* Traverse the chain index from back to forth, and add the values to the begining of the
+	 * aggregation hash chain.
+	 */
+
+	res = KSI_AggregationHashChain_getChainIndex(pCurrent, &pCurrentIndex);
+	if (res != KSI_OK) {
+		KSI_pushError(sig->ctx, res, NULL);
+		goto cleanup;
+	}
 
-		/* We assume the aggregation hash chain is ordered and the first aggregation hash chain is the one
-		 * with the longest chain index.
-		 */
-		res = KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, 0, &pCurrent);
-		if (res != KSI_OK || pCurrent == NULL) {
-			KSI_pushError(sig->ctx, res != KSI_OK ? res : (res = KSI_INVALID_STATE), NULL);
+	for (i = KSI_IntegerList_length(pCurrentIndex); i > 0; i--) {
+		KSI_Integer *tmp = NULL;
+		KSI_Integer *ref = NULL;
+
+		res = KSI_IntegerList_elementAt(pCurrentIndex, i - 1, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(sig->ctx, res, NULL);
 			goto cleanup;
 		}
 
-		/* Traverse the chain index from back to forth, and add the values to the begining of the
-		 * aggregation hash chain.
-		 */
-
-		res = KSI_AggregationHashChain_getChainIndex(pCurrent, &pCurrentIndex);
+		res = KSI_IntegerList_insertAt(pIndex, 0, ref = KSI_Integer_ref(tmp));
 		if (res != KSI_OK) {
+			/* Cleanup the reference. */
+			KSI_Integer_free(ref);
+
 			KSI_pushError(sig->ctx, res, NULL);
 			goto cleanup;
 		}
+	}
 
-		for (i = KSI_IntegerList_length(pCurrentIndex); i > 0; i--) {
-			KSI_Integer *tmp = NULL;
-			KSI_Integer *ref = NULL;
+	res = KSI_OK;
 
-			res = KSI_IntegerList_elementAt(pCurrentIndex, i - 1, &tmp);
-			if (res != KSI_OK) {
-				KSI_pushError(sig->ctx, res, NULL);
-				goto cleanup;
-			}
+cleanup:
 
-			res = KSI_IntegerList_insertAt(pIndex, 0, ref = KSI_Integer_ref(tmp));
-			if (res != KSI_OK) {
-				/* Cleanup the reference. */
-				KSI_Integer_free(ref);
+	return res;
+}
 
-				KSI_pushError(sig->ctx, res, NULL);
-				goto cleanup;
-			}
-		}
+static int appendAggregationChain(KSI_Signature *sig, KSI_AggregationHashChain *aggr) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TLV *tlv = NULL;
+	KSI_LIST(KSI_HashChainLink) *pList = NULL;
+
+	if (sig == NULL || aggr == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(sig->ctx);
+
+	res = KSI_AggregationHashChain_getChain(aggr, &pList);
+	if (res != KSI_OK) {
+		KSI_pushError(sig->ctx, res, NULL);
+		goto cleanup;
+	}
 
+	if (KSI_HashChainLinkList_length(pList) > 0) {
+		res = prepareAggregationChain(sig, aggr);
+		if (res != KSI_OK) {
+			KSI_pushError(sig->ctx, res, NULL);
+			goto cleanup;
+		}
 
 		/* Prepend the aggregation hash chain to the signature. */
 		{
@@ -663,6 +684,190 @@ cleanup:
 	return res;
 }
 
+/**
+ * Calculates the output level of the aggregation hash chain without hashing.
+ */
+static int getChainLevel(const KSI_AggregationHashChain *aggr, KSI_uint64_t *level) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+	KSI_uint64_t tmp = 0;
+	size_t i;
+
+	res = KSI_AggregationHashChain_getChain(aggr, &links);
+	if (res != KSI_OK) goto cleanup;
+
+	for (i = 0; i < KSI_HashChainLinkList_length(links); i++) {
+		KSI_HashChainLink *link = NULL;
+		KSI_Integer *levelCorrection = NULL;
+
+		res = KSI_HashChainLinkList_elementAt(links, i, &link);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_HashChainLink_getLevelCorrection(link, &levelCorrection);
+		if (res != KSI_OK) goto cleanup;
+
+		tmp += KSI_Integer_getUInt64(levelCorrection) + 1;
+		if (!KSI_IS_VALID_TREE_LEVEL(tmp)) {
+			res = KSI_INVALID_FORMAT;
+			goto cleanup;
+		}
+	}
+
+	*level = tmp;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Serializes the nested elements of the signature with the level correction of the first
+ * aggregation hash chain reduced by \c rootLevel, as done by #KSI_SignatureBuilder_appendAggregationChain.
+ */
+static int calculateCommonPart(KSI_SignatureBuilder *builder, KSI_uint64_t rootLevel) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_Signature *clone = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	size_t hdr_len;
+
+	res = KSI_Signature_clone(builder->sig, &clone);
+	if (res != KSI_OK) goto cleanup;
+
+	if (clone->baseTlv == NULL) {
+		res = KSI_TLV_new(builder->ctx, 0x0800, 0, 0, &clone->baseTlv);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_TlvTemplate_construct(builder->ctx, clone->baseTlv, clone, KSI_TLV_TEMPLATE(KSI_Signature));
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	if (rootLevel != 0) {
+		res = subRootLevel(clone, rootLevel);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_TLV_serialize(clone->baseTlv, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	/* Drop the TLV header, only the type and tag are kept. */
+	hdr_len = (raw[0] & KSI_TLV_MASK_TLV16) ? 4 : 2;
+	if (raw_len < hdr_len) {
+		res = KSI_INVALID_FORMAT;
+		goto cleanup;
+	}
+
+	KSI_free(builder->common);
+	builder->common = NULL;
+
+	builder->common_len = raw_len - hdr_len;
+	builder->common = KSI_malloc(builder->common_len + 1);
+	if (builder->common == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	memcpy(builder->common, raw + hdr_len, builder->common_len);
+	builder->commonHdr[0] = (unsigned char)((raw[0] & (KSI_TLV_MASK_LENIENT | KSI_TLV_MASK_FORWARD)) | KSI_TLV_MASK_TLV16 | (KSI_TLV_getTag(clone->baseTlv) >> 8));
+	builder->commonHdr[1] = (unsigned char)(KSI_TLV_getTag(clone->baseTlv) & 0xff);
+	builder->commonLevel = rootLevel;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_Signature_free(clone);
+
+	return res;
+}
+
+int KSI_SignatureBuilder_serializeWithAggregationChain(KSI_SignatureBuilder *builder, KSI_AggregationHashChain *aggr, unsigned char **raw, size_t *raw_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+	KSI_uint64_t rootLevel = 0;
+	unsigned char *chain = NULL;
+	size_t chain_len = 0;
+	unsigned char *tmp = NULL;
+	size_t payload_len;
+
+	if (builder == NULL || aggr == NULL || raw == NULL || raw_len == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	res = KSI_AggregationHashChain_getChain(aggr, &links);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (KSI_HashChainLinkList_length(links) > 0) {
+		res = getChainLevel(aggr, &rootLevel);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = prepareAggregationChain(builder->sig, aggr);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_TlvTemplate_serializeObject(builder->ctx, aggr, 0x0801, 0, 0, KSI_TLV_TEMPLATE(KSI_AggregationHashChain), &chain, &chain_len);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* The common part is calculated once for all the chains ending at the same level. */
+	if (builder->common == NULL || builder->commonLevel != rootLevel) {
+		res = calculateCommonPart(builder, rootLevel);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	payload_len = builder->common_len + chain_len;
+	if (payload_len > 0xffff) {
+		KSI_pushError(builder->ctx, res = KSI_BUFFER_OVERFLOW, "Signature too large.");
+		goto cleanup;
+	}
+
+	tmp = KSI_malloc(payload_len + 4);
+	if (tmp == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	/* The appended chain is the last nested element of the signature. */
+	tmp[0] = builder->commonHdr[0];
+	tmp[1] = builder->commonHdr[1];
+	tmp[2] = (unsigned char)((payload_len >> 8) & 0xff);
+	tmp[3] = (unsigned char)(payload_len & 0xff);
+	memcpy(tmp + 4, builder->common, builder->common_len);
+	if (chain_len > 0) memcpy(tmp + 4 + builder->common_len, chain, chain_len);
+
+	*raw = tmp;
+	*raw_len = payload_len + 4;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(chain);
+	KSI_free(tmp);
+
+	return res;
+}
+
 static int KSI_Signature_new(KSI_CTX *ctx, KSI_Signature **sig) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_Signature *tmp = NULL;
@@ -734,6 +939,9 @@ int KSI_SignatureBuilder_open(KSI_CTX *ctx, KSI_SignatureBuilder **builder) {
 	tmp->ctx = ctx;
 	tmp->noVerify = 0;
 	tmp->sig = NULL;
+	tmp->common = NULL;
+	tmp->common_len = 0;
+	tmp->commonLevel = 0;
 
 	res = KSI_Signature_new(ctx, &tmp->sig);
 	if (res != KSI_OK) {
@@ -773,6 +981,9 @@ int KSI_SignatureBuilder_openFromSignature(const KSI_Signature *sig, KSI_Signatu
 	tmp->ctx = sig->ctx;
 	tmp->noVerify = 0;
 	tmp->sig = NULL;
+	tmp->common = NULL;
+	tmp->common_len = 0;
+	tmp->commonLevel = 0;
 
 	res = KSI_Signature_clone(sig, &tmp->sig);
 	if (res != KSI_OK) {
@@ -1122,6 +1333,7 @@ cleanup:
 void KSI_SignatureBuilder_free(KSI_SignatureBuilder *builder) {
 	if (builder != NULL) {
 		KSI_Signature_free(builder->sig);
+		KSI_free(builder->common);
 		KSI_free(builder);
 	}
 }
@@ -142,6 +142,21 @@ extern "C" {
 	 */
 	int KSI_SignatureBuilder_createSignatureWithAggregationChain(KSI_SignatureBuilder *builder, KSI_AggregationHashChain *aggr, KSI_Signature **sig);
 
+	/**
+	 * Serializes the signature with the aggregation chain appended, as #KSI_SignatureBuilder_createSignatureWithAggregationChain
+	 * would do, without creating a signature object. The nested elements of the signature common to all the
+	 * appended chains are serialized once by the builder, and only the appended chain is serialized per call.
+	 * \param[in]	builder		Pointer to the builder.
+	 * \param[in]	aggr		Aggregation hash chain.
+	 * \param[out]	raw			Pointer to the receiving pointer of the serialized signature.
+	 * \param[out]	raw_len		Length of the serialized signature.
+	 * \note The aggregation time and the chain index of \c aggr are updated.
+	 * \note The output is not verified, the caller is responsible for the correctness of \c aggr.
+	 * \note The caller is responsible for freeing the output with #KSI_free.
+	 * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+	 */
+	int KSI_SignatureBuilder_serializeWithAggregationChain(KSI_SignatureBuilder *builder, KSI_AggregationHashChain *aggr, unsigned char **raw, size_t *raw_len);
+
 	/**
 	 * This function sets the calendar authentication record of the signature.
 	 * \param[in]	builder		Pointer to the builder.
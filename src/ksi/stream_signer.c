@@ -0,0 +1,545 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "stream_signer.h"
+#include "blocksigner.h"
+#include "compatibility.h"
+
+#define STREAM_SIGNER_DEFAULT_BLOCK_SIZE 1024
+#define STREAM_SIGNER_DEFAULT_BLOCK_AGE 1000
+#define STREAM_SIGNER_DEFAULT_MAX_PENDING 65536
+
+typedef struct StreamRecord_st {
+	void *recordCtx;
+	KSI_BlockSignerHandle *handle;
+	/** Time of adding the record in milliseconds, see #KSI_getMonotonicTimeMs. */
+	KSI_uint64_t addedAt;
+} StreamRecord;
+
+typedef struct StreamBlock_st {
+	StreamRecord *records;
+	size_t records_len;
+	size_t records_size;
+} StreamBlock;
+
+struct KSI_StreamSigner_st {
+	KSI_CTX *ctx;
+	KSI_BlockSignerPipeline *pipeline;
+	/** Hasher for the records. */
+	KSI_DataHasher *hasher;
+	/** Closed blocks in the order of closing, the last block is the open one. */
+	StreamBlock *blocks;
+	size_t blocks_len;
+	size_t blocks_size;
+	/** Number of records not yet passed to the sink. */
+	size_t pending;
+
+	size_t maxBlockSize;
+	size_t maxBlockAge;
+	size_t maxPending;
+
+	KSI_StreamSignerSink sink;
+	void *sinkCtx;
+
+	KSI_uint64_t recordsAdded;
+	KSI_uint64_t recordsSigned;
+	KSI_uint64_t recordsFailed;
+	KSI_uint64_t blocksClosed;
+	KSI_uint64_t latencyTotal;
+	KSI_uint64_t latencyMax;
+	/** Time of adding the first record. */
+	KSI_uint64_t startedAt;
+};
+
+static void StreamBlock_clear(StreamBlock *block) {
+	size_t i;
+
+	for (i = 0; i < block->records_len; i++) {
+		KSI_BlockSignerHandle_free(block->records[i].handle);
+	}
+	KSI_free(block->records);
+
+	block->records = NULL;
+	block->records_len = 0;
+	block->records_size = 0;
+}
+
+/**
+ * Passes the records of the oldest closed block to the sink. Called by the pipeline in the order
+ * of closing, thus the block is always the first one in the list.
+ */
+static int stream_deliverBlock(void *c, KSI_BlockSigner KSI_UNUSED(*block), int status) {
+	int res = KSI_OK;
+	KSI_StreamSigner *signer = c;
+	StreamBlock *blk = &signer->blocks[0];
+	KSI_uint64_t now = KSI_getMonotonicTimeMs();
+	size_t i;
+
+	for (i = 0; i < blk->records_len && res == KSI_OK; i++) {
+		StreamRecord *rec = &blk->records[i];
+		unsigned char *raw = NULL;
+		size_t raw_len = 0;
+		int recStatus = status;
+		KSI_uint64_t latency = now - rec->addedAt;
+
+		if (recStatus == KSI_OK) {
+			recStatus = KSI_BlockSignerHandle_serializeSignature(rec->handle, &raw, &raw_len);
+		}
+
+		res = signer->sink(signer->sinkCtx, rec->recordCtx, recStatus, recStatus == KSI_OK ? raw : NULL, recStatus == KSI_OK ? raw_len : 0);
+
+		KSI_free(raw);
+
+		if (recStatus == KSI_OK) {
+			signer->recordsSigned++;
+		} else {
+			signer->recordsFailed++;
+		}
+		signer->latencyTotal += latency;
+		if (latency > signer->latencyMax) signer->latencyMax = latency;
+	}
+
+	/* On a sink failure the rest of the block is dropped together with the block. */
+	signer->pending -= blk->records_len;
+	StreamBlock_clear(blk);
+
+	signer->blocks_len--;
+	memmove(signer->blocks, signer->blocks + 1, signer->blocks_len * sizeof(StreamBlock));
+
+	return res;
+}
+
+int KSI_StreamSigner_new(KSI_CTX *ctx, KSI_AsyncService *service, KSI_HashAlgorithm algo, KSI_DataHash *prevLeaf, KSI_OctetString *iv,
+		KSI_StreamSignerSink sink, void *sinkCtx, KSI_StreamSigner **signer) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_StreamSigner *tmp = NULL;
+	KSI_BlockSigner *first = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (ctx == NULL || service == NULL || sink == NULL || signer == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_StreamSigner);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ctx = ctx;
+	tmp->pipeline = NULL;
+	tmp->hasher = NULL;
+	tmp->blocks = NULL;
+	tmp->blocks_len = 0;
+	tmp->blocks_size = 0;
+	tmp->pending = 0;
+	tmp->maxBlockSize = STREAM_SIGNER_DEFAULT_BLOCK_SIZE;
+	tmp->maxBlockAge = STREAM_SIGNER_DEFAULT_BLOCK_AGE;
+	tmp->maxPending = STREAM_SIGNER_DEFAULT_MAX_PENDING;
+	tmp->sink = sink;
+	tmp->sinkCtx = sinkCtx;
+	tmp->recordsAdded = 0;
+	tmp->recordsSigned = 0;
+	tmp->recordsFailed = 0;
+	tmp->blocksClosed = 0;
+	tmp->latencyTotal = 0;
+	tmp->latencyMax = 0;
+	tmp->startedAt = 0;
+
+	tmp->blocks = KSI_calloc(4, sizeof(StreamBlock));
+	if (tmp->blocks == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	tmp->blocks_size = 4;
+	/* The open block. */
+	tmp->blocks_len = 1;
+
+	res = KSI_DataHasher_open(ctx, algo, &tmp->hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_BlockSigner_new(ctx, algo, prevLeaf, iv, &first);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_BlockSignerPipeline_new(first, service, stream_deliverBlock, tmp, &tmp->pipeline);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*signer = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockSigner_free(first);
+	KSI_StreamSigner_free(tmp);
+
+	return res;
+}
+
+void KSI_StreamSigner_free(KSI_StreamSigner *signer) {
+	size_t i;
+
+	if (signer == NULL) return;
+
+	/* Free the pipeline first, as it refers to the blocks through the callback context. */
+	KSI_BlockSignerPipeline_free(signer->pipeline);
+
+	for (i = 0; i < signer->blocks_len; i++) {
+		StreamBlock_clear(&signer->blocks[i]);
+	}
+	KSI_free(signer->blocks);
+	KSI_DataHasher_free(signer->hasher);
+	KSI_free(signer);
+}
+
+int KSI_StreamSigner_setMaxBlockSize(KSI_StreamSigner *signer, size_t records) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL || records == 0) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	signer->maxBlockSize = records;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_StreamSigner_setMaxBlockAge(KSI_StreamSigner *signer, size_t ms) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	signer->maxBlockAge = ms;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_StreamSigner_setMaxPending(KSI_StreamSigner *signer, size_t records) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL || records == 0) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	signer->maxPending = records;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int stream_closeBlock(KSI_StreamSigner *signer) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	/* Make room for the next block first, so that a failure leaves the current block open. */
+	if (signer->blocks_len == signer->blocks_size) {
+		size_t size = signer->blocks_size * 2;
+		StreamBlock *tmp = KSI_calloc(size, sizeof(StreamBlock));
+
+		if (tmp == NULL) {
+			KSI_pushError(signer->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		memcpy(tmp, signer->blocks, signer->blocks_len * sizeof(StreamBlock));
+		KSI_free(signer->blocks);
+		signer->blocks = tmp;
+		signer->blocks_size = size;
+	}
+
+	res = KSI_BlockSignerPipeline_closeBlock(signer->pipeline);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	memset(&signer->blocks[signer->blocks_len++], 0, sizeof(StreamBlock));
+	signer->blocksClosed++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static bool stream_isBlockDue(const KSI_StreamSigner *signer, KSI_uint64_t now) {
+	const StreamBlock *blk = &signer->blocks[signer->blocks_len - 1];
+
+	if (blk->records_len == 0) return false;
+	if (blk->records_len >= signer->maxBlockSize) return true;
+
+	return signer->maxBlockAge > 0 && now - blk->records[0].addedAt >= signer->maxBlockAge;
+}
+
+int KSI_StreamSigner_addHash(KSI_StreamSigner *signer, KSI_DataHash *hsh, void *recordCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSignerHandle *handle = NULL;
+	StreamBlock *blk = NULL;
+	StreamRecord *rec = NULL;
+	KSI_uint64_t now;
+
+	if (signer == NULL || hsh == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	/* Backpressure, the caller has to run the signer before adding more records. */
+	if (signer->pending >= signer->maxPending) {
+		res = KSI_ASYNC_REQUEST_CACHE_FULL;
+		goto cleanup;
+	}
+
+	/* A full block is closed before adding to it, so that a failure to close does not lose the record. */
+	blk = &signer->blocks[signer->blocks_len - 1];
+	if (blk->records_len >= signer->maxBlockSize) {
+		res = stream_closeBlock(signer);
+		if (res != KSI_OK) goto cleanup;
+		blk = &signer->blocks[signer->blocks_len - 1];
+	}
+
+	if (blk->records_len == blk->records_size) {
+		size_t size = blk->records_size == 0 ? 64 : blk->records_size * 2;
+		StreamRecord *tmp = KSI_calloc(size, sizeof(StreamRecord));
+
+		if (tmp == NULL) {
+			KSI_pushError(signer->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		if (blk->records_len > 0) memcpy(tmp, blk->records, blk->records_len * sizeof(StreamRecord));
+		KSI_free(blk->records);
+		blk->records = tmp;
+		blk->records_size = size;
+	}
+
+	res = KSI_BlockSignerPipeline_getBlockSigner(signer->pipeline, &bs);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, &handle);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	now = KSI_getMonotonicTimeMs();
+	if (signer->recordsAdded == 0) signer->startedAt = now;
+
+	rec = &blk->records[blk->records_len++];
+	rec->recordCtx = recordCtx;
+	rec->handle = handle;
+	rec->addedAt = now;
+	handle = NULL;
+
+	signer->pending++;
+	signer->recordsAdded++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_BlockSignerHandle_free(handle);
+
+	return res;
+}
+
+int KSI_StreamSigner_addRecord(KSI_StreamSigner *signer, const void *data, size_t data_len, void *recordCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *hsh = NULL;
+
+	if (signer == NULL || (data == NULL && data_len != 0)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	/* Check the limit before hashing. */
+	if (signer->pending >= signer->maxPending) {
+		res = KSI_ASYNC_REQUEST_CACHE_FULL;
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_reset(signer->hasher);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_add(signer->hasher, data, data_len);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_DataHasher_close(signer->hasher, &hsh);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_StreamSigner_addHash(signer, hsh, recordCtx);
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+int KSI_StreamSigner_flush(KSI_StreamSigner *signer) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (signer->blocks[signer->blocks_len - 1].records_len > 0) {
+		res = stream_closeBlock(signer);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_StreamSigner_run(KSI_StreamSigner *signer, size_t *pending) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (signer == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(signer->ctx);
+
+	if (stream_isBlockDue(signer, KSI_getMonotonicTimeMs())) {
+		res = stream_closeBlock(signer);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_BlockSignerPipeline_run(signer->pipeline, NULL);
+	if (res != KSI_OK) {
+		KSI_pushError(signer->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (pending != NULL && signer != NULL) *pending = signer->pending;
+
+	return res;
+}
+
+int KSI_StreamSigner_getCounter(const KSI_StreamSigner *signer, int counter, KSI_uint64_t *value) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_uint64_t delivered;
+	KSI_uint64_t elapsed;
+
+	if (signer == NULL || value == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	delivered = signer->recordsSigned + signer->recordsFailed;
+
+	switch (counter) {
+		case KSI_STREAM_SIGNER_RECORDS_ADDED:
+			*value = signer->recordsAdded;
+			break;
+		case KSI_STREAM_SIGNER_RECORDS_SIGNED:
+			*value = signer->recordsSigned;
+			break;
+		case KSI_STREAM_SIGNER_RECORDS_FAILED:
+			*value = signer->recordsFailed;
+			break;
+		case KSI_STREAM_SIGNER_BLOCKS_CLOSED:
+			*value = signer->blocksClosed;
+			break;
+		case KSI_STREAM_SIGNER_LATENCY_AVG:
+			*value = delivered > 0 ? signer->latencyTotal / delivered : 0;
+			break;
+		case KSI_STREAM_SIGNER_LATENCY_MAX:
+			*value = signer->latencyMax;
+			break;
+		case KSI_STREAM_SIGNER_THROUGHPUT:
+			elapsed = signer->recordsAdded > 0 ? KSI_getMonotonicTimeMs() - signer->startedAt : 0;
+			*value = elapsed > 0 ? delivered * 1000 / elapsed : 0;
+			break;
+		default:
+			res = KSI_INVALID_ARGUMENT;
+			goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef STREAM_SIGNER_H_
+#define STREAM_SIGNER_H_
+
+#include "types.h"
+#include "hash.h"
+#include "net_async.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup streamsigner Stream Signer
+ * The stream signer signs a continuous stream of records. The records are hashed and added to
+ * a block, the block is closed when it reaches the configured number of records or age, and the
+ * root of the block is signed through an asynchronous signing service while the next block is
+ * already being filled. The signatures of the records are passed to the output sink in the order
+ * the records were added.
+ *
+ * The stream signer does not create any threads, the time limits and the responses are handled
+ * by #KSI_StreamSigner_run, which should be called regularly.
+ * @{
+ */
+
+/**
+ * Output sink of the stream signer.
+ * \param[in]	sinkCtx		Sink context.
+ * \param[in]	recordCtx	Record context passed to #KSI_StreamSigner_addRecord or #KSI_StreamSigner_addHash.
+ * \param[in]	status		#KSI_OK if the record was signed, otherwise an error code.
+ * \param[in]	raw			Serialized signature of the record, \c NULL on failure.
+ * \param[in]	raw_len		Length of the serialized signature.
+ * \return #KSI_OK to continue, any other value is returned to the caller of #KSI_StreamSigner_run.
+ * \note The serialized signature is freed when the sink returns.
+ */
+typedef int (*KSI_StreamSignerSink)(void *sinkCtx, void *recordCtx, int status, const unsigned char *raw, size_t raw_len);
+
+/**
+ * Counters of the stream signer, see #KSI_StreamSigner_getCounter.
+ */
+typedef enum KSI_StreamSignerCounter_en {
+	/** Number of records added. */
+	KSI_STREAM_SIGNER_RECORDS_ADDED = 0,
+	/** Number of records passed to the sink with a signature. */
+	KSI_STREAM_SIGNER_RECORDS_SIGNED,
+	/** Number of records passed to the sink with an error. */
+	KSI_STREAM_SIGNER_RECORDS_FAILED,
+	/** Number of blocks closed. */
+	KSI_STREAM_SIGNER_BLOCKS_CLOSED,
+	/** Average time in milliseconds from adding a record until passing it to the sink. */
+	KSI_STREAM_SIGNER_LATENCY_AVG,
+	/** Maximum time in milliseconds from adding a record until passing it to the sink. */
+	KSI_STREAM_SIGNER_LATENCY_MAX,
+	/** Number of records passed to the sink per second, measured from the first added record. */
+	KSI_STREAM_SIGNER_THROUGHPUT,
+	__KSI_STREAM_SIGNER_COUNTER_COUNT
+} KSI_StreamSignerCounter;
+
+/**
+ * Creates a new stream signer.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	service		Signing async service, see #KSI_SigningAsyncService_new.
+ * \param[in]	algo		Hash algorithm for hashing the records and the aggregation trees.
+ * \param[in]	prevLeaf	Last leaf of the previous stream, used for masking (can be \c NULL).
+ * \param[in]	iv			Initial value for masking, if \c NULL masking is not used.
+ * \param[in]	sink		Output sink receiving the record signatures.
+ * \param[in]	sinkCtx		Sink context.
+ * \param[out]	signer		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The \c service is not owned by the stream signer and must not be freed nor used for other
+ * requests while the stream signer is in use.
+ */
+int KSI_StreamSigner_new(KSI_CTX *ctx, KSI_AsyncService *service, KSI_HashAlgorithm algo, KSI_DataHash *prevLeaf, KSI_OctetString *iv,
+		KSI_StreamSignerSink sink, void *sinkCtx, KSI_StreamSigner **signer);
+
+/**
+ * Cleanup method for the #KSI_StreamSigner. The records not yet passed to the sink are dropped.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ */
+void KSI_StreamSigner_free(KSI_StreamSigner *signer);
+
+/**
+ * Sets the number of records after which the block is closed. The default is 1024.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	records		Maximum number of records in a block, must be greater than 0.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_StreamSigner_setMaxBlockSize(KSI_StreamSigner *signer, size_t records);
+
+/**
+ * Sets the time after which a block is closed, measured from adding its first record. The default
+ * is 1000 milliseconds.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	ms			Maximum age of a block in milliseconds, 0 disables the time limit.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The time limit is checked by #KSI_StreamSigner_run.
+ */
+int KSI_StreamSigner_setMaxBlockAge(KSI_StreamSigner *signer, size_t ms);
+
+/**
+ * Sets the maximum number of records that have been added but not yet passed to the sink. When the
+ * limit is reached, new records are rejected until the signatures of the earlier records have been
+ * received. The default is 65536.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	records		Maximum number of pending records, must be greater than 0.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_StreamSigner_setMaxPending(KSI_StreamSigner *signer, size_t records);
+
+/**
+ * Hashes the record and adds it to the current block.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	data		Record data.
+ * \param[in]	data_len	Length of the record data.
+ * \param[in]	recordCtx	Record context passed to the sink.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \return #KSI_ASYNC_REQUEST_CACHE_FULL, if the maximum number of pending records has been reached.
+ * In this case the record is not added, call #KSI_StreamSigner_run and try again.
+ */
+int KSI_StreamSigner_addRecord(KSI_StreamSigner *signer, const void *data, size_t data_len, void *recordCtx);
+
+/**
+ * Adds a hash of a record to the current block, see #KSI_StreamSigner_addRecord.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	hsh			Hash of the record.
+ * \param[in]	recordCtx	Record context passed to the sink.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \return #KSI_ASYNC_REQUEST_CACHE_FULL, if the maximum number of pending records has been reached.
+ */
+int KSI_StreamSigner_addHash(KSI_StreamSigner *signer, KSI_DataHash *hsh, void *recordCtx);
+
+/**
+ * Closes the current block regardless of its size and age. Does nothing if the block is empty.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note To wait for all the signatures call #KSI_StreamSigner_run until there are no pending records.
+ */
+int KSI_StreamSigner_flush(KSI_StreamSigner *signer);
+
+/**
+ * Closes the current block if it has reached its age limit, runs the async service without blocking
+ * and passes the received record signatures to the sink.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[out]	pending		Number of records not yet passed to the sink (can be \c NULL).
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_StreamSigner_run(KSI_StreamSigner *signer, size_t *pending);
+
+/**
+ * Getter for the counters of the stream signer.
+ * \param[in]	signer		Instance of the #KSI_StreamSigner.
+ * \param[in]	counter		Counter, see #KSI_StreamSignerCounter.
+ * \param[out]	value		Value of the counter.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ */
+int KSI_StreamSigner_getCounter(const KSI_StreamSigner *signer, int counter, KSI_uint64_t *value);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_SIGNER_H_ */
@@ -17,6 +17,7 @@
  * reserves and retains all trademark rights.
  */
 
+#include <stdio.h>
 #include <string.h>
 
 #include "internal.h"
@@ -24,6 +25,12 @@
 #include "hashchain.h"
 #include "impl/meta_data_impl.h"
 
+#ifdef _WIN32
+#  include <windows.h>
+#elif defined(HAVE_PTHREAD_H)
+#  include <pthread.h>
+#endif
+
 KSI_IMPLEMENT_LIST(KSI_TreeBuilderLeafProcessor, NULL);
 
 struct KSI_TreeLeafHandle_st {
@@ -36,7 +43,18 @@ KSI_IMPLEMENT_REF(KSI_TreeLeafHandle);
 
 KSI_IMPLEMENT_LIST(KSI_TreeLeafHandle, KSI_TreeLeafHandle_free);
 
-static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *leftSibling, KSI_TreeNode *rightSibling, KSI_TreeNode **root);
+/** The tree builder with the fields that are not part of the public structure. */
+typedef struct TreeBuilderImpl_st {
+	KSI_TreeBuilder builder;
+	/** Number of threads used for calculating the internal nodes. If greater than 1, the hash values
+	 * of the internal nodes are calculated in parallel when the tree is closed. */
+	size_t threads;
+} TreeBuilderImpl;
+
+/* Every tree builder is allocated by #KSI_TreeBuilder_new as a #TreeBuilderImpl. */
+#define TREE_BUILDER_THREADS(builder) (((TreeBuilderImpl *)(builder))->threads)
+
+static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *leftSibling, KSI_TreeNode *rightSibling, bool defer, KSI_TreeNode **root);
 
 void KSI_TreeNode_free(KSI_TreeNode *node) {
 	if (node != NULL ) {
@@ -168,7 +186,34 @@ cleanup:
 	return res;
 }
 
-static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *leftSibling, KSI_TreeNode *rightSibling, KSI_TreeNode **root) {
+/**
+ * Calculates the hash values of the internal nodes of the subtree, whose calculation was deferred.
+ */
+static int calculatePending(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *node) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (node == NULL || node->hash != NULL || node->metaData != NULL) {
+		res = KSI_OK;
+		goto cleanup;
+	}
+
+	res = calculatePending(ctx, hsr, node->leftChild);
+	if (res != KSI_OK) goto cleanup;
+
+	res = calculatePending(ctx, hsr, node->rightChild);
+	if (res != KSI_OK) goto cleanup;
+
+	res = joinHashes(ctx, hsr, node->leftChild, node->rightChild, node->level, &node->hash);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *leftSibling, KSI_TreeNode *rightSibling, bool defer, KSI_TreeNode **root) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_TreeNode *tmp = NULL;
 	int level;
@@ -194,18 +239,48 @@ static int KSI_TreeNode_join(KSI_CTX *ctx, KSI_DataHasher *hsr, KSI_TreeNode *le
 		goto cleanup;
 	}
 
-	/* Create the root hash value. */
-	res = joinHashes(ctx, hsr, leftSibling, rightSibling, level, &hsh);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
-	}
+	if (defer && leftSibling->metaData == NULL && rightSibling->metaData == NULL) {
+		/* The hash value is calculated when the tree is closed. As the meta-data is serialized
+		 * using the KSI context, the meta-data nodes are always joined immediately. */
+		tmp = KSI_new(KSI_TreeNode);
+		if (tmp == NULL) {
+			KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
 
-	/* Create a new tree node. */
-	res = KSI_TreeNode_new(ctx, hsh, NULL, level, &tmp);
-	if (res != KSI_OK) {
-		KSI_pushError(ctx, res, NULL);
-		goto cleanup;
+		tmp->ctx = ctx;
+		tmp->hash = NULL;
+		tmp->metaData = NULL;
+		tmp->level = level;
+		tmp->parent = NULL;
+		tmp->leftChild = NULL;
+		tmp->rightChild = NULL;
+	} else {
+		res = calculatePending(ctx, hsr, leftSibling);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = calculatePending(ctx, hsr, rightSibling);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		/* Create the root hash value. */
+		res = joinHashes(ctx, hsr, leftSibling, rightSibling, level, &hsh);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		/* Create a new tree node. */
+		res = KSI_TreeNode_new(ctx, hsh, NULL, level, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
 	}
 
 	/* Update references. */
@@ -246,7 +321,7 @@ int KSI_TreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, KSI_TreeBuilder **
 		goto cleanup;
 	}
 
-	tmp = KSI_new(KSI_TreeBuilder);
+	tmp = (KSI_TreeBuilder *)KSI_new(TreeBuilderImpl);
 	if (tmp == NULL) {
 		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
 		goto cleanup;
@@ -258,6 +333,7 @@ int KSI_TreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, KSI_TreeBuilder **
 	tmp->algo = algo;
 	tmp->cbList = NULL;
 	tmp->hsr = NULL;
+	TREE_BUILDER_THREADS(tmp) = 0;
 	memset(tmp->stack, 0, sizeof(tmp->stack));
 
 	tmp->maxTreeLevel = 0;
@@ -326,7 +402,7 @@ static int insertNode(KSI_TreeBuilder *builder, KSI_TreeNode *node) {
 		builder->stack[node->level] = node;
 	} else {
 		/* The slot is taken - create a new node from the existing ones. */
-		res = KSI_TreeNode_join(builder->ctx, builder->hsr, pSlot, node, &root);
+		res = KSI_TreeNode_join(builder->ctx, builder->hsr, pSlot, node, TREE_BUILDER_THREADS(builder) > 1, &root);
 		if (res != KSI_OK) {
 			KSI_pushError(builder->ctx, res, NULL);
 			goto cleanup;
@@ -384,7 +460,7 @@ static int processAndInsertNode(KSI_TreeBuilder *builder, KSI_TreeNode *node) {
 		if (res != KSI_OK) goto cleanup;
 
 		if (tmp != NULL) {
-			res = KSI_TreeNode_join(builder->ctx, builder->hsr, localRoot == NULL ? node : localRoot, tmp, &localRoot);
+			res = KSI_TreeNode_join(builder->ctx, builder->hsr, localRoot == NULL ? node : localRoot, tmp, TREE_BUILDER_THREADS(builder) > 1, &localRoot);
 			if (res != KSI_OK) goto cleanup;
 		}
 	}
@@ -564,6 +640,179 @@ int KSI_TreeBuilder_addMetaData(KSI_TreeBuilder *builder, KSI_MetaData *metaData
 	return addLeaf(builder, NULL, metaData, level, leaf);
 }
 
+int KSI_TreeBuilder_setThreadCount(KSI_TreeBuilder *builder, size_t threads) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t i;
+
+	if (builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	/* The mode may not be changed after adding the first leaf. */
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN && builder->stack[i] == NULL; i++);
+	if (i < KSI_TREE_BUILDER_STACK_LEN || builder->rootNode != NULL) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The thread count may not be changed after adding leafs.");
+		goto cleanup;
+	}
+
+	TREE_BUILDER_THREADS(builder) = threads;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+typedef struct TreeHashWorker_st {
+	/** Roots of the subtrees to be calculated, shared between all the workers. */
+	KSI_TreeNode **subtrees;
+	size_t subtrees_len;
+	/** The worker calculates the subtrees \c first, \c first + \c step, ... */
+	size_t first;
+	size_t step;
+	/** Hasher of the worker, it is not bound to the KSI context. */
+	KSI_DataHasher *hsr;
+	/** Set if the worker was run in a separate thread. */
+	bool started;
+	int res;
+#ifdef _WIN32
+	HANDLE thread;
+#elif defined(HAVE_PTHREAD_H)
+	pthread_t thread;
+#endif
+} TreeHashWorker;
+
+static void treeHashWorker_process(TreeHashWorker *worker) {
+	size_t i;
+
+	worker->res = KSI_OK;
+
+	for (i = worker->first; i < worker->subtrees_len && worker->res == KSI_OK; i += worker->step) {
+		worker->res = calculatePending(NULL, worker->hsr, worker->subtrees[i]);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI treeHashWorker_run(LPVOID arg) {
+	treeHashWorker_process(arg);
+	return 0;
+}
+#elif defined(HAVE_PTHREAD_H)
+static void *treeHashWorker_run(void *arg) {
+	treeHashWorker_process(arg);
+	return NULL;
+}
+#endif
+
+static void collectSubtrees(KSI_TreeNode *node, unsigned depth, KSI_TreeNode **subtrees, size_t *subtrees_len) {
+	if (node == NULL || node->hash != NULL || node->metaData != NULL) return;
+
+	if (depth == 0) {
+		subtrees[(*subtrees_len)++] = node;
+	} else {
+		collectSubtrees(node->leftChild, depth - 1, subtrees, subtrees_len);
+		collectSubtrees(node->rightChild, depth - 1, subtrees, subtrees_len);
+	}
+}
+
+/**
+ * Calculates the deferred hash values of the tree. The subtrees at a fixed depth are distributed
+ * between the worker threads and the top levels of the tree are calculated by the caller.
+ */
+static int calculateTree(KSI_TreeBuilder *builder, KSI_TreeNode *root) {
+	int res = KSI_UNKNOWN_ERROR;
+	TreeHashWorker *workers = NULL;
+	KSI_TreeNode **subtrees = NULL;
+	size_t subtrees_len = 0;
+	size_t i;
+	unsigned depth = 2;
+
+	/* Have a few subtrees per worker to balance the uneven subtree sizes. */
+	while (((size_t)1 << depth) < TREE_BUILDER_THREADS(builder) * 4 && depth < 16) depth++;
+
+	subtrees = KSI_calloc((size_t)1 << depth, sizeof(KSI_TreeNode *));
+	workers = KSI_calloc(TREE_BUILDER_THREADS(builder), sizeof(TreeHashWorker));
+	if (subtrees == NULL || workers == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	collectSubtrees(root, depth, subtrees, &subtrees_len);
+
+	for (i = 0; i < TREE_BUILDER_THREADS(builder); i++) {
+		workers[i].subtrees = subtrees;
+		workers[i].subtrees_len = subtrees_len;
+		workers[i].first = i;
+		workers[i].step = TREE_BUILDER_THREADS(builder);
+		workers[i].started = false;
+		workers[i].res = KSI_OK;
+
+		res = KSI_DataHasher_open(NULL, builder->algo, &workers[i].hsr);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* The caller thread acts as the first worker. */
+	for (i = 1; i < TREE_BUILDER_THREADS(builder) && i < subtrees_len; i++) {
+#ifdef _WIN32
+		workers[i].thread = CreateThread(NULL, 0, treeHashWorker_run, &workers[i], 0, NULL);
+		workers[i].started = (workers[i].thread != NULL);
+#elif defined(HAVE_PTHREAD_H)
+		workers[i].started = (pthread_create(&workers[i].thread, NULL, treeHashWorker_run, &workers[i]) == 0);
+#endif
+	}
+
+	treeHashWorker_process(&workers[0]);
+
+	for (i = 1; i < TREE_BUILDER_THREADS(builder); i++) {
+		if (workers[i].started) {
+#ifdef _WIN32
+			WaitForSingleObject(workers[i].thread, INFINITE);
+			CloseHandle(workers[i].thread);
+#elif defined(HAVE_PTHREAD_H)
+			pthread_join(workers[i].thread, NULL);
+#endif
+		} else {
+			/* Threads are not available, do the work here. */
+			treeHashWorker_process(&workers[i]);
+		}
+	}
+
+	for (i = 0; i < TREE_BUILDER_THREADS(builder); i++) {
+		if (workers[i].res != KSI_OK) {
+			KSI_pushError(builder->ctx, res = workers[i].res, "Unable to calculate the subtree.");
+			goto cleanup;
+		}
+	}
+
+	/* Merge the top levels. */
+	res = calculatePending(builder->ctx, builder->hsr, root);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (workers != NULL) {
+		for (i = 0; i < TREE_BUILDER_THREADS(builder); i++) {
+			KSI_DataHasher_free(workers[i].hsr);
+		}
+	}
+	KSI_free(workers);
+	KSI_free(subtrees);
+
+	return res;
+}
+
 int KSI_TreeBuilder_close(KSI_TreeBuilder *builder) {
 	int res = KSI_UNKNOWN_ERROR;
 	KSI_TreeNode *root = NULL;
@@ -589,7 +838,7 @@ int KSI_TreeBuilder_close(KSI_TreeBuilder *builder) {
 			if (root == NULL) {
 				root = node;
 			} else {
-				res = KSI_TreeNode_join(builder->ctx, builder->hsr, node, root, &tmp);
+				res = KSI_TreeNode_join(builder->ctx, builder->hsr, node, root, TREE_BUILDER_THREADS(builder) > 1, &tmp);
 				if (res != KSI_OK) goto cleanup;
 
 				root = tmp;
@@ -607,6 +856,14 @@ int KSI_TreeBuilder_close(KSI_TreeBuilder *builder) {
 		goto cleanup;
 	}
 
+	if (TREE_BUILDER_THREADS(builder) > 1) {
+		res = calculateTree(builder, root);
+		if (res != KSI_OK) {
+			KSI_TreeNode_free(root);
+			goto cleanup;
+		}
+	}
+
 	builder->rootNode = root;
 
 	res = KSI_OK;
@@ -827,3 +1084,1624 @@ cleanup:
 	return res;
 }
 
+
+/** Marks a reference to a leaf in #CompactTreeLevel::refs. */
+#define COMPACT_TREE_LEAF_REF 0x80000000u
+#define COMPACT_TREE_INITIAL_SIZE 0x100
+/** Number of the lowest levels of internal nodes that are not kept, but recalculated from the leafs. */
+#define COMPACT_TREE_UNSTORED_LEVELS 2
+/** The previous leaf value of the masking is kept for every such number of leafs, the number of
+ * leafs below the lowest kept internal node. */
+#define COMPACT_TREE_MASK_INTERVAL (1u << (COMPACT_TREE_UNSTORED_LEVELS + 1))
+
+typedef struct CompactTreeLevel_st {
+	/** References to the nodes of the level in the order of creation. A reference is either the
+	 * index of a leaf (marked with #COMPACT_TREE_LEAF_REF) or the index of an internal node. As the
+	 * nodes of a level are joined pairwise, the parent of the node \c i is the internal node \c i / 2
+	 * of the next level. Not allocated while all the leafs have the same level, as then the
+	 * references follow from the positions. */
+	uint32_t *refs;
+	size_t refs_len;
+	size_t refs_size;
+	/** Imprints of the internal nodes, \c NULL for the levels recalculated from the leafs. */
+	unsigned char *nodes;
+	/** Position of each internal node in \c refs, allocated together with \c refs. */
+	uint32_t *nodePos;
+	size_t nodes_len;
+	size_t nodes_size;
+	/** Imprint of the last node of the level, while it waits for its sibling. */
+	unsigned char pending[KSI_MAX_IMPRINT_LEN];
+	size_t pending_len;
+} CompactTreeLevel;
+
+struct KSI_CompactTreeBuilder_st {
+	/** KSI context. */
+	KSI_CTX *ctx;
+	/** Hashing algorithm for the internal nodes. */
+	KSI_HashAlgorithm algo;
+	/** Length of the internal node imprints. */
+	size_t nodeLen;
+	/** Common hashing object. */
+	KSI_DataHasher *hsr;
+
+	/** Imprints of the leafs, each \c leafLen bytes. */
+	unsigned char *leaves;
+	size_t leafLen;
+	/** Input level of each leaf, \c NULL as long as all the leafs have the level \c uniformLevel. */
+	unsigned char *leafLevel;
+	/** Position of each leaf in the references of its level, allocated together with \c leafLevel. */
+	uint32_t *leafPos;
+	unsigned uniformLevel;
+	size_t leaves_len;
+	size_t leaves_size;
+	/** The level above the first leaf node, the internal nodes of the #COMPACT_TREE_UNSTORED_LEVELS
+	 * levels starting from it are recalculated when needed. */
+	unsigned lowLevel;
+
+	/** Initial value of the masking, \c NULL if the leafs are not masked. */
+	unsigned char *iv;
+	size_t iv_len;
+	/** Previous leaf value of the first leaf. */
+	unsigned char firstPrev[KSI_MAX_IMPRINT_LEN];
+	size_t firstPrev_len;
+	/** Previous leaf value of the next leaf. */
+	unsigned char prevLeaf[KSI_MAX_IMPRINT_LEN];
+	size_t prevLeaf_len;
+	/** Previous leaf value of every #COMPACT_TREE_MASK_INTERVAL-th leaf after the first interval,
+	 * each \c nodeLen bytes. The masks are recalculated from these. */
+	unsigned char *checkpoints;
+	size_t checkpoints_size;
+
+	CompactTreeLevel levels[KSI_TREE_BUILDER_STACK_LEN];
+
+	/** Set when the tree is closed. */
+	bool closed;
+	/** Levels of the complete binary trees remaining at closing, in ascending order. */
+	unsigned stackLevel[KSI_TREE_BUILDER_STACK_LEN];
+	size_t stack_len;
+	/** The nodes created by closing; the first is the lowest complete tree and the last is the root. */
+	unsigned char closing[KSI_TREE_BUILDER_STACK_LEN][KSI_MAX_IMPRINT_LEN];
+	size_t closingLen[KSI_TREE_BUILDER_STACK_LEN];
+	unsigned closingLevel[KSI_TREE_BUILDER_STACK_LEN];
+};
+
+/** The recalculated masks of an interval of leafs, see #compactTree_mask. */
+typedef struct CompactTreeMaskWalk_st {
+	/** Index of the first leaf of the interval, not a multiple of #COMPACT_TREE_MASK_INTERVAL if empty. */
+	size_t start;
+	unsigned char masks[COMPACT_TREE_MASK_INTERVAL][KSI_MAX_IMPRINT_LEN];
+} CompactTreeMaskWalk;
+
+static int compactTree_grow(void **arr, size_t el_size, size_t len, size_t size) {
+	void *tmp = NULL;
+
+	tmp = KSI_calloc(size, el_size);
+	if (tmp == NULL) return KSI_OUT_OF_MEMORY;
+
+	if (len > 0) memcpy(tmp, *arr, len * el_size);
+	KSI_free(*arr);
+	*arr = tmp;
+
+	return KSI_OK;
+}
+
+static int compactTree_join(KSI_CTX *ctx, KSI_DataHasher *hsr, const unsigned char *left, size_t left_len, const unsigned char *right, size_t right_len, unsigned level, unsigned char *out) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char l;
+
+	if (!KSI_IS_VALID_TREE_LEVEL(level)) {
+		KSI_pushError(ctx, res = KSI_INVALID_STATE, "Tree too large.");
+		goto cleanup;
+	}
+
+	l = (unsigned char) level;
+
+	res = KSI_DataHasher_reset(hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, left, left_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, right, right_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, &l, 1);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	memcpy(out, imprint, imprint_len);
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+static unsigned compactTree_leafLevel(const KSI_CompactTreeBuilder *builder, size_t index) {
+	return builder->leafLevel != NULL ? builder->leafLevel[index] : builder->uniformLevel;
+}
+
+static size_t compactTree_leafPos(const KSI_CompactTreeBuilder *builder, size_t index) {
+	return builder->leafPos != NULL ? builder->leafPos[index] : index;
+}
+
+static uint32_t compactTree_ref(const KSI_CompactTreeBuilder *builder, unsigned level, size_t pos) {
+	if (builder->leafLevel != NULL) return builder->levels[level].refs[pos];
+
+	/* All the leaf nodes are on the level below the lowest internal nodes and every other level
+	 * consists of internal nodes only, both in the order of creation. */
+	return level + 1 == builder->lowLevel ? (uint32_t)pos | COMPACT_TREE_LEAF_REF : (uint32_t)pos;
+}
+
+static size_t compactTree_nodePos(const KSI_CompactTreeBuilder *builder, unsigned level, size_t node) {
+	return builder->levels[level].nodePos != NULL ? builder->levels[level].nodePos[node] : node;
+}
+
+static bool compactTree_isStored(const KSI_CompactTreeBuilder *builder, unsigned level) {
+	return level < builder->lowLevel || level >= builder->lowLevel + COMPACT_TREE_UNSTORED_LEVELS;
+}
+
+/**
+ * Calculates the mask of the leaf from the previous leaf value and the initial value, and the
+ * previous leaf value of the next leaf, the same way as the masking leaf processor of the
+ * #KSI_BlockSigner does. The output \c next may be the same buffer as \c prev.
+ */
+static int compactTree_maskStep(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, KSI_DataHasher *hsr, const unsigned char *prev, size_t prev_len,
+		const unsigned char *leaf, unsigned level, unsigned char *mask, unsigned char *next) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	res = KSI_DataHasher_reset(hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, prev, prev_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_add(hsr, builder->iv, builder->iv_len);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHasher_close(hsr, &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	memcpy(mask, imprint, imprint_len);
+
+	/* The mask is the left sibling in the previous leaf value. */
+	res = compactTree_join(ctx, hsr, mask, builder->nodeLen, leaf, builder->leafLen, level + 1, next);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+/**
+ * Returns the mask of the leaf. The masks of the whole interval of the leaf are recalculated
+ * from the kept previous leaf value, as the nodes recalculated together are in the same interval.
+ */
+static int compactTree_mask(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, KSI_DataHasher *hsr, CompactTreeMaskWalk *walk, size_t index, const unsigned char **mask) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t start = index - index % COMPACT_TREE_MASK_INTERVAL;
+	unsigned char prev[KSI_MAX_IMPRINT_LEN];
+	size_t prev_len;
+	size_t i;
+
+	if (walk->start != start) {
+		if (start == 0) {
+			memcpy(prev, builder->firstPrev, builder->firstPrev_len);
+			prev_len = builder->firstPrev_len;
+		} else {
+			memcpy(prev, builder->checkpoints + (start / COMPACT_TREE_MASK_INTERVAL - 1) * builder->nodeLen, builder->nodeLen);
+			prev_len = builder->nodeLen;
+		}
+
+		walk->start = 1;
+		for (i = start; i < builder->leaves_len && i < start + COMPACT_TREE_MASK_INTERVAL; i++) {
+			res = compactTree_maskStep(builder, ctx, hsr, prev, prev_len, builder->leaves + i * builder->leafLen,
+					compactTree_leafLevel(builder, i), walk->masks[i - start], prev);
+			if (res != KSI_OK) goto cleanup;
+
+			prev_len = builder->nodeLen;
+		}
+		walk->start = start;
+	}
+
+	*mask = walk->masks[index - start];
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Returns the imprint of the node at position \c pos of the given level. A masked leaf node and
+ * an internal node of the levels that are not kept are recalculated into \c buf.
+ */
+static int compactTree_node(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, KSI_DataHasher *hsr, CompactTreeMaskWalk *walk, unsigned level, size_t pos, unsigned char *buf, const unsigned char **imprint, size_t *imprint_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	uint32_t ref = compactTree_ref(builder, level, pos);
+
+	if (ref & COMPACT_TREE_LEAF_REF) {
+		size_t i = ref & ~COMPACT_TREE_LEAF_REF;
+		const unsigned char *leaf = builder->leaves + i * builder->leafLen;
+
+		if (builder->iv == NULL) {
+			*imprint = leaf;
+			*imprint_len = builder->leafLen;
+		} else {
+			const unsigned char *mask = NULL;
+
+			res = compactTree_mask(builder, ctx, hsr, walk, i, &mask);
+			if (res != KSI_OK) goto cleanup;
+
+			res = compactTree_join(ctx, hsr, leaf, builder->leafLen, mask, builder->nodeLen, level, buf);
+			if (res != KSI_OK) goto cleanup;
+
+			*imprint = buf;
+			*imprint_len = builder->nodeLen;
+		}
+	} else if (builder->levels[level].nodes != NULL) {
+		*imprint = builder->levels[level].nodes + ref * builder->nodeLen;
+		*imprint_len = builder->nodeLen;
+	} else {
+		unsigned char lbuf[KSI_MAX_IMPRINT_LEN];
+		unsigned char rbuf[KSI_MAX_IMPRINT_LEN];
+		const unsigned char *left = NULL;
+		const unsigned char *right = NULL;
+		size_t left_len = 0;
+		size_t right_len = 0;
+
+		/* The node was created by joining the pair of nodes at positions 2 * ref of the level below. */
+		res = compactTree_node(builder, ctx, hsr, walk, level - 1, 2 * (size_t)ref, lbuf, &left, &left_len);
+		if (res != KSI_OK) goto cleanup;
+
+		res = compactTree_node(builder, ctx, hsr, walk, level - 1, 2 * (size_t)ref + 1, rbuf, &right, &right_len);
+		if (res != KSI_OK) goto cleanup;
+
+		res = compactTree_join(ctx, hsr, left, left_len, right, right_len, level, buf);
+		if (res != KSI_OK) goto cleanup;
+
+		*imprint = buf;
+		*imprint_len = builder->nodeLen;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, KSI_CompactTreeBuilder **builder) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CompactTreeBuilder *tmp = NULL;
+
+	if (ctx == NULL || builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	if (!KSI_isHashAlgorithmSupported(algo)) {
+		KSI_pushError(ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_CompactTreeBuilder);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memset(tmp, 0, sizeof(KSI_CompactTreeBuilder));
+	tmp->ctx = ctx;
+	tmp->algo = algo;
+	tmp->nodeLen = KSI_getHashLength(algo) + 1;
+	tmp->closed = false;
+
+	res = KSI_DataHasher_open(ctx, algo, &tmp->hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	*builder = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CompactTreeBuilder_free(tmp);
+
+	return res;
+}
+
+void KSI_CompactTreeBuilder_free(KSI_CompactTreeBuilder *builder) {
+	if (builder != NULL) {
+		size_t i;
+
+		for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+			KSI_free(builder->levels[i].refs);
+			KSI_free(builder->levels[i].nodes);
+			KSI_free(builder->levels[i].nodePos);
+		}
+
+		KSI_free(builder->leaves);
+		KSI_free(builder->leafLevel);
+		KSI_free(builder->leafPos);
+		KSI_free(builder->iv);
+		KSI_free(builder->checkpoints);
+		KSI_DataHasher_free(builder->hsr);
+		KSI_free(builder);
+	}
+}
+
+int KSI_CompactTreeBuilder_setMasking(KSI_CompactTreeBuilder *builder, const KSI_DataHash *prevLeaf, const KSI_OctetString *iv) {
+	int res = KSI_UNKNOWN_ERROR;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	const unsigned char *ivData = NULL;
+	size_t ivData_len = 0;
+	unsigned char *tmp = NULL;
+
+	if (builder == NULL || prevLeaf == NULL || iv == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->leaves_len > 0) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The masking must be set before adding the leafs.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_getImprint(prevLeaf, &imprint, &imprint_len);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OctetString_extract(iv, &ivData, &ivData_len);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	/* Keep a non-NULL value also for an empty initial value. */
+	tmp = KSI_malloc(ivData_len + 1);
+	if (tmp == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	if (ivData_len > 0) memcpy(tmp, ivData, ivData_len);
+
+	KSI_free(builder->iv);
+	builder->iv = tmp;
+	builder->iv_len = ivData_len;
+	tmp = NULL;
+
+	memcpy(builder->firstPrev, imprint, imprint_len);
+	builder->firstPrev_len = imprint_len;
+	memcpy(builder->prevLeaf, imprint, imprint_len);
+	builder->prevLeaf_len = imprint_len;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(tmp);
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_getPrevLeaf(const KSI_CompactTreeBuilder *builder, KSI_DataHash **prevLeaf) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (builder == NULL || prevLeaf == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->iv == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The leafs are not masked.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_fromImprint(builder->ctx, builder->prevLeaf, builder->prevLeaf_len, prevLeaf);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Allocates the leaf levels and positions and the node references, which follow from the
+ * positions as long as all the leafs have the same level.
+ */
+static int compactTree_split(KSI_CompactTreeBuilder *builder) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char *leafLevel = NULL;
+	uint32_t *leafPos = NULL;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		CompactTreeLevel *lvl = &builder->levels[i];
+
+		if (lvl->refs == NULL && lvl->refs_size > 0) {
+			lvl->refs = KSI_calloc(lvl->refs_size, sizeof(uint32_t));
+			if (lvl->refs == NULL) {
+				res = KSI_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			for (j = 0; j < lvl->refs_len; j++) lvl->refs[j] = compactTree_ref(builder, (unsigned)i, j);
+		}
+
+		if (lvl->nodePos == NULL && lvl->nodes_size > 0) {
+			lvl->nodePos = KSI_calloc(lvl->nodes_size, sizeof(uint32_t));
+			if (lvl->nodePos == NULL) {
+				res = KSI_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			for (j = 0; j < lvl->nodes_len; j++) lvl->nodePos[j] = (uint32_t)j;
+		}
+	}
+
+	leafLevel = KSI_calloc(builder->leaves_size, 1);
+	leafPos = KSI_calloc(builder->leaves_size, sizeof(uint32_t));
+	if (leafLevel == NULL || leafPos == NULL) {
+		res = KSI_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	for (j = 0; j < builder->leaves_len; j++) {
+		leafLevel[j] = (unsigned char)builder->uniformLevel;
+		leafPos[j] = (uint32_t)j;
+	}
+
+	/* From now on the references are explicit. */
+	builder->leafLevel = leafLevel;
+	leafLevel = NULL;
+	builder->leafPos = leafPos;
+	leafPos = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(leafLevel);
+	KSI_free(leafPos);
+
+	return res;
+}
+
+/**
+ * Appends the reference to the level and joins the pairs of nodes upwards, just as #insertNode does.
+ */
+static int compactTree_insert(KSI_CompactTreeBuilder *builder, unsigned level, uint32_t ref, const unsigned char *imprint, size_t imprint_len) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char buf[KSI_MAX_IMPRINT_LEN];
+
+	for (;;) {
+		CompactTreeLevel *lvl = &builder->levels[level];
+		CompactTreeLevel *parent = NULL;
+
+		if (lvl->refs_len == lvl->refs_size) {
+			size_t size = lvl->refs_size == 0 ? COMPACT_TREE_INITIAL_SIZE : lvl->refs_size * 2;
+
+			if (builder->leafLevel != NULL) {
+				res = compactTree_grow((void **)&lvl->refs, sizeof(uint32_t), lvl->refs_len, size);
+				if (res != KSI_OK) {
+					KSI_pushError(builder->ctx, res, NULL);
+					goto cleanup;
+				}
+			}
+			lvl->refs_size = size;
+		}
+
+		if (lvl->refs != NULL) lvl->refs[lvl->refs_len] = ref;
+		lvl->refs_len++;
+
+		/* The first node of a pair waits for its sibling. */
+		if (lvl->refs_len % 2 != 0) {
+			memcpy(lvl->pending, imprint, imprint_len);
+			lvl->pending_len = imprint_len;
+			break;
+		}
+
+		if (!KSI_IS_VALID_TREE_LEVEL(level + 1)) {
+			KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "Tree too large.");
+			goto cleanup;
+		}
+
+		parent = &builder->levels[level + 1];
+		if (parent->nodes_len == parent->nodes_size) {
+			size_t size = parent->nodes_size == 0 ? COMPACT_TREE_INITIAL_SIZE : parent->nodes_size * 2;
+
+			res = KSI_OK;
+			if (compactTree_isStored(builder, level + 1)) res = compactTree_grow((void **)&parent->nodes, builder->nodeLen, parent->nodes_len, size);
+			if (res == KSI_OK && builder->leafLevel != NULL) res = compactTree_grow((void **)&parent->nodePos, sizeof(uint32_t), parent->nodes_len, size);
+			if (res != KSI_OK) {
+				KSI_pushError(builder->ctx, res, NULL);
+				goto cleanup;
+			}
+			parent->nodes_size = size;
+		}
+
+		res = compactTree_join(builder->ctx, builder->hsr, lvl->pending, lvl->pending_len, imprint, imprint_len, level + 1, buf);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+
+		if (parent->nodes != NULL) memcpy(parent->nodes + parent->nodes_len * builder->nodeLen, buf, builder->nodeLen);
+		if (parent->nodePos != NULL) parent->nodePos[parent->nodes_len] = (uint32_t)parent->refs_len;
+
+		ref = (uint32_t)parent->nodes_len++;
+		imprint = buf;
+		imprint_len = builder->nodeLen;
+		level++;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_addImprint(KSI_CompactTreeBuilder *builder, const unsigned char *imprint, int level) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char mask[KSI_MAX_IMPRINT_LEN];
+	unsigned char node[KSI_MAX_IMPRINT_LEN];
+	const unsigned char *nodeImprint = imprint;
+	size_t imprint_len;
+	size_t i;
+	unsigned nodeLevel;
+
+	if (builder == NULL || imprint == NULL || !KSI_IS_VALID_TREE_LEVEL(level)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has been finished, new leafs may not be added.");
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmSupported(imprint[0])) {
+		KSI_pushError(builder->ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+	imprint_len = KSI_getHashLength(imprint[0]) + 1;
+
+	nodeLevel = (unsigned)level + (builder->iv != NULL ? 1 : 0);
+	if (!KSI_IS_VALID_TREE_LEVEL(nodeLevel)) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree height is too large.");
+		goto cleanup;
+	}
+
+	if (builder->leaves_len == 0) {
+		builder->leafLen = imprint_len;
+		builder->uniformLevel = (unsigned)level;
+		builder->lowLevel = nodeLevel + 1;
+	} else if (builder->leafLen != imprint_len) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_ARGUMENT, "All the leafs must have the same hash algorithm.");
+		goto cleanup;
+	}
+
+	if (builder->leaves_len >= COMPACT_TREE_LEAF_REF) {
+		KSI_pushError(builder->ctx, res = KSI_BUFFER_OVERFLOW, "Too many leafs.");
+		goto cleanup;
+	}
+
+	if (builder->leafLevel == NULL && (unsigned)level != builder->uniformLevel) {
+		res = compactTree_split(builder);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (builder->leaves_len == builder->leaves_size) {
+		size_t size = builder->leaves_size == 0 ? COMPACT_TREE_INITIAL_SIZE : builder->leaves_size * 2;
+
+		res = compactTree_grow((void **)&builder->leaves, builder->leafLen, builder->leaves_len, size);
+		if (res == KSI_OK && builder->leafLevel != NULL) res = compactTree_grow((void **)&builder->leafLevel, 1, builder->leaves_len, size);
+		if (res == KSI_OK && builder->leafLevel != NULL) res = compactTree_grow((void **)&builder->leafPos, sizeof(uint32_t), builder->leaves_len, size);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+		builder->leaves_size = size;
+	}
+
+	i = builder->leaves_len;
+
+	if (builder->iv != NULL) {
+		/* Keep the previous leaf value at the start of every interval for recalculating the masks. */
+		if (i > 0 && i % COMPACT_TREE_MASK_INTERVAL == 0) {
+			size_t cp = i / COMPACT_TREE_MASK_INTERVAL - 1;
+
+			if (cp == builder->checkpoints_size) {
+				size_t size = builder->checkpoints_size == 0 ? COMPACT_TREE_INITIAL_SIZE : builder->checkpoints_size * 2;
+
+				res = compactTree_grow((void **)&builder->checkpoints, builder->nodeLen, cp, size);
+				if (res != KSI_OK) {
+					KSI_pushError(builder->ctx, res, NULL);
+					goto cleanup;
+				}
+				builder->checkpoints_size = size;
+			}
+			memcpy(builder->checkpoints + cp * builder->nodeLen, builder->prevLeaf, builder->nodeLen);
+		}
+
+		res = compactTree_maskStep(builder, builder->ctx, builder->hsr, builder->prevLeaf, builder->prevLeaf_len, imprint, (unsigned)level, mask, builder->prevLeaf);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+		builder->prevLeaf_len = builder->nodeLen;
+
+		/* The leaf is the left child of the masked leaf node. */
+		res = compactTree_join(builder->ctx, builder->hsr, imprint, imprint_len, mask, builder->nodeLen, nodeLevel, node);
+		if (res != KSI_OK) {
+			KSI_pushError(builder->ctx, res, NULL);
+			goto cleanup;
+		}
+		nodeImprint = node;
+	}
+
+	memcpy(builder->leaves + i * builder->leafLen, imprint, imprint_len);
+	if (builder->leafLevel != NULL) {
+		builder->leafLevel[i] = (unsigned char)level;
+		builder->leafPos[i] = (uint32_t)builder->levels[nodeLevel].refs_len;
+	}
+	builder->leaves_len++;
+
+	res = compactTree_insert(builder, nodeLevel, (uint32_t)i | COMPACT_TREE_LEAF_REF, nodeImprint, builder->iv != NULL ? builder->nodeLen : imprint_len);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_close(KSI_CompactTreeBuilder *builder) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned i;
+
+	if (builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has already been closed.");
+		goto cleanup;
+	}
+
+	if (builder->leaves_len == 0) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has no leafs.");
+		goto cleanup;
+	}
+
+	/* Finalize the forest of complete binary trees into a single tree, the same way as #KSI_TreeBuilder_close. */
+	builder->stack_len = 0;
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		const CompactTreeLevel *lvl = &builder->levels[i];
+		size_t j = builder->stack_len;
+
+		if (lvl->refs_len % 2 == 0) continue;
+
+		builder->stackLevel[j] = i;
+
+		if (j == 0) {
+			memcpy(builder->closing[0], lvl->pending, lvl->pending_len);
+			builder->closingLen[0] = lvl->pending_len;
+			builder->closingLevel[0] = i;
+		} else {
+			unsigned level = (i > builder->closingLevel[j - 1] ? i : builder->closingLevel[j - 1]) + 1;
+
+			res = compactTree_join(builder->ctx, builder->hsr, lvl->pending, lvl->pending_len, builder->closing[j - 1], builder->closingLen[j - 1], level, builder->closing[j]);
+			if (res != KSI_OK) {
+				KSI_pushError(builder->ctx, res, NULL);
+				goto cleanup;
+			}
+			builder->closingLen[j] = builder->nodeLen;
+			builder->closingLevel[j] = level;
+		}
+
+		builder->stack_len++;
+	}
+
+	builder->closed = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+size_t KSI_CompactTreeBuilder_getLeafCount(const KSI_CompactTreeBuilder *builder) {
+	return builder == NULL ? 0 : builder->leaves_len;
+}
+
+int KSI_CompactTreeBuilder_getRoot(const KSI_CompactTreeBuilder *builder, KSI_DataHash **root, unsigned *level) {
+	int res = KSI_UNKNOWN_ERROR;
+	size_t top;
+
+	if (builder == NULL || root == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (!builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has not been closed.");
+		goto cleanup;
+	}
+
+	top = builder->stack_len - 1;
+
+	res = KSI_DataHash_fromImprint(builder->ctx, builder->closing[top], builder->closingLen[top], root);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (level != NULL) *level = builder->closingLevel[top];
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int appendImprintLink(KSI_CTX *ctx, KSI_LIST(KSI_HashChainLink) *links, bool isLeft, const unsigned char *imprint, size_t imprint_len, unsigned levelGap) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_HashChainLink *link = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_Integer *levelCorrection = NULL;
+
+	res = KSI_HashChainLink_new(ctx, &link);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_HashChainLink_setIsLeft(link, isLeft);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_fromImprint(ctx, imprint, imprint_len, &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_HashChainLink_setImprint(link, hsh);
+	if (res != KSI_OK) goto cleanup;
+	hsh = NULL;
+
+	if (levelGap > 0) {
+		res = KSI_Integer_new(ctx, levelGap, &levelCorrection);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_HashChainLink_setLevelCorrection(link, levelCorrection);
+		if (res != KSI_OK) goto cleanup;
+		levelCorrection = NULL;
+	}
+
+	res = KSI_HashChainLinkList_append(links, link);
+	if (res != KSI_OK) goto cleanup;
+	link = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(levelCorrection);
+	KSI_DataHash_free(hsh);
+	KSI_HashChainLink_free(link);
+
+	return res;
+}
+
+static int compactTree_getHashChainLinks(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, KSI_DataHasher *hsr, size_t index, KSI_LIST(KSI_HashChainLink) *links) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char buf[KSI_MAX_IMPRINT_LEN];
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned level = compactTree_leafLevel(builder, index);
+	size_t pos = compactTree_leafPos(builder, index);
+	CompactTreeMaskWalk walk;
+	size_t j;
+
+	walk.start = 1;
+
+	if (builder->iv != NULL) {
+		res = compactTree_mask(builder, ctx, hsr, &walk, index, &imprint);
+		if (res != KSI_OK) goto cleanup;
+
+		/* The leaf is the left child of the masked leaf node. */
+		res = appendImprintLink(ctx, links, true, imprint, builder->nodeLen, 0);
+		if (res != KSI_OK) goto cleanup;
+		level++;
+	}
+
+	/* Climb while the node has a sibling on its level. */
+	while ((pos ^ 1) < builder->levels[level].refs_len) {
+		res = compactTree_node(builder, ctx, hsr, &walk, level, pos ^ 1, buf, &imprint, &imprint_len);
+		if (res != KSI_OK) goto cleanup;
+
+		res = appendImprintLink(ctx, links, (pos & 1) == 0, imprint, imprint_len, 0);
+		if (res != KSI_OK) goto cleanup;
+
+		pos = compactTree_nodePos(builder, level + 1, pos / 2);
+		level++;
+	}
+
+	/* The node is the root of one of the complete binary trees joined at closing. */
+	for (j = 0; j < builder->stack_len && builder->stackLevel[j] != level; j++);
+	if (j == builder->stack_len) {
+		res = KSI_INVALID_STATE;
+		goto cleanup;
+	}
+
+	if (j > 0) {
+		/* The lower trees are on the right. */
+		res = appendImprintLink(ctx, links, true, builder->closing[j - 1], builder->closingLen[j - 1], builder->closingLevel[j] - level - 1);
+		if (res != KSI_OK) goto cleanup;
+		level = builder->closingLevel[j];
+	}
+
+	for (j++; j < builder->stack_len; j++) {
+		const CompactTreeLevel *lvl = &builder->levels[builder->stackLevel[j]];
+
+		/* The root of a higher complete tree is the unpaired last node of its level. */
+		res = appendImprintLink(ctx, links, false, lvl->pending, lvl->pending_len, builder->closingLevel[j] - level - 1);
+		if (res != KSI_OK) goto cleanup;
+		level = builder->closingLevel[j];
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Creates the aggregation hash chain from the input hash imprint and the links. The ownership of
+ * \c links is taken, also in case of failure.
+ */
+static int createAggregationChain(KSI_CTX *ctx, KSI_HashAlgorithm algo, const unsigned char *input, size_t input_len, KSI_LIST(KSI_HashChainLink) *links, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AggregationHashChain *tmp = NULL;
+	KSI_DataHash *inputHash = NULL;
+	KSI_Integer *algoId = NULL;
+
+	res = KSI_AggregationHashChain_new(ctx, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationHashChain_setChain(tmp, links);
+	if (res != KSI_OK) goto cleanup;
+	links = NULL;
+
+	res = KSI_DataHash_fromImprint(ctx, input, input_len, &inputHash);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationHashChain_setInputHash(tmp, inputHash);
+	if (res != KSI_OK) goto cleanup;
+	inputHash = NULL;
+
+	res = KSI_Integer_new(ctx, algo, &algoId);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_AggregationHashChain_setAggrHashId(tmp, algoId);
+	if (res != KSI_OK) goto cleanup;
+	algoId = NULL;
+
+	*chain = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(algoId);
+	KSI_DataHash_free(inputHash);
+	KSI_HashChainLinkList_free(links);
+	KSI_AggregationHashChain_free(tmp);
+
+	return res;
+}
+
+static int compactTree_getAggregationChain(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, KSI_DataHasher *hsr, size_t index, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+
+	if (!builder->closed) {
+		KSI_pushError(ctx, res = KSI_INVALID_STATE, "The tree has not been closed.");
+		goto cleanup;
+	}
+
+	if (index >= builder->leaves_len) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, "Leaf index out of range.");
+		goto cleanup;
+	}
+
+	res = KSI_HashChainLinkList_new(&links);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = compactTree_getHashChainLinks(builder, ctx, hsr, index, links);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = createAggregationChain(ctx, builder->algo, builder->leaves + index * builder->leafLen, builder->leafLen, links, chain);
+	links = NULL;
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_HashChainLinkList_free(links);
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_getAggregationChain(KSI_CompactTreeBuilder *builder, size_t index, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (builder == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	res = compactTree_getAggregationChain(builder, builder->ctx, builder->hsr, index, chain);
+
+cleanup:
+
+	return res;
+}
+
+int KSI_CompactTreeBuilder_getAggregationChainWithCtx(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, size_t index, KSI_AggregationHashChain **chain) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHasher *hsr = NULL;
+
+	if (builder == NULL || ctx == NULL || chain == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	/* Some of the nodes are calculated on the fly, the hasher of the builder must not be shared. */
+	res = KSI_DataHasher_open(NULL, builder->algo, &hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = compactTree_getAggregationChain(builder, ctx, hsr, index, chain);
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+/* Layout of a node record in the spill file of #KSI_StreamTreeBuilder. */
+#define STREAM_TREE_REC_LEVEL		0
+#define STREAM_TREE_REC_FLAGS		1
+#define STREAM_TREE_REC_LEFT		2
+#define STREAM_TREE_REC_RIGHT		10
+#define STREAM_TREE_REC_IMPRINT		18
+#define STREAM_TREE_REC_LEN			(STREAM_TREE_REC_IMPRINT + KSI_MAX_IMPRINT_LEN)
+
+/** The node is an input leaf, the aggregation hash chain is emitted for it. */
+#define STREAM_TREE_FLAG_LEAF		0x01
+/** The node is an internal node with references to its children. */
+#define STREAM_TREE_FLAG_INTERNAL	0x02
+
+typedef struct StreamTreeNode_st {
+	/** Index of the record in the spill file. */
+	uint64_t ref;
+	unsigned level;
+	unsigned flags;
+	/** Record indices of the children of an internal node, the index of an input leaf in the order of adding. */
+	uint64_t left;
+	uint64_t right;
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t imprint_len;
+} StreamTreeNode;
+
+typedef struct StreamTreeLink_st {
+	bool isLeft;
+	unsigned levelGap;
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t imprint_len;
+} StreamTreeLink;
+
+struct KSI_StreamTreeBuilder_st {
+	/** KSI context. */
+	KSI_CTX *ctx;
+	/** Hashing algorithm for the internal nodes. */
+	KSI_HashAlgorithm algo;
+	/** Common hashing object. */
+	KSI_DataHasher *hsr;
+
+	/** Name of the spill file, \c NULL for a temporary file. */
+	char *fileName;
+	/** The spill file holding all the nodes of the tree. */
+	FILE *file;
+	/** Number of records written to the spill file. */
+	uint64_t records;
+	/** Number of leafs added. */
+	size_t leaves_len;
+
+	/** The roots of the complete binary trees not joined yet, the node in slot \c i is at level \c i. */
+	StreamTreeNode stack[KSI_TREE_BUILDER_STACK_LEN];
+	bool used[KSI_TREE_BUILDER_STACK_LEN];
+
+	/** Set when the tree is closed. */
+	bool closed;
+	StreamTreeNode root;
+};
+
+static void uint64_write(unsigned char *buf, uint64_t val) {
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		buf[i] = (unsigned char)(val & 0xff);
+		val >>= 8;
+	}
+}
+
+static uint64_t uint64_read(const unsigned char *buf) {
+	uint64_t val = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		val = (val << 8) | buf[i];
+	}
+
+	return val;
+}
+
+static int streamTree_seek(FILE *f, uint64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)offset, SEEK_SET);
+#elif defined(HAVE_FSEEKO)
+	return fseeko(f, (off_t)offset, SEEK_SET);
+#else
+	if (offset > LONG_MAX) return -1;
+	return fseek(f, (long)offset, SEEK_SET);
+#endif
+}
+
+/**
+ * Appends the node to the spill file and assigns the record index to the node.
+ */
+static int streamTree_write(KSI_StreamTreeBuilder *builder, StreamTreeNode *node) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char rec[STREAM_TREE_REC_LEN];
+
+	memset(rec, 0, sizeof(rec));
+	rec[STREAM_TREE_REC_LEVEL] = (unsigned char)node->level;
+	rec[STREAM_TREE_REC_FLAGS] = (unsigned char)node->flags;
+	uint64_write(rec + STREAM_TREE_REC_LEFT, node->left);
+	uint64_write(rec + STREAM_TREE_REC_RIGHT, node->right);
+	memcpy(rec + STREAM_TREE_REC_IMPRINT, node->imprint, node->imprint_len);
+
+	if (fwrite(rec, 1, sizeof(rec), builder->file) != sizeof(rec)) {
+		KSI_pushError(builder->ctx, res = KSI_IO_ERROR, "Unable to write to the spill file.");
+		goto cleanup;
+	}
+
+	node->ref = builder->records++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int streamTree_read(KSI_StreamTreeBuilder *builder, uint64_t ref, StreamTreeNode *node) {
+	int res = KSI_UNKNOWN_ERROR;
+	unsigned char rec[STREAM_TREE_REC_LEN];
+
+	if (ref >= builder->records || streamTree_seek(builder->file, ref * STREAM_TREE_REC_LEN) != 0 ||
+			fread(rec, 1, sizeof(rec), builder->file) != sizeof(rec)) {
+		KSI_pushError(builder->ctx, res = KSI_IO_ERROR, "Unable to read from the spill file.");
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmSupported(rec[STREAM_TREE_REC_IMPRINT])) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_FORMAT, "Corrupted spill file.");
+		goto cleanup;
+	}
+
+	node->ref = ref;
+	node->level = rec[STREAM_TREE_REC_LEVEL];
+	node->flags = rec[STREAM_TREE_REC_FLAGS];
+	node->left = uint64_read(rec + STREAM_TREE_REC_LEFT);
+	node->right = uint64_read(rec + STREAM_TREE_REC_RIGHT);
+	node->imprint_len = KSI_getHashLength(rec[STREAM_TREE_REC_IMPRINT]) + 1;
+	memcpy(node->imprint, rec + STREAM_TREE_REC_IMPRINT, node->imprint_len);
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int streamTree_join(KSI_StreamTreeBuilder *builder, const StreamTreeNode *left, const StreamTreeNode *right, unsigned level, StreamTreeNode *out) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char l;
+
+	if (!KSI_IS_VALID_TREE_LEVEL(level)) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "Tree too large.");
+		goto cleanup;
+	}
+
+	l = (unsigned char) level;
+
+	res = KSI_DataHasher_reset(builder->hsr);
+	if (res == KSI_OK) res = KSI_DataHasher_add(builder->hsr, left->imprint, left->imprint_len);
+	if (res == KSI_OK) res = KSI_DataHasher_add(builder->hsr, right->imprint, right->imprint_len);
+	if (res == KSI_OK) res = KSI_DataHasher_add(builder->hsr, &l, 1);
+	if (res == KSI_OK) res = KSI_DataHasher_close(builder->hsr, &hsh);
+	if (res == KSI_OK) res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	out->level = level;
+	out->flags = STREAM_TREE_FLAG_INTERNAL;
+	out->left = left->ref;
+	out->right = right->ref;
+	memcpy(out->imprint, imprint, imprint_len);
+	out->imprint_len = imprint_len;
+
+	res = streamTree_write(builder, out);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+int KSI_StreamTreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, const char *fileName, KSI_StreamTreeBuilder **builder) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_StreamTreeBuilder *tmp = NULL;
+
+	if (ctx == NULL || builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(ctx);
+
+	tmp = KSI_new(KSI_StreamTreeBuilder);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	memset(tmp, 0, sizeof(KSI_StreamTreeBuilder));
+	tmp->ctx = ctx;
+	tmp->algo = algo;
+
+	res = KSI_DataHasher_open(ctx, algo, &tmp->hsr);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (fileName != NULL) {
+		res = KSI_strdup(fileName, &tmp->fileName);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		tmp->file = fopen(fileName, "w+b");
+	} else {
+		tmp->file = tmpfile();
+	}
+
+	if (tmp->file == NULL) {
+		KSI_pushError(ctx, res = KSI_IO_ERROR, "Unable to create the spill file.");
+		goto cleanup;
+	}
+
+	*builder = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_StreamTreeBuilder_free(tmp);
+
+	return res;
+}
+
+void KSI_StreamTreeBuilder_free(KSI_StreamTreeBuilder *builder) {
+	if (builder != NULL) {
+		if (builder->file != NULL) {
+			fclose(builder->file);
+			if (builder->fileName != NULL) remove(builder->fileName);
+		}
+		KSI_free(builder->fileName);
+		KSI_DataHasher_free(builder->hsr);
+		KSI_free(builder);
+	}
+}
+
+/**
+ * Inserts the node into the frontier, joining the complete binary trees of equal height.
+ */
+static int streamTree_insert(KSI_StreamTreeBuilder *builder, StreamTreeNode *node) {
+	int res = KSI_UNKNOWN_ERROR;
+	StreamTreeNode parent;
+	unsigned level = node->level;
+
+	while (builder->used[level]) {
+		res = streamTree_join(builder, &builder->stack[level], node, level + 1, &parent);
+		if (res != KSI_OK) goto cleanup;
+
+		builder->used[level] = false;
+		*node = parent;
+		level++;
+	}
+
+	builder->stack[level] = *node;
+	builder->used[level] = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_StreamTreeBuilder_addImprint(KSI_StreamTreeBuilder *builder, const unsigned char *imprint, const unsigned char *mask, int level) {
+	int res = KSI_UNKNOWN_ERROR;
+	StreamTreeNode leaf;
+	StreamTreeNode msk;
+	StreamTreeNode node;
+
+	if (builder == NULL || imprint == NULL || !KSI_IS_VALID_TREE_LEVEL(level)) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has been finished, new leafs may not be added.");
+		goto cleanup;
+	}
+
+	if (!KSI_isHashAlgorithmSupported(imprint[0])) {
+		KSI_pushError(builder->ctx, res = KSI_UNAVAILABLE_HASH_ALGORITHM, NULL);
+		goto cleanup;
+	}
+
+	if (mask != NULL && mask[0] != builder->algo) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_ARGUMENT, "The mask must have the hash algorithm of the tree.");
+		goto cleanup;
+	}
+
+	if (mask != NULL && !KSI_IS_VALID_TREE_LEVEL(level + 1)) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree height is too large.");
+		goto cleanup;
+	}
+
+	memset(&leaf, 0, sizeof(leaf));
+	leaf.level = (unsigned)level;
+	leaf.flags = STREAM_TREE_FLAG_LEAF;
+	leaf.left = builder->leaves_len;
+	leaf.imprint_len = KSI_getHashLength(imprint[0]) + 1;
+	memcpy(leaf.imprint, imprint, leaf.imprint_len);
+
+	res = streamTree_write(builder, &leaf);
+	if (res != KSI_OK) goto cleanup;
+
+	if (mask != NULL) {
+		memset(&msk, 0, sizeof(msk));
+		msk.level = (unsigned)level;
+		msk.imprint_len = KSI_getHashLength(mask[0]) + 1;
+		memcpy(msk.imprint, mask, msk.imprint_len);
+
+		res = streamTree_write(builder, &msk);
+		if (res != KSI_OK) goto cleanup;
+
+		/* The leaf is the left child of the masked leaf node. */
+		res = streamTree_join(builder, &leaf, &msk, (unsigned)level + 1, &node);
+		if (res != KSI_OK) goto cleanup;
+	} else {
+		node = leaf;
+	}
+
+	res = streamTree_insert(builder, &node);
+	if (res != KSI_OK) goto cleanup;
+
+	builder->leaves_len++;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+int KSI_StreamTreeBuilder_close(KSI_StreamTreeBuilder *builder) {
+	int res = KSI_UNKNOWN_ERROR;
+	StreamTreeNode root;
+	StreamTreeNode tmp;
+	bool hasRoot = false;
+	unsigned i;
+
+	if (builder == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has already been closed.");
+		goto cleanup;
+	}
+
+	if (builder->leaves_len == 0) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has no leafs.");
+		goto cleanup;
+	}
+
+	/* Finalize the forest of complete binary trees into a single tree, the same way as #KSI_TreeBuilder_close. */
+	for (i = 0; i < KSI_TREE_BUILDER_STACK_LEN; i++) {
+		if (!builder->used[i]) continue;
+
+		if (!hasRoot) {
+			root = builder->stack[i];
+			hasRoot = true;
+		} else {
+			res = streamTree_join(builder, &builder->stack[i], &root, (i > root.level ? i : root.level) + 1, &tmp);
+			if (res != KSI_OK) goto cleanup;
+
+			root = tmp;
+		}
+		builder->used[i] = false;
+	}
+
+	if (fflush(builder->file) != 0) {
+		KSI_pushError(builder->ctx, res = KSI_IO_ERROR, "Unable to write to the spill file.");
+		goto cleanup;
+	}
+
+	builder->root = root;
+	builder->closed = true;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+size_t KSI_StreamTreeBuilder_getLeafCount(const KSI_StreamTreeBuilder *builder) {
+	return builder == NULL ? 0 : builder->leaves_len;
+}
+
+int KSI_StreamTreeBuilder_getRoot(const KSI_StreamTreeBuilder *builder, KSI_DataHash **root, unsigned *level) {
+	int res = KSI_UNKNOWN_ERROR;
+
+	if (builder == NULL || root == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (!builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has not been closed.");
+		goto cleanup;
+	}
+
+	res = KSI_DataHash_fromImprint(builder->ctx, builder->root.imprint, builder->root.imprint_len, root);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (level != NULL) *level = builder->root.level;
+
+	res = KSI_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Walks the subtree depth-first from left to right and emits the aggregation hash chain of each
+ * input leaf. The siblings on the path from the root are kept in \c path.
+ */
+static int streamTree_emit(KSI_StreamTreeBuilder *builder, const StreamTreeNode *node, StreamTreeLink *path, size_t depth, size_t *count, KSI_AggregationChainCallback cb, void *cbCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_LIST(KSI_HashChainLink) *links = NULL;
+	KSI_AggregationHashChain *chain = NULL;
+	StreamTreeNode left;
+	StreamTreeNode right;
+	size_t i;
+
+	if (node->flags & STREAM_TREE_FLAG_LEAF) {
+		res = KSI_HashChainLinkList_new(&links);
+		if (res != KSI_OK) goto cleanup;
+
+		for (i = depth; i > 0; i--) {
+			const StreamTreeLink *link = &path[i - 1];
+
+			res = appendImprintLink(builder->ctx, links, link->isLeft, link->imprint, link->imprint_len, link->levelGap);
+			if (res != KSI_OK) goto cleanup;
+		}
+
+		res = createAggregationChain(builder->ctx, builder->algo, node->imprint, node->imprint_len, links, &chain);
+		links = NULL;
+		if (res != KSI_OK) goto cleanup;
+
+		res = cb(cbCtx, (size_t)node->left, chain);
+		if (res != KSI_OK) goto cleanup;
+
+		(*count)++;
+	} else if (node->flags & STREAM_TREE_FLAG_INTERNAL) {
+		if (depth >= KSI_TREE_BUILDER_STACK_LEN) {
+			res = KSI_INVALID_FORMAT;
+			goto cleanup;
+		}
+
+		res = streamTree_read(builder, node->left, &left);
+		if (res != KSI_OK) goto cleanup;
+
+		res = streamTree_read(builder, node->right, &right);
+		if (res != KSI_OK) goto cleanup;
+
+		if (left.level >= node->level || right.level >= node->level) {
+			res = KSI_INVALID_FORMAT;
+			goto cleanup;
+		}
+
+		path[depth].isLeft = true;
+		path[depth].levelGap = node->level - left.level - 1;
+		memcpy(path[depth].imprint, right.imprint, right.imprint_len);
+		path[depth].imprint_len = right.imprint_len;
+
+		res = streamTree_emit(builder, &left, path, depth + 1, count, cb, cbCtx);
+		if (res != KSI_OK) goto cleanup;
+
+		path[depth].isLeft = false;
+		path[depth].levelGap = node->level - right.level - 1;
+		memcpy(path[depth].imprint, left.imprint, left.imprint_len);
+		path[depth].imprint_len = left.imprint_len;
+
+		res = streamTree_emit(builder, &right, path, depth + 1, count, cb, cbCtx);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* The masks do not have a chain. */
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_HashChainLinkList_free(links);
+	KSI_AggregationHashChain_free(chain);
+
+	return res;
+}
+
+int KSI_StreamTreeBuilder_getAggregationChains(KSI_StreamTreeBuilder *builder, KSI_AggregationChainCallback cb, void *cbCtx) {
+	int res = KSI_UNKNOWN_ERROR;
+	StreamTreeLink *path = NULL;
+	size_t count = 0;
+
+	if (builder == NULL || cb == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	KSI_ERR_clearErrors(builder->ctx);
+
+	if (!builder->closed) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "The tree has not been closed.");
+		goto cleanup;
+	}
+
+	path = KSI_calloc(KSI_TREE_BUILDER_STACK_LEN, sizeof(StreamTreeLink));
+	if (path == NULL) {
+		KSI_pushError(builder->ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	res = streamTree_emit(builder, &builder->root, path, 0, &count, cb, cbCtx);
+	if (res != KSI_OK) {
+		KSI_pushError(builder->ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (count != builder->leaves_len) {
+		KSI_pushError(builder->ctx, res = KSI_INVALID_STATE, "Leaf count mismatch in the spill file.");
+		goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_free(path);
+
+	return res;
+}
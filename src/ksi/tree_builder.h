@@ -217,6 +217,18 @@ int KSI_TreeBuilder_addDataHash(KSI_TreeBuilder *builder, KSI_DataHash *hsh, int
  */
 int KSI_TreeBuilder_addMetaData(KSI_TreeBuilder *builder, KSI_MetaData *metaData, int level, KSI_TreeLeafHandle **leaf);
 
+/**
+ * Sets the number of threads used for hashing. If \c threads is greater than 1, the hash values of the
+ * internal nodes are not calculated while adding the leafs, but in parallel by #KSI_TreeBuilder_close,
+ * one subtree per thread. The resulting tree is the same as calculated by a single thread.
+ * \param[in]	builder		The builder.
+ * \param[in]	threads		Number of threads, 0 or 1 to calculate the nodes immediately.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The thread count may only be set before adding the first leaf. If the platform does not
+ * support threads, the nodes are calculated by the calling thread.
+ */
+int KSI_TreeBuilder_setThreadCount(KSI_TreeBuilder *builder, size_t threads);
+
 /**
  * This function finalizes the building of the tree. After calling this function no more leafs
  * may be added to the computation and doing so would result in an error.
@@ -225,6 +237,201 @@ int KSI_TreeBuilder_addMetaData(KSI_TreeBuilder *builder, KSI_MetaData *metaData
  */
 int KSI_TreeBuilder_close(KSI_TreeBuilder *builder);
 
+/**
+ * A tree builder which keeps the nodes of each tree level as a contiguous array of imprints
+ * instead of a graph of #KSI_TreeNode objects. The tree shape and the root value are the same
+ * as computed by #KSI_TreeBuilder for the same input, but the leafs are addressed by their
+ * index and the leaf processors are replaced by the optional masking of the leafs (see
+ * #KSI_CompactTreeBuilder_setMasking). Besides the leafs, only the internal nodes above the
+ * lowest few levels are kept, the rest of the tree and the masks are recalculated when the
+ * aggregation hash chains are extracted.
+ */
+typedef struct KSI_CompactTreeBuilder_st KSI_CompactTreeBuilder;
+
+/**
+ * Constructor for the #KSI_CompactTreeBuilder object.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	algo		Algorithm used for the internal nodes.
+ * \param[out]	builder		Pointer to the receiving pointer.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \see #KSI_CompactTreeBuilder_free
+ */
+int KSI_CompactTreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, KSI_CompactTreeBuilder **builder);
+
+/**
+ * Destructor for the #KSI_CompactTreeBuilder object.
+ * \param[in]	builder		Pointer to the object.
+ */
+void KSI_CompactTreeBuilder_free(KSI_CompactTreeBuilder *builder);
+
+/**
+ * Enables the masking of the leafs, the same way as the masking leaf processor of the
+ * #KSI_BlockSigner does. Each leaf is joined with a mask as the right sibling, the mask
+ * is calculated from the previous leaf value and the initial value.
+ * \param[in]	builder		The builder.
+ * \param[in]	prevLeaf	Previous leaf value of the first leaf.
+ * \param[in]	iv			Initial value of the masking.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The masking must be enabled before adding the first leaf.
+ * \see #KSI_CompactTreeBuilder_getPrevLeaf
+ */
+int KSI_CompactTreeBuilder_setMasking(KSI_CompactTreeBuilder *builder, const KSI_DataHash *prevLeaf, const KSI_OctetString *iv);
+
+/**
+ * Getter for the previous leaf value after the last added leaf, to be used for masking the
+ * leafs that follow.
+ * \param[in]	builder		The builder with the masking enabled.
+ * \param[out]	prevLeaf	Pointer to the receiving pointer.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The caller is responsible for freeing the output with #KSI_DataHash_free.
+ */
+int KSI_CompactTreeBuilder_getPrevLeaf(const KSI_CompactTreeBuilder *builder, KSI_DataHash **prevLeaf);
+
+/**
+ * Adds a new leaf to the tree. If the masking is enabled, the leaf is first joined with its mask.
+ * \param[in]	builder		The builder.
+ * \param[in]	imprint		Imprint of the leaf hash value.
+ * \param[in]	level		The level of the leaf.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note All the leafs of the tree must use the same hash algorithm.
+ */
+int KSI_CompactTreeBuilder_addImprint(KSI_CompactTreeBuilder *builder, const unsigned char *imprint, int level);
+
+/**
+ * This function finalizes the building of the tree. After calling this function no more leafs
+ * may be added.
+ * \param[in]	builder 	The builder.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_CompactTreeBuilder_close(KSI_CompactTreeBuilder *builder);
+
+/**
+ * Returns the number of leafs added to the tree.
+ * \param[in]	builder 	The builder.
+ * \return Number of leafs.
+ */
+size_t KSI_CompactTreeBuilder_getLeafCount(const KSI_CompactTreeBuilder *builder);
+
+/**
+ * Getter for the root of the closed tree.
+ * \param[in]	builder 	The builder.
+ * \param[out]	root		Pointer to the receiving pointer.
+ * \param[out]	level		Level of the root node (can be \c NULL).
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The caller is responsible for freeing the output with #KSI_DataHash_free.
+ */
+int KSI_CompactTreeBuilder_getRoot(const KSI_CompactTreeBuilder *builder, KSI_DataHash **root, unsigned *level);
+
+/**
+ * Generates an aggregation hash chain from the leaf with the given index to the root of the
+ * closed tree.
+ * \param[in]	builder 	The builder.
+ * \param[in]	index		Index of the leaf in the order of adding.
+ * \param[out]	chain		Pointer to the receiving pointer.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \see #KSI_AggregationHashChain_free.
+ */
+int KSI_CompactTreeBuilder_getAggregationChain(KSI_CompactTreeBuilder *builder, size_t index, KSI_AggregationHashChain **chain);
+
+/**
+ * Same as #KSI_CompactTreeBuilder_getAggregationChain, but the output is created in the given
+ * KSI context and the builder is not modified. As long as no new leafs are added, the function
+ * may be called concurrently from several threads, each with its own KSI context.
+ * \param[in]	builder 	The closed builder.
+ * \param[in]	ctx			KSI context of the output.
+ * \param[in]	index		Index of the leaf in the order of adding.
+ * \param[out]	chain		Pointer to the receiving pointer.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \see #KSI_AggregationHashChain_free.
+ */
+int KSI_CompactTreeBuilder_getAggregationChainWithCtx(const KSI_CompactTreeBuilder *builder, KSI_CTX *ctx, size_t index, KSI_AggregationHashChain **chain);
+
+/**
+ * A tree builder for blocks that do not fit into memory. Only the roots of the complete binary
+ * trees not yet joined (at most one per tree level) are kept in memory, all the nodes of the tree
+ * are appended to a spill file. After closing, the aggregation hash chains of the leafs are
+ * emitted in the order of adding by a single pass over the tree. The tree shape and the root
+ * value are the same as computed by #KSI_CompactTreeBuilder for the same input.
+ */
+typedef struct KSI_StreamTreeBuilder_st KSI_StreamTreeBuilder;
+
+/**
+ * Callback for receiving the aggregation hash chains of the leafs.
+ * \param[in]	cbCtx		Callback context.
+ * \param[in]	index		Index of the leaf in the order of adding.
+ * \param[in]	chain		Aggregation hash chain from the leaf to the root.
+ * \return #KSI_OK to continue, any other value stops the iteration and is returned to the caller.
+ * \note The chain is freed after the callback returns, use #KSI_AggregationHashChain_ref to keep it.
+ */
+typedef int (*KSI_AggregationChainCallback)(void *cbCtx, size_t index, KSI_AggregationHashChain *chain);
+
+/**
+ * Constructor for the #KSI_StreamTreeBuilder object.
+ * \param[in]	ctx			KSI context.
+ * \param[in]	algo		Algorithm used for the internal nodes.
+ * \param[in]	fileName	Path of the spill file, if \c NULL a temporary file is used.
+ * \param[out]	builder		Pointer to the receiving pointer.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The spill file is overwritten and removed by #KSI_StreamTreeBuilder_free.
+ * \see #KSI_StreamTreeBuilder_free
+ */
+int KSI_StreamTreeBuilder_new(KSI_CTX *ctx, KSI_HashAlgorithm algo, const char *fileName, KSI_StreamTreeBuilder **builder);
+
+/**
+ * Destructor for the #KSI_StreamTreeBuilder object.
+ * \param[in]	builder		Pointer to the object.
+ */
+void KSI_StreamTreeBuilder_free(KSI_StreamTreeBuilder *builder);
+
+/**
+ * Adds a new leaf to the tree, see #KSI_CompactTreeBuilder_addImprint.
+ * \param[in]	builder		The builder.
+ * \param[in]	imprint		Imprint of the leaf hash value.
+ * \param[in]	mask		Imprint of the mask value (can be \c NULL).
+ * \param[in]	level		Level of the leaf.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_StreamTreeBuilder_addImprint(KSI_StreamTreeBuilder *builder, const unsigned char *imprint, const unsigned char *mask, int level);
+
+/**
+ * This function finalizes the building of the tree. After calling this function no more leafs
+ * may be added to the computation and doing so would result in an error.
+ * \param[in]	builder 	The builder.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_StreamTreeBuilder_close(KSI_StreamTreeBuilder *builder);
+
+/**
+ * Returns the number of leafs added to the tree.
+ * \param[in]	builder 	The builder.
+ * \return Number of leafs.
+ */
+size_t KSI_StreamTreeBuilder_getLeafCount(const KSI_StreamTreeBuilder *builder);
+
+/**
+ * Getter for the root of the closed tree.
+ * \param[in]	builder 	The builder.
+ * \param[out]	root		Pointer to the receiving pointer.
+ * \param[out]	level		Level of the root node (can be \c NULL).
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ * \note The caller is responsible for freeing the output with #KSI_DataHash_free.
+ */
+int KSI_StreamTreeBuilder_getRoot(const KSI_StreamTreeBuilder *builder, KSI_DataHash **root, unsigned *level);
+
+/**
+ * Generates the aggregation hash chains of all the leafs of the closed tree and passes them to
+ * the callback in a single left to right pass over the tree. Only the path from the root to the
+ * current leaf is kept in memory.
+ * \note The order of the leafs in the tree is the order of adding, unless the leafs have different
+ * levels: a leaf with a higher level may be placed before the lower subtrees added earlier. The
+ * callback receives the index of each leaf in the order of adding.
+ * \param[in]	builder 	The builder.
+ * \param[in]	cb			Callback receiving the chains.
+ * \param[in]	cbCtx		Callback context.
+ * \return On success returns KSI_OK, otherwise a status code is returned (see #KSI_StatusCode).
+ */
+int KSI_StreamTreeBuilder_getAggregationChains(KSI_StreamTreeBuilder *builder, KSI_AggregationChainCallback cb, void *cbCtx);
+
 /**
  * @}
  */
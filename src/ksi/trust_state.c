@@ -0,0 +1,259 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+
+#include "internal.h"
+#include "compatibility.h"
+#include "net.h"
+#include "pkitruststore.h"
+#include "publicationsfile.h"
+
+#include "impl/ctx_impl.h"
+#include "impl/pkitruststore_impl.h"
+#include "impl/publicationsfile_impl.h"
+#include "impl/trust_state_impl.h"
+
+static void certConstraints_free(KSI_CertConstraint *arr) {
+	size_t i;
+	if (arr != NULL) {
+		for (i = 0; arr[i].oid != NULL; i++) {
+			KSI_free(arr[i].oid);
+			KSI_free(arr[i].val);
+		}
+		KSI_free(arr);
+	}
+}
+
+static int certConstraints_copy(KSI_CTX *ctx, const KSI_CertConstraint *arr, KSI_CertConstraint **out) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CertConstraint *tmp = NULL;
+	size_t count = 0;
+	size_t i;
+
+	while (arr[count++].oid != NULL);
+
+	tmp = KSI_calloc(count, sizeof(KSI_CertConstraint));
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; arr[i].oid != NULL; i++) {
+		res = KSI_strdup(arr[i].oid, &tmp[i].oid);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+
+		res = KSI_strdup(arr[i].val, &tmp[i].val);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	*out = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	certConstraints_free(tmp);
+
+	return res;
+}
+
+/* The raw buffer of the verification view is owned by the trust state. */
+static void trustState_keepRaw(void *unused) {
+	(void)unused;
+}
+
+int KSI_TrustState_new(KSI_CTX *ctx, KSI_TrustState **state) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_TrustState *tmp = NULL;
+	KSI_RequestHandle *handle = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKITruststore *pki = NULL;
+	const unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+	if (ctx == NULL || state == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	KSI_LOG_debug(ctx, "Receiving publications file for a new trust state.");
+
+	res = KSI_sendPublicationRequest(ctx, NULL, 0, &handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_RequestHandle_perform(handle);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_RequestHandle_getResponse(handle, &raw, &raw_len);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (raw == NULL || raw_len == 0) {
+		KSI_pushError(ctx, res = KSI_INVALID_FORMAT, "Empty publications file.");
+		goto cleanup;
+	}
+
+	tmp = KSI_new(KSI_TrustState);
+	if (tmp == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->ref = 1;
+	tmp->raw = NULL;
+	tmp->raw_len = 0;
+	tmp->index = NULL;
+	tmp->truststore = NULL;
+	tmp->certConstraints = NULL;
+	tmp->createdAt = time(NULL);
+	tmp->successor = NULL;
+	tmp->refreshing = NULL;
+
+	tmp->raw = KSI_malloc(raw_len);
+	if (tmp->raw == NULL) {
+		KSI_pushError(ctx, res = KSI_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	memcpy(tmp->raw, raw, raw_len);
+	tmp->raw_len = raw_len;
+
+	res = KSI_PublicationsFile_fromSharedRaw(ctx, tmp->raw, tmp->raw_len, trustState_keepRaw, NULL, &pubFile);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, "Received publications file not verified.");
+		goto cleanup;
+	}
+
+	res = KSI_CTX_getPKITruststore(ctx, &pki);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_PKITruststore_share(NULL, pki, &tmp->truststore);
+	if (res != KSI_OK) {
+		KSI_pushError(ctx, res, NULL);
+		goto cleanup;
+	}
+
+	if (ctx->certConstraints != NULL) {
+		res = certConstraints_copy(ctx, ctx->certConstraints, &tmp->certConstraints);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	/* The indexes are built once here, the attached contexts only read them. */
+	pubFile->ctx = NULL;
+	tmp->index = pubFile;
+	pubFile = NULL;
+
+	*state = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_RequestHandle_free(handle);
+	KSI_TrustState_free(tmp);
+
+	return res;
+}
+
+KSI_TrustState *KSI_TrustState_ref(KSI_TrustState *state) {
+	if (state != NULL) {
+		KSI_atomicIncrement(&state->ref);
+	}
+	return state;
+}
+
+void KSI_TrustState_free(KSI_TrustState *state) {
+	KSI_TrustState *successor = NULL;
+
+	/* The replacement chain is released iteratively, as it may be long in a long running process. */
+	while (state != NULL && KSI_atomicDecrement(&state->ref) == 0) {
+		successor = KSI_atomicLoadPtr(&state->successor);
+
+		KSI_PublicationsFile_free(state->index);
+		KSI_free(state->raw);
+		KSI_PKITruststore_free(state->truststore);
+		certConstraints_free(state->certConstraints);
+		KSI_free(state);
+
+		state = successor;
+	}
+}
+
+int KSI_TrustState_replace(KSI_TrustState *state, KSI_TrustState *successor) {
+	if (state == NULL || successor == NULL || KSI_TrustState_latest(successor) == state) {
+		return KSI_INVALID_ARGUMENT;
+	}
+
+	KSI_TrustState_ref(successor);
+	if (!KSI_atomicCompareAndSwapPtr(&state->successor, NULL, successor)) {
+		KSI_TrustState_free(successor);
+		return KSI_INVALID_STATE;
+	}
+
+	return KSI_OK;
+}
+
+time_t KSI_TrustState_getCreatedAt(const KSI_TrustState *state) {
+	return state != NULL ? state->createdAt : 0;
+}
+
+KSI_TrustState *KSI_TrustState_latest(KSI_TrustState *state) {
+	KSI_TrustState *successor = NULL;
+
+	while (state != NULL && (successor = KSI_atomicLoadPtr(&state->successor)) != NULL) {
+		state = successor;
+	}
+
+	return state;
+}
+
+int KSI_TrustState_claimRefresh(KSI_TrustState *state, KSI_CTX *ctx) {
+	return KSI_atomicCompareAndSwapPtr(&state->refreshing, NULL, ctx);
+}
+
+void KSI_TrustState_releaseRefresh(KSI_TrustState *state, KSI_CTX *ctx) {
+	KSI_atomicCompareAndSwapPtr(&state->refreshing, ctx, NULL);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef TRUST_STATE_H_
+#define TRUST_STATE_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup truststate Shared Trust State
+ * The trust state is a verified publications file together with the PKI truststore and the
+ * publications file certificate constraints it was verified with. The trust state is immutable
+ * and reference counted, so a single instance can be shared by all the #KSI_CTX objects of the
+ * process, also between threads, instead of every context downloading, parsing and keeping its
+ * own copy of the publications file.
+ *
+ * A context is attached to the trust state with #KSI_CTX_setTrustState. When the trust state
+ * is older than #KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, the first attached context calling
+ * #KSI_receivePublicationsFile downloads a new publications file and publishes it with
+ * #KSI_TrustState_replace, all the other contexts continue using the current state and switch
+ * over to the new one on their next call.
+ * @{
+ */
+
+/**
+ * Creates a new trust state by receiving the publications file with the network provider of
+ * \c ctx and verifying it with the PKI truststore and the publications file certificate
+ * constraints of \c ctx.
+ * \param[in]	ctx			KSI context.
+ * \param[out]	state		Pointer to the receiving pointer.
+ * \return status code (#KSI_OK, when operation succeeded, otherwise an error code).
+ * \note The trust state keeps a reference to the PKI truststore of \c ctx, which must not be
+ * modified afterwards.
+ * \see #KSI_TrustState_free, #KSI_CTX_setTrustState
+ */
+int KSI_TrustState_new(KSI_CTX *ctx, KSI_TrustState **state);
+
+/**
+ * Increases the reference count of the trust state. The function is thread-safe.
+ * \param[in]	state		Trust state.
+ * \return The input trust state.
+ */
+KSI_TrustState *KSI_TrustState_ref(KSI_TrustState *state);
+
+/**
+ * Decreases the reference count of the trust state and frees it, when the count reaches zero.
+ * The function is thread-safe.
+ * \param[in]	state		Trust state.
+ */
+void KSI_TrustState_free(KSI_TrustState *state);
+
+/**
+ * Publishes \c successor as the replacement of \c state. The contexts attached to \c state
+ * switch to \c successor on their next call to #KSI_receivePublicationsFile. A trust state
+ * can be replaced only once. The function is thread-safe.
+ * \param[in]	state		Trust state to be replaced.
+ * \param[in]	successor	The new trust state.
+ * \return status code (#KSI_OK, when operation succeeded, #KSI_INVALID_STATE if the state has
+ * already been replaced, otherwise an error code).
+ * \note The ownership of \c successor is not taken.
+ */
+int KSI_TrustState_replace(KSI_TrustState *state, KSI_TrustState *successor);
+
+/**
+ * Returns the time the publications file of the trust state was received.
+ * \param[in]	state		Trust state.
+ * \return Creation time of the trust state, or 0 if \c state is \c NULL.
+ */
+time_t KSI_TrustState_getCreatedAt(const KSI_TrustState *state);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRUST_STATE_H_ */
@@ -102,6 +102,36 @@ extern "C" {
 	 */
 	typedef struct KSI_PKITruststore_st KSI_PKITruststore;
 
+	/**
+	 * Cache of extended calendar hash chains.
+	 */
+	typedef struct KSI_CalendarCache_st KSI_CalendarCache;
+
+	/**
+	 * Local copy of the calendar database.
+	 */
+	typedef struct KSI_CalendarMirror_st KSI_CalendarMirror;
+
+	/**
+	 * Signer of a continuous stream of records.
+	 */
+	typedef struct KSI_StreamSigner_st KSI_StreamSigner;
+
+	/**
+	 * Immutable publications file and PKI trust anchors shared between contexts.
+	 */
+	typedef struct KSI_TrustState_st KSI_TrustState;
+
+	/**
+	 * Cache of successful PKI verification results.
+	 */
+	typedef struct KSI_PKIVerificationCache_st KSI_PKIVerificationCache;
+
+	/**
+	 * Hit and miss counters of the PKI verification result cache.
+	 */
+	typedef struct KSI_PKIVerificationCacheStats_st KSI_PKIVerificationCacheStats;
+
 	/**
 	 * Network endpoint description that must have implementation according to the type of transport layer used.
 	 */
@@ -153,6 +183,18 @@ extern "C" {
 		char *val;
 	};
 
+	/** Hit and miss counters of the PKI verification result cache. */
+	struct KSI_PKIVerificationCacheStats_st {
+		/** Number of signature verifications answered from the cache. */
+		size_t signatureHits;
+		/** Number of signature verifications performed. */
+		size_t signatureMisses;
+		/** Number of certificate chain verifications answered from the cache. */
+		size_t certificateHits;
+		/** Number of certificate chain verifications performed. */
+		size_t certificateMisses;
+	};
+
 #define KSI_APPLY_TO_NOT_NULL(val, fn, args) (((val) != NULL) ? ( val->fn != NULL ? (val->fn args) : KSI_INVALID_STATE) : KSI_INVALID_ARGUMENT)
 
 
@@ -576,7 +576,11 @@ void KSI_Integer_free(KSI_Integer *o) {
 	}
 }
 
-KSI_IMPLEMENT_REF(KSI_Integer);
+KSI_DEFINE_REF(KSI_Integer) {
+	/* The pooled values are shared between all the KSI contexts and are never freed. */
+	if (o != NULL && o->value >= integerPoolSize) o->ref++;
+	return o;
+}
 
 char *KSI_Integer_toDateString(const KSI_Integer *o, char *buf, size_t buf_len) {
 	char *ret = NULL;
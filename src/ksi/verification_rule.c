@@ -2650,59 +2650,16 @@ cleanup:
 	return res;
 }
 
-static int initExtendedCalendarHashChain(KSI_VerificationContext *info, KSI_Integer *endTime) {
+static int requestExtendedCalendarHashChain(KSI_CTX *ctx, KSI_Integer *startTime, KSI_Integer *endTime, KSI_CalendarHashChain **chain) {
 	int res = KSI_UNKNOWN_ERROR;
-	KSI_CTX *ctx = NULL;
-	const KSI_Signature *sig = NULL;
-	KSI_Integer *startTime = NULL;
 	KSI_ExtendReq *req = NULL;
 	KSI_RequestHandle *handle = NULL;
 	KSI_ExtendResp *resp = NULL;
 	KSI_Integer *status = NULL;
 	KSI_CalendarHashChain *tmp = NULL;
-	KSI_AggregationHashChain *aggr = NULL;
-	VerificationTempData *tempData = NULL;
 	KSI_Integer *respReqId = NULL;
 	KSI_Integer *reqReqId = NULL;
 
-	if (info == NULL || info->ctx == NULL || info->signature == NULL) {
-		res = KSI_INVALID_ARGUMENT;
-		goto cleanup;
-	}
-
-
-	ctx = info->ctx;
-	sig = info->signature;
-	KSI_ERR_clearErrors(ctx);
-
-	tempData = info->tempData;
-	if (tempData == NULL) {
-		KSI_pushError(ctx, res = KSI_INVALID_STATE, "Verification context not properly initialized.");
-		goto cleanup;
-	}
-
-	/* Extract start time. */
-	if (sig->calendarChain != NULL) {
-		res = KSI_CalendarHashChain_getAggregationTime(sig->calendarChain, &startTime);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
-	} else {
-		/* Take the first aggregation hash chain, as all of the chain should have the same value for "aggregation time". */
-		res = (KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, 0, &aggr));
-		if (res != KSI_OK) goto cleanup;
-
-		res = KSI_AggregationHashChain_getAggregationTime(aggr, &startTime);
-		if (res != KSI_OK) {
-			KSI_pushError(ctx,res, NULL);
-			goto cleanup;
-		}
-	}
-
-	/* Clone the start time object. */
-	KSI_Integer_ref(startTime);
-
 	res = KSI_createExtendRequest(ctx, startTime, endTime, &req);
 	if (res != KSI_OK) {
 		KSI_pushError(ctx,res, NULL);
@@ -2771,6 +2728,91 @@ static int initExtendedCalendarHashChain(KSI_VerificationContext *info, KSI_Inte
 		goto cleanup;
 	}
 
+	*chain = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+	KSI_ExtendReq_free(req);
+	KSI_RequestHandle_free(handle);
+	KSI_ExtendResp_free(resp);
+	KSI_CalendarHashChain_free(tmp);
+
+	return res;
+}
+
+static int initExtendedCalendarHashChain(KSI_VerificationContext *info, KSI_Integer *endTime) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_CTX *ctx = NULL;
+	const KSI_Signature *sig = NULL;
+	KSI_Integer *startTime = NULL;
+	KSI_CalendarHashChain *tmp = NULL;
+	KSI_AggregationHashChain *aggr = NULL;
+	VerificationTempData *tempData = NULL;
+
+	if (info == NULL || info->ctx == NULL || info->signature == NULL) {
+		res = KSI_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+
+	ctx = info->ctx;
+	sig = info->signature;
+	KSI_ERR_clearErrors(ctx);
+
+	tempData = info->tempData;
+	if (tempData == NULL) {
+		KSI_pushError(ctx, res = KSI_INVALID_STATE, "Verification context not properly initialized.");
+		goto cleanup;
+	}
+
+	/* Extract start time. */
+	if (sig->calendarChain != NULL) {
+		res = KSI_CalendarHashChain_getAggregationTime(sig->calendarChain, &startTime);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
+	} else {
+		/* Take the first aggregation hash chain, as all of the chain should have the same value for "aggregation time". */
+		res = (KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, 0, &aggr));
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_AggregationHashChain_getAggregationTime(aggr, &startTime);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx,res, NULL);
+			goto cleanup;
+		}
+	}
+
+	/* Clone the start time object. */
+	KSI_Integer_ref(startTime);
+
+	/* Extending to the calendar head can not be served from the cache. */
+	if (ctx->calendarCache != NULL && endTime != NULL) {
+		res = KSI_CalendarCache_get(ctx->calendarCache, startTime, endTime, &tmp);
+		if (res != KSI_OK) {
+			KSI_pushError(ctx, res, NULL);
+			goto cleanup;
+		}
+	}
+
+	if (tmp == NULL) {
+		res = requestExtendedCalendarHashChain(ctx, startTime, endTime, &tmp);
+		if (res != KSI_OK) goto cleanup;
+
+		/* Only keep the chains that are compatible with the signature. */
+		if (ctx->calendarCache != NULL && endTime != NULL &&
+				(sig->calendarChain == NULL || KSI_CalendarHashChain_verifyCompatibilityTo(sig->calendarChain, tmp) == KSI_OK)) {
+			res = KSI_CalendarCache_add(ctx->calendarCache, startTime, endTime, tmp);
+			if (res != KSI_OK) {
+				KSI_pushError(ctx, res, NULL);
+				goto cleanup;
+			}
+		}
+	}
+
 	if (tempData->calendarChain != NULL) {
 		KSI_CalendarHashChain_free(tempData->calendarChain);
 	}
@@ -2781,9 +2823,6 @@ static int initExtendedCalendarHashChain(KSI_VerificationContext *info, KSI_Inte
 
 cleanup:
 	KSI_Integer_free(startTime);
-	KSI_ExtendReq_free(req);
-	KSI_RequestHandle_free(handle);
-	KSI_ExtendResp_free(resp);
 	KSI_CalendarHashChain_free(tmp);
 
 	return res;
@@ -77,6 +77,14 @@ static void asyncSigning_verifyOptions(CuTest* tc, const char *url, const char *
 	verifyOption(tc, as, KSI_ASYNC_OPT_SND_TIMEOUT, 10, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, 1, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_MAX_REQUEST_COUNT, 1, 15);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_KEEP_ALIVE, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE, 16, 4);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS, 0, 2);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_MULTIPLEX, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_RESPONSE_CALLBACK, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_AUTO_PACING, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_BATCH_SIZE, 0, 16);
+	verifyOption(tc, as, KSI_ASYNC_OPT_BATCH_WINDOW, 0, 100);
 
 	KSI_AsyncService_free(as);
 }
@@ -130,7 +138,7 @@ void Test_AsyncSigningService_verifyCacheSizeOption_http(CuTest* tc) {
 	asyncSigning_verifyCacheSizeOption(tc, KSITest_composeUri(TEST_SCHEME_HTTP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass);
 }
 
-static void asyncSigning_loop_getResponse(CuTest* tc, const char *url, const char *user, const char *pass) {
+static void asyncSigning_loop_getResponse(CuTest* tc, const char *url, const char *user, const char *pass, size_t keepAlive) {
 	int res;
 	KSI_AsyncService *as = NULL;
 	time_t startTime;
@@ -155,6 +163,9 @@ static void asyncSigning_loop_getResponse(CuTest* tc, const char *url, const cha
 	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)(NOF_TEST_REQUESTS));
 	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
 
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_HTTP_KEEP_ALIVE, (void*)keepAlive);
+	CuAssert(tc, "Unable to set keep-alive.", res == KSI_OK);
+
 	p_req = TEST_REQUESTS;
 	do {
 		KSI_AsyncHandle *respHandle = NULL;
@@ -304,12 +315,17 @@ static void asyncSigning_loop_getResponse(CuTest* tc, const char *url, const cha
 
 void Test_AsyncSign_loop_tcp(CuTest* tc) {
 	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
-	asyncSigning_loop_getResponse(tc, KSITest_composeUri(TEST_SCHEME_TCP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass);
+	asyncSigning_loop_getResponse(tc, KSITest_composeUri(TEST_SCHEME_TCP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass, 0);
 }
 
 void Test_AsyncSign_loop_http(CuTest* tc) {
 	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
-	asyncSigning_loop_getResponse(tc, KSITest_composeUri(TEST_SCHEME_HTTP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass);
+	asyncSigning_loop_getResponse(tc, KSITest_composeUri(TEST_SCHEME_HTTP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass, 0);
+}
+
+void Test_AsyncSign_loop_http_keepAlive(CuTest* tc) {
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	asyncSigning_loop_getResponse(tc, KSITest_composeUri(TEST_SCHEME_HTTP, &conf.aggregator), conf.aggregator.user, conf.aggregator.pass, 1);
 }
 
 
@@ -1259,6 +1275,7 @@ CuSuite* AsyncAggrIntegrationTests_getSuite(void) {
 	SUITE_ADD_TEST(suite, Test_AsyncSigningService_verifyOptions_http);
 	SUITE_ADD_TEST(suite, Test_AsyncSigningService_verifyCacheSizeOption_http);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_loop_http);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_loop_http_keepAlive);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_useSigningHandle_loop_http);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_collect_http);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_useExtender_http);
@@ -120,6 +120,10 @@ static CuSuite* initSuite(void) {
 	addSuite(suite, KSITest_Flags_getSuite);
 	addSuite(suite, KSITest_SignatureBuilder_getSuite);
 	addSuite(suite, KSITest_List_getSuite);
+	addSuite(suite, KSITest_CalendarCache_getSuite);
+	addSuite(suite, KSITest_CalendarMirror_getSuite);
+	addSuite(suite, KSITest_StreamSigner_getSuite);
+	addSuite(suite, KSITest_TrustState_getSuite);
 
 	return suite;
 }
@@ -84,6 +84,10 @@ CuSuite* KSITest_Blocksigner_getSuite(void);
 CuSuite* KSITest_Flags_getSuite(void);
 CuSuite* KSITest_SignatureBuilder_getSuite(void);
 CuSuite* KSITest_List_getSuite(void);
+CuSuite* KSITest_CalendarCache_getSuite(void);
+CuSuite* KSITest_CalendarMirror_getSuite(void);
+CuSuite* KSITest_StreamSigner_getSuite(void);
+CuSuite* KSITest_TrustState_getSuite(void);
 
 
 #ifdef __cplusplus
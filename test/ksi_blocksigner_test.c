@@ -20,12 +20,16 @@
 #include <string.h>
 #include <ksi/ksi.h>
 #include <ksi/blocksigner.h>
+#include <ksi/blockverifier.h>
+#include <ksi/net_async.h>
 
 #include "cutest/CuTest.h"
 #include "all_tests.h"
+#include "test_mock_async.h"
 
 #include "../src/ksi/impl/ctx_impl.h"
 #include "../src/ksi/impl/net_http_impl.h"
+#include "../src/ksi/impl/signature_impl.h"
 
 extern KSI_CTX *ctx;
 
@@ -239,6 +243,418 @@ static void testMasking(CuTest *tc) {
 #undef TEST_AGGR_RESPONSE_FILE
 }
 
+static void testMaskingWithThreads(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSignerHandle *hndl = NULL;
+	KSI_Signature *sig = NULL;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_BlockSigner_setThreadCount(bs, 4);
+	CuAssert(tc, "Unable to set the thread count.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, i == 50 ? &hndl : NULL);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+	}
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	/* The response matches only the same tree as calculated by a single thread. */
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	res = KSI_BlockSignerHandle_getSignature(hndl, &sig);
+	CuAssert(tc, "Unable to get the leaf signature.", res == KSI_OK && sig != NULL);
+
+	res = KSI_Signature_verifyWithPolicy(sig, hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+	CuAssert(tc, "Leaf signature should be valid.", res == KSI_OK);
+
+	KSI_Signature_free(sig);
+	KSI_BlockSignerHandle_free(hndl);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+static void testSerializeSignature(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSignerHandle *hndl[101];
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	memset(hndl, 0, sizeof(hndl));
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, &hndl[i]);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+	}
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		KSI_Signature *sig = NULL;
+		KSI_Signature *parsed = NULL;
+		unsigned char *raw = NULL;
+		size_t raw_len = 0;
+		unsigned char *spliced = NULL;
+		size_t spliced_len = 0;
+
+		res = KSI_BlockSignerHandle_getSignature(hndl[i], &sig);
+		CuAssert(tc, "Unable to get the leaf signature.", res == KSI_OK && sig != NULL);
+
+		res = KSI_Signature_serialize(sig, &raw, &raw_len);
+		CuAssert(tc, "Unable to serialize the leaf signature.", res == KSI_OK);
+
+		res = KSI_BlockSignerHandle_serializeSignature(hndl[i], &spliced, &spliced_len);
+		CuAssert(tc, "Unable to splice the leaf signature.", res == KSI_OK && spliced != NULL);
+
+		CuAssert(tc, "Spliced signature mismatch.", raw_len == spliced_len && !memcmp(raw, spliced, raw_len));
+
+		res = KSI_Signature_parse(ctx, spliced, spliced_len, &parsed);
+		CuAssert(tc, "Unable to parse the spliced signature.", res == KSI_OK && parsed != NULL);
+
+		res = KSI_Signature_verifyWithPolicy(parsed, hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+		CuAssert(tc, "Spliced signature should be valid.", res == KSI_OK);
+
+		KSI_Signature_free(parsed);
+		KSI_Signature_free(sig);
+		KSI_free(raw);
+		KSI_free(spliced);
+		KSI_BlockSignerHandle_free(hndl[i]);
+	}
+
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+typedef struct SignatureCheck_st {
+	KSI_DataHash *hsh;
+	/** If set, the signatures are compared with the ones serialized by the block signer. */
+	KSI_BlockSigner *bs;
+	size_t count;
+	size_t failures;
+} SignatureCheck;
+
+static int checkLeafSignature(void *c, size_t index, KSI_Signature *sig) {
+	SignatureCheck *check = c;
+
+	if (index != check->count || KSI_Signature_verifyWithPolicy(sig, check->hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL) != KSI_OK) {
+		check->failures++;
+	}
+	check->count++;
+
+	if (check->bs != NULL) {
+		unsigned char *raw = NULL;
+		size_t raw_len = 0;
+		unsigned char *expected = NULL;
+		size_t expected_len = 0;
+
+		if (KSI_Signature_serialize(sig, &raw, &raw_len) != KSI_OK ||
+				KSI_BlockSigner_serializeSignatureAt(check->bs, index, &expected, &expected_len) != KSI_OK ||
+				raw_len != expected_len || memcmp(raw, expected, raw_len)) {
+			check->failures++;
+		}
+
+		KSI_free(raw);
+		KSI_free(expected);
+	}
+
+	return KSI_OK;
+}
+
+static void testAddLeavesStreaming(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_Signature *leafSig = NULL;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char imprints[101 * (KSI_MAX_IMPRINT_LEN + 1)];
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+	SignatureCheck check;
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_BlockSigner_setStreaming(bs, NULL);
+	CuAssert(tc, "Unable to set the streaming mode.", res == KSI_OK);
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	CuAssert(tc, "Unable to get imprint.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		memcpy(imprints + i * imprint_len, imprint, imprint_len);
+	}
+
+	res = KSI_BlockSigner_addLeaves(bs, imprints, NULL, 101);
+	CuAssert(tc, "Unable to add leafs to the block signer.", res == KSI_OK);
+
+	res = KSI_BlockSigner_setStreaming(bs, NULL);
+	CuAssert(tc, "Streaming mode should not be changed after adding leafs.", res == KSI_INVALID_STATE);
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	/* The response matches only the same tree as built from the tree nodes in testMasking. */
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	check.hsh = hsh;
+	check.bs = NULL;
+	check.count = 0;
+	check.failures = 0;
+
+	res = KSI_BlockSigner_getSignatures(bs, checkLeafSignature, &check);
+	CuAssert(tc, "Unable to get the leaf signatures.", res == KSI_OK);
+	CuAssert(tc, "Leaf signature count mismatch.", check.count == 101);
+	CuAssert(tc, "Leaf signatures should be valid.", check.failures == 0);
+
+	res = KSI_BlockSigner_getAllSignatures(bs, 4, checkLeafSignature, &check);
+	CuAssert(tc, "Streamed leafs should not be extracted in parallel.", res == KSI_INVALID_STATE);
+
+	res = KSI_BlockSigner_getSignatureAt(bs, 0, &leafSig);
+	CuAssert(tc, "Streamed leafs should not be accessible by index.", res == KSI_INVALID_STATE && leafSig == NULL);
+
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+static void testBlockVerifier(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockVerifier *bv = NULL;
+	KSI_BlockSignerHandle *hndl[101];
+	KSI_AggregationHashChain *chain = NULL;
+	KSI_Signature *sig = NULL;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *other = NULL;
+	KSI_DataHash *prevInput = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	memset(hndl, 0, sizeof(hndl));
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	KSITest_DataHash_fromStr(ctx, "0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", &other);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, &hndl[i]);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK && hndl[i] != NULL);
+	}
+
+	res = KSI_BlockSignerHandle_getAggregationChain(hndl[0], &chain);
+	CuAssert(tc, "Aggregation chain should not be available before signing.", res == KSI_INVALID_STATE && chain == NULL);
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	res = KSI_BlockSigner_getSignature(bs, &sig);
+	CuAssert(tc, "Unable to get the block signature.", res == KSI_OK && sig != NULL);
+
+	res = KSI_BlockVerifier_new(ctx, sig, KSI_VERIFICATION_POLICY_INTERNAL, NULL, &bv);
+	CuAssert(tc, "Unable to create block verifier.", res == KSI_OK && bv != NULL);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSignerHandle_getAggregationChain(hndl[i], &chain);
+		CuAssert(tc, "Unable to get the record aggregation chain.", res == KSI_OK && chain != NULL);
+
+		res = KSI_BlockVerifier_verifyRecord(bv, hsh, chain);
+		CuAssert(tc, "Record should be valid.", res == KSI_OK);
+
+		res = KSI_BlockVerifier_verifyRecord(bv, other, chain);
+		CuAssert(tc, "Record with a wrong hash should not be valid.", res == KSI_VERIFICATION_FAILURE);
+
+		KSI_AggregationHashChain_free(chain);
+		chain = NULL;
+	}
+
+	/* A record chain leading to a different root must fail. */
+	res = KSI_BlockSignerHandle_getAggregationChain(hndl[0], &chain);
+	CuAssert(tc, "Unable to get the record aggregation chain.", res == KSI_OK && chain != NULL);
+
+	res = KSI_AggregationHashChain_getInputHash(chain, &prevInput);
+	CuAssert(tc, "Unable to get the input hash.", res == KSI_OK && prevInput != NULL);
+
+	res = KSI_AggregationHashChain_setInputHash(chain, KSI_DataHash_ref(other));
+	CuAssert(tc, "Unable to replace the input hash.", res == KSI_OK);
+	KSI_DataHash_free(prevInput);
+
+	res = KSI_BlockVerifier_verifyRecord(bv, other, chain);
+	CuAssert(tc, "Record with a modified chain should not be valid.", res == KSI_VERIFICATION_FAILURE);
+
+	for (i = 0; i < 101; ++i) {
+		KSI_BlockSignerHandle_free(hndl[i]);
+	}
+	KSI_AggregationHashChain_free(chain);
+	KSI_BlockVerifier_free(bv);
+	KSI_Signature_free(sig);
+	KSI_DataHash_free(hsh);
+	KSI_DataHash_free(other);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+static void testAddLeaves(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockVerifier *bv = NULL;
+	KSI_AggregationHashChain *chain = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_Signature *leafSig = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	unsigned char *spliced = NULL;
+	size_t spliced_len = 0;
+	SignatureCheck check;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char imprints[101 * (KSI_MAX_IMPRINT_LEN + 1)];
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	CuAssert(tc, "Unable to get imprint.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		memcpy(imprints + i * imprint_len, imprint, imprint_len);
+	}
+
+	/* Add the leafs in two parts. */
+	res = KSI_BlockSigner_addLeaves(bs, imprints, NULL, 60);
+	CuAssert(tc, "Unable to add leafs to the block signer.", res == KSI_OK);
+
+	res = KSI_BlockSigner_addLeaves(bs, imprints + 60 * imprint_len, NULL, 41);
+	CuAssert(tc, "Unable to add leafs to the block signer.", res == KSI_OK);
+
+	res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, NULL);
+	CuAssert(tc, "Leafs with handles should not be mixed with bulk leafs.", res == KSI_INVALID_STATE);
+
+	res = KSI_BlockSigner_getAggregationChainAt(bs, 0, &chain);
+	CuAssert(tc, "Aggregation chain should not be available before signing.", res == KSI_INVALID_STATE && chain == NULL);
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	/* The response matches only the same tree as built from the tree nodes in testMasking. */
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the blocksigner.", res == KSI_OK);
+
+	res = KSI_BlockSigner_getSignature(bs, &sig);
+	CuAssert(tc, "Unable to get the block signature.", res == KSI_OK && sig != NULL);
+
+	res = KSI_BlockVerifier_new(ctx, sig, KSI_VERIFICATION_POLICY_INTERNAL, NULL, &bv);
+	CuAssert(tc, "Unable to create block verifier.", res == KSI_OK && bv != NULL);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_getAggregationChainAt(bs, i, &chain);
+		CuAssert(tc, "Unable to get the record aggregation chain.", res == KSI_OK && chain != NULL);
+
+		res = KSI_BlockVerifier_verifyRecord(bv, hsh, chain);
+		CuAssert(tc, "Record should be valid.", res == KSI_OK);
+
+		KSI_AggregationHashChain_free(chain);
+		chain = NULL;
+	}
+
+	res = KSI_BlockSigner_getSignatureAt(bs, 100, &leafSig);
+	CuAssert(tc, "Unable to get the leaf signature.", res == KSI_OK && leafSig != NULL);
+
+	res = KSI_Signature_verifyWithPolicy(leafSig, hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+	CuAssert(tc, "Leaf signature should be valid.", res == KSI_OK);
+
+	res = KSI_Signature_serialize(leafSig, &raw, &raw_len);
+	CuAssert(tc, "Unable to serialize the leaf signature.", res == KSI_OK);
+
+	res = KSI_BlockSigner_serializeSignatureAt(bs, 100, &spliced, &spliced_len);
+	CuAssert(tc, "Unable to splice the leaf signature.", res == KSI_OK && spliced != NULL);
+	CuAssert(tc, "Spliced signature mismatch.", raw_len == spliced_len && !memcmp(raw, spliced, raw_len));
+
+	res = KSI_BlockSigner_getAggregationChainAt(bs, 101, &chain);
+	CuAssert(tc, "Leaf index out of range should fail.", res != KSI_OK && chain == NULL);
+
+	/* With 3 threads the leafs are processed in two batches. */
+	check.hsh = hsh;
+	check.bs = bs;
+	check.count = 0;
+	check.failures = 0;
+
+	res = KSI_BlockSigner_getAllSignatures(bs, 3, checkLeafSignature, &check);
+	CuAssert(tc, "Unable to get the leaf signatures in parallel.", res == KSI_OK);
+	CuAssert(tc, "Leaf signature count mismatch.", check.count == 101);
+	CuAssert(tc, "Leaf signatures should be valid and in order.", check.failures == 0);
+
+	KSI_free(raw);
+	KSI_free(spliced);
+	KSI_Signature_free(leafSig);
+	KSI_BlockVerifier_free(bv);
+	KSI_Signature_free(sig);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
 static void testIdentityMedaData(CuTest *tc) {
 #define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_meta_data_response.tlv"
 	int res = KSI_UNKNOWN_ERROR;
@@ -497,6 +913,291 @@ static void testAddDeprecatedLeaf(CuTest *tc) {
 }
 
 
+static void testShards(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv"
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSigner *shard = NULL;
+	KSI_BlockSigner *empty = NULL;
+	KSI_BlockSigner *tmp = NULL;
+	KSI_BlockSignerHandle *hndl = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_DataHash *seed = NULL;
+	KSI_DataHash *otherSeed = NULL;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_BlockSigner_openShard(bs, &shard);
+	CuAssert(tc, "Unable to open a shard.", res == KSI_OK && shard != NULL);
+
+	res = KSI_BlockSigner_openShard(bs, &empty);
+	CuAssert(tc, "Unable to open a shard.", res == KSI_OK && empty != NULL);
+
+	res = KSI_BlockSigner_openShard(shard, &tmp);
+	CuAssert(tc, "A shard should not be sharded.", res == KSI_INVALID_STATE && tmp == NULL);
+
+	res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, NULL);
+	CuAssert(tc, "Leafs of a sharded block should be added to the shards.", res == KSI_INVALID_STATE);
+
+	res = KSI_BlockSigner_getPrevLeaf(shard, &seed);
+	CuAssert(tc, "The first shard should continue the masking chain.", res == KSI_OK && KSI_DataHash_equals(seed, prev));
+
+	res = KSI_BlockSigner_getPrevLeaf(empty, &otherSeed);
+	CuAssert(tc, "The other shards should have their own masking chains.", res == KSI_OK && otherSeed != NULL && !KSI_DataHash_equals(seed, otherSeed));
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(shard, hsh, 0, NULL, i == 50 ? &hndl : NULL);
+		CuAssert(tc, "Unable to add leaf hash to the shard.", res == KSI_OK);
+	}
+
+	res = KSI_BlockSigner_closeAndSign(shard);
+	CuAssert(tc, "A shard should be closed together with the block.", res == KSI_INVALID_STATE);
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	/* The empty shard is left out, the single shard gives the same tree as in testMasking. */
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the sharded block.", res == KSI_OK);
+
+	res = KSI_BlockSignerHandle_getSignature(hndl, &sig);
+	CuAssert(tc, "Unable to get the leaf signature.", res == KSI_OK && sig != NULL);
+
+	res = KSI_Signature_verifyWithPolicy(sig, hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+	CuAssert(tc, "Leaf signature should be valid.", res == KSI_OK);
+
+	KSI_Signature_free(sig);
+	KSI_BlockSignerHandle_free(hndl);
+	KSI_DataHash_free(seed);
+	KSI_DataHash_free(otherSeed);
+	KSI_BlockSigner_free(shard);
+	KSI_BlockSigner_free(empty);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+static void testShardsWithMasking(CuTest *tc) {
+#define TEST_AGGR_RESPONSE_FILE  "resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_shards_masking_response.tlv"
+#define TEST_SHARDS 3
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSigner *shards[TEST_SHARDS];
+	KSI_BlockSignerHandle *hndl[20];
+	KSI_Signature *blockSig = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_DataHash *blockRoot = NULL;
+	KSI_DataHash *lastLeaf = NULL;
+	KSI_DataHash *prevLeaf = NULL;
+	const size_t sizes[TEST_SHARDS] = {7, 13, 0};
+	size_t count = 0;
+	size_t i;
+	size_t j;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	memset(shards, 0, sizeof(shards));
+	memset(hndl, 0, sizeof(hndl));
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	for (i = 0; i < TEST_SHARDS; i++) {
+		res = KSI_BlockSigner_openShard(bs, &shards[i]);
+		CuAssert(tc, "Unable to open a shard.", res == KSI_OK && shards[i] != NULL);
+	}
+
+	/* Two non-empty shards of different sizes, the last shard is left empty. */
+	for (i = 0; i < TEST_SHARDS; i++) {
+		for (j = 0; j < sizes[i]; j++) {
+			res = KSI_BlockSigner_addLeaf(shards[i], hsh, 0, NULL, &hndl[count++]);
+			CuAssert(tc, "Unable to add leaf hash to the shard.", res == KSI_OK && hndl[count - 1] != NULL);
+		}
+	}
+
+	res = KSI_BlockSigner_getPrevLeaf(shards[1], &lastLeaf);
+	CuAssert(tc, "Unable to get the last leaf of the shard.", res == KSI_OK && lastLeaf != NULL);
+
+	KSI_CTX_setAggregator(ctx, getFullResourcePathUri(TEST_AGGR_RESPONSE_FILE), TEST_USER, TEST_PASS);
+
+	res = KSI_BlockSigner_closeAndSign(bs);
+	CuAssert(tc, "Unable to close the sharded block.", res == KSI_OK);
+
+	res = KSI_BlockSigner_getPrevLeaf(bs, &prevLeaf);
+	CuAssert(tc, "The block should continue the masking chain from the last leaf of the last non-empty shard.",
+			res == KSI_OK && KSI_DataHash_equals(prevLeaf, lastLeaf));
+
+	res = KSI_BlockSigner_getSignature(bs, &blockSig);
+	CuAssert(tc, "Unable to get the block signature.", res == KSI_OK && blockSig != NULL);
+
+	res = KSI_Signature_getDocumentHash(blockSig, &blockRoot);
+	CuAssert(tc, "Unable to get the block root hash.", res == KSI_OK && blockRoot != NULL);
+
+	for (i = 0; i < count; i++) {
+		bool found = false;
+
+		res = KSI_BlockSignerHandle_getSignature(hndl[i], &sig);
+		CuAssert(tc, "Unable to get the leaf signature.", res == KSI_OK && sig != NULL);
+
+		res = KSI_Signature_verifyWithPolicy(sig, hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL);
+		CuAssert(tc, "Leaf signature should be valid.", res == KSI_OK);
+
+		/* The consistent aggregation hash chains of the leaf must pass the root of the block. */
+		for (j = 0; j < KSI_AggregationHashChainList_length(sig->aggregationChainList); j++) {
+			KSI_AggregationHashChain *chain = NULL;
+			KSI_DataHash *input = NULL;
+
+			res = KSI_AggregationHashChainList_elementAt(sig->aggregationChainList, j, &chain);
+			CuAssert(tc, "Unable to get the aggregation hash chain.", res == KSI_OK && chain != NULL);
+
+			res = KSI_AggregationHashChain_getInputHash(chain, &input);
+			CuAssert(tc, "Unable to get the input hash.", res == KSI_OK && input != NULL);
+
+			if (KSI_DataHash_equals(input, blockRoot)) found = true;
+		}
+		CuAssert(tc, "Leaf signature should contain the block signature.", found);
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		KSI_BlockSignerHandle_free(hndl[i]);
+	}
+	for (i = 0; i < TEST_SHARDS; i++) {
+		KSI_BlockSigner_free(shards[i]);
+	}
+	KSI_Signature_free(blockSig);
+	KSI_DataHash_free(lastLeaf);
+	KSI_DataHash_free(prevLeaf);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+#undef TEST_SHARDS
+#undef TEST_AGGR_RESPONSE_FILE
+}
+
+typedef struct PipelineCheck_st {
+	KSI_DataHash *hsh;
+	KSI_BlockSignerHandle *hndl;
+	size_t count;
+	size_t failures;
+} PipelineCheck;
+
+static int checkPipelineBlock(void *c, KSI_BlockSigner KSI_UNUSED(*block), int status) {
+	PipelineCheck *check = c;
+	KSI_Signature *sig = NULL;
+
+	check->count++;
+
+	if (status != KSI_OK || KSI_BlockSignerHandle_getSignature(check->hndl, &sig) != KSI_OK ||
+			KSI_Signature_verifyWithPolicy(sig, check->hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL) != KSI_OK) {
+		check->failures++;
+	}
+
+	KSI_Signature_free(sig);
+
+	return KSI_OK;
+}
+
+static void testPipeline(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_BlockSignerPipeline *pipeline = NULL;
+	KSI_BlockSigner *bs = NULL;
+	KSI_BlockSigner *next = NULL;
+	KSI_BlockSignerHandle *hndl = NULL;
+	KSI_DataHash *lastLeaf = NULL;
+	KSI_DataHash *nextPrev = NULL;
+	PipelineCheck check;
+	size_t pending = 0;
+	size_t i;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+	res = KSI_BlockSigner_new(ctx, KSI_HASHALG_SHA2_256, prev, iv, &bs);
+	CuAssert(tc, "Unable to create block signer with masking.", res == KSI_OK && bs != NULL);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, sizeof(TEST_AGGR_RESPONSE_FILES) / sizeof(*TEST_AGGR_RESPONSE_FILES), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	check.hsh = hsh;
+	check.hndl = NULL;
+	check.count = 0;
+	check.failures = 0;
+
+	res = KSI_BlockSignerPipeline_new(bs, as, checkPipelineBlock, &check, &pipeline);
+	CuAssert(tc, "Unable to create block signer pipeline.", res == KSI_OK && pipeline != NULL);
+
+	for (i = 0; i < 101; ++i) {
+		res = KSI_BlockSigner_addLeaf(bs, hsh, 0, NULL, i == 50 ? &hndl : NULL);
+		CuAssert(tc, "Unable to add leaf hash to the block signer.", res == KSI_OK);
+	}
+	check.hndl = hndl;
+
+	res = KSI_BlockSigner_getPrevLeaf(bs, &lastLeaf);
+	CuAssert(tc, "Unable to get the last leaf.", res == KSI_OK && lastLeaf != NULL);
+
+	res = KSI_BlockSignerPipeline_closeBlock(pipeline);
+	CuAssert(tc, "Unable to close the block.", res == KSI_OK);
+	CuAssert(tc, "Block should not be signed yet.", check.count == 0);
+
+	/* The next block accepts leafs before the previous one is signed. */
+	res = KSI_BlockSignerPipeline_getBlockSigner(pipeline, &next);
+	CuAssert(tc, "Unable to get the next block signer.", res == KSI_OK && next != NULL && next != bs);
+
+	res = KSI_BlockSigner_getPrevLeaf(next, &nextPrev);
+	CuAssert(tc, "The last leaf should be carried forward.", res == KSI_OK && KSI_DataHash_equals(lastLeaf, nextPrev));
+
+	res = KSI_BlockSigner_addLeaf(next, hsh, 0, NULL, NULL);
+	CuAssert(tc, "Unable to add leaf hash to the next block.", res == KSI_OK);
+
+	for (i = 0; i < 10 && check.count == 0; i++) {
+		res = KSI_BlockSignerPipeline_run(pipeline, &pending);
+		CuAssert(tc, "Unable to run the pipeline.", res == KSI_OK);
+	}
+
+	CuAssert(tc, "Block should have been delivered once.", check.count == 1 && pending == 0);
+	CuAssert(tc, "Leaf signature should be valid.", check.failures == 0);
+
+	KSI_BlockSignerPipeline_free(pipeline);
+	KSI_AsyncService_free(as);
+	KSI_BlockSignerHandle_free(hndl);
+	KSI_DataHash_free(nextPrev);
+	KSI_DataHash_free(lastLeaf);
+	KSI_DataHash_free(hsh);
+	KSI_BlockSigner_free(bs);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+}
+
 static void preTest(void) {
 	ctx->netProvider->requestCount = 0;
 }
@@ -508,6 +1209,14 @@ CuSuite* KSITest_Blocksigner_getSuite(void) {
 
 	SUITE_ADD_TEST(suite, testFreeBeforeClose);
 	SUITE_ADD_TEST(suite, testMasking);
+	SUITE_ADD_TEST(suite, testMaskingWithThreads);
+	SUITE_ADD_TEST(suite, testSerializeSignature);
+	SUITE_ADD_TEST(suite, testBlockVerifier);
+	SUITE_ADD_TEST(suite, testAddLeaves);
+	SUITE_ADD_TEST(suite, testAddLeavesStreaming);
+	SUITE_ADD_TEST(suite, testPipeline);
+	SUITE_ADD_TEST(suite, testShards);
+	SUITE_ADD_TEST(suite, testShardsWithMasking);
 	SUITE_ADD_TEST(suite, testMedaData);
 	SUITE_ADD_TEST(suite, testIdentityMedaData);
 	SUITE_ADD_TEST(suite, testSingle);
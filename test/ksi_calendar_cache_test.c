@@ -0,0 +1,183 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ksi/calendar_cache.h>
+#include <ksi/hashchain.h>
+
+#include "all_tests.h"
+
+#include "../src/ksi/impl/ctx_impl.h"
+#include "../src/ksi/impl/net_impl.h"
+
+extern KSI_CTX *ctx;
+
+#define TEST_USER "anon"
+#define TEST_PASS "anon"
+
+#define TEST_SIGNATURE_FILE     "resource/tlv/ok-sig-2014-04-30.1.ksig"
+#define TEST_EXT_RESPONSE_FILE  "resource/tlv/v2/ok-sig-2014-04-30.1-extend_response.tlv"
+#define TEST_CACHE_FILE         "ksi_calendar_cache_test.tmp"
+
+static void preTest(void) {
+	ctx->netProvider->requestCount = 0;
+
+	KSI_CTX_setOption(ctx, KSI_OPT_EXT_PDU_VER, (void*)KSI_PDU_VERSION_2);
+	remove(TEST_CACHE_FILE);
+}
+
+static void postTest(void) {
+	KSI_CTX_setOption(ctx, KSI_OPT_EXT_PDU_VER, (void*)KSI_EXTENDING_PDU_VERSION);
+	KSI_CTX_setCalendarCache(ctx, NULL);
+	remove(TEST_CACHE_FILE);
+}
+
+static void testCalendarCache_getMissing(CuTest *tc) {
+	int res;
+	KSI_CalendarCache *cache = NULL;
+	KSI_Integer *aggrTime = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_CalendarCache_new(ctx, NULL, &cache);
+	CuAssert(tc, "Unable to create calendar cache.", res == KSI_OK && cache != NULL);
+
+	res = KSI_Integer_new(ctx, 1398866256, &aggrTime);
+	CuAssert(tc, "Unable to create aggregation time.", res == KSI_OK);
+
+	res = KSI_Integer_new(ctx, 1400112000, &pubTime);
+	CuAssert(tc, "Unable to create publication time.", res == KSI_OK);
+
+	res = KSI_CalendarCache_get(cache, aggrTime, pubTime, &chain);
+	CuAssert(tc, "Calendar cache should be empty.", res == KSI_OK && chain == NULL);
+	CuAssert(tc, "Calendar cache size mismatch.", KSI_CalendarCache_size(cache) == 0);
+
+	KSI_Integer_free(aggrTime);
+	KSI_Integer_free(pubTime);
+	KSI_CalendarCache_free(cache);
+}
+
+static void testCalendarCache_extendUsesCache(CuTest *tc) {
+	int res;
+	KSI_CalendarCache *cache = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_Signature *ext1 = NULL;
+	KSI_Signature *ext2 = NULL;
+	unsigned char *raw1 = NULL;
+	unsigned char *raw2 = NULL;
+	size_t raw1_len = 0;
+	size_t raw2_len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_CalendarCache_new(ctx, TEST_CACHE_FILE, &cache);
+	CuAssert(tc, "Unable to create calendar cache.", res == KSI_OK && cache != NULL);
+
+	res = KSI_CTX_setCalendarCache(ctx, cache);
+	CuAssert(tc, "Unable to set calendar cache.", res == KSI_OK);
+
+	res = KSI_Signature_fromFile(ctx, getFullResourcePath(TEST_SIGNATURE_FILE), &sig);
+	CuAssert(tc, "Unable to load signature from file.", res == KSI_OK && sig != NULL);
+
+	res = KSI_CTX_setExtender(ctx, getFullResourcePathUri(TEST_EXT_RESPONSE_FILE), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set extend response from file.", res == KSI_OK);
+
+	res = KSI_extendSignature(ctx, sig, &ext1);
+	CuAssert(tc, "Unable to extend the signature.", res == KSI_OK && ext1 != NULL);
+	CuAssert(tc, "Extender should have been called once.", ctx->netProvider->requestCount == 1);
+	CuAssert(tc, "Calendar hash chain should have been cached.", KSI_CalendarCache_size(cache) == 1);
+
+	res = KSI_extendSignature(ctx, sig, &ext2);
+	CuAssert(tc, "Unable to extend the signature from cache.", res == KSI_OK && ext2 != NULL);
+	CuAssert(tc, "Extender should not have been called again.", ctx->netProvider->requestCount == 1);
+
+	res = KSI_Signature_serialize(ext1, &raw1, &raw1_len);
+	CuAssert(tc, "Unable to serialize extended signature.", res == KSI_OK);
+
+	res = KSI_Signature_serialize(ext2, &raw2, &raw2_len);
+	CuAssert(tc, "Unable to serialize extended signature.", res == KSI_OK);
+
+	CuAssert(tc, "Extended signatures mismatch.", raw1_len == raw2_len && !memcmp(raw1, raw2, raw1_len));
+
+	KSI_free(raw1);
+	KSI_free(raw2);
+	KSI_Signature_free(ext1);
+	KSI_Signature_free(ext2);
+	KSI_Signature_free(sig);
+}
+
+static void testCalendarCache_loadFromFile(CuTest *tc) {
+	int res;
+	KSI_CalendarCache *cache = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_Signature *ext = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_CalendarCache_new(ctx, TEST_CACHE_FILE, &cache);
+	CuAssert(tc, "Unable to create calendar cache.", res == KSI_OK && cache != NULL);
+
+	res = KSI_CTX_setCalendarCache(ctx, cache);
+	CuAssert(tc, "Unable to set calendar cache.", res == KSI_OK);
+
+	res = KSI_Signature_fromFile(ctx, getFullResourcePath(TEST_SIGNATURE_FILE), &sig);
+	CuAssert(tc, "Unable to load signature from file.", res == KSI_OK && sig != NULL);
+
+	res = KSI_CTX_setExtender(ctx, getFullResourcePathUri(TEST_EXT_RESPONSE_FILE), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to set extend response from file.", res == KSI_OK);
+
+	res = KSI_extendSignature(ctx, sig, &ext);
+	CuAssert(tc, "Unable to extend the signature.", res == KSI_OK && ext != NULL);
+	KSI_Signature_free(ext);
+	ext = NULL;
+
+	/* Replace the cache with a new instance reading the same file. */
+	cache = NULL;
+	res = KSI_CalendarCache_new(ctx, TEST_CACHE_FILE, &cache);
+	CuAssert(tc, "Unable to load calendar cache from file.", res == KSI_OK && cache != NULL);
+	CuAssert(tc, "Calendar cache size mismatch.", KSI_CalendarCache_size(cache) == 1);
+
+	res = KSI_CTX_setCalendarCache(ctx, cache);
+	CuAssert(tc, "Unable to set calendar cache.", res == KSI_OK);
+
+	ctx->netProvider->requestCount = 0;
+	res = KSI_extendSignature(ctx, sig, &ext);
+	CuAssert(tc, "Unable to extend the signature from persisted cache.", res == KSI_OK && ext != NULL);
+	CuAssert(tc, "Extender should not have been called.", ctx->netProvider->requestCount == 0);
+
+	KSI_Signature_free(ext);
+	KSI_Signature_free(sig);
+}
+
+CuSuite* KSITest_CalendarCache_getSuite(void) {
+	CuSuite* suite = CuSuiteNew();
+
+	suite->preTest = preTest;
+	suite->postTest = postTest;
+
+	SUITE_ADD_TEST(suite, testCalendarCache_getMissing);
+	SUITE_ADD_TEST(suite, testCalendarCache_extendUsesCache);
+	SUITE_ADD_TEST(suite, testCalendarCache_loadFromFile);
+
+	return suite;
+}
@@ -0,0 +1,711 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ksi/calendar_mirror.h>
+#include <ksi/hashchain.h>
+#include <ksi/net.h>
+#include <ksi/net_async.h>
+
+#include "all_tests.h"
+#include "test_mock_async.h"
+
+extern KSI_CTX *ctx;
+
+#define TEST_FEED_FILE          "ksi_calendar_mirror_test.tmp"
+#define TEST_FIRST_TIME         100
+#define TEST_LEAF_COUNT         64
+#define TEST_UPSTREAM_FILE      "ksi_calendar_mirror_test_upstream.tmp"
+
+static void postTest(void) {
+	KSI_CTX_setCalendarMirror(ctx, NULL);
+	remove(TEST_FEED_FILE);
+	remove(getFullResourcePath(TEST_UPSTREAM_FILE));
+}
+
+static int createLeaf(KSI_uint64_t t, KSI_DataHash **hsh) {
+	char buf[32];
+	KSI_snprintf(buf, sizeof(buf), "leaf-%llu", (unsigned long long)t);
+	return KSI_DataHash_create(ctx, buf, strlen(buf), KSI_HASHALG_SHA2_256, hsh);
+}
+
+static int writeImprint(FILE *f, const KSI_DataHash *hsh) {
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	int res;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) return res;
+
+	return fwrite(imprint, 1, imprint_len, f) == imprint_len ? KSI_OK : KSI_IO_ERROR;
+}
+
+/* Writes a feed, where the roots of the subtrees before the first time are hashes of the subtree position. */
+static int writeFeed(KSI_uint64_t firstTime, size_t count) {
+	int res = KSI_UNKNOWN_ERROR;
+	FILE *f = NULL;
+	KSI_DataHash *hsh = NULL;
+	unsigned char hdr[16] = "KSICALMR";
+	size_t i;
+	int level;
+
+	f = fopen(TEST_FEED_FILE, "wb");
+	if (f == NULL) return KSI_IO_ERROR;
+
+	for (i = 0; i < 8; i++) {
+		hdr[8 + i] = (unsigned char)(firstTime >> (8 * (7 - i)));
+	}
+	if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+
+	for (level = 63; level >= 0; level--) {
+		if ((firstTime >> level) & 1) {
+			res = createLeaf(1000000 + level, &hsh);
+			if (res != KSI_OK) goto cleanup;
+
+			res = writeImprint(f, hsh);
+			if (res != KSI_OK) goto cleanup;
+
+			KSI_DataHash_free(hsh);
+			hsh = NULL;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		res = createLeaf(firstTime + i, &hsh);
+		if (res != KSI_OK) goto cleanup;
+
+		res = writeImprint(f, hsh);
+		if (res != KSI_OK) goto cleanup;
+
+		KSI_DataHash_free(hsh);
+		hsh = NULL;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_DataHash_free(hsh);
+	fclose(f);
+
+	return res;
+}
+
+static int combine(const KSI_DataHash *left, const KSI_DataHash *right, KSI_DataHash **out) {
+	int res;
+	KSI_DataHasher *hsr = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned char level = 0xff;
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res != KSI_OK) goto cleanup;
+
+	KSI_DataHash_getImprint(left, &imprint, &imprint_len);
+	KSI_DataHasher_add(hsr, imprint, imprint_len);
+	KSI_DataHash_getImprint(right, &imprint, &imprint_len);
+	KSI_DataHasher_add(hsr, imprint, imprint_len);
+	KSI_DataHasher_add(hsr, &level, 1);
+
+	res = KSI_DataHasher_close(hsr, out);
+
+cleanup:
+
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+static int createPublicationsFile(KSI_uint64_t pubTime, KSI_DataHash *pubHash, KSI_PublicationsFile **pubFile) {
+	int res;
+	KSI_PublicationsFile *tmp = NULL;
+	KSI_LIST(KSI_PublicationRecord) *list = NULL;
+	KSI_PublicationRecord *rec = NULL;
+	KSI_PublicationData *pubData = NULL;
+	KSI_Integer *t = NULL;
+
+	res = KSI_PublicationsFile_new(ctx, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PublicationRecordList_new(&list);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PublicationRecord_new(ctx, &rec);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PublicationData_new(ctx, &pubData);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(ctx, pubTime, &t);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PublicationData_setTime(pubData, t);
+	if (res != KSI_OK) goto cleanup;
+	t = NULL;
+
+	res = KSI_PublicationData_setImprint(pubData, KSI_DataHash_ref(pubHash));
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_PublicationRecord_setPublishedData(rec, pubData);
+	if (res != KSI_OK) goto cleanup;
+	pubData = NULL;
+
+	res = KSI_PublicationRecordList_append(list, rec);
+	if (res != KSI_OK) goto cleanup;
+	rec = NULL;
+
+	res = KSI_PublicationsFile_setPublications(tmp, list);
+	if (res != KSI_OK) goto cleanup;
+	list = NULL;
+
+	*pubFile = tmp;
+	tmp = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_Integer_free(t);
+	KSI_PublicationData_free(pubData);
+	KSI_PublicationRecord_free(rec);
+	KSI_PublicationRecordList_free(list);
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/* Loads the feed into a mirror, which is verified against a publication of its last leaf. */
+static int createVerifiedMirror(KSI_CalendarMirror **mirror, KSI_DataHash **pubHash) {
+	int res;
+	KSI_CalendarMirror *tmp = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_uint64_t firstTime = 0;
+	KSI_uint64_t lastTime = 0;
+
+	res = writeFeed(TEST_FIRST_TIME, TEST_LEAF_COUNT);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarMirror_new(ctx, &tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarMirror_load(tmp, TEST_FEED_FILE);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarMirror_getTimeRange(tmp, &firstTime, &lastTime);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarMirror_getCalendarHashChain(tmp, firstTime, lastTime, &chain);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarHashChain_aggregate(chain, &root);
+	if (res != KSI_OK) goto cleanup;
+
+	res = createPublicationsFile(lastTime, root, &pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_CalendarMirror_verify(tmp, pubFile);
+	if (res != KSI_OK) goto cleanup;
+
+	*mirror = tmp;
+	tmp = NULL;
+	*pubHash = root;
+	root = NULL;
+
+	res = KSI_OK;
+
+cleanup:
+
+	KSI_CalendarMirror_free(tmp);
+	KSI_CalendarHashChain_free(chain);
+	KSI_PublicationsFile_free(pubFile);
+	KSI_DataHash_free(root);
+
+	return res;
+}
+
+/* Writes the upstream extender response for the request, the chain is freed by the function. */
+static int writeUpstreamResponse(KSI_uint64_t requestId, KSI_CalendarHashChain *chain, const char *user, const char *pass) {
+	int res;
+	KSI_ExtendPdu *pdu = NULL;
+	KSI_Header *hdr = NULL;
+	KSI_ExtendResp *resp = NULL;
+	KSI_Utf8String *str = NULL;
+	KSI_Integer *val = NULL;
+	KSI_DataHash *hmac = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	FILE *f = NULL;
+
+	res = KSI_ExtendPdu_new(ctx, &pdu);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_new(ctx, &hdr);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Utf8String_new(ctx, user, strlen(user) + 1, &str);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Header_setLoginId(hdr, str);
+	if (res != KSI_OK) goto cleanup;
+	str = NULL;
+
+	res = KSI_ExtendPdu_setHeader(pdu, hdr);
+	if (res != KSI_OK) goto cleanup;
+	hdr = NULL;
+
+	res = KSI_ExtendResp_new(ctx, &resp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(ctx, requestId, &val);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setRequestId(resp, val);
+	if (res != KSI_OK) goto cleanup;
+	val = NULL;
+
+	res = KSI_Integer_new(ctx, 0, &val);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendResp_setStatus(resp, val);
+	if (res != KSI_OK) goto cleanup;
+	val = NULL;
+
+	res = KSI_ExtendResp_setCalendarHashChain(resp, chain);
+	if (res != KSI_OK) goto cleanup;
+	chain = NULL;
+
+	res = KSI_ExtendPdu_setResponse(pdu, resp);
+	if (res != KSI_OK) goto cleanup;
+	resp = NULL;
+
+	res = KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &hmac);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_setHmac(pdu, hmac);
+	if (res != KSI_OK) goto cleanup;
+	hmac = NULL;
+
+	res = KSI_ExtendPdu_updateHmac(pdu, KSI_HASHALG_SHA2_256, pass);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendPdu_serialize(pdu, &raw, &raw_len);
+	if (res != KSI_OK) goto cleanup;
+
+	f = fopen(getFullResourcePath(TEST_UPSTREAM_FILE), "wb");
+	if (f == NULL) {
+		res = KSI_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = fwrite(raw, 1, raw_len, f) == raw_len ? KSI_OK : KSI_IO_ERROR;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_CalendarHashChain_free(chain);
+	KSI_free(raw);
+	KSI_DataHash_free(hmac);
+	KSI_Integer_free(val);
+	KSI_Utf8String_free(str);
+	KSI_ExtendResp_free(resp);
+	KSI_Header_free(hdr);
+	KSI_ExtendPdu_free(pdu);
+
+	return res;
+}
+
+static int createExtendHandle(KSI_uint64_t aggrTime, KSI_uint64_t pubTime, KSI_AsyncHandle **handle) {
+	int res;
+	KSI_ExtendReq *req = NULL;
+	KSI_Integer *t = NULL;
+
+	res = KSI_ExtendReq_new(ctx, &req);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_Integer_new(ctx, aggrTime, &t);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_setAggregationTime(req, t);
+	if (res != KSI_OK) goto cleanup;
+	t = NULL;
+
+	res = KSI_Integer_new(ctx, pubTime, &t);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_ExtendReq_setPublicationTime(req, t);
+	if (res != KSI_OK) goto cleanup;
+	t = NULL;
+
+	res = KSI_AsyncExtendHandle_new(ctx, req, handle);
+	if (res != KSI_OK) goto cleanup;
+	req = NULL;
+
+cleanup:
+
+	KSI_Integer_free(t);
+	KSI_ExtendReq_free(req);
+
+	return res;
+}
+
+static void testCalendarMirror_treeShape(CuTest *tc) {
+	int res;
+	KSI_CalendarMirror *mirror = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_DataHash *leaf[5];
+	KSI_DataHash *n01 = NULL;
+	KSI_DataHash *n23 = NULL;
+	KSI_DataHash *n03 = NULL;
+	KSI_DataHash *expected = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_uint64_t t;
+	time_t aggrTime;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = writeFeed(0, 5);
+	CuAssert(tc, "Unable to write calendar feed.", res == KSI_OK);
+
+	/* The calendar tree over 5 leaves is ((L0, L1), (L2, L3)), L4. */
+	for (t = 0; t < 5; t++) {
+		res = createLeaf(t, &leaf[t]);
+		CuAssert(tc, "Unable to create leaf.", res == KSI_OK);
+	}
+	res = combine(leaf[0], leaf[1], &n01);
+	CuAssert(tc, "Unable to combine.", res == KSI_OK);
+	res = combine(leaf[2], leaf[3], &n23);
+	CuAssert(tc, "Unable to combine.", res == KSI_OK);
+	res = combine(n01, n23, &n03);
+	CuAssert(tc, "Unable to combine.", res == KSI_OK);
+	res = combine(n03, leaf[4], &expected);
+	CuAssert(tc, "Unable to combine.", res == KSI_OK);
+
+	res = KSI_CalendarMirror_new(ctx, &mirror);
+	CuAssert(tc, "Unable to create calendar mirror.", res == KSI_OK && mirror != NULL);
+
+	res = KSI_CalendarMirror_load(mirror, "file://" TEST_FEED_FILE);
+	CuAssert(tc, "Unable to load calendar feed.", res == KSI_OK);
+
+	for (t = 0; t < 5; t++) {
+		res = KSI_CalendarMirror_getCalendarHashChain(mirror, t, 4, &chain);
+		CuAssert(tc, "Unable to get calendar hash chain.", res == KSI_OK && chain != NULL);
+
+		res = KSI_CalendarHashChain_calculateAggregationTime(chain, &aggrTime);
+		CuAssert(tc, "Calendar hash chain shape mismatch.", res == KSI_OK && aggrTime == (time_t)t);
+
+		res = KSI_CalendarHashChain_aggregate(chain, &root);
+		CuAssert(tc, "Unable to aggregate calendar hash chain.", res == KSI_OK);
+		CuAssert(tc, "Calendar root hash mismatch.", KSI_DataHash_equals(root, expected));
+
+		KSI_DataHash_free(root);
+		root = NULL;
+		KSI_CalendarHashChain_free(chain);
+		chain = NULL;
+	}
+
+	for (t = 0; t < 5; t++) KSI_DataHash_free(leaf[t]);
+	KSI_DataHash_free(n01);
+	KSI_DataHash_free(n23);
+	KSI_DataHash_free(n03);
+	KSI_DataHash_free(expected);
+	KSI_CalendarMirror_free(mirror);
+}
+
+static void testCalendarMirror_verifyAndExtend(CuTest *tc) {
+	int res;
+	KSI_CalendarMirror *mirror = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_CalendarHashChain *extChain = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationsFile *badPubFile = NULL;
+	KSI_DataHash *pubHash = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_ExtendReq *req = NULL;
+	KSI_ExtendResp *resp = NULL;
+	KSI_RequestHandle *handle = NULL;
+	KSI_Integer *aggrTime = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_Integer *status = NULL;
+	KSI_uint64_t firstTime = 0;
+	KSI_uint64_t lastTime = 0;
+	KSI_uint64_t t;
+	time_t calcTime;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = writeFeed(TEST_FIRST_TIME, TEST_LEAF_COUNT);
+	CuAssert(tc, "Unable to write calendar feed.", res == KSI_OK);
+
+	res = KSI_CalendarMirror_new(ctx, &mirror);
+	CuAssert(tc, "Unable to create calendar mirror.", res == KSI_OK && mirror != NULL);
+
+	res = KSI_CalendarMirror_load(mirror, TEST_FEED_FILE);
+	CuAssert(tc, "Unable to load calendar feed.", res == KSI_OK);
+
+	res = KSI_CalendarMirror_getTimeRange(mirror, &firstTime, &lastTime);
+	CuAssert(tc, "Time range mismatch.", res == KSI_OK && firstTime == TEST_FIRST_TIME && lastTime == TEST_FIRST_TIME + TEST_LEAF_COUNT - 1);
+
+	/* All the chains to the same publication must lead to the same root. */
+	for (t = firstTime; t <= lastTime; t++) {
+		res = KSI_CalendarMirror_getCalendarHashChain(mirror, t, lastTime, &chain);
+		CuAssert(tc, "Unable to get calendar hash chain.", res == KSI_OK && chain != NULL);
+
+		res = KSI_CalendarHashChain_calculateAggregationTime(chain, &calcTime);
+		CuAssert(tc, "Calendar hash chain shape mismatch.", res == KSI_OK && calcTime == (time_t)t);
+
+		res = KSI_CalendarHashChain_aggregate(chain, &root);
+		CuAssert(tc, "Unable to aggregate calendar hash chain.", res == KSI_OK);
+		if (pubHash == NULL) {
+			pubHash = root;
+		} else {
+			CuAssert(tc, "Calendar root hash mismatch.", KSI_DataHash_equals(root, pubHash));
+			KSI_DataHash_free(root);
+		}
+		root = NULL;
+
+		KSI_CalendarHashChain_free(chain);
+		chain = NULL;
+	}
+
+	res = KSI_CalendarMirror_getCalendarHashChain(mirror, firstTime - 1, lastTime, &chain);
+	CuAssert(tc, "Chain before the mirror should not be available.", res != KSI_OK && chain == NULL);
+
+	/* Publication of a different calendar. */
+	res = createPublicationsFile(lastTime, pubHash, &pubFile);
+	CuAssert(tc, "Unable to create publications file.", res == KSI_OK);
+
+	res = createLeaf(0, &root);
+	CuAssert(tc, "Unable to create hash.", res == KSI_OK);
+	res = createPublicationsFile(lastTime, root, &badPubFile);
+	CuAssert(tc, "Unable to create publications file.", res == KSI_OK);
+	KSI_DataHash_free(root);
+	root = NULL;
+
+	res = KSI_CalendarMirror_verify(mirror, badPubFile);
+	CuAssert(tc, "Calendar mirror should not verify.", res == KSI_VERIFICATION_FAILURE);
+
+	res = KSI_CalendarMirror_verify(mirror, pubFile);
+	CuAssert(tc, "Unable to verify calendar mirror.", res == KSI_OK);
+
+	res = KSI_CTX_setCalendarMirror(ctx, mirror);
+	CuAssert(tc, "Unable to set calendar mirror.", res == KSI_OK);
+
+	/* Extend through the network provider of the context. */
+	res = KSI_ExtendReq_new(ctx, &req);
+	CuAssert(tc, "Unable to create extend request.", res == KSI_OK);
+
+	res = KSI_Integer_new(ctx, TEST_FIRST_TIME + 5, &aggrTime);
+	CuAssert(tc, "Unable to create aggregation time.", res == KSI_OK);
+	res = KSI_ExtendReq_setAggregationTime(req, aggrTime);
+	CuAssert(tc, "Unable to set aggregation time.", res == KSI_OK);
+
+	res = KSI_Integer_new(ctx, lastTime, &pubTime);
+	CuAssert(tc, "Unable to create publication time.", res == KSI_OK);
+	res = KSI_ExtendReq_setPublicationTime(req, pubTime);
+	CuAssert(tc, "Unable to set publication time.", res == KSI_OK);
+
+	res = KSI_sendExtendRequest(ctx, req, &handle);
+	CuAssert(tc, "Unable to send extend request.", res == KSI_OK && handle != NULL);
+
+	res = KSI_RequestHandle_perform(handle);
+	CuAssert(tc, "Unable to perform extend request.", res == KSI_OK);
+
+	res = KSI_RequestHandle_getExtendResponse(handle, &resp);
+	CuAssert(tc, "Unable to get extend response.", res == KSI_OK && resp != NULL);
+
+	res = KSI_ExtendResp_getStatus(resp, &status);
+	CuAssert(tc, "Extend response status mismatch.", res == KSI_OK && KSI_Integer_equalsUInt(status, 0));
+
+	res = KSI_ExtendResp_getCalendarHashChain(resp, &extChain);
+	CuAssert(tc, "Extend response does not contain calendar hash chain.", res == KSI_OK && extChain != NULL);
+
+	res = KSI_CalendarHashChain_aggregate(extChain, &root);
+	CuAssert(tc, "Extended root hash mismatch.", res == KSI_OK && KSI_DataHash_equals(root, pubHash));
+	KSI_DataHash_free(root);
+	root = NULL;
+
+	KSI_ExtendResp_free(resp);
+	resp = NULL;
+	KSI_RequestHandle_free(handle);
+	handle = NULL;
+
+	/* Aggregation time before the mirror gets the extender status code. */
+	res = KSI_Integer_new(ctx, TEST_FIRST_TIME - 1, &aggrTime);
+	CuAssert(tc, "Unable to create aggregation time.", res == KSI_OK);
+	res = KSI_ExtendReq_setAggregationTime(req, aggrTime);
+	CuAssert(tc, "Unable to set aggregation time.", res == KSI_OK);
+
+	res = KSI_sendExtendRequest(ctx, req, &handle);
+	CuAssert(tc, "Unable to send extend request.", res == KSI_OK && handle != NULL);
+
+	res = KSI_RequestHandle_perform(handle);
+	CuAssert(tc, "Unable to perform extend request.", res == KSI_OK);
+
+	res = KSI_RequestHandle_getExtendResponse(handle, &resp);
+	CuAssert(tc, "Unable to get extend response.", res == KSI_OK && resp != NULL);
+
+	res = KSI_ExtendResp_getStatus(resp, &status);
+	CuAssert(tc, "Extend response status mismatch.", res == KSI_OK && KSI_convertExtenderStatusCode(status) == KSI_SERVICE_EXTENDER_REQUEST_TIME_TOO_OLD);
+
+	KSI_ExtendResp_free(resp);
+	KSI_RequestHandle_free(handle);
+	KSI_ExtendReq_free(req);
+	KSI_DataHash_free(pubHash);
+	KSI_PublicationsFile_free(pubFile);
+	KSI_PublicationsFile_free(badPubFile);
+}
+
+static void testCalendarMirror_asyncExtendWithFallback(CuTest *tc) {
+	static const char *upstreamResponses[] = { TEST_UPSTREAM_FILE };
+	int res;
+	KSI_CalendarMirror *mirror = NULL;
+	KSI_CalendarMirror *upstreamMirror = NULL;
+	KSI_CalendarHashChain *chain = NULL;
+	KSI_DataHash *pubHash = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *localHandle = NULL;
+	KSI_AsyncHandle *upstreamHandle = NULL;
+	KSI_AsyncHandle *handle = NULL;
+	KSI_ExtendResp *resp = NULL;
+	KSI_CalendarHashChain *extChain = NULL;
+	KSI_uint64_t requestId = 0;
+	const KSI_uint64_t lastTime = TEST_FIRST_TIME + TEST_LEAF_COUNT - 1;
+	size_t pending = 0;
+	size_t received = 0;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+	time_t calcTime;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = createVerifiedMirror(&mirror, &pubHash);
+	CuAssert(tc, "Unable to create verified calendar mirror.", res == KSI_OK && mirror != NULL);
+
+	/* The upstream extender has the calendar from before the mirror. */
+	res = writeFeed(TEST_FIRST_TIME - 4, TEST_LEAF_COUNT + 4);
+	CuAssert(tc, "Unable to write calendar feed.", res == KSI_OK);
+
+	res = KSI_CalendarMirror_new(ctx, &upstreamMirror);
+	CuAssert(tc, "Unable to create calendar mirror.", res == KSI_OK && upstreamMirror != NULL);
+
+	res = KSI_CalendarMirror_load(upstreamMirror, TEST_FEED_FILE);
+	CuAssert(tc, "Unable to load calendar feed.", res == KSI_OK);
+
+	res = KSI_ExtendingAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create async service.", res == KSI_OK && as != NULL);
+
+	res = KSI_AsyncService_setCalendarMirror(as, mirror);
+	CuAssert(tc, "Mirror should not be set before the endpoint.", res == KSI_INVALID_STATE);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, upstreamResponses, 1, "anon", "anon");
+	CuAssert(tc, "Unable to set service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)2);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setCalendarMirror(as, mirror);
+	CuAssert(tc, "Unable to set calendar mirror.", res == KSI_OK);
+
+	/* Within the mirror. */
+	res = createExtendHandle(TEST_FIRST_TIME + 5, lastTime, &localHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && localHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, localHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	/* Before the mirror. */
+	res = createExtendHandle(TEST_FIRST_TIME - 1, lastTime, &upstreamHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && upstreamHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, upstreamHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncHandle_getRequestId(upstreamHandle, &requestId);
+	CuAssert(tc, "Unable to get request id.", res == KSI_OK);
+
+	res = KSI_CalendarMirror_getCalendarHashChain(upstreamMirror, TEST_FIRST_TIME - 1, lastTime, &chain);
+	CuAssert(tc, "Unable to get calendar hash chain.", res == KSI_OK && chain != NULL);
+
+	res = writeUpstreamResponse(requestId, chain, "anon", "anon");
+	CuAssert(tc, "Unable to write upstream response.", res == KSI_OK);
+
+	do {
+		res = KSI_AsyncService_run(as, &handle, &pending);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+
+		if (handle == NULL) continue;
+		received++;
+
+		res = KSI_AsyncHandle_getState(handle, &state);
+		CuAssert(tc, "Response not received.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_AsyncHandle_getExtendResp(handle, &resp);
+		CuAssert(tc, "Unable to get extend response.", res == KSI_OK && resp != NULL);
+
+		res = KSI_ExtendResp_getCalendarHashChain(resp, &extChain);
+		CuAssert(tc, "Extend response does not contain calendar hash chain.", res == KSI_OK && extChain != NULL);
+
+		res = KSI_CalendarHashChain_calculateAggregationTime(extChain, &calcTime);
+		CuAssert(tc, "Unable to calculate aggregation time.", res == KSI_OK);
+
+		if (handle == localHandle) {
+			CuAssert(tc, "Mirror response aggregation time mismatch.", calcTime == TEST_FIRST_TIME + 5);
+
+			res = KSI_CalendarHashChain_aggregate(extChain, &root);
+			CuAssert(tc, "Extended root hash mismatch.", res == KSI_OK && KSI_DataHash_equals(root, pubHash));
+			KSI_DataHash_free(root);
+			root = NULL;
+		} else {
+			CuAssert(tc, "Unexpected handle.", handle == upstreamHandle);
+			CuAssert(tc, "Upstream response aggregation time mismatch.", calcTime == TEST_FIRST_TIME - 1);
+		}
+
+		KSI_AsyncHandle_free(handle);
+		handle = NULL;
+	} while (pending);
+
+	CuAssert(tc, "Response count mismatch.", received == 2);
+
+	/* Without the mirror all the requests are sent to the endpoint. */
+	res = KSI_AsyncService_setCalendarMirror(as, NULL);
+	CuAssert(tc, "Unable to remove calendar mirror.", res == KSI_OK);
+
+	KSI_AsyncService_free(as);
+	KSI_CalendarMirror_free(upstreamMirror);
+	KSI_DataHash_free(pubHash);
+}
+
+CuSuite* KSITest_CalendarMirror_getSuite(void) {
+	CuSuite* suite = CuSuiteNew();
+
+	suite->postTest = postTest;
+
+	SUITE_ADD_TEST(suite, testCalendarMirror_treeShape);
+	SUITE_ADD_TEST(suite, testCalendarMirror_verifyAndExtend);
+	SUITE_ADD_TEST(suite, testCalendarMirror_asyncExtendWithFallback);
+
+	return suite;
+}
@@ -29,6 +29,8 @@
 #include "all_tests.h"
 #include "test_mock_async.h"
 
+#include "../src/ksi/impl/net_async_impl.h"
+
 
 extern KSI_CTX *ctx;
 
@@ -154,10 +156,52 @@ void Test_AsyncSingningService_verifyOptions(CuTest* tc) {
 	verifyOption(tc, as, KSI_ASYNC_OPT_SND_TIMEOUT, 10, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, 1, 15);
 	verifyOption(tc, as, KSI_ASYNC_OPT_MAX_REQUEST_COUNT, 1, 15);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_KEEP_ALIVE, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_HANDLE_POOL_SIZE, 16, 4);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_MAX_HOST_CONNECTIONS, 0, 2);
+	verifyOption(tc, as, KSI_ASYNC_OPT_HTTP_MULTIPLEX, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_RESPONSE_CALLBACK, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_AUTO_PACING, 0, 1);
+	verifyOption(tc, as, KSI_ASYNC_OPT_BATCH_SIZE, 0, 16);
+	verifyOption(tc, as, KSI_ASYNC_OPT_BATCH_WINDOW, 0, 100);
 
 	KSI_AsyncService_free(as);
 }
 
+static void Test_AsyncPacer_requestRate(CuTest* tc) {
+	size_t options[__NOF_KSI_ASYNC_OPT];
+	KSI_AsyncPacer pacer;
+	long delay;
+
+	memset(options, 0, sizeof(options));
+	memset(&pacer, 0, sizeof(pacer));
+	pacer.options = options;
+
+	/* 10 requests per second, the tokens are accumulated for 100 ms. */
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 10;
+	options[KSI_ASYNC_PRIVOPT_ROUND_DURATION] = 1;
+	CuAssert(tc, "The bucket should start full.", KSI_AsyncPacer_available(&pacer) == 1);
+	CuAssert(tc, "Request should be sent at once.", KSI_AsyncPacer_getDelay(&pacer) == 0);
+
+	KSI_AsyncPacer_consume(&pacer, 1);
+	delay = KSI_AsyncPacer_getDelay(&pacer);
+	CuAssert(tc, "Next request should be paced.", delay > 0 && delay <= 100);
+
+	/* Nothing can be sent. */
+	options[KSI_ASYNC_OPT_MAX_REQUEST_COUNT] = 0;
+	CuAssert(tc, "No request should be allowed.", KSI_AsyncPacer_available(&pacer) == 0);
+	CuAssert(tc, "Rate should be rechecked after a round.", KSI_AsyncPacer_getDelay(&pacer) == 1000);
+
+	/* The server configuration is used only if enabled. */
+	pacer.confCount = 5;
+	pacer.confPeriodMs = 50;
+	CuAssert(tc, "Server configuration should not be used.", KSI_AsyncPacer_available(&pacer) == 0);
+
+	options[KSI_ASYNC_OPT_AUTO_PACING] = 1;
+	delay = KSI_AsyncPacer_getDelay(&pacer);
+	CuAssert(tc, "Server request rate should be used.", delay >= 0 && delay <= 10);
+}
+
 static int dummyCallback(KSI_CTX KSI_UNUSED(*ctx), KSI_Config KSI_UNUSED(*cnf)) {
 	return KSI_OK;
 }
@@ -290,6 +334,57 @@ static void Test_AsyncSingningService_runEmpty(CuTest* tc) {
 	KSI_AsyncService_free(as);
 }
 
+static void Test_AsyncSingningService_getPollFds_noEndpoint(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncPollFd fds[1];
+	size_t fdsLen = 1;
+	long timeout = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSI_AsyncService_getPollFds(as, NULL, &fdsLen, &timeout);
+	CuAssert(tc, "Missing descriptor array must be rejected.", res == KSI_INVALID_ARGUMENT);
+
+	res = KSI_AsyncService_getPollFds(as, fds, &fdsLen, &timeout);
+	CuAssert(tc, "Service without endpoint must fail.", res == KSI_INVALID_STATE);
+
+	res = KSI_AsyncService_wait(as, 0);
+	CuAssert(tc, "Service without endpoint must fail.", res == KSI_INVALID_STATE);
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSingningService_waitEmpty(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	size_t fdsLen = 0;
+	long timeout = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, NULL, NULL);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_getPollFds(as, NULL, &fdsLen, &timeout);
+	CuAssert(tc, "Unable to get poll descriptors.", res == KSI_OK);
+	CuAssert(tc, "Idle service must not have anything to wait for.", fdsLen == 0 && timeout == -1);
+
+	/* Must return immediately. */
+	res = KSI_AsyncService_wait(as, -1);
+	CuAssert(tc, "Failed to wait for async service.", res == KSI_OK);
+
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSingningService_verifyReqId(CuTest* tc) {
 	int res;
 	KSI_AsyncService *as = NULL;
@@ -372,6 +467,68 @@ static void Test_AsyncSingningService_verifyRequestCacheFull(CuTest* tc) {
 	KSI_AsyncService_free(as);
 }
 
+static void Test_AsyncSingningService_verifyRequestCacheReuse(CuTest* tc) {
+	KSI_AsyncHandle *handle[2] = {NULL, NULL};
+	KSI_AsyncHandle *respHandle = NULL;
+	KSI_uint64_t reqId[2] = {0, 0};
+	KSI_uint64_t nextId = 0;
+	int res;
+	KSI_AsyncService *as = NULL;
+	size_t i;
+	size_t waiting = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)2);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	/* Make the requests time out at once. */
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RCV_TIMEOUT, (void *)0);
+	CuAssert(tc, "Unable to set receive timeout.", res == KSI_OK);
+
+	for (i = 0; i < 2; i++) {
+		res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &handle[i]);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && handle[i] != NULL);
+
+		res = KSI_AsyncService_addRequest(as, handle[i]);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+		res = KSI_AsyncHandle_getRequestId(handle[i], &reqId[i]);
+		CuAssert(tc, "Unable to get handle request id.", res == KSI_OK && reqId[i] != 0);
+	}
+
+	/* A handle can not be added while it is in the cache. */
+	res = KSI_AsyncService_addRequest(as, handle[0]);
+	CuAssert(tc, "Handle in progress should not be added.", res == KSI_INVALID_STATE);
+
+	/* The timed out handles are returned in the order of sending. */
+	for (i = 0; i < 2; i++) {
+		respHandle = NULL;
+		res = KSI_AsyncService_run(as, &respHandle, &waiting);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+		CuAssert(tc, "Wrong handle returned.", respHandle == handle[i]);
+	}
+	CuAssert(tc, "There should be no waiting requests.", waiting == 0);
+
+	/* The released cache positions are reused, but with a different id. */
+	res = KSI_AsyncService_addRequest(as, handle[0]);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncHandle_getRequestId(handle[0], &nextId);
+	CuAssert(tc, "Unable to get handle request id.", res == KSI_OK);
+	CuAssert(tc, "Request id should not be repeated.", nextId != reqId[0] && nextId != reqId[1]);
+	CuAssert(tc, "Released cache position should be reused.", (nextId & 0xffffffff) == (reqId[0] & 0xffffffff));
+
+	KSI_AsyncHandle_free(handle[1]);
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSign_oneRequest_verifyReqCtx(CuTest* tc) {
 	static const char *TEST_AGGR_RESPONSE_FILES[] = {
 		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
@@ -444,6 +601,255 @@ static void Test_AsyncSign_oneRequest_verifyReqCtx(CuTest* tc) {
 	KSI_AsyncService_free(as);
 }
 
+static void Test_AsyncSign_oneRequest_wait(CuTest* tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	size_t fdsLen = 0;
+	long timeout = -1;
+	size_t onHold = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	/* The mock client does not expose any sockets, thus it is polled regularly. */
+	res = KSI_AsyncService_getPollFds(as, NULL, &fdsLen, &timeout);
+	CuAssert(tc, "Unable to get poll descriptors.", res == KSI_OK && fdsLen == 0);
+	CuAssert(tc, "Timeout must be set while a request is pending.", timeout >= 0 && timeout <= 1000);
+
+	res = KSI_AsyncService_wait(as, -1);
+	CuAssert(tc, "Failed to wait for async service.", res == KSI_OK);
+
+	res = KSI_AsyncService_run(as, &respHandle, &onHold);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK && respHandle == reqHandle);
+
+	res = KSI_AsyncService_getPollFds(as, NULL, &fdsLen, &timeout);
+	CuAssert(tc, "Unable to get poll descriptors.", res == KSI_OK);
+	CuAssert(tc, "Service must not have anything to wait for.", fdsLen == 0 && timeout == -1);
+
+	KSI_AsyncHandle_free(respHandle);
+	KSI_AsyncService_free(as);
+}
+
+typedef struct ResponseCallbackCheck_st {
+	size_t count;
+	int lastState;
+	int lastErr;
+	int ret;
+} ResponseCallbackCheck;
+
+static int responseCallback(KSI_CTX KSI_UNUSED(*ctx), void *userp, KSI_AsyncHandle *handle) {
+	ResponseCallbackCheck *check = userp;
+
+	check->count++;
+	KSI_AsyncHandle_getState(handle, &check->lastState);
+	KSI_AsyncHandle_getError(handle, &check->lastErr);
+	KSI_AsyncHandle_free(handle);
+
+	return check->ret;
+}
+
+static void Test_AsyncSign_oneRequest_responseCallback(CuTest* tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	ResponseCallbackCheck check;
+	size_t onHold = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	memset(&check, 0, sizeof(check));
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RESPONSE_CALLBACK, (void *)responseCallback);
+	CuAssert(tc, "Unable to set response callback.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)&check);
+	CuAssert(tc, "Unable to set callback user data.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncService_run(as, &respHandle, &onHold);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+	CuAssert(tc, "Response must be passed to the callback.", respHandle == NULL && onHold == 0);
+	CuAssert(tc, "Callback invocation mismatch.", check.count == 1 && check.lastState == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_multipleRequests_responseCallback_rcvTimeout0(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	ResponseCallbackCheck check;
+	size_t onHold = 0;
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	memset(&check, 0, sizeof(check));
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)3);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	/* All requests are finalized with a timeout during the first run. */
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RCV_TIMEOUT, (void *)0);
+	CuAssert(tc, "Unable to set receive timeout.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RESPONSE_CALLBACK, (void *)responseCallback);
+	CuAssert(tc, "Unable to set response callback.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)&check);
+	CuAssert(tc, "Unable to set callback user data.", res == KSI_OK);
+
+	for (i = 0; i < 3; i++) {
+		KSI_AsyncHandle *reqHandle = NULL;
+
+		res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+		res = KSI_AsyncService_addRequest(as, reqHandle);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+	}
+
+	res = KSI_AsyncService_run(as, &respHandle, &onHold);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+	CuAssert(tc, "All requests must be passed to the callback.", respHandle == NULL && onHold == 0);
+	CuAssert(tc, "Callback invocation mismatch.", check.count == 3 &&
+			check.lastState == KSI_ASYNC_STATE_ERROR && check.lastErr == KSI_NETWORK_RECIEVE_TIMEOUT);
+
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_multipleRequests_handleResponseCallback(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *cbHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	ResponseCallbackCheck check;
+	size_t onHold = 0;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	memset(&check, 0, sizeof(check));
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)2);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RCV_TIMEOUT, (void *)0);
+	CuAssert(tc, "Unable to set receive timeout.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)&check);
+	CuAssert(tc, "Unable to set callback user data.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	/* Only the second request has a callback. */
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &cbHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && cbHandle != NULL);
+
+	res = KSI_AsyncHandle_setResponseCallback(cbHandle, responseCallback);
+	CuAssert(tc, "Unable to set handle response callback.", res == KSI_OK);
+
+	res = KSI_AsyncService_addRequest(as, cbHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncService_run(as, &respHandle, &onHold);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK);
+	CuAssert(tc, "Callback invocation mismatch.", check.count == 1 && check.lastState == KSI_ASYNC_STATE_ERROR);
+	CuAssert(tc, "Request without callback must be returned by run.", respHandle == reqHandle && onHold == 0);
+
+	KSI_AsyncHandle_free(respHandle);
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_oneRequest_responseCallbackError(CuTest* tc) {
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	ResponseCallbackCheck check;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	memset(&check, 0, sizeof(check));
+	check.ret = KSI_INVALID_STATE;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, NULL, 0, "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RCV_TIMEOUT, (void *)0);
+	CuAssert(tc, "Unable to set receive timeout.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_RESPONSE_CALLBACK, (void *)responseCallback);
+	CuAssert(tc, "Unable to set response callback.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_CALLBACK_USERDATA, (void *)&check);
+	CuAssert(tc, "Unable to set callback user data.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncService_run(as, &respHandle, NULL);
+	CuAssert(tc, "Callback error must be returned by run.", res == KSI_INVALID_STATE && respHandle == NULL);
+	CuAssert(tc, "Callback invocation mismatch.", check.count == 1);
+
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSign_oneRequest_verifySignature(CuTest* tc) {
 #define TEST_SIGNATURE_FILE     "resource/tlv/ok-sig-2014-07-01.1.ksig"
 	static const char *TEST_AGGR_RESPONSE_FILES[] = {
@@ -508,6 +914,148 @@ static void Test_AsyncSign_oneRequest_verifySignature(CuTest* tc) {
 #undef TEST_SIGNATURE_FILE
 }
 
+static void Test_AsyncSign_batch_oneRequest_verifySignature(CuTest* tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle = NULL;
+	KSI_AsyncHandle *respHandle = NULL;
+	KSI_Signature *signature = NULL;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_BATCH_SIZE, (void *)4);
+	CuAssert(tc, "Unable to set batch size.", res == KSI_OK);
+
+	res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d", 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle);
+	CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle != NULL);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	/* A single collected request is sent out as it is. */
+	res = KSI_AsyncService_run(as, &respHandle, NULL);
+	CuAssert(tc, "Failed to run async service.", res == KSI_OK && respHandle == reqHandle);
+
+	res = KSI_AsyncHandle_getState(respHandle, &state);
+	CuAssert(tc, "Unable to get request state.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+	res = KSI_AsyncHandle_getSignature(respHandle, &signature);
+	CuAssert(tc, "Unable to extract signature.", res == KSI_OK && signature != NULL);
+
+	KSI_Signature_free(signature);
+	KSI_AsyncHandle_free(respHandle);
+	KSI_AsyncService_free(as);
+}
+
+static void Test_AsyncSign_batch_multipleRequests(CuTest* tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response.tlv",
+	};
+	static const char *TEST_REQ_HASHES[] = {
+		"0111a700b0c8066c47ecba05ed37bc14dcadb238552d86c659342d1d7e87b8772d",
+		"01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2",
+		"0103ce8a99d60a808deb9872ec92846f5a56c816ad446824923f53c03691c88b8c",
+	};
+
+	int res;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *reqHandle[3] = {NULL, NULL, NULL};
+	KSI_AsyncHandle *respHandle = NULL;
+	KSI_AsyncPollFd fds[4];
+	size_t fds_len = sizeof(fds) / sizeof(*fds);
+	long timeout = -1;
+	size_t onHold = 0;
+	size_t count = 0;
+	KSI_uint64_t reqId = 0;
+	KSI_uint64_t firstId = 0;
+	KSI_AggregationResp *firstResp = NULL;
+	size_t i;
+
+	KSI_LOG_debug(ctx, "%s", __FUNCTION__);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, TEST_RESP_COUNT(TEST_AGGR_RESPONSE_FILES), "anon", "anon");
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void *)3);
+	CuAssert(tc, "Unable to set request cache size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_BATCH_SIZE, (void *)3);
+	CuAssert(tc, "Unable to set batch size.", res == KSI_OK);
+
+	res = KSI_AsyncService_setOption(as, KSI_ASYNC_OPT_BATCH_WINDOW, (void *)10000);
+	CuAssert(tc, "Unable to set batch window.", res == KSI_OK);
+
+	for (i = 0; i < 3; i++) {
+		res = KSITest_createAggrAsyncHandle(ctx, 1, (unsigned char *)TEST_REQ_HASHES[i], 0, KSI_HASHALG_INVALID_VALUE, NULL, 0, 0, &reqHandle[i]);
+		CuAssert(tc, "Unable to create async handle.", res == KSI_OK && reqHandle[i] != NULL);
+	}
+
+	for (i = 0; i < 2; i++) {
+		res = KSI_AsyncService_addRequest(as, reqHandle[i]);
+		CuAssert(tc, "Unable to add request.", res == KSI_OK);
+	}
+
+	/* The requests are collected until the batch size or the time window is reached. */
+	res = KSI_AsyncService_getPollFds(as, fds, &fds_len, &timeout);
+	CuAssert(tc, "Unable to get poll descriptors.", res == KSI_OK && timeout > 0 && timeout <= 10000);
+
+	res = KSI_AsyncService_addRequest(as, reqHandle[2]);
+	CuAssert(tc, "Unable to add request.", res == KSI_OK);
+
+	res = KSI_AsyncService_getPendingCount(as, &count);
+	CuAssert(tc, "Pending count mismatch.", res == KSI_OK && count == 3);
+
+	/* The collected requests are returned in the order of adding. */
+	for (i = 0; i < 3; i++) {
+		int state = KSI_ASYNC_STATE_UNDEFINED;
+		KSI_AggregationResp *resp = NULL;
+		KSI_Signature *signature = NULL;
+
+		res = KSI_AsyncService_run(as, &respHandle, &onHold);
+		CuAssert(tc, "Failed to run async service.", res == KSI_OK && respHandle == reqHandle[i]);
+		CuAssert(tc, "Waiting count mismatch.", onHold == 2 - i);
+
+		res = KSI_AsyncHandle_getRequestId(respHandle, &reqId);
+		CuAssert(tc, "Unable to get request id.", res == KSI_OK && reqId != 0);
+		if (i == 0) firstId = reqId;
+		CuAssert(tc, "The collected requests must share the request id.", reqId == firstId);
+
+		res = KSI_AsyncHandle_getState(respHandle, &state);
+		CuAssert(tc, "Unable to get request state.", res == KSI_OK && state == KSI_ASYNC_STATE_RESPONSE_RECEIVED);
+
+		res = KSI_AsyncHandle_getAggregationResp(respHandle, &resp);
+		CuAssert(tc, "Unable to get aggregation response.", res == KSI_OK && resp != NULL);
+		if (i == 0) firstResp = resp;
+		CuAssert(tc, "The collected requests must share the aggregation response.", resp == firstResp);
+
+		/* The recorded response does not match the root of the local tree. */
+		res = KSI_AsyncHandle_getSignature(respHandle, &signature);
+		CuAssert(tc, "Signature should not be created.", res != KSI_OK && signature == NULL);
+
+		if (i > 0) KSI_AsyncHandle_free(respHandle);
+	}
+
+	res = KSI_AsyncService_getPendingCount(as, &count);
+	CuAssert(tc, "Pending count mismatch.", res == KSI_OK && count == 0);
+
+	KSI_AsyncHandle_free(reqHandle[0]);
+	KSI_AsyncService_free(as);
+}
+
 static void Test_AsyncSign_oneRequest_multipleResponses_verifySignature(CuTest* tc) {
 #define TEST_SIGNATURE_FILE     "resource/tlv/ok-sig-2014-07-01.1.ksig"
 	static const char *TEST_AGGR_RESPONSE_FILES[] = {
@@ -1807,17 +2355,28 @@ CuSuite* KSITest_NetAsync_getSuite(void) {
 	suite->preTest = preTest;
 
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyOptions);
+	SUITE_ADD_TEST(suite, Test_AsyncPacer_requestRate);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyPushConfCallbackOptions);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyCacheSizeOption);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_addEmptyReq);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_addRequest_noEndpoint);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_runEmpty);
+	SUITE_ADD_TEST(suite, Test_AsyncSingningService_getPollFds_noEndpoint);
+	SUITE_ADD_TEST(suite, Test_AsyncSingningService_waitEmpty);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyReqId);
 	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyRequestCacheFull);
+	SUITE_ADD_TEST(suite, Test_AsyncSingningService_verifyRequestCacheReuse);
 
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifyReqCtx);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_wait);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_responseCallback);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_responseCallback_rcvTimeout0);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_multipleRequests_handleResponseCallback);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_responseCallbackError);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifySignature);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_multipleResponses_verifySignature);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_batch_oneRequest_verifySignature);
+	SUITE_ADD_TEST(suite, Test_AsyncSign_batch_multipleRequests);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_verifyNoError);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_responseWithPushConf_viaServiceCallback);
 	SUITE_ADD_TEST(suite, Test_AsyncSign_oneRequest_responseWithPushConf_viaKsiCtxAggrCallback);
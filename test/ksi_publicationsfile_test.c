@@ -25,13 +25,17 @@
 #include "all_tests.h"
 
 #include "../src/ksi/internal.h"
+#include "../src/ksi/fast_tlv.h"
 
+#include "../src/ksi/impl/ctx_impl.h"
 #include "../src/ksi/impl/publicationsfile_impl.h"
 
 extern KSI_CTX *ctx;
 
 #define TEST_PUBLICATIONS_FILE "resource/tlv/publications.tlv"
 #define TEST_PUBLICATIONS_FILE_INVALID_PKI "resource/tlv/publfile-nok-pki.tlv"
+#define TEST_TMP_PUBLICATIONS_FILE "ksi_publicationsfile_test.tmp"
+#define TEST_TMP_SNAPSHOT_FILE "ksi_publicationsfile_snapshot_test.tmp"
 #define TAMPERED_PUBLICATIONS_FILE "resource/tlv/publications-fake-publication.tlv"
 
 static void testLoadPublicationsFile(CuTest *tc) {
@@ -209,6 +213,184 @@ static void testVerifyPublicationsFileContainsIntermediateCerts(CuTest *tc) {
 	KSI_CTX_free(ctx);
 }
 
+static void testReceivePublicationsFileNotModified(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx = NULL;
+	KSI_PublicationsFile *pubFile1 = NULL;
+	KSI_PublicationsFile *pubFile2 = NULL;
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, getFullResourcePathUri(TEST_PUBLICATIONS_FILE));
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	/* Every call triggers a new request. */
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set publications file cache timeout.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile1);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile1 != NULL);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile2);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile2 != NULL);
+	CuAssert(tc, "Unmodified publications file should not be replaced.", pubFile1 == pubFile2);
+
+	KSI_PublicationsFile_free(pubFile1);
+	KSI_PublicationsFile_free(pubFile2);
+	KSI_CTX_free(ctx);
+}
+
+static void testReceivePublicationsFileServesStale(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx = NULL;
+	KSI_PublicationsFile *pubFile1 = NULL;
+	KSI_PublicationsFile *pubFile2 = NULL;
+	KSI_PublicationsFile *pubFile3 = NULL;
+	char tmpFile[2048];
+	char tmpUri[2048];
+	char buf[1024];
+	size_t count;
+	FILE *in = NULL;
+	FILE *out = NULL;
+
+	KSI_snprintf(tmpFile, sizeof(tmpFile), "%s", getFullResourcePath(TEST_TMP_PUBLICATIONS_FILE));
+	KSI_snprintf(tmpUri, sizeof(tmpUri), "%s", getFullResourcePathUri(TEST_TMP_PUBLICATIONS_FILE));
+
+	in = fopen(getFullResourcePath(TEST_PUBLICATIONS_FILE), "rb");
+	CuAssert(tc, "Unable to open publications file.", in != NULL);
+
+	out = fopen(tmpFile, "wb");
+	CuAssert(tc, "Unable to create temporary publications file.", out != NULL);
+
+	while ((count = fread(buf, 1, sizeof(buf), in)) > 0) {
+		CuAssert(tc, "Unable to write temporary publications file.", fwrite(buf, 1, count, out) == count);
+	}
+	fclose(in);
+	fclose(out);
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, tmpUri);
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set publications file cache timeout.", res == KSI_OK);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_MAX_STALE_SECONDS, (void *)3600);
+	CuAssert(tc, "Unable to set publications file max stale time.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile1);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile1 != NULL);
+
+	/* The refresh fails, but the stale file is still served. */
+	remove(tmpFile);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile2);
+	CuAssert(tc, "Stale publications file should be returned.", res == KSI_OK && pubFile2 == pubFile1);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_MAX_STALE_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set publications file max stale time.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile3);
+	CuAssert(tc, "Expired publications file should not be returned.", res != KSI_OK && pubFile3 == NULL);
+
+	KSI_PublicationsFile_free(pubFile1);
+	KSI_PublicationsFile_free(pubFile2);
+	KSI_CTX_free(ctx);
+}
+
+/* Writes the file with the first prefix_len bytes replaced with zeros. */
+static int writePublicationsFile(const char *from, const char *to, size_t prefix_len) {
+	int res = KSI_IO_ERROR;
+	FILE *in = NULL;
+	FILE *out = NULL;
+	size_t pos = 0;
+	int c;
+
+	in = fopen(from, "rb");
+	out = fopen(to, "wb");
+	if (in == NULL || out == NULL) goto cleanup;
+
+	while ((c = fgetc(in)) != EOF) {
+		if (fputc(pos++ < prefix_len ? 0 : c, out) == EOF) goto cleanup;
+	}
+
+	res = KSI_OK;
+
+cleanup:
+
+	if (in != NULL) fclose(in);
+	if (out != NULL) fclose(out);
+
+	return res;
+}
+
+static void testReceivePublicationsFileIncrementally(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx = NULL;
+	KSI_PublicationsFile *pubFile1 = NULL;
+	KSI_PublicationsFile *pubFile2 = NULL;
+	KSI_PublicationsFile *pubFile3 = NULL;
+	char tmpFile[2048];
+	char tmpUri[2048];
+
+	KSI_snprintf(tmpFile, sizeof(tmpFile), "%s", getFullResourcePath(TEST_TMP_PUBLICATIONS_FILE));
+	KSI_snprintf(tmpUri, sizeof(tmpUri), "%s", getFullResourcePathUri(TEST_TMP_PUBLICATIONS_FILE));
+
+	res = writePublicationsFile(getFullResourcePath(TEST_PUBLICATIONS_FILE), tmpFile, 0);
+	CuAssert(tc, "Unable to create temporary publications file.", res == KSI_OK);
+
+	res = KSITest_CTX_clone(&ctx);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationUrl(ctx, tmpUri);
+	CuAssert(tc, "Unable to set pubfile URI.", res == KSI_OK);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set publications file cache timeout.", res == KSI_OK);
+
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PUBFILE_INCREMENTAL_DOWNLOAD, (void *)1);
+	CuAssert(tc, "Unable to enable incremental download.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile1);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile1 != NULL);
+
+	/* Only the end of the file may be read, as the rest of it is not valid any more. */
+	res = writePublicationsFile(getFullResourcePath(TEST_PUBLICATIONS_FILE), tmpFile, pubFile1->signedDataLength);
+	CuAssert(tc, "Unable to update temporary publications file.", res == KSI_OK);
+	ctx->publicationsFileLastModified = 0;
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile2);
+	CuAssert(tc, "Unable to receive publications file incrementally.", res == KSI_OK && pubFile2 != NULL && pubFile2 != pubFile1);
+	CuAssert(tc, "Publications file content mismatch.", pubFile2->raw_len == pubFile1->raw_len && !memcmp(pubFile2->raw, pubFile1->raw, pubFile1->raw_len));
+
+	/* A longer file with a different beginning fails the verification and is received in full. */
+	res = writePublicationsFile(getFullResourcePath(TEST_PUBLICATIONS_FILE_INVALID_PKI), tmpFile, 0);
+	CuAssert(tc, "Unable to update temporary publications file.", res == KSI_OK);
+	ctx->publicationsFileLastModified = 0;
+
+	res = KSI_receivePublicationsFile(ctx, &pubFile3);
+	CuAssert(tc, "Unable to receive the full publications file.", res == KSI_OK && pubFile3 != NULL);
+	CuAssert(tc, "Publications file should have been received in full.", pubFile3->raw_len != pubFile1->raw_len);
+
+	KSI_PublicationsFile_free(pubFile1);
+	KSI_PublicationsFile_free(pubFile2);
+	KSI_PublicationsFile_free(pubFile3);
+	KSI_CTX_free(ctx);
+	remove(tmpFile);
+}
+
 static void testReceivePublicationsFileInvalidConstraints(CuTest *tc) {
 	int res;
 	KSI_PublicationsFile *pubFile = NULL;
@@ -759,6 +941,284 @@ static void testSerializePublicationsFile(CuTest *tc) {
 	if (f) fclose(f);
 }
 
+static void testIndexedLookupsMatchRecords(CuTest *tc) {
+	int res;
+	size_t i;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_LIST(KSI_PublicationRecord) *pubList = NULL;
+	KSI_LIST(KSI_CertificateRecord) *certList = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_getPublications(pubFile, &pubList);
+	CuAssert(tc, "Unable to get publication records.", res == KSI_OK && pubList != NULL);
+
+	for (i = 0; i < KSI_PublicationRecordList_length(pubList); i++) {
+		KSI_PublicationRecord *pubRec = NULL;
+		KSI_PublicationRecord *found = NULL;
+		KSI_PublicationData *pubData = NULL;
+		KSI_Integer *pubTime = NULL;
+
+		res = KSI_PublicationRecordList_elementAt(pubList, i, &pubRec);
+		CuAssert(tc, "Unable to get publication record.", res == KSI_OK && pubRec != NULL);
+
+		res = KSI_PublicationRecord_getPublishedData(pubRec, &pubData);
+		CuAssert(tc, "Unable to get published data.", res == KSI_OK && pubData != NULL);
+
+		res = KSI_PublicationData_getTime(pubData, &pubTime);
+		CuAssert(tc, "Unable to get publication time.", res == KSI_OK && pubTime != NULL);
+
+		res = KSI_PublicationsFile_findPublication(pubFile, pubRec, &found);
+		CuAssert(tc, "Publication record not found.", res == KSI_OK && found == pubRec);
+		KSI_PublicationRecord_free(found);
+		found = NULL;
+
+		res = KSI_PublicationsFile_getPublicationDataByTime(pubFile, pubTime, &found);
+		CuAssert(tc, "Publication record not found by time.", res == KSI_OK && found == pubRec);
+	}
+
+	res = KSI_PublicationsFile_getCertificates(pubFile, &certList);
+	CuAssert(tc, "Unable to get certificate records.", res == KSI_OK && certList != NULL);
+
+	for (i = 0; i < KSI_CertificateRecordList_length(certList); i++) {
+		KSI_CertificateRecord *certRec = NULL;
+		KSI_OctetString *certId = NULL;
+		KSI_PKICertificate *cert = NULL;
+		KSI_PKICertificate *found = NULL;
+
+		res = KSI_CertificateRecordList_elementAt(certList, i, &certRec);
+		CuAssert(tc, "Unable to get certificate record.", res == KSI_OK && certRec != NULL);
+
+		res = KSI_CertificateRecord_getCertId(certRec, &certId);
+		CuAssert(tc, "Unable to get certificate ID.", res == KSI_OK && certId != NULL);
+
+		res = KSI_CertificateRecord_getCert(certRec, &cert);
+		CuAssert(tc, "Unable to get certificate.", res == KSI_OK && cert != NULL);
+
+		res = KSI_PublicationsFile_getPKICertificateById(pubFile, certId, &found);
+		CuAssert(tc, "Certificate not found by ID.", res == KSI_OK && found == cert);
+	}
+
+	KSI_PublicationsFile_free(pubFile);
+}
+
+static void testIndexNotUsedAfterListModified(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_LIST(KSI_PublicationRecord) *pubList = NULL;
+	KSI_PublicationRecord *first = NULL;
+	KSI_PublicationRecord *last = NULL;
+	KSI_PublicationRecord *clone = NULL;
+	KSI_PublicationRecord *found = NULL;
+	KSI_Integer *firstTime = NULL;
+	KSI_Integer *lastTime = NULL;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_getPublications(pubFile, &pubList);
+	CuAssert(tc, "Unable to get publication records.", res == KSI_OK && pubList != NULL && KSI_PublicationRecordList_length(pubList) > 1);
+
+	res = KSI_PublicationRecordList_elementAt(pubList, 0, &first);
+	CuAssert(tc, "Unable to get publication record.", res == KSI_OK && first != NULL);
+
+	res = KSI_PublicationRecordList_elementAt(pubList, KSI_PublicationRecordList_length(pubList) - 1, &last);
+	CuAssert(tc, "Unable to get publication record.", res == KSI_OK && last != NULL);
+
+	res = KSI_Integer_new(ctx, KSI_Integer_getUInt64(first->publishedData->time), &firstTime);
+	CuAssert(tc, "Unable to create integer.", res == KSI_OK && firstTime != NULL);
+
+	lastTime = last->publishedData->time;
+
+	res = KSI_PublicationRecord_clone(last, &clone);
+	CuAssert(tc, "Unable to clone publication record.", res == KSI_OK && clone != NULL);
+
+	/* Replacing a record keeps the length of the list, but frees the indexed record. */
+	res = KSI_PublicationRecordList_replaceAt(pubList, 0, clone);
+	CuAssert(tc, "Unable to replace publication record.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_getPublicationDataByTime(pubFile, firstTime, &found);
+	CuAssert(tc, "Replaced publication record should not be found.", res == KSI_OK && found == NULL);
+
+	res = KSI_PublicationsFile_getPublicationDataByTime(pubFile, lastTime, &found);
+	CuAssert(tc, "The first matching record should be found.", res == KSI_OK && found == clone);
+
+	KSI_Integer_free(firstTime);
+	KSI_PublicationsFile_free(pubFile);
+}
+
+static void testLazyLoadMatchesEagerLoad(CuTest *tc) {
+	int res;
+	size_t i;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationsFile *lazyFile = NULL;
+	KSI_LIST(KSI_PublicationRecord) *pubList = NULL;
+	KSI_LIST(KSI_CertificateRecord) *certList = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_Integer *tm = NULL;
+	char *raw = NULL;
+	size_t raw_len = 0;
+	char *lazyRaw = NULL;
+	size_t lazyRaw_len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_fromFileLazy(ctx, getFullResourcePath(TEST_PUBLICATIONS_FILE), &lazyFile);
+	CuAssert(tc, "Unable to read publications file lazily.", res == KSI_OK && lazyFile != NULL);
+
+	res = KSI_PublicationsFile_verify(lazyFile, ctx);
+	CuAssert(tc, "Lazily loaded publications file should verify.", res == KSI_OK);
+
+	res = KSI_Integer_new(ctx, 1289779234, &tm);
+	CuAssert(tc, "Unable to create integer.", res == KSI_OK && tm != NULL);
+
+	res = KSI_PublicationsFile_getNearestPublication(lazyFile, tm, &pubRec);
+	CuAssert(tc, "Unable to find nearest publication.", res == KSI_OK && pubRec != NULL);
+	CuAssert(tc, "Unexpected publication time.", KSI_Integer_equalsUInt(pubRec->publishedData->time, 1292371200));
+	KSI_PublicationRecord_free(pubRec);
+	pubRec = NULL;
+
+	res = KSI_PublicationsFile_getPublications(pubFile, &pubList);
+	CuAssert(tc, "Unable to get publication records.", res == KSI_OK && pubList != NULL);
+
+	for (i = 0; i < KSI_PublicationRecordList_length(pubList); i++) {
+		KSI_PublicationRecord *eager = NULL;
+		KSI_PublicationRecord *found = NULL;
+
+		res = KSI_PublicationRecordList_elementAt(pubList, i, &eager);
+		CuAssert(tc, "Unable to get publication record.", res == KSI_OK && eager != NULL);
+
+		res = KSI_PublicationsFile_getPublicationDataByTime(lazyFile, eager->publishedData->time, &found);
+		CuAssert(tc, "Publication record not found by time.", res == KSI_OK && found != NULL);
+		CuAssert(tc, "Publication record mismatch.", KSI_DataHash_equals(found->publishedData->imprint, eager->publishedData->imprint));
+	}
+
+	res = KSI_PublicationsFile_getCertificates(pubFile, &certList);
+	CuAssert(tc, "Unable to get certificate records.", res == KSI_OK && certList != NULL);
+
+	for (i = 0; i < KSI_CertificateRecordList_length(certList); i++) {
+		KSI_CertificateRecord *certRec = NULL;
+		KSI_OctetString *certId = NULL;
+		KSI_PKICertificate *found = NULL;
+
+		res = KSI_CertificateRecordList_elementAt(certList, i, &certRec);
+		CuAssert(tc, "Unable to get certificate record.", res == KSI_OK && certRec != NULL);
+
+		res = KSI_CertificateRecord_getCertId(certRec, &certId);
+		CuAssert(tc, "Unable to get certificate ID.", res == KSI_OK && certId != NULL);
+
+		res = KSI_PublicationsFile_getPKICertificateById(lazyFile, certId, &found);
+		CuAssert(tc, "Certificate not found by ID.", res == KSI_OK && found != NULL);
+	}
+
+	/* Accessing the lists parses all the records. */
+	pubList = NULL;
+	res = KSI_PublicationsFile_getPublications(lazyFile, &pubList);
+	CuAssert(tc, "Unable to get publication records.", res == KSI_OK && pubList != NULL);
+	CuAssert(tc, "Publication record count mismatch.", KSI_PublicationRecordList_length(pubList) == KSI_PublicationRecordList_length(pubFile->publications));
+
+	res = KSI_PublicationsFile_serialize(ctx, pubFile, &raw, &raw_len);
+	CuAssert(tc, "Unable to serialize publications file.", res == KSI_OK && raw != NULL);
+
+	res = KSI_PublicationsFile_serialize(ctx, lazyFile, &lazyRaw, &lazyRaw_len);
+	CuAssert(tc, "Unable to serialize lazily loaded publications file.", res == KSI_OK && lazyRaw != NULL);
+	CuAssert(tc, "Serialized publications files mismatch.", raw_len == lazyRaw_len && !memcmp(raw, lazyRaw, raw_len));
+
+	KSI_free(raw);
+	KSI_free(lazyRaw);
+	KSI_Integer_free(tm);
+	KSI_PublicationsFile_free(lazyFile);
+	KSI_PublicationsFile_free(pubFile);
+}
+
+static void readPublicationsFile(CuTest *tc, unsigned char **raw, size_t *raw_len) {
+	FILE *f = NULL;
+	long len = 0;
+	unsigned char *tmp = NULL;
+
+	f = fopen(getFullResourcePath(TEST_PUBLICATIONS_FILE), "rb");
+	CuAssert(tc, "Unable to open publications file.", f != NULL);
+
+	CuAssert(tc, "Unable to seek publications file.", fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0);
+
+	tmp = KSI_malloc((size_t)len);
+	CuAssert(tc, "Out of memory.", tmp != NULL);
+	CuAssert(tc, "Unable to read publications file.", fread(tmp, 1, (size_t)len, f) == (size_t)len);
+	fclose(f);
+
+	*raw = tmp;
+	*raw_len = (size_t)len;
+}
+
+static void writeTmpPublicationsFile(CuTest *tc, const char *fileName, const unsigned char *raw, size_t raw_len, const char *mode) {
+	FILE *f = NULL;
+
+	f = fopen(fileName, mode);
+	CuAssert(tc, "Unable to create temporary publications file.", f != NULL);
+	CuAssert(tc, "Unable to write temporary publications file.", fwrite(raw, 1, raw_len, f) == raw_len);
+	fclose(f);
+}
+
+/* Finds the value of the first TLV with the given tag in the buffer. */
+static unsigned char *findTlvValue(unsigned char *ptr, size_t len, unsigned tag, size_t *val_len) {
+	KSI_FTLV ftlv;
+
+	while (len > 0) {
+		if (KSI_FTLV_memRead(ptr, len, &ftlv) != KSI_OK) return NULL;
+		if (ftlv.tag == tag) {
+			*val_len = ftlv.dat_len;
+			return ptr + ftlv.hdr_len;
+		}
+		ptr += ftlv.hdr_len + ftlv.dat_len;
+		len -= ftlv.hdr_len + ftlv.dat_len;
+	}
+	return NULL;
+}
+
+static void testLazyLoadRejectsMalformedRecord(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	char tmpFile[2048];
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	unsigned char *ptr = NULL;
+	size_t len = 0;
+
+	KSI_ERR_clearErrors(ctx);
+
+	KSI_snprintf(tmpFile, sizeof(tmpFile), "%s", getFullResourcePath(TEST_TMP_PUBLICATIONS_FILE));
+
+	readPublicationsFile(tc, &raw, &raw_len);
+
+	/* Corrupt the hash algorithm of the first published imprint. */
+	ptr = findTlvValue(raw + 8, raw_len - 8, 0x0703, &len);
+	CuAssert(tc, "Publication record not found.", ptr != NULL);
+	ptr = findTlvValue(ptr, len, 0x10, &len);
+	CuAssert(tc, "Published data not found.", ptr != NULL);
+	ptr = findTlvValue(ptr, len, 0x04, &len);
+	CuAssert(tc, "Published imprint not found.", ptr != NULL && len > 1);
+	ptr[0] = 0xff;
+
+	writeTmpPublicationsFile(tc, tmpFile, raw, raw_len, "wb");
+
+	res = KSI_PublicationsFile_fromFileLazy(ctx, tmpFile, &pubFile);
+	CuAssert(tc, "Malformed publication record should be reported at load.", res == KSI_INVALID_FORMAT && pubFile == NULL);
+
+	remove(tmpFile);
+	KSI_free(raw);
+}
+
 static void testGetNearestPublication(CuTest *tc) {
 	int res;
 	KSI_PublicationsFile *pubFile = NULL;
@@ -980,6 +1440,230 @@ static void publicationStringForHash(CuTest *tc, KSI_DataHash *hash) {
 	KSI_free(base32);
 }
 
+static void testVerifyPublicationsFileWithSnapshot(CuTest *tc) {
+	static const KSI_CertConstraint invalidConstraints[] = {
+		{ KSI_CERT_EMAIL, "invalid@guardtime.com"},
+		{ NULL, NULL }
+	};
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_CTX *ctx2 = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKIVerificationCacheStats before;
+	KSI_PKIVerificationCacheStats after;
+	FILE *f = NULL;
+
+	remove(TEST_TMP_SNAPSHOT_FILE);
+
+	res = KSITest_CTX_clone(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx1);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFileSnapshot(ctx1, TEST_TMP_SNAPSHOT_FILE);
+	CuAssert(tc, "Unable to set publications file snapshot.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFile(ctx1, getFullResourcePath(TEST_PUBLICATIONS_FILE), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx1);
+	CuAssert(tc, "Publications file should verify.", res == KSI_OK);
+
+	f = fopen(TEST_TMP_SNAPSHOT_FILE, "rb");
+	CuAssert(tc, "Publications file snapshot should have been written.", f != NULL);
+	fclose(f);
+
+	/* A new context with the same configuration, e.g. after a restart, trusts the snapshot. */
+	res = KSITest_CTX_clone(&ctx2);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx2 != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx2);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFileSnapshot(ctx2, TEST_TMP_SNAPSHOT_FILE);
+	CuAssert(tc, "Unable to set publications file snapshot.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx2, &before);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx2);
+	CuAssert(tc, "Publications file should verify by snapshot.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx2, &after);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+	CuAssert(tc, "PKI verification should not have been performed.", after.signatureMisses == before.signatureMisses && after.signatureHits == before.signatureHits);
+
+	/* Different constraints must not match the snapshot. */
+	res = KSI_CTX_setDefaultPubFileCertConstraints(ctx2, invalidConstraints);
+	CuAssert(tc, "Unable to set certificate constraints.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx2);
+	CuAssert(tc, "Publications file should not verify with invalid constraints.", res != KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_CTX_free(ctx1);
+	KSI_CTX_free(ctx2);
+	remove(TEST_TMP_SNAPSHOT_FILE);
+}
+
+static int snapshotIndexLogger(void *logCtx, int level, const char *message) {
+	if (level == KSI_LOG_DEBUG && strstr(message, "index taken from snapshot") != NULL) {
+		++*(int *)logCtx;
+	}
+	return KSI_OK;
+}
+
+static void testLazyLoadFromSnapshotIndex(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationsFile *parsed = NULL;
+	KSI_PublicationsFile *indexed = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_PublicationData *pubData = NULL;
+	KSI_Integer *pubTime = NULL;
+	KSI_Integer *searchTime = NULL;
+	KSI_PKICertificate *cert = NULL;
+	KSI_PKISignature *pkiSig = NULL;
+	KSI_OctetString *certId = NULL;
+	KSI_PKIVerificationCacheStats before;
+	KSI_PKIVerificationCacheStats after;
+	unsigned char *snapshot = NULL;
+	long len = 0;
+	int fromSnapshot = 0;
+	size_t i;
+	FILE *f = NULL;
+
+	remove(TEST_TMP_SNAPSHOT_FILE);
+
+	res = KSITest_CTX_clone(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx1);
+	CuAssert(tc, "Unable to set default values to context.", res == KSI_OK);
+
+	res = KSI_CTX_setPublicationsFileSnapshot(ctx1, TEST_TMP_SNAPSHOT_FILE);
+	CuAssert(tc, "Unable to set publications file snapshot.", res == KSI_OK);
+
+	res = KSI_CTX_setLoggerCallback(ctx1, snapshotIndexLogger, &fromSnapshot);
+	CuAssert(tc, "Unable to set logger.", res == KSI_OK);
+
+	res = KSI_CTX_setLogLevel(ctx1, KSI_LOG_DEBUG);
+	CuAssert(tc, "Unable to set log level.", res == KSI_OK);
+
+	/* Without a snapshot the file is parsed. */
+	res = KSI_PublicationsFile_fromFileLazy(ctx1, getFullResourcePath(TEST_PUBLICATIONS_FILE), &parsed);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && parsed != NULL);
+	CuAssert(tc, "Index should not have been taken from a snapshot.", fromSnapshot == 0);
+
+	res = KSI_PublicationsFile_verify(parsed, ctx1);
+	CuAssert(tc, "Publications file should verify.", res == KSI_OK);
+
+	/* The snapshot records the index next to the verification result. */
+	f = fopen(TEST_TMP_SNAPSHOT_FILE, "rb");
+	CuAssert(tc, "Publications file snapshot should have been written.", f != NULL);
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	snapshot = KSI_malloc(len);
+	CuAssert(tc, "Out of memory.", snapshot != NULL);
+	CuAssert(tc, "Unable to read snapshot.", fread(snapshot, 1, len, f) == (size_t)len);
+	fclose(f);
+
+	CuAssert(tc, "Unexpected snapshot header.", len > 9 && memcmp(snapshot, "KSIPFSNP", 8) == 0 && snapshot[8] == 2);
+	CuAssert(tc, "Snapshot should contain the index.", (size_t)len > parsed->lazyPubRecs_len * 13 + parsed->lazyCertRecs_len * 8);
+
+	/* The next lazy load takes the index from the snapshot. */
+	res = KSI_PublicationsFile_fromFileLazy(ctx1, getFullResourcePath(TEST_PUBLICATIONS_FILE), &indexed);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && indexed != NULL);
+	CuAssert(tc, "Index should have been taken from the snapshot.", fromSnapshot == 1);
+	CuAssert(tc, "Lazy file expected.", indexed->isLazy);
+
+	CuAssert(tc, "Signed data length mismatch.", indexed->signedDataLength == parsed->signedDataLength);
+	CuAssert(tc, "Publication count mismatch.", indexed->lazyPubRecs_len == parsed->lazyPubRecs_len && indexed->timeIndex_len == parsed->timeIndex_len);
+	for (i = 0; i < parsed->lazyPubRecs_len; i++) {
+		CuAssert(tc, "Publication record location mismatch.",
+				indexed->lazyPubRecs[i].offset == parsed->lazyPubRecs[i].offset &&
+				indexed->lazyPubRecs[i].len == parsed->lazyPubRecs[i].len &&
+				indexed->lazyPubRecs[i].imprintOffset == parsed->lazyPubRecs[i].imprintOffset &&
+				indexed->lazyPubRecs[i].imprint_len == parsed->lazyPubRecs[i].imprint_len);
+		CuAssert(tc, "Time index mismatch.",
+				indexed->timeIndex[i].time == parsed->timeIndex[i].time &&
+				indexed->timeIndex[i].pos == parsed->timeIndex[i].pos);
+	}
+	CuAssert(tc, "Certificate count mismatch.", indexed->lazyCertRecs_len == parsed->lazyCertRecs_len && indexed->certIndex_count == parsed->certIndex_count);
+	for (i = 0; i < parsed->lazyCertRecs_len; i++) {
+		CuAssert(tc, "Certificate record location mismatch.",
+				indexed->lazyCertRecs[i].offset == parsed->lazyCertRecs[i].offset &&
+				indexed->lazyCertRecs[i].len == parsed->lazyCertRecs[i].len);
+	}
+
+	res = KSI_Integer_new(ctx1, 1289779234, &searchTime);
+	CuAssert(tc, "Unable to create integer.", res == KSI_OK && searchTime != NULL);
+
+	res = KSI_PublicationsFile_getNearestPublication(indexed, searchTime, &pubRec);
+	CuAssert(tc, "Unable to get nearest publication.", res == KSI_OK && pubRec != NULL);
+
+	res = KSI_PublicationRecord_getPublishedData(pubRec, &pubData);
+	CuAssert(tc, "Unable to get published data.", res == KSI_OK && pubData != NULL);
+
+	res = KSI_PublicationData_getTime(pubData, &pubTime);
+	CuAssert(tc, "Unable to get publication time.", res == KSI_OK && pubTime != NULL);
+	CuAssert(tc, "Unexpected publication time.", KSI_Integer_equalsUInt(pubTime, 1292371200));
+
+	res = KSI_PublicationsFile_getSignature(indexed, &pkiSig);
+	CuAssert(tc, "Unable to get PKI signature.", res == KSI_OK && pkiSig != NULL);
+
+	for (i = 0; i < parsed->certIndex_size; i++) {
+		if (parsed->certIndex[i].id == NULL) continue;
+
+		res = KSI_OctetString_new(ctx1, parsed->certIndex[i].id, parsed->certIndex[i].id_len, &certId);
+		CuAssert(tc, "Unable to create certificate ID.", res == KSI_OK && certId != NULL);
+
+		res = KSI_PublicationsFile_getPKICertificateById(indexed, certId, &cert);
+		CuAssert(tc, "Certificate should be found by ID.", res == KSI_OK && cert != NULL);
+
+		KSI_OctetString_free(certId);
+		certId = NULL;
+	}
+
+	/* The verification result is accepted from the snapshot as well. */
+	res = KSI_PKITruststore_getCacheStats(ctx1, &before);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFile(ctx1, getFullResourcePath(TEST_PUBLICATIONS_FILE), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx1);
+	CuAssert(tc, "Publications file should verify by snapshot.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx1, &after);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+	CuAssert(tc, "PKI verification should not have been performed.", after.signatureMisses == before.signatureMisses && after.signatureHits == before.signatureHits);
+
+	KSI_PublicationsFile_free(pubFile);
+	pubFile = NULL;
+	KSI_PublicationsFile_free(indexed);
+	indexed = NULL;
+
+	/* Setting the expiry to 0 disables the snapshot. */
+	res = KSI_CTX_setOption(ctx1, KSI_OPT_PUBFILE_SNAPSHOT_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set snapshot expiry.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFileLazy(ctx1, getFullResourcePath(TEST_PUBLICATIONS_FILE), &indexed);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && indexed != NULL);
+	CuAssert(tc, "Index should not have been taken from a disabled snapshot.", fromSnapshot == 1);
+
+	KSI_free(snapshot);
+	KSI_PublicationRecord_free(pubRec);
+	KSI_Integer_free(searchTime);
+	KSI_PublicationsFile_free(indexed);
+	KSI_PublicationsFile_free(parsed);
+	KSI_CTX_free(ctx1);
+	remove(TEST_TMP_SNAPSHOT_FILE);
+}
+
 static void testPublicationStringWithSupportedHashAlgs(CuTest *tc) {
 	int res;
 	size_t i = 0;
@@ -1029,6 +1713,10 @@ CuSuite* KSITest_Publicationsfile_getSuite(void) {
 	SUITE_ADD_TEST(suite, testSetPublicationsFileConstraints);
 	SUITE_ADD_TEST(suite, testVerifyPublicationsFileWithFileSpecificConstraints);
 	SUITE_ADD_TEST(suite, testVerifyPublicationsFileAdditionalPublications);
+	SUITE_ADD_TEST(suite, testIndexedLookupsMatchRecords);
+	SUITE_ADD_TEST(suite, testIndexNotUsedAfterListModified);
+	SUITE_ADD_TEST(suite, testLazyLoadMatchesEagerLoad);
+	SUITE_ADD_TEST(suite, testLazyLoadRejectsMalformedRecord);
 	SUITE_ADD_TEST(suite, testGetNearestPublication);
 	SUITE_ADD_TEST(suite, testGetNearestPublicationOf0);
 	SUITE_ADD_TEST(suite, testGetNearestPublicationWithPubTime);
@@ -1038,6 +1726,11 @@ CuSuite* KSITest_Publicationsfile_getSuite(void) {
 	SUITE_ADD_TEST(suite, testGetLatestPublicationOfFuture);
 	SUITE_ADD_TEST(suite, testReceivePublicationsFileInvalidConstraints);
 	SUITE_ADD_TEST(suite, testReceivePublicationsFileInvalidPki);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileNotModified);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileServesStale);
+	SUITE_ADD_TEST(suite, testVerifyPublicationsFileWithSnapshot);
+	SUITE_ADD_TEST(suite, testLazyLoadFromSnapshotIndex);
+	SUITE_ADD_TEST(suite, testReceivePublicationsFileIncrementally);
 	SUITE_ADD_TEST(suite, testPublicationStringWithSupportedHashAlgs);
 
 	return suite;
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+#include <ksi/ksi.h>
+#include <ksi/stream_signer.h>
+#include <ksi/compatibility.h>
+
+#include "cutest/CuTest.h"
+#include "all_tests.h"
+#include "test_mock_async.h"
+
+extern KSI_CTX *ctx;
+
+#define TEST_USER "anon"
+#define TEST_PASS "anon"
+
+typedef struct SinkCheck_st {
+	KSI_DataHash *hsh;
+	/** Index of the next expected record. */
+	size_t next;
+	size_t signed_count;
+	size_t failed_count;
+	size_t errors;
+} SinkCheck;
+
+static int checkSink(void *c, void *recordCtx, int status, const unsigned char *raw, size_t raw_len) {
+	SinkCheck *check = c;
+	size_t *index = recordCtx;
+	KSI_Signature *sig = NULL;
+
+	/* The records must be passed to the sink in the order of adding. */
+	if (*index != check->next++) check->errors++;
+
+	if (status == KSI_OK) {
+		check->signed_count++;
+		if (raw == NULL || raw_len == 0 ||
+				KSI_Signature_parse(ctx, (unsigned char *)raw, raw_len, &sig) != KSI_OK ||
+				KSI_Signature_verifyWithPolicy(sig, check->hsh, 0, KSI_VERIFICATION_POLICY_INTERNAL, NULL) != KSI_OK) {
+			check->errors++;
+		}
+	} else {
+		check->failed_count++;
+		if (raw != NULL) check->errors++;
+	}
+
+	KSI_Signature_free(sig);
+
+	return KSI_OK;
+}
+
+static void testStreamSigner_signBlock(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/test_masking_response.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_StreamSigner *ss = NULL;
+	SinkCheck check;
+	size_t index[101];
+	size_t pending = 0;
+	size_t i;
+	KSI_uint64_t value = 0;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *prev = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char ivDat[] = {0x01, 0x02, 0xff, 0xfe, 0xaa, 0xa9, 0xf1, 0x55, 0x23, 0x51, 0xa1};
+
+	KSI_OctetString_new(ctx, ivDat, sizeof(ivDat), &iv);
+	KSI_DataHash_createZero(ctx, KSI_HASHALG_SHA2_256, &prev);
+	KSITest_DataHash_fromStr(ctx, "01004313f53502a18fe4a31ae0197ab09d4597042942a3a54e846fa01ff5479fa2", &hsh);
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, sizeof(TEST_AGGR_RESPONSE_FILES) / sizeof(*TEST_AGGR_RESPONSE_FILES), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	memset(&check, 0, sizeof(check));
+	check.hsh = hsh;
+
+	res = KSI_StreamSigner_new(ctx, as, KSI_HASHALG_SHA2_256, prev, iv, checkSink, &check, &ss);
+	CuAssert(tc, "Unable to create stream signer.", res == KSI_OK && ss != NULL);
+
+	res = KSI_StreamSigner_setMaxBlockSize(ss, 101);
+	CuAssert(tc, "Unable to set block size.", res == KSI_OK);
+
+	res = KSI_StreamSigner_setMaxBlockAge(ss, 0);
+	CuAssert(tc, "Unable to set block age.", res == KSI_OK);
+
+	for (i = 0; i < 101; ++i) {
+		index[i] = i;
+		res = KSI_StreamSigner_addHash(ss, hsh, &index[i]);
+		CuAssert(tc, "Unable to add record hash to the stream signer.", res == KSI_OK);
+	}
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_BLOCKS_CLOSED, &value);
+	CuAssert(tc, "The block should be closed by run.", res == KSI_OK && value == 0);
+
+	for (i = 0; i < 10; i++) {
+		res = KSI_StreamSigner_run(ss, &pending);
+		CuAssert(tc, "Unable to run the stream signer.", res == KSI_OK);
+		if (pending == 0) break;
+	}
+
+	CuAssert(tc, "All records should have been passed to the sink.", pending == 0 && check.next == 101);
+	CuAssert(tc, "All records should have been signed.", check.signed_count == 101 && check.failed_count == 0);
+	CuAssert(tc, "Record signatures mismatch.", check.errors == 0);
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_RECORDS_ADDED, &value);
+	CuAssert(tc, "Added records counter mismatch.", res == KSI_OK && value == 101);
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_RECORDS_SIGNED, &value);
+	CuAssert(tc, "Signed records counter mismatch.", res == KSI_OK && value == 101);
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_BLOCKS_CLOSED, &value);
+	CuAssert(tc, "Closed blocks counter mismatch.", res == KSI_OK && value == 1);
+
+	res = KSI_StreamSigner_getCounter(ss, __KSI_STREAM_SIGNER_COUNTER_COUNT, &value);
+	CuAssert(tc, "Unknown counter should be rejected.", res == KSI_INVALID_ARGUMENT);
+
+	KSI_StreamSigner_free(ss);
+	KSI_AsyncService_free(as);
+	KSI_DataHash_free(hsh);
+	KSI_OctetString_free(iv);
+	KSI_DataHash_free(prev);
+}
+
+static void testStreamSigner_backpressure(CuTest *tc) {
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_StreamSigner *ss = NULL;
+	SinkCheck check;
+	size_t index[4] = {0, 1, 2, 3};
+	size_t i;
+	KSI_uint64_t value = 0;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	memset(&check, 0, sizeof(check));
+
+	res = KSI_StreamSigner_new(ctx, as, KSI_HASHALG_SHA2_256, NULL, NULL, checkSink, &check, &ss);
+	CuAssert(tc, "Unable to create stream signer.", res == KSI_OK && ss != NULL);
+
+	res = KSI_StreamSigner_setMaxPending(ss, 0);
+	CuAssert(tc, "Pending limit 0 should be rejected.", res == KSI_INVALID_ARGUMENT);
+
+	res = KSI_StreamSigner_setMaxPending(ss, 3);
+	CuAssert(tc, "Unable to set pending limit.", res == KSI_OK);
+
+	for (i = 0; i < 3; ++i) {
+		res = KSI_StreamSigner_addRecord(ss, "record", 6, &index[i]);
+		CuAssert(tc, "Unable to add record to the stream signer.", res == KSI_OK);
+	}
+
+	res = KSI_StreamSigner_addRecord(ss, "record", 6, &index[3]);
+	CuAssert(tc, "Record over the pending limit should be rejected.", res == KSI_ASYNC_REQUEST_CACHE_FULL);
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_RECORDS_ADDED, &value);
+	CuAssert(tc, "Added records counter mismatch.", res == KSI_OK && value == 3);
+	CuAssert(tc, "No record should have been passed to the sink.", check.next == 0);
+
+	KSI_StreamSigner_free(ss);
+	KSI_AsyncService_free(as);
+}
+
+static void testStreamSigner_blockAge(CuTest *tc) {
+	static const char *TEST_AGGR_RESPONSE_FILES[] = {
+		"resource/tlv/" TEST_RESOURCE_AGGR_VER "/ok-sig-2014-07-01.1-aggr_response-with-status-301.tlv",
+	};
+	int res = KSI_UNKNOWN_ERROR;
+	KSI_AsyncService *as = NULL;
+	KSI_StreamSigner *ss = NULL;
+	SinkCheck check;
+	size_t index = 0;
+	size_t pending = 0;
+	size_t i;
+	KSI_uint64_t start;
+	KSI_uint64_t value = 0;
+
+	res = KSI_SigningAsyncService_new(ctx, &as);
+	CuAssert(tc, "Unable to create new async service object.", res == KSI_OK && as != NULL);
+
+	/* The aggregator responds with an error status. */
+	res = KSITest_MockAsyncService_setEndpoint(as, TEST_AGGR_RESPONSE_FILES, sizeof(TEST_AGGR_RESPONSE_FILES) / sizeof(*TEST_AGGR_RESPONSE_FILES), TEST_USER, TEST_PASS);
+	CuAssert(tc, "Unable to configure service endpoint.", res == KSI_OK);
+
+	memset(&check, 0, sizeof(check));
+
+	res = KSI_StreamSigner_new(ctx, as, KSI_HASHALG_SHA2_256, NULL, NULL, checkSink, &check, &ss);
+	CuAssert(tc, "Unable to create stream signer.", res == KSI_OK && ss != NULL);
+
+	res = KSI_StreamSigner_setMaxBlockAge(ss, 10);
+	CuAssert(tc, "Unable to set block age.", res == KSI_OK);
+
+	res = KSI_StreamSigner_addRecord(ss, "record", 6, &index);
+	CuAssert(tc, "Unable to add record to the stream signer.", res == KSI_OK);
+
+	/* The mock endpoint responds on the first run, thus let the block age before running. */
+	start = KSI_getMonotonicTimeMs();
+	while (KSI_getMonotonicTimeMs() - start < 10);
+
+	for (i = 0; i < 10; i++) {
+		res = KSI_StreamSigner_run(ss, &pending);
+		CuAssert(tc, "Unable to run the stream signer.", res == KSI_OK);
+		if (pending == 0) break;
+	}
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_BLOCKS_CLOSED, &value);
+	CuAssert(tc, "The block should have been closed by age.", res == KSI_OK && value == 1);
+	CuAssert(tc, "The record should have been passed to the sink as failed.", pending == 0 && check.failed_count == 1 && check.errors == 0);
+
+	res = KSI_StreamSigner_getCounter(ss, KSI_STREAM_SIGNER_LATENCY_MAX, &value);
+	CuAssert(tc, "Latency should cover the block age.", res == KSI_OK && value >= 10);
+
+	KSI_StreamSigner_free(ss);
+	KSI_AsyncService_free(as);
+}
+
+CuSuite* KSITest_StreamSigner_getSuite(void) {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, testStreamSigner_signBlock);
+	SUITE_ADD_TEST(suite, testStreamSigner_backpressure);
+	SUITE_ADD_TEST(suite, testStreamSigner_blockAge);
+
+	return suite;
+}
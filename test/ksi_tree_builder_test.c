@@ -28,6 +28,8 @@
 
 extern KSI_CTX *ctx;
 
+#define TEST_SPILL_FILE "ksi_tree_builder_test.tmp"
+
 static void testCreateTreeBuilder(CuTest* tc) {
 	int res;
 	KSI_TreeBuilder *builder = NULL;
@@ -300,6 +302,476 @@ static void testTreeBuilderDoubleClose(CuTest *tc) {
 	KSI_DataHash_free(hsh);
 }
 
+static int chainsEqual(const KSI_AggregationHashChain *left, const KSI_AggregationHashChain *right) {
+	KSI_LIST(KSI_HashChainLink) *leftLinks = NULL;
+	KSI_LIST(KSI_HashChainLink) *rightLinks = NULL;
+	KSI_DataHash *leftHash = NULL;
+	KSI_DataHash *rightHash = NULL;
+	size_t i;
+
+	if (KSI_AggregationHashChain_getInputHash(left, &leftHash) != KSI_OK) return 0;
+	if (KSI_AggregationHashChain_getInputHash(right, &rightHash) != KSI_OK) return 0;
+	if (!KSI_DataHash_equals(leftHash, rightHash)) return 0;
+
+	if (KSI_AggregationHashChain_getChain(left, &leftLinks) != KSI_OK) return 0;
+	if (KSI_AggregationHashChain_getChain(right, &rightLinks) != KSI_OK) return 0;
+	if (KSI_HashChainLinkList_length(leftLinks) != KSI_HashChainLinkList_length(rightLinks)) return 0;
+
+	for (i = 0; i < KSI_HashChainLinkList_length(leftLinks); i++) {
+		KSI_HashChainLink *l = NULL;
+		KSI_HashChainLink *r = NULL;
+		KSI_Integer *lCorr = NULL;
+		KSI_Integer *rCorr = NULL;
+		int lIsLeft;
+		int rIsLeft;
+
+		if (KSI_HashChainLinkList_elementAt(leftLinks, i, &l) != KSI_OK) return 0;
+		if (KSI_HashChainLinkList_elementAt(rightLinks, i, &r) != KSI_OK) return 0;
+
+		if (KSI_HashChainLink_getIsLeft(l, &lIsLeft) != KSI_OK) return 0;
+		if (KSI_HashChainLink_getIsLeft(r, &rIsLeft) != KSI_OK) return 0;
+		if (!lIsLeft != !rIsLeft) return 0;
+
+		if (KSI_HashChainLink_getLevelCorrection(l, &lCorr) != KSI_OK) return 0;
+		if (KSI_HashChainLink_getLevelCorrection(r, &rCorr) != KSI_OK) return 0;
+		if (KSI_Integer_getUInt64(lCorr) != KSI_Integer_getUInt64(rCorr)) return 0;
+
+		if (KSI_HashChainLink_getImprint(l, &leftHash) != KSI_OK) return 0;
+		if (KSI_HashChainLink_getImprint(r, &rightHash) != KSI_OK) return 0;
+		if (leftHash == NULL && rightHash == NULL) {
+			KSI_MetaDataElement *lMd = NULL;
+			KSI_MetaDataElement *rMd = NULL;
+
+			/* Meta-data links do not have an imprint. */
+			if (KSI_HashChainLink_getMetaData(l, &lMd) != KSI_OK) return 0;
+			if (KSI_HashChainLink_getMetaData(r, &rMd) != KSI_OK) return 0;
+			if (lMd == NULL || rMd == NULL) return 0;
+		} else if (!KSI_DataHash_equals(leftHash, rightHash)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void testCompactTreeBuilderSameAsTreeBuilder(CuTest *tc) {
+	int res;
+	KSI_TreeBuilder *builder = NULL;
+	KSI_CompactTreeBuilder *compact = NULL;
+	const int levels[] = { 0, 0, 1, 0, 3, 0, 0, 1, 1, 0, 2, 0, 0, 0, 5, 0, 0, 1, 0, 0, 0, 2, 0 };
+	const size_t count = sizeof(levels) / sizeof(levels[0]);
+	KSI_TreeLeafHandle *handles[sizeof(levels) / sizeof(levels[0])];
+	KSI_AggregationHashChain *chn = NULL;
+	KSI_AggregationHashChain *compactChn = NULL;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *root = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	unsigned rootLevel = 0;
+	size_t i;
+	size_t n;
+
+	for (n = 1; n <= count; n++) {
+		res = KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &builder);
+		CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && builder != NULL);
+
+		res = KSI_CompactTreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &compact);
+		CuAssert(tc, "Unable to create compact tree builder.", res == KSI_OK && compact != NULL);
+
+		for (i = 0; i < n; i++) {
+			char data[16];
+
+			KSI_snprintf(data, sizeof(data), "test%u", (unsigned)i);
+			res = KSI_DataHash_create(ctx, data, strlen(data), KSI_HASHALG_SHA1, &hsh);
+			CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+			res = KSI_TreeBuilder_addDataHash(builder, hsh, levels[i], &handles[i]);
+			CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+
+			res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+			CuAssert(tc, "Unable to get imprint.", res == KSI_OK);
+
+			res = KSI_CompactTreeBuilder_addImprint(compact, imprint, levels[i]);
+			CuAssert(tc, "Unable to add imprint to the compact tree builder.", res == KSI_OK);
+
+			KSI_DataHash_free(hsh);
+			hsh = NULL;
+		}
+
+		res = KSI_TreeBuilder_close(builder);
+		CuAssert(tc, "Unable to close tree builder.", res == KSI_OK);
+
+		res = KSI_CompactTreeBuilder_close(compact);
+		CuAssert(tc, "Unable to close compact tree builder.", res == KSI_OK);
+
+		res = KSI_CompactTreeBuilder_getRoot(compact, &root, &rootLevel);
+		CuAssert(tc, "Unable to get the root of the compact tree.", res == KSI_OK && root != NULL);
+		CuAssert(tc, "Root hash mismatch.", KSI_DataHash_equals(root, builder->rootNode->hash));
+		CuAssert(tc, "Root level mismatch.", rootLevel == builder->rootNode->level);
+
+		for (i = 0; i < n; i++) {
+			res = KSI_TreeLeafHandle_getAggregationChain(handles[i], &chn);
+			CuAssert(tc, "Unable to extract aggregation chain.", res == KSI_OK && chn != NULL);
+
+			res = KSI_CompactTreeBuilder_getAggregationChain(compact, i, &compactChn);
+			CuAssert(tc, "Unable to extract aggregation chain from the compact tree.", res == KSI_OK && compactChn != NULL);
+
+			CuAssert(tc, "Aggregation chain mismatch.", chainsEqual(chn, compactChn));
+
+			KSI_AggregationHashChain_free(chn);
+			chn = NULL;
+			KSI_AggregationHashChain_free(compactChn);
+			compactChn = NULL;
+			KSI_TreeLeafHandle_free(handles[i]);
+		}
+
+		res = KSI_CompactTreeBuilder_getAggregationChain(compact, n, &compactChn);
+		CuAssert(tc, "Leaf index out of range should fail.", res == KSI_INVALID_ARGUMENT && compactChn == NULL);
+
+		KSI_DataHash_free(root);
+		root = NULL;
+		KSI_TreeBuilder_free(builder);
+		builder = NULL;
+		KSI_CompactTreeBuilder_free(compact);
+		compact = NULL;
+	}
+}
+
+static KSI_MetaData *testMetaData = NULL;
+static size_t metaDataCounter = 0;
+static int testMaskProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out);
+static int testMetaDataProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out);
+static KSI_TreeBuilderLeafProcessor maskProcessor = { testMaskProcessor, NULL, 1 };
+static KSI_TreeBuilderLeafProcessor metaDataProcessor = { testMetaDataProcessor, &metaDataCounter, 1 };
+
+static int testMaskProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
+	int res;
+	KSI_DataHash *mask = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	(void)c;
+
+	res = KSI_DataHash_getImprint(in->hash, &imprint, &imprint_len);
+	if (res != KSI_OK) return res;
+
+	res = KSI_DataHash_create(ctx, imprint, imprint_len, KSI_HASHALG_SHA2_256, &mask);
+	if (res != KSI_OK) return res;
+
+	res = KSI_TreeNode_new(ctx, mask, NULL, in->level, out);
+	KSI_DataHash_free(mask);
+
+	return res;
+}
+
+static int testMetaDataProcessor(KSI_TreeNode *in, void *c, KSI_TreeNode **out) {
+	size_t *counter = c;
+
+	/* Every third leaf gets the meta-data. */
+	if ((*counter)++ % 3 != 0) {
+		*out = NULL;
+		return KSI_OK;
+	}
+
+	return KSI_TreeNode_new(ctx, NULL, testMetaData, in->level, out);
+}
+
+static void buildTree(CuTest *tc, size_t threads, size_t n, KSI_TreeBuilder **builder, KSI_TreeLeafHandle **handles) {
+	int res;
+	KSI_TreeBuilder *tmp = NULL;
+	KSI_DataHash *hsh = NULL;
+	size_t i;
+
+	res = KSI_TreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &tmp);
+	CuAssert(tc, "Unable to create tree builder.", res == KSI_OK && tmp != NULL);
+
+	res = KSI_TreeBuilder_setThreadCount(tmp, threads);
+	CuAssert(tc, "Unable to set thread count.", res == KSI_OK);
+
+	res = KSI_TreeBuilderLeafProcessorList_append(tmp->cbList, &maskProcessor);
+	CuAssert(tc, "Unable to add leaf processor.", res == KSI_OK);
+
+	res = KSI_TreeBuilderLeafProcessorList_append(tmp->cbList, &metaDataProcessor);
+	CuAssert(tc, "Unable to add leaf processor.", res == KSI_OK);
+
+	metaDataCounter = 0;
+
+	for (i = 0; i < n; i++) {
+		char data[16];
+
+		KSI_snprintf(data, sizeof(data), "test%u", (unsigned)i);
+		res = KSI_DataHash_create(ctx, data, strlen(data), KSI_HASHALG_SHA2_256, &hsh);
+		CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+		res = KSI_TreeBuilder_addDataHash(tmp, hsh, (i % 7 == 3) ? 2 : 0, handles != NULL ? &handles[i] : NULL);
+		CuAssert(tc, "Unable to add data hash to the tree builder.", res == KSI_OK);
+
+		KSI_DataHash_free(hsh);
+		hsh = NULL;
+	}
+
+	res = KSI_TreeBuilder_setThreadCount(tmp, threads);
+	CuAssert(tc, "Thread count should not be changed after adding leafs.", res == KSI_INVALID_STATE);
+
+	res = KSI_TreeBuilder_close(tmp);
+	CuAssert(tc, "Unable to close tree builder.", res == KSI_OK);
+
+	*builder = tmp;
+}
+
+static void testTreeBuilderThreads(CuTest *tc) {
+	int res;
+	KSI_TreeBuilder *sequential = NULL;
+	KSI_TreeBuilder *parallel = NULL;
+	KSI_TreeLeafHandle *seqHandles[40];
+	KSI_TreeLeafHandle *parHandles[40];
+	KSI_AggregationHashChain *seqChn = NULL;
+	KSI_AggregationHashChain *parChn = NULL;
+	KSI_Utf8String *clientId = NULL;
+	size_t i;
+	size_t n;
+
+	res = KSI_MetaData_new(ctx, &testMetaData);
+	CuAssert(tc, "Unable to create meta-data.", res == KSI_OK);
+
+	res = KSI_Utf8String_new(ctx, "client", 7, &clientId);
+	CuAssert(tc, "Unable to create client id.", res == KSI_OK);
+
+	res = KSI_MetaData_setClientId(testMetaData, clientId);
+	CuAssert(tc, "Unable to set client id.", res == KSI_OK);
+
+	KSI_Utf8String_free(clientId);
+
+	for (n = 1; n <= 40; n++) {
+		buildTree(tc, 0, n, &sequential, seqHandles);
+		buildTree(tc, 3, n, &parallel, parHandles);
+
+		CuAssert(tc, "Root hash mismatch.", KSI_DataHash_equals(sequential->rootNode->hash, parallel->rootNode->hash));
+		CuAssert(tc, "Root level mismatch.", sequential->rootNode->level == parallel->rootNode->level);
+
+		for (i = 0; i < n; i++) {
+			res = KSI_TreeLeafHandle_getAggregationChain(seqHandles[i], &seqChn);
+			CuAssert(tc, "Unable to extract aggregation chain.", res == KSI_OK && seqChn != NULL);
+
+			res = KSI_TreeLeafHandle_getAggregationChain(parHandles[i], &parChn);
+			CuAssert(tc, "Unable to extract aggregation chain.", res == KSI_OK && parChn != NULL);
+
+			CuAssert(tc, "Aggregation chain mismatch.", chainsEqual(seqChn, parChn));
+
+			KSI_AggregationHashChain_free(seqChn);
+			seqChn = NULL;
+			KSI_AggregationHashChain_free(parChn);
+			parChn = NULL;
+			KSI_TreeLeafHandle_free(seqHandles[i]);
+			KSI_TreeLeafHandle_free(parHandles[i]);
+		}
+
+		KSI_TreeBuilder_free(sequential);
+		KSI_TreeBuilder_free(parallel);
+	}
+
+	/* A larger tree with more subtrees than threads. */
+	buildTree(tc, 0, 5000, &sequential, NULL);
+	buildTree(tc, 8, 5000, &parallel, NULL);
+	CuAssert(tc, "Root hash mismatch.", KSI_DataHash_equals(sequential->rootNode->hash, parallel->rootNode->hash));
+
+	KSI_TreeBuilder_free(sequential);
+	KSI_TreeBuilder_free(parallel);
+	KSI_MetaData_free(testMetaData);
+	testMetaData = NULL;
+}
+
+typedef struct ChainCompare_st {
+	KSI_CompactTreeBuilder *compact;
+	size_t count;
+	size_t mismatches;
+} ChainCompare;
+
+static int compareWithCompact(void *c, size_t index, KSI_AggregationHashChain *chain) {
+	ChainCompare *cmp = c;
+	KSI_AggregationHashChain *expected = NULL;
+	int res;
+
+	res = KSI_CompactTreeBuilder_getAggregationChain(cmp->compact, index, &expected);
+	if (res != KSI_OK || !chainsEqual(expected, chain)) cmp->mismatches++;
+	cmp->count++;
+
+	KSI_AggregationHashChain_free(expected);
+
+	return KSI_OK;
+}
+
+/**
+ * Calculates the mask of the next leaf and the previous leaf value of the leaf after it, the same
+ * way as the masking of #KSI_BlockSigner does.
+ */
+static int nextMask(KSI_DataHash **prevLeaf, const KSI_OctetString *iv, const unsigned char *imprint, size_t imprint_len, int level, KSI_DataHash **mask) {
+	int res;
+	KSI_DataHasher *hsr = NULL;
+	KSI_DataHash *tmp = NULL;
+	KSI_DataHash *next = NULL;
+	unsigned char lvl = (unsigned char)(level + 1);
+
+	res = KSI_DataHasher_open(ctx, KSI_HASHALG_SHA2_256, &hsr);
+	if (res == KSI_OK) res = KSI_DataHasher_addImprint(hsr, *prevLeaf);
+	if (res == KSI_OK) res = KSI_DataHasher_addOctetString(hsr, iv);
+	if (res == KSI_OK) res = KSI_DataHasher_close(hsr, &tmp);
+	if (res == KSI_OK) res = KSI_DataHasher_reset(hsr);
+	if (res == KSI_OK) res = KSI_DataHasher_addImprint(hsr, tmp);
+	if (res == KSI_OK) res = KSI_DataHasher_add(hsr, imprint, imprint_len);
+	if (res == KSI_OK) res = KSI_DataHasher_add(hsr, &lvl, 1);
+	if (res == KSI_OK) res = KSI_DataHasher_close(hsr, &next);
+	if (res == KSI_OK) {
+		KSI_DataHash_free(*prevLeaf);
+		*prevLeaf = next;
+		next = NULL;
+		*mask = tmp;
+		tmp = NULL;
+	}
+
+	KSI_DataHash_free(next);
+	KSI_DataHash_free(tmp);
+	KSI_DataHasher_free(hsr);
+
+	return res;
+}
+
+static void testStreamTreeBuilderSameAsCompact(CuTest *tc) {
+	int res;
+	KSI_CompactTreeBuilder *compact = NULL;
+	KSI_StreamTreeBuilder *stream = NULL;
+	const int mixedLevels[] = { 0, 0, 1, 0, 3, 0, 0, 1, 1, 0, 2, 0, 0, 0, 5, 0, 0, 1, 0, 0, 0, 2, 0 };
+	/* Leafs of the same level, enough to have kept masks and nodes above the recalculated levels. */
+	const int uniformLevels[45] = { 0 };
+	const int *levels = NULL;
+	size_t count = 0;
+	KSI_DataHash *hsh = NULL;
+	KSI_DataHash *mask = NULL;
+	KSI_DataHash *root = NULL;
+	KSI_DataHash *streamRoot = NULL;
+	KSI_DataHash *prevLeaf = NULL;
+	KSI_DataHash *compactPrevLeaf = NULL;
+	KSI_OctetString *iv = NULL;
+	const unsigned char *imprint = NULL;
+	const unsigned char *maskImprint = NULL;
+	size_t imprint_len = 0;
+	size_t mask_len = 0;
+	unsigned rootLevel = 0;
+	unsigned streamLevel = 0;
+	ChainCompare cmp;
+	int masked;
+	int uniform;
+	size_t i;
+	size_t n;
+
+	res = KSI_OctetString_new(ctx, (const unsigned char *)"initial value", 13, &iv);
+	CuAssert(tc, "Unable to create initial value.", res == KSI_OK && iv != NULL);
+
+	for (uniform = 0; uniform < 2; uniform++) {
+		levels = uniform ? uniformLevels : mixedLevels;
+		count = uniform ? sizeof(uniformLevels) / sizeof(uniformLevels[0]) : sizeof(mixedLevels) / sizeof(mixedLevels[0]);
+
+		for (masked = 0; masked < 2; masked++) {
+			for (n = 1; n <= count; n++) {
+				res = KSI_CompactTreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, &compact);
+				CuAssert(tc, "Unable to create compact tree builder.", res == KSI_OK && compact != NULL);
+
+				res = KSI_StreamTreeBuilder_new(ctx, KSI_HASHALG_SHA2_256, masked ? TEST_SPILL_FILE : NULL, &stream);
+				CuAssert(tc, "Unable to create stream tree builder.", res == KSI_OK && stream != NULL);
+
+				if (masked) {
+					res = KSI_DataHash_create(ctx, "previous", 8, KSI_HASHALG_SHA2_512, &prevLeaf);
+					CuAssert(tc, "Unable to create previous leaf.", res == KSI_OK && prevLeaf != NULL);
+
+					res = KSI_CompactTreeBuilder_setMasking(compact, prevLeaf, iv);
+					CuAssert(tc, "Unable to set masking.", res == KSI_OK);
+				}
+
+				for (i = 0; i < n; i++) {
+					char data[16];
+
+					KSI_snprintf(data, sizeof(data), "test%u", (unsigned)i);
+					res = KSI_DataHash_create(ctx, data, strlen(data), KSI_HASHALG_SHA1, &hsh);
+					CuAssert(tc, "Unable to create data hash.", res == KSI_OK && hsh != NULL);
+
+					res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+					CuAssert(tc, "Unable to get imprint.", res == KSI_OK);
+
+					if (masked) {
+						res = nextMask(&prevLeaf, iv, imprint, imprint_len, levels[i], &mask);
+						CuAssert(tc, "Unable to create mask.", res == KSI_OK && mask != NULL);
+
+						res = KSI_DataHash_getImprint(mask, &maskImprint, &mask_len);
+						CuAssert(tc, "Unable to get imprint.", res == KSI_OK);
+					}
+
+					res = KSI_CompactTreeBuilder_addImprint(compact, imprint, levels[i]);
+					CuAssert(tc, "Unable to add imprint to the compact tree builder.", res == KSI_OK);
+
+					res = KSI_StreamTreeBuilder_addImprint(stream, imprint, maskImprint, levels[i]);
+					CuAssert(tc, "Unable to add imprint to the stream tree builder.", res == KSI_OK);
+
+					KSI_DataHash_free(hsh);
+					hsh = NULL;
+					KSI_DataHash_free(mask);
+					mask = NULL;
+					maskImprint = NULL;
+				}
+
+				CuAssert(tc, "Leaf count mismatch.", KSI_StreamTreeBuilder_getLeafCount(stream) == n);
+
+				if (masked) {
+					res = KSI_CompactTreeBuilder_getPrevLeaf(compact, &compactPrevLeaf);
+					CuAssert(tc, "Unable to get the previous leaf.", res == KSI_OK && compactPrevLeaf != NULL);
+					CuAssert(tc, "Previous leaf mismatch.", KSI_DataHash_equals(prevLeaf, compactPrevLeaf));
+
+					KSI_DataHash_free(compactPrevLeaf);
+					compactPrevLeaf = NULL;
+					KSI_DataHash_free(prevLeaf);
+					prevLeaf = NULL;
+				}
+
+				res = KSI_StreamTreeBuilder_getAggregationChains(stream, compareWithCompact, &cmp);
+				CuAssert(tc, "Chains should not be available before closing.", res == KSI_INVALID_STATE);
+
+				res = KSI_CompactTreeBuilder_close(compact);
+				CuAssert(tc, "Unable to close compact tree builder.", res == KSI_OK);
+
+				res = KSI_StreamTreeBuilder_close(stream);
+				CuAssert(tc, "Unable to close stream tree builder.", res == KSI_OK);
+
+				res = KSI_CompactTreeBuilder_getRoot(compact, &root, &rootLevel);
+				CuAssert(tc, "Unable to get the root of the compact tree.", res == KSI_OK && root != NULL);
+
+				res = KSI_StreamTreeBuilder_getRoot(stream, &streamRoot, &streamLevel);
+				CuAssert(tc, "Unable to get the root of the stream tree.", res == KSI_OK && streamRoot != NULL);
+				CuAssert(tc, "Root hash mismatch.", KSI_DataHash_equals(root, streamRoot));
+				CuAssert(tc, "Root level mismatch.", rootLevel == streamLevel);
+
+				cmp.compact = compact;
+				cmp.count = 0;
+				cmp.mismatches = 0;
+
+				res = KSI_StreamTreeBuilder_getAggregationChains(stream, compareWithCompact, &cmp);
+				CuAssert(tc, "Unable to get the aggregation chains.", res == KSI_OK);
+				CuAssert(tc, "Aggregation chain count mismatch.", cmp.count == n);
+				CuAssert(tc, "Aggregation chain mismatch.", cmp.mismatches == 0);
+
+				KSI_DataHash_free(root);
+				root = NULL;
+				KSI_DataHash_free(streamRoot);
+				streamRoot = NULL;
+				KSI_CompactTreeBuilder_free(compact);
+				compact = NULL;
+				KSI_StreamTreeBuilder_free(stream);
+				stream = NULL;
+			}
+		}
+	}
+
+	KSI_OctetString_free(iv);
+}
+
 CuSuite* KSITest_TreeBuilder_getSuite(void)
 {
 	CuSuite* suite = CuSuiteNew();
@@ -314,6 +786,9 @@ CuSuite* KSITest_TreeBuilder_getSuite(void)
 	SUITE_ADD_TEST(suite, testEmptyTreeBuilderClosing);
 	SUITE_ADD_TEST(suite, testEmptyTreeBuilderWithMaxLevelClosing);
 	SUITE_ADD_TEST(suite, testTreeBuilderDoubleClose);
+	SUITE_ADD_TEST(suite, testCompactTreeBuilderSameAsTreeBuilder);
+	SUITE_ADD_TEST(suite, testTreeBuilderThreads);
+	SUITE_ADD_TEST(suite, testStreamTreeBuilderSameAsCompact);
 
 	return suite;
 }
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2013-2017 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ksi/pkitruststore.h>
+#include <ksi/trust_state.h>
+
+#include "all_tests.h"
+
+#include "../src/ksi/impl/ctx_impl.h"
+#include "../src/ksi/impl/net_impl.h"
+#include "../src/ksi/impl/publicationsfile_impl.h"
+#include "../src/ksi/impl/trust_state_impl.h"
+
+extern KSI_CTX *ctx;
+
+static int createContext(KSI_CTX **out) {
+	int res;
+	KSI_CTX *tmp = NULL;
+
+	res = KSITest_CTX_clone(&tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSITest_setDefaultPubfileAndVerInfo(tmp);
+	if (res != KSI_OK) goto cleanup;
+
+	*out = tmp;
+	tmp = NULL;
+
+cleanup:
+
+	KSI_CTX_free(tmp);
+
+	return res;
+}
+
+static void testTrustState_sharedBetweenContexts(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_CTX *ctx2 = NULL;
+	KSI_TrustState *state = NULL;
+	KSI_PublicationsFile *pubFile1 = NULL;
+	KSI_PublicationsFile *pubFile2 = NULL;
+
+	res = createContext(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSITest_CTX_clone(&ctx2);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx2 != NULL);
+
+	res = KSI_TrustState_new(ctx1, &state);
+	CuAssert(tc, "Unable to create trust state.", res == KSI_OK && state != NULL);
+
+	res = KSI_CTX_setTrustState(ctx1, state);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	res = KSI_CTX_setTrustState(ctx2, state);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	/* The state is kept alive by the contexts. */
+	KSI_TrustState_free(state);
+
+	res = KSI_receivePublicationsFile(ctx1, &pubFile1);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile1 != NULL);
+
+	res = KSI_receivePublicationsFile(ctx2, &pubFile2);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile2 != NULL);
+
+	CuAssert(tc, "Publications file objects should be context specific.", pubFile1 != pubFile2);
+	CuAssert(tc, "Publications file content should be shared.", pubFile1->raw == pubFile2->raw && pubFile1->raw == ctx1->trustState->raw);
+
+	res = KSI_verifyPublicationsFile(ctx1, pubFile1);
+	CuAssert(tc, "Unable to verify publications file.", res == KSI_OK);
+
+	/* The second context has neither a truststore nor constraints of its own. */
+	res = KSI_verifyPublicationsFile(ctx2, pubFile2);
+	CuAssert(tc, "Unable to verify publications file with the shared truststore.", res == KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile1);
+	KSI_PublicationsFile_free(pubFile2);
+	KSI_CTX_free(ctx1);
+	KSI_CTX_free(ctx2);
+}
+
+static void testTrustState_indexAndVerificationReused(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_CTX *ctx2 = NULL;
+	KSI_TrustState *state = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_Integer *tm = NULL;
+	KSI_PKIVerificationCacheStats stats;
+	KSI_CertConstraint constraints[] = {
+		{ KSI_CERT_EMAIL, "publications@guardtime.com" },
+		{ NULL, NULL }
+	};
+
+	res = createContext(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSITest_CTX_clone(&ctx2);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx2 != NULL);
+
+	res = KSI_TrustState_new(ctx1, &state);
+	CuAssert(tc, "Unable to create trust state.", res == KSI_OK && state != NULL);
+
+	/* The state does not depend on the context that created it. */
+	KSI_CTX_free(ctx1);
+
+	res = KSI_CTX_setTrustState(ctx2, state);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx2, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Indexes should be borrowed from the trust state.", pubFile->isIndexShared &&
+			pubFile->timeIndex == state->index->timeIndex && pubFile->certIndex == state->index->certIndex);
+
+	res = KSI_verifyPublicationsFile(ctx2, pubFile);
+	CuAssert(tc, "Unable to verify publications file.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx2, &stats);
+	CuAssert(tc, "Unable to get PKI cache statistics.", res == KSI_OK);
+	CuAssert(tc, "Publications file should not be verified again.", stats.signatureHits == 0 && stats.signatureMisses == 0);
+
+	res = KSI_Integer_new(ctx2, 1289779234, &tm);
+	CuAssert(tc, "Unable to create integer.", res == KSI_OK && tm != NULL);
+
+	res = KSI_PublicationsFile_getNearestPublication(pubFile, tm, &pubRec);
+	CuAssert(tc, "Unable to find nearest publication.", res == KSI_OK && pubRec != NULL);
+	CuAssert(tc, "Unexpected publication time.", KSI_Integer_equalsUInt(pubRec->publishedData->time, 1292371200));
+	CuAssert(tc, "Shared index should not be modified.", state->index->lazyPubCache == NULL);
+
+	/* Changing the constraints requires a new verification. */
+	res = KSI_CTX_setDefaultPubFileCertConstraints(ctx2, constraints);
+	CuAssert(tc, "Unable to set certificate constraints.", res == KSI_OK);
+	CuAssert(tc, "Verification result should be discarded.", pubFile->verifiedBy == NULL);
+
+	KSI_PublicationRecord_free(pubRec);
+	KSI_Integer_free(tm);
+	KSI_PublicationsFile_free(pubFile);
+	KSI_TrustState_free(state);
+	KSI_CTX_free(ctx2);
+}
+
+static void testTrustState_replace(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_TrustState *state1 = NULL;
+	KSI_TrustState *state2 = NULL;
+	KSI_PublicationsFile *pubFile1 = NULL;
+	KSI_PublicationsFile *pubFile2 = NULL;
+
+	res = createContext(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSI_TrustState_new(ctx1, &state1);
+	CuAssert(tc, "Unable to create trust state.", res == KSI_OK && state1 != NULL);
+
+	res = KSI_TrustState_new(ctx1, &state2);
+	CuAssert(tc, "Unable to create trust state.", res == KSI_OK && state2 != NULL);
+
+	res = KSI_CTX_setTrustState(ctx1, state1);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx1, &pubFile1);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile1 != NULL);
+	CuAssert(tc, "Publications file should be taken from the trust state.", pubFile1->raw == state1->raw);
+
+	res = KSI_TrustState_replace(state1, state1);
+	CuAssert(tc, "Trust state should not be replaceable by itself.", res == KSI_INVALID_ARGUMENT);
+
+	res = KSI_TrustState_replace(state1, state2);
+	CuAssert(tc, "Unable to replace the trust state.", res == KSI_OK);
+
+	res = KSI_TrustState_replace(state1, state2);
+	CuAssert(tc, "Trust state should be replaceable only once.", res == KSI_INVALID_STATE);
+
+	res = KSI_receivePublicationsFile(ctx1, &pubFile2);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile2 != NULL);
+	CuAssert(tc, "Context should have switched to the new trust state.", ctx1->trustState == state2 && pubFile2->raw == state2->raw);
+
+	/* The replaced publications file remains usable. */
+	res = KSI_verifyPublicationsFile(ctx1, pubFile1);
+	CuAssert(tc, "Unable to verify the replaced publications file.", res == KSI_OK);
+
+	KSI_PublicationsFile_free(pubFile1);
+	KSI_PublicationsFile_free(pubFile2);
+	KSI_TrustState_free(state1);
+	KSI_TrustState_free(state2);
+	KSI_CTX_free(ctx1);
+}
+
+static void testTrustState_refreshedOnce(CuTest *tc) {
+	int res;
+	KSI_CTX *ctx1 = NULL;
+	KSI_CTX *ctx2 = NULL;
+	KSI_TrustState *state = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+
+	res = createContext(&ctx1);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx1 != NULL);
+
+	res = KSITest_CTX_clone(&ctx2);
+	CuAssert(tc, "Unable to create KSI context.", res == KSI_OK && ctx2 != NULL);
+
+	res = KSI_TrustState_new(ctx1, &state);
+	CuAssert(tc, "Unable to create trust state.", res == KSI_OK && state != NULL);
+
+	res = KSI_CTX_setTrustState(ctx1, state);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	res = KSI_CTX_setTrustState(ctx2, state);
+	CuAssert(tc, "Unable to attach the trust state.", res == KSI_OK);
+
+	/* The first context considers the state expired and refreshes it. */
+	res = KSI_CTX_setOption(ctx1, KSI_OPT_PUBFILE_CACHE_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to set publications file cache timeout.", res == KSI_OK);
+
+	res = KSI_receivePublicationsFile(ctx1, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Trust state should have been replaced.", state->successor != NULL && ctx1->trustState == state->successor);
+	KSI_PublicationsFile_free(pubFile);
+	pubFile = NULL;
+
+	/* The second context picks up the replacement without refreshing. */
+	ctx2->netProvider->requestCount = 0;
+	res = KSI_receivePublicationsFile(ctx2, &pubFile);
+	CuAssert(tc, "Unable to receive publications file.", res == KSI_OK && pubFile != NULL);
+	CuAssert(tc, "Context should have switched to the new trust state.", ctx2->trustState == ctx1->trustState);
+	CuAssert(tc, "Publications file should not have been requested.", ctx2->netProvider->requestCount == 0);
+
+	KSI_PublicationsFile_free(pubFile);
+	KSI_TrustState_free(state);
+	KSI_CTX_free(ctx1);
+	KSI_CTX_free(ctx2);
+}
+
+CuSuite* KSITest_TrustState_getSuite(void) {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, testTrustState_sharedBetweenContexts);
+	SUITE_ADD_TEST(suite, testTrustState_indexAndVerificationReused);
+	SUITE_ADD_TEST(suite, testTrustState_replace);
+	SUITE_ADD_TEST(suite, testTrustState_refreshedOnce);
+
+	return suite;
+}
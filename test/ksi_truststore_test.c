@@ -23,6 +23,7 @@
 #include <ksi/pkitruststore.h>
 #include "ksi/tlv.h"
 #include "ksi/io.h"
+#include "ksi/publicationsfile.h"
 
 #include "cutest/CuTest.h"
 #include "all_tests.h"
@@ -245,6 +246,66 @@ static void TestPKICertificateToString(CuTest *tc) {
 
 
 
+static void TestVerificationResultCache(CuTest *tc) {
+	int res;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PKITruststore *pki = NULL;
+	KSI_PKIVerificationCacheStats before;
+	KSI_PKIVerificationCacheStats after;
+
+	KSI_ERR_clearErrors(ctx);
+
+	res = KSITest_setDefaultPubfileAndVerInfo(ctx);
+	CuAssert(tc, "Unable to set default publications file constraints.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_fromFile(ctx, getFullResourcePath("resource/tlv/publications.tlv"), &pubFile);
+	CuAssert(tc, "Unable to read publications file.", res == KSI_OK && pubFile != NULL);
+
+	res = KSI_PKITruststore_new(ctx, 0, &pki);
+	CuAssert(tc, "Unable to create PKI truststore.", res == KSI_OK && pki != NULL);
+
+	res = KSI_PKITruststore_addLookupFile(pki, getFullResourcePath("resource/crt/mock.crt"));
+	CuAssert(tc, "Unable to read certificate.", res == KSI_OK);
+
+	res = KSI_CTX_setPKITruststore(ctx, pki);
+	CuAssert(tc, "Unable to set new PKI truststore for KSI context.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx, &before);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+
+	res = KSI_PublicationsFile_verify(pubFile, ctx);
+	CuAssert(tc, "Publications file should verify with mock certificate.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx, &after);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+	CuAssert(tc, "Signature should not be found in cache.", after.signatureMisses == before.signatureMisses + 1 && after.signatureHits == before.signatureHits);
+	CuAssert(tc, "Certificate should not be found in cache.", after.certificateMisses == before.certificateMisses + 1 && after.certificateHits == before.certificateHits);
+
+	before = after;
+	res = KSI_PublicationsFile_verify(pubFile, ctx);
+	CuAssert(tc, "Publications file should verify from cache.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx, &after);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+	CuAssert(tc, "Signature should be found in cache.", after.signatureHits == before.signatureHits + 1 && after.signatureMisses == before.signatureMisses);
+	CuAssert(tc, "Certificate should be found in cache.", after.certificateHits == before.certificateHits + 1 && after.certificateMisses == before.certificateMisses);
+
+	/* Disable the cache. */
+	res = KSI_CTX_setOption(ctx, KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS, (void *)0);
+	CuAssert(tc, "Unable to disable the cache.", res == KSI_OK);
+
+	before = after;
+	res = KSI_PublicationsFile_verify(pubFile, ctx);
+	CuAssert(tc, "Publications file should verify without cache.", res == KSI_OK);
+
+	res = KSI_PKITruststore_getCacheStats(ctx, &after);
+	CuAssert(tc, "Unable to get cache statistics.", res == KSI_OK);
+	CuAssert(tc, "Disabled cache should not be used.", !memcmp(&before, &after, sizeof(before)));
+
+	KSI_CTX_setOption(ctx, KSI_OPT_PKI_VERIFICATION_CACHE_TTL_SECONDS, (void *)KSI_CTX_PKI_VERIFICATION_CACHE_DEFAULT_TTL);
+	KSI_PublicationsFile_free(pubFile);
+}
+
 CuSuite* KSITest_Truststore_getSuite(void)
 {
 	CuSuite* suite = CuSuiteNew();
@@ -254,6 +315,7 @@ CuSuite* KSITest_Truststore_getSuite(void)
 	SUITE_ADD_TEST(suite, TestParseAndSeraializeCert);
 	SUITE_ADD_TEST(suite, TestExtractingOfPKICertificate);
 	SUITE_ADD_TEST(suite, TestPKICertificateToString);
+	SUITE_ADD_TEST(suite, TestVerificationResultCache);
 
 	return suite;
 }